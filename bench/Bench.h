@@ -0,0 +1,136 @@
+/**
+ * @file Bench.h
+ * @brief
+ * 小さな処理の時間を測るベンチマーク。PCではstd::chronoのナノ秒、
+ * ESP32ではCPUのサイクルカウンタで測る(同じコア上で測るのでサイクル数のまま使える)。
+ * 結果は1ベンチマーク1行のJSON(JSON Lines)で出力し、コミット間の比較はcompare.pyで行う。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include <Arduino.h>
+#define BENCH_PLATFORM "esp32"
+#define BENCH_UNIT "cycles"
+inline uint32_t benchTicks() { return ESP.getCycleCount(); }
+/// 1回の計測の長さ[tick] 約10ms
+inline uint32_t benchTargetTicks() { return getCpuFrequencyMhz() * 10000; }
+/// 1秒あたりのtick数
+inline float benchTicksPerSecond() { return getCpuFrequencyMhz() * 1e6f; }
+#else
+#include <chrono>
+#define BENCH_PLATFORM "host"
+#define BENCH_UNIT "ns"
+inline uint32_t benchTicks() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+inline uint32_t benchTargetTicks() { return 10000000; }
+inline float benchTicksPerSecond() { return 1e9f; }
+#endif
+
+// 結果に付けるリビジョン(-DBENCH_REVISION=\"abc1234\"で指定)
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+/**
+ * @brief 値を使ったことにして、計算が最適化で消されないようにする
+ *
+ * @tparam T
+ * @param v
+ */
+template <class T> inline void benchKeep(T &v) {
+  asm volatile("" : : "r"(&v) : "memory");
+}
+
+/**
+ * @brief
+ * ベンチマークの実行と出力。1回の計測が約10msになるまで繰り返し回数を増やし、
+ * それをREPEAT回測って1回あたりの最小値と中央値を出す。
+ * outはprintfを持つもの(Serialなど)。
+ *
+ * @tparam Out
+ */
+template <class Out> class BenchRunner {
+public:
+  static constexpr uint8_t REPEAT = 7;
+
+  BenchRunner(Out &out) : out_(out) {}
+
+  /**
+   * @brief bodyを測る。bodyは繰り返しの番号(uint32_t)を受け取る関数
+   *
+   * @tparam F
+   * @param name
+   * @param body
+   */
+  template <class F> void run(const char *name, F body) {
+    float min, median;
+    uint32_t iters = sample(body, min, median);
+    out_.printf("{\"bench\":\"%s\",\"platform\":\"" BENCH_PLATFORM
+                "\",\"rev\":\"" BENCH_REVISION "\",\"unit\":\"" BENCH_UNIT
+                "\",\"iters\":%u,\"min\":%.2f,\"median\":%.2f}\n",
+                name, (unsigned)iters, min, median);
+  }
+
+  /**
+   * @brief
+   * bodyを測り、1回あたりに処理するバイト数・フレーム数から処理速度(中央値から計算)も出す
+   *
+   * @tparam F
+   * @param name
+   * @param body
+   * @param bytes bodyが1回で処理するバイト数
+   * @param frames bodyが1回で処理するフレーム数
+   */
+  template <class F>
+  void runThroughput(const char *name, F body, uint32_t bytes, uint32_t frames) {
+    float min, median;
+    uint32_t iters = sample(body, min, median);
+    float per_s = median > 0 ? benchTicksPerSecond() / median : 0;
+    out_.printf("{\"bench\":\"%s\",\"platform\":\"" BENCH_PLATFORM
+                "\",\"rev\":\"" BENCH_REVISION "\",\"unit\":\"" BENCH_UNIT
+                "\",\"iters\":%u,\"min\":%.2f,\"median\":%.2f"
+                ",\"bytes_per_s\":%.0f,\"frames_per_s\":%.0f}\n",
+                name, (unsigned)iters, min, median, bytes * per_s, frames * per_s);
+  }
+
+private:
+  Out &out_;
+
+  /// 繰り返し回数を決めてREPEAT回測り、1回あたりの最小値と中央値を求める
+  template <class F> static uint32_t sample(F &body, float &min, float &median) {
+    uint32_t iters = 1;
+    while (measure(body, iters) < benchTargetTicks() && iters < (1UL << 30)) {
+      iters *= 2;
+    }
+    float per_op[REPEAT];
+    for (uint8_t r = 0; r < REPEAT; r++) {
+      per_op[r] = (float)measure(body, iters) / iters;
+    }
+    // 挿入ソート(REPEATは小さい)
+    for (uint8_t i = 1; i < REPEAT; i++) {
+      for (uint8_t j = i; j > 0 && per_op[j - 1] > per_op[j]; j--) {
+        float t = per_op[j];
+        per_op[j] = per_op[j - 1];
+        per_op[j - 1] = t;
+      }
+    }
+    min = per_op[0];
+    median = per_op[REPEAT / 2];
+    return iters;
+  }
+
+  template <class F> static uint32_t measure(F &body, uint32_t iters) {
+    uint32_t start = benchTicks();
+    for (uint32_t i = 0; i < iters; i++) {
+      body(i);
+    }
+    return benchTicks() - start;
+  }
+};
@@ -0,0 +1,147 @@
+/**
+ * @file LegacyMu.h
+ * @brief
+ * 比較用に残した以前のMUWrapperの解析・送信データ生成(ベンチマーク専用。本体では使わない)。
+ * 解析の状態を関数内のstatic変数に持ち、1文字ずつ文字列に連結してstrtolで長さを読む
+ * (元はstrcatに終端のない1文字を渡していたので、ここではstrncatにしている)。
+ * 送信は"@DTxx"、データ、CRLFの3回に分けてコールバックを呼ぶ。
+ * インスタンスは1つだけ使うこと(static変数を共有するため)。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <MUwrapper.hpp>
+
+/**
+ * @brief 以前のMUWrapper
+ *
+ */
+class LegacyMUWrapper {
+public:
+  LegacyMUWrapper(MUCallback callback) : callback(callback) {}
+
+  bool pushRawData(uint8_t *data, uint8_t len) {
+    static phase_t phase = PHASE_WAIT_HEAD;
+    static char command_char[4] = {0};
+    static char length_char[3] = {0};
+    static uint8_t buf[MU_MAX_DATALEN];
+    static uint8_t length_reported = 0;
+    static uint8_t length = 0;
+    static char footer_char[3] = {0};
+    while (len--) {
+      uint8_t d = *(data++);
+      switch (phase) {
+      case PHASE_WAIT_HEAD:
+        if (d == '*') {
+          phase = PHASE_COMMAND;
+          memset(length_char, 0, 3);
+          memset(command_char, 0, 4);
+          memset(footer_char, 0, 3);
+        }
+        break;
+      case PHASE_COMMAND:
+        if (!((d >= 'A' && d <= 'Z') || d == '=')) {
+          error(MU_ERR_INVALID_COMMAND);
+          phase = PHASE_WAIT_HEAD;
+          break;
+        }
+        strncat(command_char, (char *)&d, 1);
+        if (strncmp(command_char, "DR=", 3) == 0) {
+          phase = PHASE_LENGTH;
+          break;
+        }
+        if (strncmp(command_char, "IR", 2) == 0) {
+          phase = PHASE_TAIL;
+          error(MU_ERR_CATCH_IR);
+          break;
+        }
+        if (strlen(command_char) == 3) {
+          error(MU_ERR_INVALID_COMMAND);
+          phase = PHASE_WAIT_HEAD;
+        }
+        break;
+      case PHASE_LENGTH:
+        if (!((d >= '0' && d <= '9') || (d >= 'A' && d <= 'F'))) {
+          error(MU_ERR_LENGTH_NOT_HEX);
+          phase = PHASE_WAIT_HEAD;
+          break;
+        }
+        strncat(length_char, (char *)&d, 1);
+        if (strlen(length_char) == 2) {
+          phase = PHASE_DATA;
+          length_reported = (uint8_t)strtol(length_char, NULL, 16);
+          if (length_reported > MU_MAX_DATALEN) {
+            error(MU_ERR_LENGTH_TOO_LONG);
+            phase = PHASE_WAIT_HEAD;
+            break;
+          }
+          length = 0;
+        }
+        break;
+      case PHASE_DATA:
+        buf[length++] = d;
+        if (length_reported == length) {
+          phase = PHASE_TAIL_HASDATA;
+        }
+        break;
+      case PHASE_TAIL:
+      case PHASE_TAIL_HASDATA:
+        strncat(footer_char, (char *)&d, 1);
+        if (strlen(footer_char) == 2) {
+          if (strncmp(footer_char, "\r\n", 2) == 0) {
+            if (phase == PHASE_TAIL_HASDATA) {
+              callback(MU_EVENT_RX_COMPLETE, buf, length_reported);
+            }
+            phase = PHASE_WAIT_HEAD;
+            break;
+          }
+          error(MU_ERR_TAIL_NOT_CRLF);
+        }
+        break;
+      }
+    }
+    return true;
+  }
+
+  bool send(uint8_t *data, uint8_t len) {
+    uint8_t buf[6] = {0};
+    sprintf((char *)buf, "@DT%02X", len);
+    callback(MU_EVENT_SEND_REQUEST, buf, 5);
+    callback(MU_EVENT_SEND_REQUEST, data, len);
+    sprintf((char *)buf, "\r\n");
+    callback(MU_EVENT_SEND_REQUEST, buf, 2);
+    return true;
+  }
+
+  void setParam(const char param[3], uint8_t value) {
+    char value_char[3] = {0};
+    sprintf(value_char, "%02X", value);
+    uint8_t buffer[16];
+    buffer[0] = (uint8_t)'@';
+    memcpy(buffer + 1, param, 2);
+    memcpy(buffer + 3, value_char, 2);
+    buffer[5] = '\r';
+    buffer[6] = '\n';
+    callback(MU_EVENT_SEND_REQUEST, buffer, 7);
+  }
+
+private:
+  enum phase_t : uint8_t {
+    PHASE_WAIT_HEAD,
+    PHASE_COMMAND,
+    PHASE_LENGTH,
+    PHASE_DATA,
+    PHASE_TAIL,
+    PHASE_TAIL_HASDATA,
+  };
+  MUCallback callback = nullptr;
+
+  void error(MUError e) {
+    uint8_t err = (uint8_t)e;
+    callback(MU_EVENT_ERROR, &err, 1);
+  }
+};
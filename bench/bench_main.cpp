@@ -0,0 +1,504 @@
+/**
+ * @file bench_main.cpp
+ * @brief
+ * 1フレームごとに通る処理のベンチマーク。PCでもESP32でも同じ処理を測る。
+ * PC: pio run -e bench-native && .pio/build/bench-native/program
+ * ESP32: pio run -e bench-esp32 -t upload -t monitor
+ * @version 0.1
+ *
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Bench.h"
+#include "LegacyMu.h"
+#include <FrameCheck.h>
+#include <Mailbox.h>
+#include <MUwrapper.hpp>
+#include <controller.h>
+#include <packetizer.hpp>
+#include <wiiClassic.h>
+
+namespace {
+
+/// 送信要求を受けるだけのコールバック
+void countSend(void *context, MUEvent event, uint8_t *data, uint8_t len) {
+  (void)event;
+  (void)data;
+  *(uint32_t *)context += len;
+}
+
+/// ボタンとアナログ値を繰り返しの番号から作る
+void fill(controller::ControllerData &c, uint32_t i) {
+  for (uint8_t b = 0; b < 16; b++) {
+    c.setButton((controller::Index)b, (i >> b) & 1);
+  }
+  for (uint8_t a = 0; a < 6; a++) {
+    c.setAnalogFine((controller::Index)(controller::LstickX + a),
+                    (uint8_t)(i + a * 7));
+  }
+}
+
+/// PacketSchemaにする前のControllerData::packetize(Packetizerの連鎖呼び出し)
+packet_t packetizeChained(controller::ControllerData &c) {
+  packet_t packet;
+  Packetizer p;
+  p.init(packet).pack(c.Button).pack(c.Analogue, 3);
+  return packet;
+}
+
+/// LegacyMUWrapperのコールバック(文脈を受け取れないのでグローバルに数える)
+uint32_t legacy_count = 0;
+void countLegacy(MUEvent event, uint8_t *data, uint8_t len) {
+  (void)event;
+  (void)data;
+  legacy_count += len;
+}
+
+/// タスク間で受け渡す入力(main.cppのInputSampleと同じ大きさ)
+struct Sample {
+  uint32_t time_us;
+  uint32_t seq;
+  controller::ControllerData pad[2];
+  uint8_t connected;
+  bool emergency;
+};
+
+/// 受信データの解析に渡す量。PCでは1MB、ESP32では内部RAMに収まる量
+#if defined(ESP_PLATFORM)
+constexpr uint32_t STREAM_BYTES = 32 * 1024;
+#else
+constexpr uint32_t STREAM_BYTES = 1024 * 1024;
+#endif
+
+/**
+ * @brief MUがUARTに出すデータ(受信データ・応答)を並べたもの
+ *
+ */
+struct MuStream {
+  uint8_t *data = nullptr;
+  uint32_t len = 0;
+  /// 含まれるフレーム('*'で始まる行)の数
+  uint32_t frames = 0;
+  /// UARTから一度に読む長さ(1~64バイト)。解析に渡すときに順に使う
+  uint8_t chunk[256];
+
+  /// 1フレーム足す。入りきらなければfalse
+  bool add(const char *head, const uint8_t *payload, uint8_t len_) {
+    uint32_t n = strlen(head) + len_ + 2;
+    if (len + n > STREAM_BYTES) {
+      return false;
+    }
+    memcpy(data + len, head, strlen(head));
+    memcpy(data + len + strlen(head), payload, len_);
+    memcpy(data + len + n - 2, "\r\n", 2);
+    len += n;
+    frames++;
+    return true;
+  }
+  bool addData(const uint8_t *payload, uint8_t len_) {
+    char head[8] = "*DR=";
+    head[4] = MU_HEX_DIGITS[len_ >> 4];
+    head[5] = MU_HEX_DIGITS[len_ & 0x0F];
+    head[6] = '\0';
+    return add(head, payload, len_);
+  }
+
+  /**
+   * @brief 全体を一度に読む長さずつ解析に渡す
+   *
+   * @tparam F (uint8_t *data, uint8_t len)を受け取る関数
+   * @param push
+   */
+  template <class F> void feed(F push) {
+    uint8_t k = 0;
+    for (uint32_t off = 0; off < len;) {
+      uint32_t n = chunk[k++];
+      if (n > len - off) {
+        n = len - off;
+      }
+      push(data + off, (uint8_t)n);
+      off += n;
+    }
+  }
+};
+
+/// 再現できる疑似乱数(xorshift32)
+uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/**
+ * @brief
+ * 実際の送信機・受信機の間と同じ内容のデータを作る。
+ * 送信機が送るフレーム(1台または2台のpackControllers、収まればCRC8付き)の*DRが大半で、
+ * @DTへの応答(*DT=xx)、送信エラー(*IR=03)、受信電波強度(*RA=xx)が混ざる。
+ *
+ * @param s
+ */
+void makeSessionStream(MuStream &s) {
+  uint32_t rnd = 0x12345678;
+  controller::ControllerData pads[2];
+  memset(pads, 0, sizeof(pads));
+  for (uint32_t i = 0;; i++) {
+    uint32_t r = nextRandom(rnd) % 100;
+    bool ok;
+    if (r < 80) {
+      fill(pads[0], i);
+      fill(pads[1], ~i);
+      uint8_t frame[controller::FRAME_MAXLEN];
+      uint8_t len = controller::packControllers(frame, pads, (i & 1) ? 3 : 1,
+                                                controller::FORMAT_HIRES);
+      // CRCが収まらない(2台の)ときはそのまま送る
+      uint8_t sealed[MU_MAX_DATALEN];
+      uint8_t sealed_len = sealFrame(sealed, frame, len, (uint8_t)i, FRAME_CHECK_CRC8);
+      ok = sealed_len ? s.addData(sealed, sealed_len) : s.addData(frame, len);
+    } else if (r < 95) {
+      ok = s.add("*DT=0B", nullptr, 0);
+    } else if (r < 98) {
+      ok = s.add("*IR=03", nullptr, 0);
+    } else {
+      ok = s.add("*RA=5A", nullptr, 0);
+    }
+    if (!ok) {
+      break;
+    }
+  }
+  for (uint16_t k = 0; k < 256; k++) {
+    s.chunk[k] = 1 + nextRandom(rnd) % 64;
+  }
+}
+
+/**
+ * @brief 長さ(1~MU_MAX_DATALEN)も中身もでたらめな*DRだけのデータを作る
+ *
+ * @param s
+ */
+void makeRandomStream(MuStream &s) {
+  uint32_t rnd = 0x9E3779B9;
+  for (;;) {
+    uint8_t payload[MU_MAX_DATALEN];
+    uint8_t len = 1 + nextRandom(rnd) % MU_MAX_DATALEN;
+    for (uint8_t k = 0; k < len; k++) {
+      payload[k] = (uint8_t)nextRandom(rnd);
+    }
+    if (!s.addData(payload, len)) {
+      break;
+    }
+  }
+  for (uint16_t k = 0; k < 256; k++) {
+    s.chunk[k] = 1 + nextRandom(rnd) % 64;
+  }
+}
+
+template <class Out> void runAll(Out &out) {
+  BenchRunner<Out> bench(out);
+  controller::ControllerData pads[2];
+  memset(pads, 0, sizeof(pads));
+  fill(pads[0], 0x1234);
+  fill(pads[1], 0x4321);
+
+  //---------------------------------------------------------- Packetizer
+  bench.run("packetizer_pack", [&](uint32_t i) {
+    packet_t p;
+    Packetizer packer;
+    uint8_t analog[3] = {(uint8_t)i, (uint8_t)(i >> 8), 0x88};
+    packer.init(p).pack((uint16_t)i).pack(analog, 3);
+    benchKeep(p);
+  });
+  bench.run("packetizer_unpack", [&](uint32_t i) {
+    packet_t p;
+    Packetizer packer;
+    p.data[0] = (uint8_t)i;
+    p.length = 5;
+    uint16_t button;
+    uint8_t analog[3];
+    packer.init(p).unpack(button).unpack(analog, 3);
+    benchKeep(button);
+    benchKeep(analog);
+  });
+  // 同じフィールドをPacketSchemaで(packetizer_pack/unpackと比べる)
+  bench.run("schema_pack", [&](uint32_t i) {
+    uint8_t out[controller::LegacySchema::size];
+    uint8_t analog[3] = {(uint8_t)i, (uint8_t)(i >> 8), 0x88};
+    controller::LegacySchema::pack(out, (uint16_t)i, analog);
+    benchKeep(out);
+  });
+  bench.run("schema_unpack", [&](uint32_t i) {
+    uint8_t in[controller::LegacySchema::size] = {(uint8_t)i, 1, 2, 3, 4};
+    uint16_t button;
+    uint8_t analog[3];
+    controller::LegacySchema::unpack(in, button, analog);
+    benchKeep(button);
+    benchKeep(analog);
+  });
+  bench.run("packetizer_pack_hires", [&](uint32_t i) {
+    packet_t p;
+    Packetizer packer;
+    packer.init(p).pack((uint16_t)i).pack((uint32_t)(i * 2654435761u));
+    benchKeep(p);
+  });
+  bench.run("schema_pack_hires", [&](uint32_t i) {
+    uint8_t out[controller::HiresBodySchema::size];
+    controller::HiresBodySchema::pack(out, (uint16_t)i, (uint32_t)(i * 2654435761u));
+    benchKeep(out);
+  });
+
+  //------------------------------------------------------ ControllerData
+  bench.run("controllerdata_set", [&](uint32_t i) {
+    fill(pads[0], i);
+    benchKeep(pads[0]);
+  });
+  bench.run("controllerdata_get", [&](uint32_t i) {
+    pads[0].Button = (uint16_t)i;
+    uint32_t sum = 0;
+    for (uint8_t b = 0; b < 16; b++) {
+      sum += pads[0].button((controller::Index)b);
+    }
+    for (uint8_t a = 0; a < 6; a++) {
+      sum += pads[0].analograw((controller::Index)(controller::LstickX + a));
+    }
+    benchKeep(sum);
+  });
+  bench.run("packetize_legacy", [&](uint32_t i) {
+    pads[0].Button = (uint16_t)i;
+    packet_t p = pads[0].packetize(controller::FORMAT_LEGACY);
+    benchKeep(p);
+  });
+  bench.run("packetize_legacy_chained", [&](uint32_t i) {
+    pads[0].Button = (uint16_t)i;
+    packet_t p = packetizeChained(pads[0]);
+    benchKeep(p);
+  });
+  bench.run("pack_legacy", [&](uint32_t i) {
+    uint8_t frame[controller::FRAME_MAXLEN];
+    pads[0].Button = (uint16_t)i;
+    uint8_t len = pads[0].pack(frame, controller::FORMAT_LEGACY);
+    benchKeep(len);
+    benchKeep(frame);
+  });
+  bench.run("packetize_hires", [&](uint32_t i) {
+    pads[0].Button = (uint16_t)i;
+    packet_t p = pads[0].packetize(controller::FORMAT_HIRES);
+    benchKeep(p);
+  });
+  bench.run("unpacketize_hires", [&](uint32_t i) {
+    uint8_t frame[7] = {controller::FORMAT_TAG_HIRES, (uint8_t)i, 0x12, 0x34,
+                        0x56, 0x78, 0x9a};
+    controller::ControllerData c;
+    bool ok = c.unpacketize(frame, sizeof(frame));
+    benchKeep(ok);
+    benchKeep(c);
+  });
+  bench.run("pack_controllers", [&](uint32_t i) {
+    uint8_t frame[controller::FRAME_MAXLEN];
+    pads[0].Button = (uint16_t)i;
+    uint8_t len = controller::packControllers(frame, pads, 3,
+                                              controller::FORMAT_LEGACY);
+    benchKeep(len);
+    benchKeep(frame);
+  });
+
+  //--------------------------------------------------- ControllerManager
+  controller::ControllerManager manager;
+  bench.run("manager_update_cartesian", [&](uint32_t i) {
+    pads[0].setAnalog(controller::LstickX, i & 15);
+    pads[0].setButton(controller::FLAG_STICK_POLAR, false);
+    manager.update(pads[0]);
+    int16_t v = manager.getValue(controller::LstickX);
+    benchKeep(v);
+  });
+  bench.run("manager_update_polar", [&](uint32_t i) {
+    pads[0].setAnalog(controller::LstickX, i & 15);
+    pads[0].setButton(controller::FLAG_STICK_POLAR, true);
+    manager.update(pads[0]);
+    int16_t v = manager.getValue(controller::LstickX);
+    benchKeep(v);
+  });
+  bench.run("lightcomplex_abs_arg", [&](uint32_t i) {
+    controller::ControllerManager::lightcomplex z((int8_t)(i & 15) - 7,
+                                                  (int8_t)((i >> 4) & 15) - 7);
+    int8_t r = z.abs();
+    float theta = z.arg();
+    benchKeep(r);
+    benchKeep(theta);
+  });
+  bench.run("lightcomplex_polar", [&](uint32_t i) {
+    controller::ControllerManager::lightcomplex z(0, 0);
+    z.polar((int8_t)(i & 15), (int8_t)((i >> 4) & 15));
+    benchKeep(z);
+  });
+
+  //---------------------------------------------------------- WiiClassic
+  bench.run("wiiclassic_map", [&](uint32_t i) {
+    uint8_t raw[6] = {(uint8_t)i, 0x20, 0x10, 0x00, (uint8_t)~i, 0xff};
+    controller::ControllerData c;
+    WiiClassic::mapButton(raw, c);
+    benchKeep(c);
+  });
+
+  //---------------------------------------------------------- FrameCheck
+  // 1回あたりMU_MAX_DATALENバイト(1フレームの最大)にかける
+  uint8_t block[MU_MAX_DATALEN];
+  for (uint8_t k = 0; k < sizeof(block); k++) {
+    block[k] = (uint8_t)(k * 37 + 11);
+  }
+  bench.run("crc8_12B", [&](uint32_t i) {
+    block[0] = (uint8_t)i;
+    uint8_t crc = crc8(block, sizeof(block));
+    benchKeep(crc);
+  });
+  bench.run("crc16_12B", [&](uint32_t i) {
+    block[0] = (uint8_t)i;
+    uint16_t crc = crc16(block, sizeof(block));
+    benchKeep(crc);
+  });
+  bench.run("frame_seal_crc8", [&](uint32_t i) {
+    uint8_t sealed[MU_MAX_DATALEN];
+    uint8_t frame[5] = {(uint8_t)i, 1, 2, 3, 4};
+    uint8_t len = sealFrame(sealed, frame, sizeof(frame), (uint8_t)i,
+                            FRAME_CHECK_CRC8);
+    benchKeep(len);
+    benchKeep(sealed);
+  });
+  FrameChecker checker;
+  uint8_t sealed[MU_MAX_DATALEN];
+  uint8_t sealed_len = sealFrame(sealed, block, 5, 0, FRAME_CHECK_CRC16);
+  bench.run("frame_open_crc16", [&](uint32_t i) {
+    sealed[1] = (uint8_t)i; // CRCは合わなくなるが、計算量は同じ
+    const uint8_t *payload;
+    uint8_t len;
+    bool ok = checker.open(sealed, sealed_len, payload, len);
+    benchKeep(ok);
+  });
+
+  //----------------------------------------------------------- MUWrapper
+  uint32_t sent = 0;
+  MUWrapper mu(countSend, &sent);
+  bench.run("mu_send", [&](uint32_t i) {
+    uint8_t data[5] = {(uint8_t)i, 1, 2, 3, 4};
+    mu.send(data, sizeof(data));
+  });
+  bench.run("mu_configure", [&](uint32_t i) {
+    mu.configure("CH", (uint8_t)i);
+  });
+  benchKeep(sent);
+  // 以前の送信データ生成(sprintfとコールバック3回)
+  LegacyMUWrapper legacy(countLegacy);
+  bench.run("mu_send_legacy", [&](uint32_t i) {
+    uint8_t data[5] = {(uint8_t)i, 1, 2, 3, 4};
+    legacy.send(data, sizeof(data));
+  });
+  bench.run("mu_configure_legacy", [&](uint32_t i) {
+    legacy.setParam("CH", (uint8_t)i);
+  });
+  benchKeep(legacy_count);
+  uint32_t received = 0;
+  MUWrapper rx(countSend, &received);
+  bench.run("mu_push_dr", [&](uint32_t i) {
+    uint8_t frame[] = "*DR=05\x12\x34\x56\x78\x9a\r\n";
+    frame[6] = (uint8_t)i;
+    rx.pushRawData(frame, sizeof(frame) - 1);
+  });
+  bench.run("mu_push_response", [&](uint32_t i) {
+    (void)i;
+    static const uint8_t frame[] = "*DT=05\r\n";
+    rx.pushRawData(frame, sizeof(frame) - 1);
+  });
+  benchKeep(received);
+
+  //------------------------------------------------------------- Mailbox
+  // 入力タスクからメインタスクへの受け渡し(同じタスクで書いてすぐ読む)
+  Mailbox<Sample> mailbox;
+  Sample sample;
+  memset(&sample, 0, sizeof(sample));
+  sample.pad[0] = pads[0];
+  sample.pad[1] = pads[1];
+  Sample latest;
+  bench.run("mailbox_publish", [&](uint32_t i) {
+    sample.seq = i;
+    mailbox.publish(sample);
+  });
+  bench.run("mailbox_publish_read", [&](uint32_t i) {
+    sample.seq = i;
+    mailbox.publish(sample);
+    mailbox.read(latest);
+  });
+  benchKeep(latest.seq);
+#if defined(ESP_PLATFORM)
+  // 以前の受け渡し(長さ1のキューに上書きし、待たずに受け取る)
+  QueueHandle_t queue = xQueueCreate(1, sizeof(Sample));
+  bench.run("queue_overwrite_receive", [&](uint32_t i) {
+    sample.seq = i;
+    xQueueOverwrite(queue, &sample);
+    xQueueReceive(queue, &latest, 0);
+  });
+  vQueueDelete(queue);
+  benchKeep(latest.seq);
+#endif
+
+  // 受信データの解析の処理速度。1回でストリーム全体を任意の長さに区切って渡す
+  MuStream streams[2];
+  const char *names[2][2] = {{"mu_parse_session", "mu_parse_session_legacy"},
+                             {"mu_parse_random", "mu_parse_random_legacy"}};
+  for (uint8_t k = 0; k < 2; k++) {
+    MuStream &s = streams[k];
+    s.data = (uint8_t *)malloc(STREAM_BYTES);
+    if (!s.data) {
+      out.printf("# %s: no memory\n", names[k][0]);
+      continue;
+    }
+    if (k == 0) {
+      makeSessionStream(s);
+    } else {
+      makeRandomStream(s);
+    }
+    MUWrapper parser(countSend, &received);
+    bench.runThroughput(names[k][0], [&](uint32_t i) {
+      (void)i;
+      s.feed([&](uint8_t *data, uint8_t len) { parser.pushRawData(data, len); });
+    }, s.len, s.frames);
+    bench.runThroughput(names[k][1], [&](uint32_t i) {
+      (void)i;
+      s.feed([&](uint8_t *data, uint8_t len) { legacy.pushRawData(data, len); });
+    }, s.len, s.frames);
+    free(s.data);
+  }
+  benchKeep(received);
+  benchKeep(legacy_count);
+}
+
+} // namespace
+
+#if defined(ESP_PLATFORM)
+void setup() {
+  Serial.begin(115200);
+  delay(2000); // USBシリアルがつながるのを待つ
+  runAll(Serial);
+}
+
+void loop() { delay(1000); }
+#else
+/**
+ * @brief 標準出力に書く
+ *
+ */
+struct StdoutOut {
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    return n;
+  }
+};
+
+int main() {
+  StdoutOut out;
+  runAll(out);
+  return 0;
+}
+#endif
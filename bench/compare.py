@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+"""ベンチマークの結果(JSON Lines)を2つ比べる。
+
+使い方: compare.py 前.jsonl 後.jsonl [--threshold=5] [--stat=min|median]
+最小値(--statで変更)がthreshold[%]より遅くなったものがあれば終了コード1を返す。
+PCでは他の処理に邪魔されると遅くなるだけなので、最小値のほうがばらつきが少ない。
+"""
+import json
+import sys
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue  # シリアルモニタの他の出力は無視する
+            r = json.loads(line)
+            results[(r["platform"], r["bench"])] = r
+    return results
+
+
+def main(argv):
+    threshold = 5.0
+    stat = "min"
+    paths = []
+    for arg in argv[1:]:
+        if arg.startswith("--threshold="):
+            threshold = float(arg.split("=", 1)[1])
+        elif arg.startswith("--stat="):
+            stat = arg.split("=", 1)[1]
+        else:
+            paths.append(arg)
+    if len(paths) != 2:
+        print(__doc__, file=sys.stderr)
+        return 2
+    before, after = load(paths[0]), load(paths[1])
+    regressed = False
+    print("%-8s %-28s %12s %12s %8s" % ("platform", "bench", "before", "after", "change"))
+    for key in sorted(set(before) | set(after)):
+        if key not in before or key not in after:
+            print("%-8s %-28s %s" % (key[0], key[1], "only in " + ("after" if key in after else "before")))
+            continue
+        b, a = before[key][stat], after[key][stat]
+        change = (a - b) / b * 100 if b else 0.0
+        mark = ""
+        if change > threshold:
+            mark = "  <- slower"
+            regressed = True
+        print("%-8s %-28s %12.2f %12.2f %+7.1f%%%s" % (key[0], key[1], b, a, change, mark))
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,89 @@
+/**
+ * @file Adafruit_GFX.h
+ * @brief
+ * PC用のAdafruit_GFXの代わり。点・線・塗りつぶしと文字の位置を扱う。
+ * 文字の形は本物と違い、文字コードから作った模様を描く(画面の変化の量を見るため)。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include "Arduino.h"
+
+class Adafruit_GFX : public Print {
+public:
+  Adafruit_GFX(int16_t w, int16_t h) : width_(w), height_(h) {}
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+
+  void setRotation(uint8_t r) { rotation_ = r & 3; }
+  uint8_t getRotation() const { return rotation_; }
+  void setCursor(int16_t x, int16_t y) {
+    cursor_x_ = x;
+    cursor_y_ = y;
+  }
+  void setTextSize(uint8_t s) { textsize_ = s > 0 ? s : 1; }
+  void setTextColor(uint16_t c) { textcolor_ = c; }
+  int16_t width() const { return (rotation_ & 1) ? height_ : width_; }
+  int16_t height() const { return (rotation_ & 1) ? width_ : height_; }
+
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    for (int16_t j = y; j < y + h; j++) {
+      for (int16_t i = x; i < x + w; i++) {
+        drawPixel(i, j, color);
+      }
+    }
+  }
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1,
+                uint16_t color) {
+    int16_t dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int16_t dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int16_t err = dx + dy;
+    while (true) {
+      drawPixel(x0, y0, color);
+      if (x0 == x1 && y0 == y1) {
+        break;
+      }
+      int16_t e2 = 2 * err;
+      if (e2 >= dy) {
+        err += dy;
+        x0 += sx;
+      }
+      if (e2 <= dx) {
+        err += dx;
+        y0 += sy;
+      }
+    }
+  }
+
+  size_t write(uint8_t c) override {
+    if (c == '\n') {
+      cursor_x_ = 0;
+      cursor_y_ += 8 * textsize_;
+      return 1;
+    }
+    if (c == '\r') {
+      return 1;
+    }
+    // 5x7の代わりに文字コードのビットを縦に並べた模様
+    for (int8_t i = 0; i < 5; i++) {
+      uint8_t column = (uint8_t)(c * (i + 3)) & 0x7f;
+      for (int8_t j = 0; j < 7; j++) {
+        if (column & (1 << j)) {
+          fillRect(cursor_x_ + i * textsize_, cursor_y_ + j * textsize_,
+                   textsize_, textsize_, textcolor_);
+        }
+      }
+    }
+    cursor_x_ += 6 * textsize_;
+    return 1;
+  }
+  using Print::write;
+
+protected:
+  int16_t width_;
+  int16_t height_;
+  uint8_t rotation_ = 0;
+  int16_t cursor_x_ = 0;
+  int16_t cursor_y_ = 0;
+  uint8_t textsize_ = 1;
+  uint16_t textcolor_ = 1;
+};
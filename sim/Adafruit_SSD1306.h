@@ -0,0 +1,118 @@
+/**
+ * @file Adafruit_SSD1306.h
+ * @brief
+ * PC用のAdafruit_SSD1306の代わり。フレームバッファの配置(8ページ×128バイト)と
+ * begin()/display()のI2C送信は本物に合わせる。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include "Adafruit_GFX.h"
+#include "Wire.h"
+
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_INVERSE 2
+#define BLACK SSD1306_BLACK
+#define WHITE SSD1306_WHITE
+#define INVERSE SSD1306_INVERSE
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_SWITCHCAPVCC 0x02
+
+class Adafruit_SSD1306 : public Adafruit_GFX {
+public:
+  Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire *twi, int8_t rst_pin = -1,
+                   uint32_t clkDuring = 400000UL, uint32_t clkAfter = 100000UL)
+      : Adafruit_GFX(w, h), wire_(twi), clk_during_(clkDuring),
+        clk_after_(clkAfter) {
+    (void)rst_pin;
+  }
+
+  bool begin(uint8_t switchvcc = SSD1306_SWITCHCAPVCC, uint8_t i2caddr = 0,
+             bool reset = true, bool periphBegin = true) {
+    (void)switchvcc;
+    (void)reset;
+    (void)periphBegin;
+    addr_ = i2caddr;
+    clearDisplay();
+    // 本物と同じ初期化コマンド列(水平アドレッシングモードにする)
+    static const uint8_t init[] = {0xAE, 0xD5, 0x80, 0xA8, 0x3F, 0xD3, 0x00,
+                                   0x40, 0x8D, 0x14, 0x20, 0x00, 0xA1, 0xC8,
+                                   0xDA, 0x12, 0x81, 0xCF, 0xD9, 0xF1, 0xDB,
+                                   0x40, 0xA4, 0xA6, 0x2E, 0xAF};
+    wire_->setClock(clk_during_);
+    commandList(init, sizeof(init));
+    wire_->setClock(clk_after_);
+    return true;
+  }
+
+  void clearDisplay() { memset(buffer_, 0, sizeof(buffer_)); }
+  uint8_t *getBuffer() { return buffer_; }
+
+  /// フレームバッファ全体を送る
+  void display() {
+    static const uint8_t window[] = {0x22, 0, 0xFF, 0x21, 0, 127};
+    wire_->setClock(clk_during_);
+    commandList(window, sizeof(window));
+    for (size_t pos = 0; pos < sizeof(buffer_); pos += 32) {
+      wire_->beginTransmission(addr_);
+      wire_->write((uint8_t)0x40);
+      wire_->write(buffer_ + pos, 32);
+      wire_->endTransmission();
+    }
+    wire_->setClock(clk_after_);
+  }
+
+  void ssd1306_command(uint8_t c) { commandList(&c, 1); }
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    if (x < 0 || y < 0 || x >= width() || y >= height()) {
+      return;
+    }
+    switch (rotation_) {
+    case 1: {
+      int16_t t = x;
+      x = width_ - 1 - y;
+      y = t;
+      break;
+    }
+    case 2:
+      x = width_ - 1 - x;
+      y = height_ - 1 - y;
+      break;
+    case 3: {
+      int16_t t = x;
+      x = y;
+      y = height_ - 1 - t;
+      break;
+    }
+    }
+    uint8_t &b = buffer_[x + (y / 8) * width_];
+    uint8_t bit = 1 << (y & 7);
+    switch (color) {
+    case SSD1306_WHITE:
+      b |= bit;
+      break;
+    case SSD1306_BLACK:
+      b &= ~bit;
+      break;
+    case SSD1306_INVERSE:
+      b ^= bit;
+      break;
+    }
+  }
+
+private:
+  TwoWire *wire_;
+  uint32_t clk_during_;
+  uint32_t clk_after_;
+  uint8_t addr_ = 0x3c;
+  uint8_t buffer_[128 * 64 / 8];
+
+  void commandList(const uint8_t *c, size_t n) {
+    wire_->beginTransmission(addr_);
+    wire_->write((uint8_t)0x00);
+    wire_->write(c, n);
+    wire_->endTransmission();
+  }
+};
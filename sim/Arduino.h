@@ -0,0 +1,170 @@
+/**
+ * @file Arduino.h
+ * @brief
+ * PC用のArduino(ESP32)の代わり。使っているAPIだけを模擬時間で実装する。
+ * GPIOはsim::setPinでレベルを変えると、attachInterruptArgした割り込みが呼ばれる。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <functional>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#define IRAM_ATTR
+#define CONFIG_ARDUINO_RUNNING_CORE 1
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+#define SERIAL_8N1 0x800001c
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+/// ハードウェア乱数の代わり。模擬では毎回同じ列を返す
+uint32_t esp_random();
+/// PSRAMの代わり。模擬ではヒープから取る
+bool psramFound();
+void *ps_malloc(size_t size);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void attachInterruptArg(uint8_t pin, void (*isr)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+/**
+ * @brief ArduinoのStringの代わり(使っている分だけ)
+ *
+ */
+class String {
+public:
+  String() {}
+  String(const char *s) : s_(s) {}
+  const char *c_str() const { return s_.c_str(); }
+  size_t length() const { return s_.size(); }
+
+private:
+  std::string s_;
+};
+
+/**
+ * @brief ArduinoのPrintの代わり。write(uint8_t)を実装すればprint/printfが使える
+ *
+ */
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+      write(buf[i]);
+    }
+    return len;
+  }
+  size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return printf("%d", v); }
+  size_t print(unsigned int v) { return printf("%u", v); }
+  size_t println(const char *s = "") { return print(s) + write("\r\n"); }
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (n < 0) {
+      return 0;
+    }
+    return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+  }
+};
+
+/**
+ * @brief
+ * HardwareSerialの代わり。送信はbegin()の通信速度で1バイトずつ送り出す時間を模擬し、
+ * 送り終わる時刻とともにsinkに渡す。受信はsim::injectで模擬時刻に届ける。
+ *
+ */
+class HardwareSerial : public Print {
+public:
+  /// 送信データの受け取り先。doneは最後のバイトを送り終わる時刻[us]
+  typedef std::function<void(const uint8_t *data, size_t len, uint64_t done_us)> Sink;
+
+  HardwareSerial(int port) : port_(port) {}
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rx = -1,
+             int8_t tx = -1);
+  void end() {}
+  int available();
+  int read();
+  size_t read(uint8_t *buf, size_t len);
+  int peek();
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t len) override;
+  using Print::write;
+  int availableForWrite();
+  /// 送信し終わるまで待つ
+  void flush();
+  void onReceive(std::function<void(void)> cb, bool onlyOnTimeout = false) {
+    (void)onlyOnTimeout;
+    on_receive_ = cb;
+  }
+  operator bool() const { return true; }
+
+  // ここからPC用
+  void setSink(Sink sink) { sink_ = sink; }
+  /// 受信データを今届ける(onReceiveのコールバックを呼ぶ)
+  void inject(const uint8_t *data, size_t len);
+  /// 送信FIFOの大きさ[バイト]。溜まっている分がこれを超えるとwriteが待つ
+  void setTxFifo(size_t bytes) { fifo_ = bytes; }
+  uint64_t txBytes() const { return tx_bytes_; }
+  /// 送信線を使っていた時間の合計[us]
+  uint64_t txBusyUs() const { return tx_busy_us_; }
+  unsigned long baud() const { return baud_; }
+
+private:
+  int port_;
+  unsigned long baud_ = 0;
+  size_t fifo_ = 128;
+  uint64_t line_free_us_ = 0;
+  uint64_t tx_bytes_ = 0;
+  uint64_t tx_busy_us_ = 0;
+  std::vector<uint8_t> rx_;
+  size_t rx_pos_ = 0;
+  Sink sink_;
+  std::function<void(void)> on_receive_;
+  uint64_t byteUs() const { return baud_ ? 10000000ULL / baud_ : 0; }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+namespace sim {
+/// ピンのレベルを変える。割り込みが設定されていれば呼ぶ
+void setPin(uint8_t pin, int level);
+/// 指定した時刻にピンのレベルを変える
+void setPinAt(uint64_t t_us, uint8_t pin, int level);
+} // namespace sim
@@ -0,0 +1,88 @@
+/**
+ * @file FakeUart.h
+ * @brief
+ * HardwareSerialの代わりに使うメモリ上のUART。PC上でMuReceiverなどを動かすときに使う(test/test_mu_receiver)。
+ * テスト用なのでファームウェアのビルドに入らないsim/に置く。
+ * inject()で受信データを流し込み、送信データはtxに溜まる。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+
+template <size_t Size = 1024> class FakeUart {
+public:
+  /**
+   * @brief 受信時に呼ばれる関数を登録(HardwareSerial::onReceiveと同じ形)
+   *
+   * @param callback
+   * @param onlyOnTimeout 使わない
+   */
+  void onReceive(std::function<void(void)> callback, bool onlyOnTimeout = false) {
+    (void)onlyOnTimeout;
+    callback_ = callback;
+  }
+
+  /**
+   * @brief 受信データを流し込む。入りきらない分は捨てる
+   *
+   * @param data
+   * @param len
+   * @return size_t 受け入れたバイト数
+   */
+  size_t inject(const uint8_t *data, size_t len) {
+    size_t n = rx_.push(data, len);
+    overflow += len - n;
+    if (n > 0 && callback_) {
+      callback_();
+    }
+    return n;
+  }
+
+  int available() { return (int)rx_.count; }
+  int read() {
+    uint8_t d;
+    return rx_.pop(&d, 1) ? d : -1;
+  }
+  size_t read(uint8_t *buffer, size_t size) { return rx_.pop(buffer, size); }
+  size_t write(const uint8_t *buffer, size_t size) {
+    return tx.push(buffer, size);
+  }
+  size_t write(uint8_t d) { return tx.push(&d, 1); }
+
+  /**
+   * @brief 固定長のリングバッファ
+   *
+   */
+  struct Ring {
+    uint8_t buf[Size];
+    size_t head = 0;
+    size_t count = 0;
+    size_t push(const uint8_t *data, size_t len) {
+      size_t n = 0;
+      while (n < len && count < Size) {
+        buf[(head + count++) % Size] = data[n++];
+      }
+      return n;
+    }
+    size_t pop(uint8_t *data, size_t len) {
+      size_t n = 0;
+      while (n < len && count > 0) {
+        data[n++] = buf[head];
+        head = (head + 1) % Size;
+        count--;
+      }
+      return n;
+    }
+  };
+  /// 送信されたデータ
+  Ring tx;
+  /// 受信バッファからあふれたバイト数
+  size_t overflow = 0;
+
+private:
+  Ring rx_;
+  std::function<void(void)> callback_;
+};
@@ -0,0 +1,96 @@
+/**
+ * @file LittleFS.h
+ * @brief
+ * PC用のLittleFSの代わり。ファイルはメモリ上に置く(プログラムが終われば消える)。
+ * PCのファイルを入れておくときはsim::putFileを使う。書き込みにかかる時間は模擬しない。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <map>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+
+namespace fs {
+
+class File {
+public:
+  File() {}
+  File(std::shared_ptr<std::vector<uint8_t>> data, bool writable)
+      : data_(data), writable_(writable) {}
+
+  size_t write(const uint8_t *buf, size_t len) {
+    if (!data_ || !writable_) {
+      return 0;
+    }
+    data_->insert(data_->end(), buf, buf + len);
+    return len;
+  }
+  size_t read(uint8_t *buf, size_t len) {
+    if (!data_) {
+      return 0;
+    }
+    size_t n = std::min(len, data_->size() - pos_);
+    memcpy(buf, data_->data() + pos_, n);
+    pos_ += n;
+    return n;
+  }
+  size_t size() const { return data_ ? data_->size() : 0; }
+  void close() { data_.reset(); }
+  explicit operator bool() const { return data_ != nullptr; }
+
+private:
+  std::shared_ptr<std::vector<uint8_t>> data_;
+  bool writable_ = false;
+  size_t pos_ = 0;
+};
+
+class LittleFSFS {
+public:
+  bool begin(bool formatOnFail = false) {
+    (void)formatOnFail;
+    return true;
+  }
+  File open(const char *path, const char *mode = FILE_READ) {
+    if (strcmp(mode, FILE_WRITE) == 0) {
+      std::shared_ptr<std::vector<uint8_t>> data(new std::vector<uint8_t>());
+      files_[path] = data;
+      return File(data, true);
+    }
+    auto it = files_.find(path);
+    return it == files_.end() ? File() : File(it->second, false);
+  }
+  bool exists(const char *path) const { return files_.count(path) != 0; }
+  bool remove(const char *path) { return files_.erase(path) != 0; }
+
+  // ここからPC用
+  /// ファイルの中身
+  const std::vector<uint8_t> *contents(const char *path) const {
+    auto it = files_.find(path);
+    return it == files_.end() ? nullptr : it->second.get();
+  }
+
+private:
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files_;
+};
+
+} // namespace fs
+
+using fs::File;
+
+extern fs::LittleFSFS LittleFS;
+
+namespace sim {
+/// ファイルを置く(PCから持ち込んだ記録など)
+inline void putFile(const char *path, const std::vector<uint8_t> &data) {
+  File f = LittleFS.open(path, FILE_WRITE);
+  f.write(data.data(), data.size());
+}
+} // namespace sim
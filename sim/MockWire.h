@@ -0,0 +1,99 @@
+/**
+ * @file MockWire.h
+ * @brief
+ * TwoWireの代わりに使うI2Cバス。PC上でBasicWiiClassicなどのタイミングを確かめるときに使う(test/test_wii_classic)。
+ * テスト用なのでファームウェアのビルドに入らないsim/に置く。
+ * 書き込み・読み出しの時刻を記録し、読み出しにはresponseの内容を返す。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class MockWire {
+public:
+  typedef uint32_t (*Clock)();
+  /**
+   * @brief バスで起きたこと
+   *
+   */
+  struct Event {
+    enum Kind : uint8_t { WRITE, READ } kind;
+    uint8_t addr;
+    uint8_t len;
+    uint8_t data[8];
+    uint32_t time;
+  };
+
+  MockWire(Clock clock) : clock_(clock){};
+
+  bool begin() {
+    begins++;
+    return true;
+  }
+  void beginTransmission(uint8_t addr) {
+    current_.kind = Event::WRITE;
+    current_.addr = addr;
+    current_.len = 0;
+  }
+  size_t write(uint8_t d) {
+    if (current_.len < sizeof(current_.data)) {
+      current_.data[current_.len++] = d;
+    }
+    return 1;
+  }
+  uint8_t endTransmission(bool stop = true) {
+    (void)stop;
+    current_.time = clock_();
+    record(current_);
+    return nack ? 2 : 0;
+  }
+  uint8_t requestFrom(uint8_t addr, uint8_t len) {
+    if (len > response_len) {
+      len = response_len;
+    }
+    Event e;
+    e.kind = Event::READ;
+    e.addr = addr;
+    e.len = len;
+    memcpy(e.data, response, len);
+    e.time = clock_();
+    record(e);
+    memcpy(rx_, response, len);
+    rx_len_ = len;
+    rx_pos_ = 0;
+    return len;
+  }
+  bool setClock(uint32_t hz) {
+    clock_hz = hz;
+    return true;
+  }
+  int available() { return rx_len_ - rx_pos_; }
+  int read() { return rx_pos_ < rx_len_ ? rx_[rx_pos_++] : -1; }
+
+  /// 読み出しで返すデータ
+  uint8_t response[8] = {0};
+  uint8_t response_len = 6;
+  /// trueにすると書き込みでNACKを返す
+  bool nack = false;
+  /// 記録したイベント(古いものから上書き)
+  static constexpr size_t LOG_SIZE = 64;
+  Event log[LOG_SIZE];
+  size_t count = 0;
+  uint32_t begins = 0;
+  uint32_t clock_hz = 100000;
+
+  const Event &last(size_t back = 0) const {
+    return log[(count - 1 - back) % LOG_SIZE];
+  }
+
+private:
+  Clock clock_;
+  Event current_;
+  uint8_t rx_[8];
+  uint8_t rx_len_ = 0;
+  uint8_t rx_pos_ = 0;
+  void record(const Event &e) { log[count++ % LOG_SIZE] = e; }
+};
@@ -0,0 +1,350 @@
+/**
+ * @file MuEmulator.cpp
+ * @brief 模擬MU-2の実装
+ * @version 0.1
+ *
+ */
+#include "MuEmulator.h"
+#include "SimKernel.h"
+#include <algorithm>
+
+namespace sim {
+
+namespace {
+
+bool hexValue(char c, uint8_t &v) {
+  if (c >= '0' && c <= '9') {
+    v = c - '0';
+  } else if (c >= 'A' && c <= 'F') {
+    v = c - 'A' + 10;
+  } else if (c >= 'a' && c <= 'f') {
+    v = c - 'a' + 10;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/// s[pos]からの16進数2文字
+bool parseHex(const std::string &s, size_t pos, uint8_t &value) {
+  uint8_t hi, lo;
+  if (s.size() < pos + 2 || !hexValue(s[pos], hi) || !hexValue(s[pos + 1], lo)) {
+    return false;
+  }
+  value = (hi << 4) | lo;
+  return true;
+}
+
+std::string hex(uint8_t v) {
+  char s[3] = {MU_HEX_DIGITS[v >> 4], MU_HEX_DIGITS[v & 0x0F], 0};
+  return s;
+}
+
+/// MU-2-429の周波数チャンネルの範囲
+const uint8_t CH_MIN = 0x07;
+const uint8_t CH_MAX = 0x2E;
+
+} // namespace
+
+//--------------------------------------------------------------- MuChannel
+
+MuChannel::MuChannel(const MuLinkParams &params)
+    : params_(params), rng_(params.seed ? params.seed : 1) {}
+
+void MuChannel::resetStats() {
+  MuChannelStats &s = stats_;
+  s.transmitted = s.delivered = s.collided = s.dropped = s.corrupted = 0;
+  s.deferred = s.carrier_busy = s.ir_injected = 0;
+  s.airtime_us = 0;
+  s.latency.reset();
+}
+
+uint32_t MuChannel::random() {
+  // xorshift32
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 17;
+  rng_ ^= rng_ << 5;
+  return rng_;
+}
+
+uint64_t MuChannel::busyUntil(uint8_t ch, uint64_t now_us) {
+  uint64_t until = 0;
+  for (const Transmission &t : air_) {
+    if (t.ch == ch && t.start_us <= now_us && now_us < t.end_us &&
+        t.end_us > until) {
+      until = t.end_us;
+    }
+  }
+  return until;
+}
+
+int16_t MuChannel::rssiDbm(const MuModule *module, uint8_t ch, uint64_t now_us) {
+  bool busy = false;
+  for (const Transmission &t : air_) {
+    if (t.from != module && t.ch == ch && t.start_us <= now_us && now_us < t.end_us) {
+      busy = true;
+    }
+  }
+  // 測るたびに少しばらつく
+  int16_t jitter = (int16_t)(random() % 5) - 2;
+  return (busy ? params_.signal_dbm : params_.noise_dbm) + jitter;
+}
+
+uint32_t MuChannel::begin(MuModule *from, uint8_t ch, uint64_t start_us,
+                        uint64_t end_us) {
+  // 終わった送信は(終わりの処理も済んでいるので)捨てる
+  uint64_t now = nowUs();
+  air_.erase(std::remove_if(air_.begin(), air_.end(),
+                            [now](const Transmission &t) {
+                              return t.end_us < now;
+                            }),
+             air_.end());
+  Transmission tx = {next_id_++, from, ch, start_us, end_us, false};
+  for (Transmission &t : air_) {
+    if (t.ch == ch && t.start_us < end_us && start_us < t.end_us) {
+      t.collided = true;
+      tx.collided = true;
+    }
+  }
+  air_.push_back(tx);
+  return tx.id;
+}
+
+void MuChannel::end(uint32_t id, const uint8_t *data, uint8_t len,
+                    uint8_t gi, uint8_t di, uint64_t origin_us) {
+  const Transmission *tx = nullptr;
+  for (const Transmission &t : air_) {
+    if (t.id == id) {
+      tx = &t;
+      break;
+    }
+  }
+  if (tx == nullptr) {
+    return;
+  }
+  stats_.transmitted++;
+  stats_.airtime_us += tx->end_us - tx->start_us;
+  if (tx->collided) {
+    stats_.collided++;
+    return;
+  }
+  for (MuModule *m : modules_) {
+    if (m == tx->from || m->ch_ != tx->ch) {
+      continue;
+    }
+    if (chance(params_.drop_permille)) {
+      stats_.dropped++;
+      continue;
+    }
+    if (m->receive(data, len, gi, di, origin_us, tx->start_us)) {
+      stats_.delivered++;
+    }
+  }
+}
+
+//---------------------------------------------------------------- MuModule
+
+MuModule::MuModule(MuChannel &channel, uint8_t ei) : channel_(channel), ei_(ei) {
+  channel_.modules_.push_back(this);
+}
+
+MuModule::~MuModule() {
+  std::vector<MuModule *> &m = channel_.modules_;
+  m.erase(std::remove(m.begin(), m.end(), this), m.end());
+}
+
+uint64_t MuModule::byteUs() const {
+  // 8N1なので1バイト10ビット
+  return 10000000ULL / channel_.params_.radio.uart_baud;
+}
+
+void MuModule::fromHost(const uint8_t *data, size_t len, uint64_t done_us) {
+  for (size_t i = 0; i < len; i++) {
+    uint64_t t = done_us - (len - 1 - i) * byteUs();
+    char c = (char)data[i];
+    if (!in_command_) {
+      if (c == '@') {
+        in_command_ = true;
+        line_.clear();
+        line_origin_us_ = t;
+        dt_remaining_ = 0;
+      }
+      continue;
+    }
+    if (dt_remaining_ > 0) { // @DTのデータ部は改行を含んでもよい
+      line_ += c;
+      dt_remaining_--;
+      continue;
+    }
+    if (c == '\n') {
+      if (!line_.empty() && line_.back() == '\r') {
+        line_.pop_back();
+      }
+      Command cmd = {line_, line_origin_us_};
+      at(t, [this, cmd] { accept(cmd); });
+      in_command_ = false;
+      continue;
+    }
+    line_ += c;
+    uint8_t n;
+    if (line_.size() == 4 && line_.compare(0, 2, "DT") == 0 &&
+        parseHex(line_, 2, n)) {
+      dt_remaining_ = n;
+    }
+    if (line_.size() > 300) { // 改行が来ないまま長すぎるものは捨てる
+      in_command_ = false;
+    }
+  }
+}
+
+void MuModule::accept(const Command &c) {
+  queue_.push_back(c);
+  if (!busy_) {
+    next();
+  }
+}
+
+void MuModule::next() {
+  if (queue_.empty()) {
+    busy_ = false;
+    return;
+  }
+  busy_ = true;
+  Command c = queue_.front();
+  queue_.pop_front();
+  execute(c);
+}
+
+void MuModule::execute(const Command &c) {
+  const MuLinkParams &p = channel_.params_;
+  uint64_t now = nowUs();
+  uint64_t done = now + p.command_us;
+  stats_.commands++;
+  std::string command = c.text.substr(0, 2);
+  uint8_t value;
+  bool ok = parseHex(c.text, 2, value);
+
+  if (command == "DT") {
+    stats_.dt_commands++;
+    if (!ok || c.text.size() != 4 + (size_t)value) {
+      ok = false;
+    } else if (channel_.chance(p.ir_permille)) {
+      channel_.stats_.ir_injected++;
+      stats_.ir++;
+      respond("IR", "03", done);
+      at(done, [this] { next(); });
+      return;
+    } else {
+      sense_start_us_ = now;
+      transmit(c);
+      return;
+    }
+  } else if (command == "RA" && c.text.size() == 2) {
+    // 受信電波強度。*RA=xxは-dBmの値
+    int16_t dbm = channel_.rssiDbm(this, ch_, now);
+    respond("RA", hex((uint8_t)std::min(-dbm, 255)), done);
+    at(done, [this] { next(); });
+    return;
+  } else if (ok && c.text.size() == 4) {
+    if (command == "GI") {
+      gi_ = value;
+    } else if (command == "CH" && value >= CH_MIN && value <= CH_MAX) {
+      ch_ = value;
+    } else if (command == "DI") {
+      di_ = value;
+    } else if (command == "EI") {
+      ei_ = value;
+    } else {
+      ok = false;
+    }
+  } else {
+    ok = false;
+  }
+
+  if (ok) {
+    respond(command.c_str(), hex(value), done);
+  } else {
+    stats_.errors++;
+    respond("ER", "01", done);
+  }
+  at(done, [this] { next(); });
+}
+
+void MuModule::transmit(const Command &c) {
+  const MuLinkParams &p = channel_.params_;
+  uint64_t now = nowUs();
+  uint64_t busy = channel_.busyUntil(ch_, now);
+  if (busy != 0) {
+    if (now - sense_start_us_ >= p.lbt_timeout_us) {
+      channel_.stats_.carrier_busy++;
+      stats_.ir++;
+      respond("IR", "01", now);
+      next();
+      return;
+    }
+    // 空いたあと少しずらして測り直す(同時に待っていた同士がそろって送らないように)
+    channel_.stats_.deferred++;
+    uint64_t retry = busy + channel_.random() % (p.backoff_us + 1);
+    at(retry, [this, c] { transmit(c); });
+    return;
+  }
+  uint8_t len = (uint8_t)(c.text.size() - 4);
+  tx_start_us_ = now + p.radio.tx_setup_us;
+  tx_end_us_ = now + muAirtimeUs(p.radio, len);
+  uint32_t air = channel_.begin(this, ch_, tx_start_us_, tx_end_us_);
+  stats_.sent++;
+  if (home_ch_ != 0 && ch_ != home_ch_) {
+    stats_.sent_off_home++;
+  }
+  at(tx_end_us_, [this, c, air] { finish(c, air); });
+}
+
+void MuModule::finish(const Command &c, uint32_t air) {
+  uint8_t len = (uint8_t)(c.text.size() - 4);
+  channel_.end(air, (const uint8_t *)c.text.data() + 4, len, gi_, di_,
+               c.origin_us);
+  // 送り終わってから応答する
+  respond("DT", hex(len), nowUs());
+  next();
+}
+
+bool MuModule::receive(const uint8_t *data, uint8_t len, uint8_t gi,
+                       uint8_t di, uint64_t origin_us, uint64_t start_us) {
+  if (gi != gi_ || (di != 0 && di != ei_)) {
+    return false;
+  }
+  if (tx_start_us_ < nowUs() && start_us < tx_end_us_) {
+    stats_.missed++;
+    return false;
+  }
+  std::string line = "*DR=" + hex(len);
+  line.append((const char *)data, len);
+  line += "\r\n";
+  if (channel_.chance(channel_.params_.corrupt_permille)) {
+    channel_.stats_.corrupted++;
+    line[channel_.random() % line.size()] ^= 1 << (channel_.random() % 8);
+  }
+  stats_.received++;
+  uint64_t done = toHost(line, nowUs());
+  channel_.stats_.latency.add((uint32_t)(done - origin_us));
+  return true;
+}
+
+void MuModule::respond(const char *command, const std::string &value,
+                       uint64_t at_us) {
+  toHost(std::string("*") + command + "=" + value + "\r\n", at_us);
+}
+
+uint64_t MuModule::toHost(const std::string &data, uint64_t at_us) {
+  uint64_t start = std::max(at_us, uart_free_us_);
+  uint64_t done = start + data.size() * byteUs();
+  uart_free_us_ = done;
+  at(done, [this, data] {
+    if (host_) {
+      host_((const uint8_t *)data.data(), data.size());
+    }
+  });
+  return done;
+}
+
+} // namespace sim
@@ -0,0 +1,236 @@
+/**
+ * @file MuEmulator.h
+ * @brief
+ * MU-2の模擬。ホスト(マイコン)からの@GI/@CH/@DI/@EI/@DTを受けて'*'の応答を返し、
+ * 同じチャンネルにつないだ別のMuModuleに*DR=を届ける。@RAには電波が出ているかどうかで強度を返す。
+ * 時間はSimKernelの模擬時刻で、UARTの転送時間と電波を出している時間(Airtime.h)を模擬する。
+ * キャリアセンスは電波が出ているかだけを見るので、立ち上がり時間内に送り始めた同士は衝突する。
+ * 届かない・化ける・*IRを返すことを確率で起こせる。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <deque>
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Airtime.h"
+#include "LatencyTrace.h"
+
+namespace sim {
+
+class MuModule;
+
+/**
+ * @brief チャンネル全体の設定
+ *
+ */
+struct MuLinkParams {
+  /// UARTの通信速度と無線区間の時間
+  MuRadioParams radio;
+  /// 受信側に届かない確率[‰]
+  uint16_t drop_permille = 0;
+  /// 受信側に届いた*DRの1バイトが化ける確率[‰](受信側のUARTで化けたとみなす)
+  uint16_t corrupt_permille = 0;
+  /// 送らずに*IR=03を返す確率[‰]
+  uint16_t ir_permille = 0;
+  /// キャリアセンスでこの時間空かなければあきらめて*IR=01を返す[us]
+  uint32_t lbt_timeout_us = 100000;
+  /// キャリアセンスで待ったとき、空いてから測り直すまでの時間の最大値[us](この範囲でランダム)
+  uint32_t backoff_us = 40000;
+  /// 設定コマンドを処理して応答するまでの時間[us]
+  uint32_t command_us = 1000;
+  /// 乱数の種
+  uint32_t seed = 1;
+  /// @RAで返す強度[dBm]。他のモジュールの電波が出ていればsignal_dbm、なければnoise_dbm
+  int16_t noise_dbm = -115;
+  int16_t signal_dbm = -60;
+};
+
+/**
+ * @brief チャンネルの統計
+ *
+ */
+struct MuChannelStats {
+  /// 電波を出したフレーム数
+  uint32_t transmitted = 0;
+  /// 受信側のホストに届けた*DRの数(1フレームが複数の受信機に届けば複数)
+  uint32_t delivered = 0;
+  /// 他の送信と重なって失われたフレーム数
+  uint32_t collided = 0;
+  /// drop_permilleで捨てた数
+  uint32_t dropped = 0;
+  /// corrupt_permilleで化けさせた数
+  uint32_t corrupted = 0;
+  /// キャリアセンスで待った回数
+  uint32_t deferred = 0;
+  /// キャリアセンスであきらめた(*IR=01)数
+  uint32_t carrier_busy = 0;
+  /// ir_permilleで*IR=03を返した数
+  uint32_t ir_injected = 0;
+  /// 電波が出ていた時間の合計[us](重なった分は重ねて数える)
+  uint64_t airtime_us = 0;
+  /// 送信側のMUに'@'が届いてから、受信側のホストに*DRを送り終わるまで[us]
+  LatencyHistogram latency;
+};
+
+/**
+ * @brief
+ * 模擬の無線チャンネル。MuModuleをつなぐ場所で、送信の重なりと誤りを決める。
+ * 電波の届く範囲は全員同じとし、CHの違うモジュール同士は干渉しない。
+ *
+ */
+class MuChannel {
+public:
+  MuChannel(const MuLinkParams &params = MuLinkParams());
+  const MuLinkParams &params() const { return params_; }
+  MuLinkParams &params() { return params_; }
+  const MuChannelStats &stats() const { return stats_; }
+  void resetStats();
+
+private:
+  friend class MuModule;
+  struct Transmission {
+    uint32_t id;
+    MuModule *from;
+    uint8_t ch;
+    uint64_t start_us;
+    uint64_t end_us;
+    bool collided;
+  };
+  MuLinkParams params_;
+  MuChannelStats stats_;
+  std::vector<MuModule *> modules_;
+  std::vector<Transmission> air_;
+  uint32_t next_id_ = 0;
+  uint32_t rng_;
+
+  uint32_t random();
+  bool chance(uint16_t permille) { return random() % 1000 < permille; }
+  /// チャンネルchで電波が出ていれば、空く時刻。空いていれば0
+  uint64_t busyUntil(uint8_t ch, uint64_t now_us);
+  /// moduleが受けているチャンネルchの受信電波強度[dBm]
+  int16_t rssiDbm(const MuModule *module, uint8_t ch, uint64_t now_us);
+  /// 送信を登録する。重なっている送信があれば両方を衝突にする。送信の番号を返す
+  uint32_t begin(MuModule *from, uint8_t ch, uint64_t start_us, uint64_t end_us);
+  /// 送信を終え、衝突していなければ受信できるモジュールに届ける
+  void end(uint32_t id, const uint8_t *data, uint8_t len, uint8_t gi,
+           uint8_t di, uint64_t origin_us);
+};
+
+/**
+ * @brief モジュールごとの統計
+ *
+ */
+struct MuModuleStats {
+  /// ホストから受けたコマンド数
+  uint32_t commands = 0;
+  /// そのうち@DT
+  uint32_t dt_commands = 0;
+  /// 電波を出したフレーム数
+  uint32_t sent = 0;
+  /// そのうちsetHomeで決めたチャンネル以外で出したもの
+  uint32_t sent_off_home = 0;
+  /// 返した*IRの数
+  uint32_t ir = 0;
+  /// 返した*ERの数(解釈できないコマンド)
+  uint32_t errors = 0;
+  /// ホストに届けた*DRの数
+  uint32_t received = 0;
+  /// 自分が送信中で受け取れなかったフレーム数
+  uint32_t missed = 0;
+};
+
+/**
+ * @brief
+ * 模擬のMU-2。fromHostにホストのUARTから送られたバイトを渡し、
+ * 応答と*DRはsetHostSinkで登録した関数で模擬時刻どおりにホストへ渡す。
+ * DI=00は全機器宛として扱う。
+ *
+ */
+class MuModule {
+public:
+  /// ホストへのデータの渡し先。最後のバイトがホストに届いた時刻に呼ばれる
+  typedef std::function<void(const uint8_t *data, size_t len)> HostSink;
+
+  /**
+   * @brief チャンネルにつなぐ。設定の初期値はMUWrapper::initと同じ
+   *
+   * @param channel
+   * @param ei 機器ID
+   */
+  MuModule(MuChannel &channel, uint8_t ei = 0);
+  ~MuModule();
+  void setHostSink(HostSink sink) { host_ = sink; }
+
+  /**
+   * @brief ホストのUARTから送られたデータ。sim::HardwareSerialのSinkから呼ぶ
+   *
+   * @param data
+   * @param len
+   * @param done_us 最後のバイトがMUに届く時刻
+   */
+  void fromHost(const uint8_t *data, size_t len, uint64_t done_us);
+
+  /**
+   * @brief 本来のチャンネル。これ以外で電波を出したらsent_off_homeに数える(0なら数えない)
+   *
+   * @param ch
+   */
+  void setHome(uint8_t ch) { home_ch_ = ch; }
+
+  uint8_t gi() const { return gi_; }
+  uint8_t ch() const { return ch_; }
+  uint8_t di() const { return di_; }
+  uint8_t ei() const { return ei_; }
+  const MuModuleStats &stats() const { return stats_; }
+  void resetStats() { stats_ = MuModuleStats(); }
+
+private:
+  friend class MuChannel;
+  struct Command {
+    std::string text; // '@'のあとからCRの前まで
+    uint64_t origin_us; // '@'が届いた時刻
+  };
+  MuChannel &channel_;
+  HostSink host_;
+  uint8_t gi_ = 0x04;
+  uint8_t ch_ = 0x08;
+  uint8_t di_ = 0x01;
+  uint8_t ei_;
+  uint8_t home_ch_ = 0;
+  MuModuleStats stats_;
+
+  // ホストからのコマンドの解析
+  std::string line_;
+  uint64_t line_origin_us_ = 0;
+  bool in_command_ = false;
+  size_t dt_remaining_ = 0;
+
+  // コマンドは1つずつ順に処理する
+  std::deque<Command> queue_;
+  bool busy_ = false;
+  uint64_t sense_start_us_ = 0;
+  // 電波を出している間は受信できない
+  uint64_t tx_start_us_ = 0;
+  uint64_t tx_end_us_ = 0;
+  // ホストへのUARTが空く時刻
+  uint64_t uart_free_us_ = 0;
+
+  uint64_t byteUs() const;
+  void accept(const Command &c);
+  void next();
+  void execute(const Command &c);
+  void transmit(const Command &c);
+  void finish(const Command &c, uint32_t air);
+  /// 応答"*XX=value\r\n"を時刻at_usから送る
+  void respond(const char *command, const std::string &value, uint64_t at_us);
+  /// ホストにデータを時刻at_usから送る。送り終わる時刻を返す
+  uint64_t toHost(const std::string &data, uint64_t at_us);
+  /// 電波を受けた。自分宛てならホストに*DRを送る
+  bool receive(const uint8_t *data, uint8_t len, uint8_t gi, uint8_t di,
+               uint64_t origin_us, uint64_t start_us);
+};
+
+} // namespace sim
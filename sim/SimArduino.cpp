@@ -0,0 +1,158 @@
+/**
+ * @file SimArduino.cpp
+ * @brief PC用のArduino APIの実装
+ * @version 0.1
+ *
+ */
+#include "Arduino.h"
+#include "LittleFS.h"
+#include "SimKernel.h"
+
+namespace {
+
+const int PIN_COUNT = 64;
+
+struct Pin {
+  uint8_t mode = INPUT;
+  int level = HIGH;
+  void (*isr)(void *) = nullptr;
+  void *arg = nullptr;
+  int isr_mode = 0;
+};
+Pin pins[PIN_COUNT];
+
+} // namespace
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+fs::LittleFSFS LittleFS;
+
+uint32_t millis() { return (uint32_t)(sim::nowUs() / 1000); }
+uint32_t micros() { return (uint32_t)sim::nowUs(); }
+void delay(uint32_t ms) { vTaskDelay(pdMS_TO_TICKS(ms)); }
+void delayMicroseconds(uint32_t us) { sim::sleepFor(us); }
+uint32_t esp_random() {
+  static uint32_t x = 2463534242u;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+bool psramFound() { return true; }
+void *ps_malloc(size_t size) { return malloc(size); }
+
+void pinMode(uint8_t pin, uint8_t mode) { pins[pin].mode = mode; }
+int digitalRead(uint8_t pin) { return pins[pin].level; }
+void digitalWrite(uint8_t pin, uint8_t value) { pins[pin].level = value; }
+
+void attachInterruptArg(uint8_t pin, void (*isr)(void *), void *arg, int mode) {
+  pins[pin].isr = isr;
+  pins[pin].arg = arg;
+  pins[pin].isr_mode = mode;
+}
+
+void detachInterrupt(uint8_t pin) { pins[pin].isr = nullptr; }
+
+namespace sim {
+
+void setPin(uint8_t pin, int level) {
+  Pin &p = pins[pin];
+  if (p.level == level) {
+    return;
+  }
+  p.level = level;
+  if (p.isr == nullptr) {
+    return;
+  }
+  if (p.isr_mode == CHANGE || (p.isr_mode == RISING && level == HIGH) ||
+      (p.isr_mode == FALLING && level == LOW)) {
+    p.isr(p.arg);
+  }
+}
+
+void setPinAt(uint64_t t_us, uint8_t pin, int level) {
+  at(t_us, [pin, level] { setPin(pin, level); });
+}
+
+} // namespace sim
+
+void HardwareSerial::begin(unsigned long baud, uint32_t config, int8_t rx,
+                           int8_t tx) {
+  (void)config;
+  (void)rx;
+  (void)tx;
+  // Serial(0)はUSB CDCなので通信速度によらず待たない
+  if (port_ != 0) {
+    baud_ = baud;
+  }
+}
+
+int HardwareSerial::available() { return (int)(rx_.size() - rx_pos_); }
+
+int HardwareSerial::read() {
+  if (rx_pos_ >= rx_.size()) {
+    return -1;
+  }
+  return rx_[rx_pos_++];
+}
+
+size_t HardwareSerial::read(uint8_t *buf, size_t len) {
+  size_t n = 0;
+  while (n < len && rx_pos_ < rx_.size()) {
+    buf[n++] = rx_[rx_pos_++];
+  }
+  if (rx_pos_ == rx_.size()) {
+    rx_.clear();
+    rx_pos_ = 0;
+  }
+  return n;
+}
+
+int HardwareSerial::peek() {
+  return rx_pos_ < rx_.size() ? rx_[rx_pos_] : -1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len) {
+  uint64_t byte_us = byteUs();
+  if (byte_us != 0) {
+    // FIFOがいっぱいなら空くまで待つ
+    uint64_t room_at = line_free_us_ > fifo_ * byte_us
+                           ? line_free_us_ - fifo_ * byte_us
+                           : 0;
+    if (room_at > sim::nowUs() && !sim::inInterrupt()) {
+      sim::ioWaitUntil(room_at);
+    }
+    uint64_t start = line_free_us_ > sim::nowUs() ? line_free_us_ : sim::nowUs();
+    line_free_us_ = start + len * byte_us;
+    tx_busy_us_ += len * byte_us;
+  }
+  tx_bytes_ += len;
+  if (sink_) {
+    sink_(buf, len, byte_us ? line_free_us_ : sim::nowUs());
+  }
+  return len;
+}
+
+int HardwareSerial::availableForWrite() {
+  uint64_t byte_us = byteUs();
+  if (byte_us == 0) {
+    return (int)fifo_;
+  }
+  uint64_t queued = line_free_us_ > sim::nowUs()
+                        ? (line_free_us_ - sim::nowUs() + byte_us - 1) / byte_us
+                        : 0;
+  return queued >= fifo_ ? 0 : (int)(fifo_ - queued);
+}
+
+void HardwareSerial::flush() {
+  if (line_free_us_ > sim::nowUs()) {
+    sim::ioWaitUntil(line_free_us_);
+  }
+}
+
+void HardwareSerial::inject(const uint8_t *data, size_t len) {
+  rx_.insert(rx_.end(), data, data + len);
+  if (on_receive_) {
+    on_receive_();
+  }
+}
@@ -0,0 +1,215 @@
+/**
+ * @file SimFreeRTOS.cpp
+ * @brief PC用のFreeRTOS APIの実装(SimKernelの上に作る)
+ * @version 0.1
+ *
+ */
+#include "SimKernel.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <deque>
+#include <map>
+#include <string.h>
+#include <vector>
+
+namespace {
+
+const uint64_t TICK_US = 1000000 / configTICK_RATE_HZ;
+
+// ticks待つときの時間切れの時刻。FreeRTOSと同じく次のtickの境目から数える
+uint64_t deadline(TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    return sim::FOREVER;
+  }
+  return (sim::nowUs() / TICK_US + ticks) * TICK_US;
+}
+
+struct Notify {
+  uint32_t count = 0;
+  sim::WaitList wait;
+};
+std::map<sim::Task *, Notify> notifies;
+
+struct Semaphore {
+  uint32_t count;
+  uint32_t max;
+  sim::WaitList wait;
+};
+
+struct Queue {
+  size_t length;
+  size_t item_size;
+  std::deque<std::vector<uint8_t>> items;
+  sim::WaitList rx;
+  sim::WaitList tx;
+};
+
+BaseType_t createTask(TaskFunction_t fn, const char *name, void *arg,
+                      UBaseType_t priority, TaskHandle_t *handle) {
+  // FreeRTOSと同じく、ハンドルはタスクが動き始める前に書く
+  sim::createTask(fn, name, arg, priority, handle);
+  return pdPASS;
+}
+
+} // namespace
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t fn, const char *name,
+                                uint32_t stack, void *arg,
+                                UBaseType_t priority, TaskHandle_t *handle,
+                                BaseType_t core) {
+  (void)stack;
+  (void)core;
+  return createTask(fn, name, arg, priority, handle);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core) {
+  (void)stack;
+  (void)core;
+  return createTask(fn, name, arg, priority, handle);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  if (ticks == 0) {
+    sim::yield();
+    return;
+  }
+  sim::sleepUntil(deadline(ticks));
+}
+
+void vTaskDelayUntil(TickType_t *previous, TickType_t increment) {
+  *previous += increment;
+  sim::sleepUntil((uint64_t)*previous * TICK_US);
+}
+
+TickType_t xTaskGetTickCount() { return (TickType_t)(sim::nowUs() / TICK_US); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return sim::currentTask(); }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+  Notify &n = notifies[sim::currentTask()];
+  if (n.count == 0 && ticks != 0) {
+    sim::block(&n.wait, deadline(ticks));
+  }
+  uint32_t count = n.count;
+  if (count != 0) {
+    n.count = clear ? 0 : count - 1;
+  }
+  return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  Notify &n = notifies[(sim::Task *)task];
+  n.count++;
+  sim::wake(&n.wait);
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  xTaskNotifyGive(task);
+  if (woken != nullptr) {
+    *woken = pdTRUE;
+  }
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  Semaphore *s = new Semaphore();
+  s->count = 1;
+  s->max = 1;
+  return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  Semaphore *s = new Semaphore();
+  s->count = 0;
+  s->max = 1;
+  return s;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  Semaphore *s = (Semaphore *)sem;
+  uint64_t until = deadline(ticks);
+  while (s->count == 0) {
+    if (ticks == 0 || !sim::block(&s->wait, until)) {
+      return pdFALSE;
+    }
+  }
+  s->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  Semaphore *s = (Semaphore *)sem;
+  if (s->count >= s->max) {
+    return pdFALSE;
+  }
+  s->count++;
+  sim::wake(&s->wait);
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken) {
+  BaseType_t r = xSemaphoreGive(sem);
+  if (woken != nullptr) {
+    *woken = r;
+  }
+  return r;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  Queue *q = new Queue();
+  q->length = length;
+  q->item_size = item_size;
+  return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+  Queue *q = (Queue *)queue;
+  uint64_t until = deadline(ticks);
+  while (q->items.size() >= q->length) {
+    if (ticks == 0 || sim::inInterrupt() || !sim::block(&q->tx, until)) {
+      return pdFALSE;
+    }
+  }
+  const uint8_t *p = (const uint8_t *)item;
+  q->items.push_back(std::vector<uint8_t>(p, p + q->item_size));
+  sim::wake(&q->rx);
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item,
+                             BaseType_t *woken) {
+  BaseType_t r = xQueueSend(queue, item, 0);
+  if (woken != nullptr) {
+    *woken = r;
+  }
+  return r;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+  Queue *q = (Queue *)queue;
+  q->items.clear();
+  return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+  Queue *q = (Queue *)queue;
+  uint64_t until = deadline(ticks);
+  while (q->items.empty()) {
+    if (ticks == 0 || !sim::block(&q->rx, until)) {
+      return pdFALSE;
+    }
+  }
+  memcpy(item, q->items.front().data(), q->item_size);
+  q->items.pop_front();
+  sim::wake(&q->tx);
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return (UBaseType_t)((Queue *)queue)->items.size();
+}
@@ -0,0 +1,324 @@
+/**
+ * @file SimKernel.cpp
+ * @brief 模擬時間のスケジューラの実装
+ * @version 0.1
+ *
+ */
+#include "SimKernel.h"
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+
+namespace sim {
+
+struct Task {
+  enum State { READY, RUNNING, BLOCKED, DONE };
+  std::string name;
+  int priority;
+  TaskFunction fn;
+  void *arg;
+  State state;
+  // 同じ優先度のタスクは準備ができた順に動かす
+  uint64_t ready_seq;
+  WaitList *waiting;
+  uint64_t deadline_us;
+  bool timedout;
+  uint32_t wakeups;
+  uint32_t timeouts;
+  uint32_t io_waits;
+  uint64_t io_us;
+  // このタスクの番になったらgoを立てて起こす
+  std::mutex m;
+  std::condition_variable cv;
+  bool go;
+};
+
+namespace {
+
+uint64_t now_us = 0;
+uint64_t ready_counter = 0;
+bool in_interrupt = false;
+std::vector<Task *> tasks;
+std::multimap<uint64_t, std::function<void()>> events;
+
+Task *mainTask() {
+  static Task *t = [] {
+    Task *t = new Task();
+    t->name = "loopTask";
+    t->priority = 1;
+    t->fn = nullptr;
+    t->arg = nullptr;
+    t->state = Task::RUNNING;
+    t->ready_seq = 0;
+    t->waiting = nullptr;
+    t->deadline_us = FOREVER;
+    t->timedout = false;
+    t->wakeups = 0;
+    t->timeouts = 0;
+    t->io_waits = 0;
+    t->io_us = 0;
+    t->go = false;
+    tasks.push_back(t);
+    return t;
+  }();
+  return t;
+}
+
+Task *current = nullptr;
+
+Task *self() {
+  if (current == nullptr) {
+    current = mainTask();
+  }
+  return current;
+}
+
+void makeReady(Task *t) {
+  t->state = Task::READY;
+  t->ready_seq = ++ready_counter;
+}
+
+void removeWaiter(Task *t) {
+  if (t->waiting != nullptr) {
+    std::vector<Task *> &w = t->waiting->waiters;
+    w.erase(std::remove(w.begin(), w.end(), t), w.end());
+    t->waiting = nullptr;
+  }
+}
+
+Task *highestReady() {
+  Task *best = nullptr;
+  for (Task *t : tasks) {
+    if (t->state != Task::READY) {
+      continue;
+    }
+    if (best == nullptr || t->priority > best->priority ||
+        (t->priority == best->priority && t->ready_seq < best->ready_seq)) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+// 動けるタスクがなければ、次の起床またはイベントの時刻まで時間を進める
+Task *pick() {
+  while (true) {
+    Task *best = highestReady();
+    if (best != nullptr) {
+      return best;
+    }
+    uint64_t next = FOREVER;
+    if (!events.empty()) {
+      next = events.begin()->first;
+    }
+    for (Task *t : tasks) {
+      if (t->state == Task::BLOCKED && t->deadline_us < next) {
+        next = t->deadline_us;
+      }
+    }
+    if (next == FOREVER) {
+      fprintf(stderr, "sim: deadlock at %llu us\n", (unsigned long long)now_us);
+      exit(1);
+    }
+    if (next > now_us) {
+      now_us = next;
+    }
+    while (!events.empty() && events.begin()->first <= now_us) {
+      std::function<void()> fn = events.begin()->second;
+      events.erase(events.begin());
+      in_interrupt = true;
+      fn();
+      in_interrupt = false;
+    }
+    for (Task *t : tasks) {
+      if (t->state == Task::BLOCKED && t->deadline_us <= now_us) {
+        removeWaiter(t);
+        t->timedout = true;
+        makeReady(t);
+      }
+    }
+  }
+}
+
+void waitForTurn(Task *t) {
+  std::unique_lock<std::mutex> lock(t->m);
+  t->cv.wait(lock, [t] { return t->go; });
+  t->go = false;
+}
+
+void handOver(Task *next) {
+  {
+    std::lock_guard<std::mutex> lock(next->m);
+    next->go = true;
+  }
+  next->cv.notify_one();
+}
+
+// 今のタスクの状態を変えてから呼ぶ。次に動くタスクに切り替え、自分の番が来るまで待つ
+void switchAway() {
+  Task *me = self();
+  Task *next = pick();
+  next->state = Task::RUNNING;
+  if (next == me) {
+    return;
+  }
+  current = next;
+  handOver(next);
+  if (me->state == Task::DONE) {
+    return;
+  }
+  waitForTurn(me);
+}
+
+void taskEntry(Task *t) {
+  waitForTurn(t);
+  t->fn(t->arg);
+  // FreeRTOSのタスクは戻ってはいけないが、戻ったら止めておく
+  t->state = Task::DONE;
+  switchAway();
+}
+
+} // namespace
+
+uint64_t nowUs() { return now_us; }
+
+Task *createTask(TaskFunction fn, const char *name, void *arg, int priority,
+                 void **handle) {
+  self();
+  Task *t = new Task();
+  t->name = name;
+  t->priority = priority;
+  t->fn = fn;
+  t->arg = arg;
+  t->waiting = nullptr;
+  t->deadline_us = FOREVER;
+  t->timedout = false;
+  t->wakeups = 0;
+  t->timeouts = 0;
+  t->io_waits = 0;
+  t->io_us = 0;
+  t->go = false;
+  makeReady(t);
+  tasks.push_back(t);
+  if (handle != nullptr) {
+    *handle = t;
+  }
+  std::thread(taskEntry, t).detach();
+  if (!in_interrupt && priority > self()->priority) {
+    yield();
+  }
+  return t;
+}
+
+Task *currentTask() { return self(); }
+
+bool block(WaitList *list, uint64_t deadline_us) {
+  if (in_interrupt) {
+    fprintf(stderr, "sim: blocking call from interrupt\n");
+    exit(1);
+  }
+  Task *me = self();
+  me->state = Task::BLOCKED;
+  me->waiting = list;
+  me->deadline_us = deadline_us;
+  me->timedout = false;
+  if (list != nullptr) {
+    list->waiters.push_back(me);
+  }
+  switchAway();
+  me->wakeups++;
+  if (me->timedout) {
+    me->timeouts++;
+  }
+  me->deadline_us = FOREVER;
+  return !me->timedout;
+}
+
+bool wake(WaitList *list) {
+  if (list->waiters.empty()) {
+    return false;
+  }
+  Task *best = nullptr;
+  for (Task *t : list->waiters) {
+    if (best == nullptr || t->priority > best->priority) {
+      best = t;
+    }
+  }
+  removeWaiter(best);
+  makeReady(best);
+  // 起こしたタスクのほうが優先度が高ければすぐ切り替わる(割り込みからは戻ったあとに切り替わる)
+  if (!in_interrupt && best->priority > self()->priority) {
+    yield();
+  }
+  return true;
+}
+
+void sleepUntil(uint64_t t_us) {
+  if (t_us <= now_us) {
+    yield();
+    return;
+  }
+  block(nullptr, t_us);
+}
+
+void sleepFor(uint64_t us) { sleepUntil(now_us + us); }
+
+void ioWaitUntil(uint64_t t_us) {
+  if (t_us <= now_us) {
+    return;
+  }
+  Task *me = self();
+  uint64_t start = now_us;
+  uint32_t wakeups = me->wakeups;
+  uint32_t timeouts = me->timeouts;
+  block(nullptr, t_us);
+  me->wakeups = wakeups;
+  me->timeouts = timeouts;
+  me->io_waits++;
+  me->io_us += now_us - start;
+}
+
+void ioWaitFor(uint64_t us) { ioWaitUntil(now_us + us); }
+
+void yield() {
+  if (in_interrupt) {
+    return;
+  }
+  makeReady(self());
+  switchAway();
+}
+
+void at(uint64_t t_us, std::function<void()> fn) {
+  events.insert(std::make_pair(t_us, fn));
+}
+
+bool inInterrupt() { return in_interrupt; }
+
+void run(uint64_t until_us) {
+  Task *me = self();
+  // setup()から呼ばれるloopTaskの代わり。until_usまで寝ている間に他のタスクが動く
+  me->priority = 0;
+  sleepUntil(until_us);
+}
+
+std::vector<TaskStats> taskStats() {
+  std::vector<TaskStats> out;
+  for (Task *t : tasks) {
+    TaskStats s;
+    s.name = t->name.c_str();
+    s.priority = t->priority;
+    s.wakeups = t->wakeups;
+    s.timeouts = t->timeouts;
+    s.io_waits = t->io_waits;
+    s.io_us = t->io_us;
+    out.push_back(s);
+  }
+  return out;
+}
+
+} // namespace sim
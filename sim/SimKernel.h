@@ -0,0 +1,123 @@
+/**
+ * @file SimKernel.h
+ * @brief
+ * PC上でタスクを模擬時間で動かすための小さなスケジューラ。
+ * タスクは1つずつスレッドで動き、同時に動くのは常に1つだけ(優先度の高い順)。
+ * タスクの処理は時間0で終わるとみなし、すべてのタスクが待ちに入ったときだけ
+ * 次の起床時刻またはイベントの時刻まで時間を進める。
+ * FreeRTOS・Arduinoの代わりのヘッダはこれを使って作る。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <functional>
+#include <stdint.h>
+#include <vector>
+
+namespace sim {
+
+struct Task;
+
+/// 時刻の上限(待ち時間なしで待つとき)
+const uint64_t FOREVER = UINT64_MAX;
+
+/**
+ * @brief タスクを待たせておく場所(セマフォ、キュー、通知など)
+ *
+ */
+struct WaitList {
+  std::vector<Task *> waiters;
+};
+
+/**
+ * @brief タスクごとの統計
+ *
+ */
+struct TaskStats {
+  const char *name;
+  int priority;
+  /// 待ちから起きた回数(ループの回数の目安)
+  uint32_t wakeups;
+  /// そのうち時間切れで起きた回数
+  uint32_t timeouts;
+  /// 周辺機器の転送を待った回数(wakeupsには数えない)
+  uint32_t io_waits;
+  /// 周辺機器の転送を待った時間の合計[us]
+  uint64_t io_us;
+};
+
+typedef void (*TaskFunction)(void *arg);
+
+/// 現在の模擬時刻[us]
+uint64_t nowUs();
+
+/**
+ * @brief タスクを作る。今のタスクより優先度が高ければすぐ切り替わる
+ *
+ * @param fn
+ * @param name
+ * @param arg
+ * @param priority
+ * @param handle nullptrでなければ、タスクが動き始める前に作ったタスクを書く
+ * @return Task*
+ */
+Task *createTask(TaskFunction fn, const char *name, void *arg, int priority,
+                 void **handle = nullptr);
+Task *currentTask();
+
+/**
+ * @brief 今のタスクをlistで待たせる。割り込み(イベント)の中からは呼べない
+ *
+ * @param list nullptrなら時間だけ待つ
+ * @param deadline_us この時刻になったら時間切れ
+ * @return true wake()で起こされた
+ * @return false 時間切れ
+ */
+bool block(WaitList *list, uint64_t deadline_us);
+
+/**
+ * @brief listで待っているタスクのうち優先度が一番高いものを起こす
+ *
+ * @param list
+ * @return true 起こした
+ */
+bool wake(WaitList *list);
+
+/// 指定した時刻まで待つ
+void sleepUntil(uint64_t t_us);
+/// 指定した時間だけ待つ
+void sleepFor(uint64_t us);
+/**
+ * @brief
+ * 周辺機器(I2C、UARTなど)の転送が終わるまで待つ。sleepForと同じだが、
+ * タスクの起床回数ではなく転送待ちとして数える(ドライバの中で待つ分)
+ *
+ * @param t_us
+ */
+void ioWaitUntil(uint64_t t_us);
+void ioWaitFor(uint64_t us);
+/// 同じ優先度の他のタスクに譲る
+void yield();
+
+/**
+ * @brief 指定した時刻に割り込みとしてfnを呼ぶ。fnの中では待てない
+ *
+ * @param t_us
+ * @param fn
+ */
+void at(uint64_t t_us, std::function<void()> fn);
+
+/// 割り込み(イベント)の中か
+bool inInterrupt();
+
+/**
+ * @brief 模擬時刻がuntil_usになるまでタスクを動かす。setup()のあと、メインのスレッドから呼ぶ
+ *
+ * @param until_us
+ */
+void run(uint64_t until_us);
+
+/// 全タスクの統計
+std::vector<TaskStats> taskStats();
+
+} // namespace sim
@@ -0,0 +1,68 @@
+/**
+ * @file SimWire.cpp
+ * @brief PC用のTwoWireの実装
+ * @version 0.1
+ *
+ */
+#include "SimKernel.h"
+#include "Wire.h"
+#include <string.h>
+
+TwoWire Wire(0);
+TwoWire Wire1(1);
+
+void TwoWire::beginTransmission(uint8_t addr) {
+  addr_ = addr;
+  tx_len_ = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (tx_len_ >= BUFFER_LENGTH) {
+    return 0;
+  }
+  tx_[tx_len_++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t len) {
+  size_t n = 0;
+  while (n < len && write(data[n])) {
+    n++;
+  }
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(bool stop) {
+  (void)stop;
+  transfer(tx_len_);
+  sim::I2cDevice *device = devices_[addr_ & 0x7f];
+  if (device == nullptr) {
+    return 2; // アドレスにNACK
+  }
+  device->onWrite(tx_, tx_len_);
+  return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t len, bool stop) {
+  (void)stop;
+  if (len > BUFFER_LENGTH) {
+    len = BUFFER_LENGTH;
+  }
+  transfer(len);
+  rx_pos_ = 0;
+  rx_len_ = 0;
+  sim::I2cDevice *device = devices_[addr & 0x7f];
+  if (device != nullptr) {
+    rx_len_ = device->onRead(rx_, len);
+  }
+  return (uint8_t)rx_len_;
+}
+
+// 1バイト9ビット(ACK込み)、アドレス1バイト、スタート・ストップ2ビット分だけ待つ
+void TwoWire::transfer(size_t len) {
+  uint64_t us = ((uint64_t)(len + 1) * 9 + 2) * 1000000 / hz_ + TXN_OVERHEAD_US;
+  bytes_ += len;
+  transactions_++;
+  busy_us_ += us;
+  sim::ioWaitFor(us);
+}
@@ -0,0 +1,80 @@
+/**
+ * @file Wire.h
+ * @brief
+ * PC用のTwoWireの代わり。アドレスごとにsim::I2cDeviceをつなぎ、
+ * 送受信はクロックとバイト数から求めた時間だけ呼び出したタスクを待たせる
+ * (ESP32のI2Cドライバも転送が終わるまでタスクを待たせる)。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sim {
+/**
+ * @brief I2Cバスにつなぐ機器
+ *
+ */
+class I2cDevice {
+public:
+  virtual ~I2cDevice() {}
+  /// マスターから書かれた(1回の送信分)
+  virtual void onWrite(const uint8_t *data, size_t len) = 0;
+  /// マスターから読まれた。返したバイト数だけ応答する
+  virtual size_t onRead(uint8_t *data, size_t len) = 0;
+};
+} // namespace sim
+
+class TwoWire {
+public:
+  TwoWire(int bus) : bus_(bus) {}
+  bool setPins(int sda, int scl) {
+    (void)sda;
+    (void)scl;
+    return true;
+  }
+  bool begin() { return true; }
+  bool end() { return true; }
+  bool setClock(uint32_t hz) {
+    hz_ = hz;
+    return true;
+  }
+  uint32_t getClock() { return hz_; }
+  void beginTransmission(uint8_t addr);
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *data, size_t len);
+  uint8_t endTransmission(bool stop = true);
+  uint8_t requestFrom(uint8_t addr, uint8_t len, bool stop = true);
+  int available() { return (int)(rx_len_ - rx_pos_); }
+  int read() { return rx_pos_ < rx_len_ ? rx_[rx_pos_++] : -1; }
+
+  // ここからPC用
+  void attach(uint8_t addr, sim::I2cDevice *device) { devices_[addr] = device; }
+  uint64_t bytes() const { return bytes_; }
+  uint32_t transactions() const { return transactions_; }
+  /// バスを使っていた時間の合計[us]
+  uint64_t busyUs() const { return busy_us_; }
+
+private:
+  /// 送受信バッファの大きさ(ESP32と同じ)
+  static const size_t BUFFER_LENGTH = 128;
+  /// ドライバの処理など、1回の送受信ごとにかかる時間[us]
+  static const uint32_t TXN_OVERHEAD_US = 50;
+  int bus_;
+  uint32_t hz_ = 100000;
+  sim::I2cDevice *devices_[128] = {};
+  uint8_t addr_ = 0;
+  uint8_t tx_[BUFFER_LENGTH];
+  size_t tx_len_ = 0;
+  uint8_t rx_[BUFFER_LENGTH];
+  size_t rx_len_ = 0;
+  size_t rx_pos_ = 0;
+  uint64_t bytes_ = 0;
+  uint32_t transactions_ = 0;
+  uint64_t busy_us_ = 0;
+  void transfer(size_t len);
+};
+
+extern TwoWire Wire;
+extern TwoWire Wire1;
@@ -0,0 +1,7 @@
+/**
+ * @file esp_task_wdt.h
+ * @brief PC用。ウォッチドッグは使わない
+ * @version 0.1
+ *
+ */
+#pragma once
@@ -0,0 +1,31 @@
+/**
+ * @file FreeRTOS.h
+ * @brief
+ * PC用のFreeRTOSの代わり。使っているAPIだけを模擬時間のスケジューラ(SimKernel)で実装する。
+ * 1tickは1ms。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xffffffffUL
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7fffffff
+// 割り込みから起こしたタスクへの切り替えは割り込みから戻るときにまとめて行う
+#define portYIELD_FROM_ISR(...) ((void)0)
@@ -0,0 +1,14 @@
+/**
+ * @file semphr.h
+ * @brief PC用のFreeRTOSのセマフォAPI(優先度継承はしない)
+ * @version 0.1
+ *
+ */
+#pragma once
+#include "FreeRTOS.h"
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateBinary();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
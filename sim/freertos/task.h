@@ -0,0 +1,24 @@
+/**
+ * @file task.h
+ * @brief PC用のFreeRTOSのタスクAPI
+ * @version 0.1
+ *
+ */
+#pragma once
+#include "FreeRTOS.h"
+
+BaseType_t xTaskCreateUniversal(TaskFunction_t fn, const char *name,
+                                uint32_t stack, void *arg,
+                                UBaseType_t priority, TaskHandle_t *handle,
+                                BaseType_t core);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name,
+                                   uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle,
+                                   BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t *previous, TickType_t increment);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
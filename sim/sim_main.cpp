@@ -0,0 +1,638 @@
+/**
+ * @file sim_main.cpp
+ * @brief
+ * 送信機のmain.cppをそのままPC上で模擬時間で動かす。
+ * コントローラーは決まった操作(ボタンの押し離しとスティックの往復)を返し、
+ * MU-2は模擬のMU-2(MuEmulator)で、受信機側の模擬MU-2に届いた*DRを数える。
+ * 終わったら結果をkey=valueで出力する。
+ *
+ * 使い方: sim [--seconds=N] [--estop-at=MS] [--verbose] [--drop=‰] [--corrupt=‰]
+ *             [--ir=‰] [--interferers=N] [--interferer-ms=MS] [--seed=N]
+ *             [--menu-every=MS] [--interferer-ch=HEX] [--survey-at=MS]
+ *             [--telemetry] [--uart-noise=MS] [--record-out=FILE] [--replay=FILE]
+ * --estop-at 指定した時刻[ms]に非常停止スイッチを離し、500ms後に戻す
+ * --menu-every 指定した間隔[ms]で前面ボタンからメニューを開いてチャンネルを1つ進める
+ *   確認応答付きの設定(MU_RELIABLE_CONFIG=1)なら受信機も受け取った設定のチャンネルに移る
+ * --verbose  USBシリアル(Serial)への出力も表示する
+ * --drop,--corrupt,--ir 届かない・化ける・*IR=03を返す確率[‰]
+ *   受信機はFrameCheckerで化けたフレームを捨て、捨てられずに届いた化けたフレームも数える
+ * --interferers 別のグループの送信機をN台動かす(--interferer-ms毎に8バイト)
+ * --interferer-ch 妨害する送信機のチャンネル(16進数、既定は送信機と同じ08)
+ * --survey-at 指定した時刻[ms]に前面ボタン(SW6)でチャンネルの混み具合を調べさせる
+ *   (非常停止中だけ受け付けるので、押す前から調べ終わるまで非常停止スイッチを離しておく)。
+ *   押したときのチャンネル以外で送信機が電波を出したら(調査中の非常停止フレームなど)終了コード1で終わる
+ * --telemetry USBから'T'を送って回線の統計のバイナリ出力を有効にし、読んだ記録を合計して出す
+ *   (その間は文字が出ないので、設定・調査・再生の行は結果に出ない)
+ * --uart-noise 指定した間隔[ms]でMU-2からのUARTに壊れた行を混ぜる(解析エラーの種類を順に変える)
+ * --record-out 終わったときの入力の記録をファイルに書き出す(ロボットで'D'/'S'で取り出したものと同じ形式)
+ * --replay 入力の記録をフラッシュに置き、USBからの操作と同じ手順で再生する
+ *   (200msに非常停止して'F'で読み込み、450msに'P'で再生を始めて460msに解除)。INPUT_RECORD_SPILL=1が必要
+ * 同じ引数なら毎回同じ結果になるので、送ったデータ部のハッシュ(mu_payload_hash)で再生の結果を比べられる
+ * @version 0.1
+ *
+ */
+#include <Arduino.h>
+#include <FrameCheck.h>
+#include <InputRecorder.h>
+#include <LatencyTrace.h>
+#include <LinkTelemetry.h>
+#include <MUwrapper.hpp>
+#include <ReliableLink.h>
+#include <LittleFS.h>
+#include <Wire.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "MuEmulator.h"
+#include "SimKernel.h"
+#include "pin.h"
+
+void setup();
+
+//main.cppと同じ既定値(ビルド時に-Dで変えたときはどちらにも効く)
+#ifndef MU_FRAME_CHECK
+#define MU_FRAME_CHECK FRAME_CHECK_NONE
+#endif
+#ifndef MU_SURVEY_MAX_MS
+#define MU_SURVEY_MAX_MS 3000
+#endif
+extern ReliableSender mu_reliable;
+extern InputRecorder input_recorder;
+
+namespace {
+
+/**
+ * @brief
+ * Wiiクラシックコントローラー。時刻から決まる操作を返す。
+ * Aボタンは200ms毎に押し離し、左スティックXは2秒で端から端まで動く。
+ *
+ */
+class WiiClassicDevice : public sim::I2cDevice {
+public:
+  void onWrite(const uint8_t *data, size_t len) override {
+    (void)data;
+    (void)len;
+  }
+  size_t onRead(uint8_t *data, size_t len) override {
+    uint32_t ms = (uint32_t)(sim::nowUs() / 1000);
+    uint32_t phase = ms % 4000;
+    uint8_t lx = (uint8_t)((phase < 2000 ? phase : 4000 - phase) * 63 / 2000);
+    uint8_t report[6] = {
+        (uint8_t)(0x80 | lx), // 右スティックXの上位ビットは中央
+        0x20,                 // 左スティックY
+        0x10,                 // 右スティックY
+        0x00,                 // トリガー
+        0xff,                 // ボタンは押されると0
+        (uint8_t)((ms / 200) % 2 ? 0xbf : 0xff), // bit6:A
+    };
+    reads++;
+    size_t n = len < sizeof(report) ? len : sizeof(report);
+    memcpy(data, report, n);
+    return n;
+  }
+  uint32_t reads = 0;
+};
+
+/**
+ * @brief SSD1306。送られたバイト数を数えるだけ
+ *
+ */
+class Ssd1306Device : public sim::I2cDevice {
+public:
+  void onWrite(const uint8_t *data, size_t len) override {
+    (void)data;
+    bytes += len;
+  }
+  size_t onRead(uint8_t *data, size_t len) override {
+    memset(data, 0, len);
+    return len;
+  }
+  uint64_t bytes = 0;
+};
+
+/**
+ * @brief MU-2へのUART。1行ずつに分けてフレームを数え、最近送ったデータ部を覚えておく
+ *
+ */
+struct UartSink {
+  std::string line;
+  std::deque<std::string> recent;
+  uint32_t frames = 0;
+  uint32_t estop_frames = 0;
+  uint32_t commands = 0;
+  /// 送ったデータ部を順につないだもののFNV-1aハッシュ
+  uint32_t payload_hash = 2166136261u;
+  // 非常停止スイッチを離した時刻と、そのあと最初の非常停止フレームを送り終わった時刻[us]
+  uint64_t estop_at_us = 0;
+  uint64_t estop_done_us = 0;
+
+  void operator()(const uint8_t *data, size_t len, uint64_t done_us) {
+    for (size_t i = 0; i < len; i++) {
+      line += (char)data[i];
+      // @DTのデータ部は改行を含むことがあるので長さで区切る
+      bool dt = line.compare(0, 3, "@DT") == 0 && line.size() >= 5;
+      if (dt ? line.size() < 7 + strtoul(line.substr(3, 2).c_str(), nullptr, 16)
+             : data[i] != '\n') {
+        continue;
+      }
+      if (dt) {
+        frames++;
+        for (size_t j = 5; j + 2 < line.size(); j++) {
+          payload_hash = (payload_hash ^ (uint8_t)line[j]) * 16777619u;
+        }
+        recent.push_back(line.substr(5, line.size() - 7));
+        if (recent.size() > 64) {
+          recent.pop_front();
+        }
+        if (line.compare(5, 1, "E") == 0) {
+          estop_frames++;
+          if (estop_at_us != 0 && estop_done_us == 0 &&
+              sim::nowUs() >= estop_at_us) {
+            estop_done_us = done_us;
+          }
+        }
+      } else {
+        commands++;
+      }
+      line.clear();
+    }
+  }
+};
+
+/**
+ * @brief
+ * 受信機のホスト。模擬MU-2からのデータを解析して数える。
+ * 確認応答付きのフレームには確認応答を返す
+ *
+ */
+struct ReceiverHost {
+  MUWrapper parser{&ReceiverHost::onEvent, this};
+  sim::MuModule *module = nullptr;
+  const UartSink *sent = nullptr;
+  //送信機が検査を付けているなら、付いていないフレーム(タグが化けたもの)も捨てる
+  FrameChecker checker{MU_FRAME_CHECK != FRAME_CHECK_NONE};
+  /// 検査を通ったが送信機が送ったどのフレームとも違うもの(化けたまま使われる)
+  uint32_t undetected = 0;
+  ReliableReceiver reliable;
+  uint32_t frames = 0;
+  uint32_t responses = 0;
+  uint32_t errors = 0;
+  uint32_t configs = 0;
+  /// 受け取った設定で受信機のMUのチャンネルを変えた回数
+  uint32_t channel_switches = 0;
+
+  static void onEvent(void *context, MUEvent event, uint8_t *data, uint8_t len) {
+    ReceiverHost *self = (ReceiverHost *)context;
+    if (event == MU_EVENT_RX_COMPLETE) {
+      self->frames++;
+      if (!ReliableReceiver::isData(data, len) && !(len == 1 && data[0] == 'E')) {
+        //コントローラーのフレーム
+        const uint8_t *payload;
+        uint8_t payload_len;
+        if (!self->checker.open(data, len, payload, payload_len)) {
+          return;
+        }
+        const std::deque<std::string> &recent = self->sent->recent;
+        if (std::find(recent.begin(), recent.end(),
+                      std::string((const char *)data, len)) == recent.end()) {
+          self->undetected++;
+        }
+        return;
+      }
+      uint8_t ack[RELIABLE_HEADER_LEN];
+      ReliableReceiver::Message msg;
+      bool fresh = self->reliable.accept(data, len, ack, msg);
+      if (fresh && msg.cls == MSG_CONFIG) {
+        self->configs++;
+      }
+      if (ReliableReceiver::isData(data, len) && self->module != nullptr) {
+        uint8_t frame[MU_MAX_COMMANDBUF];
+        uint8_t n = MUWrapper::encode(frame, ack, sizeof(ack));
+        self->module->fromHost(frame, n, sim::nowUs() + n * 10000000ULL / 19200);
+        //設定のチャンネル(5番目)に移る。MUはコマンドを順に処理するので確認応答を送ってから変わる
+        if (fresh && msg.cls == MSG_CONFIG && msg.len >= 5 &&
+            msg.data[4] != self->module->ch()) {
+          char ch[8];
+          snprintf(ch, sizeof(ch), "@CH%02X\r\n", msg.data[4]);
+          self->module->fromHost((const uint8_t *)ch, 7,
+                                 sim::nowUs() + (n + 7) * 10000000ULL / 19200);
+          self->channel_switches++;
+        }
+      }
+    } else if (event == MU_EVENT_RESPONSE) {
+      self->responses++;
+    } else if (event == MU_EVENT_ERROR) {
+      self->errors++;
+    }
+  }
+};
+
+/**
+ * @brief 同じチャンネルで一定周期で送る別の送信機
+ *
+ */
+struct Interferer {
+  sim::MuModule module;
+  uint64_t period_us;
+  Interferer(sim::MuChannel &channel, uint8_t ei, uint64_t period)
+      : module(channel, ei), period_us(period) {}
+
+  void start(uint64_t t_us) {
+    sim::at(t_us, [this, t_us] {
+      uint8_t payload[8] = {0};
+      uint8_t frame[MU_MAX_COMMANDBUF];
+      uint8_t len = MUWrapper::encode(frame, payload, sizeof(payload));
+      module.fromHost(frame, len, t_us + len * 10000000ULL / 19200);
+      start(t_us + period_us);
+    });
+  }
+};
+
+/**
+ * @brief MU-2からのUARTに混ぜる壊れた行。解析エラーの種類ごとに1つ
+ *
+ */
+struct UartNoise {
+  struct Line {
+    MUError error;
+    const char *text;
+  };
+  static constexpr uint8_t KINDS = 4;
+  const Line lines[KINDS] = {
+      {MU_ERR_LENGTH_NOT_HEX, "*DR=G5\r\n"},
+      {MU_ERR_INVALID_COMMAND, "*1X\r\n"},
+      {MU_ERR_LENGTH_TOO_LONG, "*DR=FF\r\n"},
+      {MU_ERR_TAIL_NOT_CRLF, "*DR=01AB\r\n"},
+  };
+  uint64_t period_us = 0;
+  uint32_t injected[MU_ERR_COUNT] = {};
+  uint32_t next = 0;
+
+  void start(uint64_t t_us) {
+    sim::at(t_us, [this, t_us] {
+      const Line &l = lines[next++ % KINDS];
+      Serial1.inject((const uint8_t *)l.text, strlen(l.text));
+      injected[l.error]++;
+      start(t_us + period_us);
+    });
+  }
+};
+
+/**
+ * @brief PCのファイル。InputRecorder::save/loadの相手
+ *
+ */
+struct HostFile {
+  FILE *f;
+  size_t write(const uint8_t *buf, size_t len) { return fwrite(buf, 1, len, f); }
+  size_t read(uint8_t *buf, size_t len) { return fread(buf, 1, len, f); }
+};
+
+/**
+ * @brief 標準出力に書くPrint
+ *
+ */
+class StdoutPrint : public Print {
+public:
+  size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+  size_t write(const uint8_t *buf, size_t len) override {
+    return fwrite(buf, 1, len, stdout);
+  }
+  using Print::write;
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double seconds = 10;
+  long estop_ms = -1;
+  bool verbose = false;
+  int interferers = 0;
+  long interferer_ms = 100;
+  long menu_ms = -1;
+  uint8_t interferer_ch = 0x08;
+  long survey_ms = -1;
+  bool telemetry = false;
+  long noise_ms = -1;
+  std::string record_out;
+  std::string replay_in;
+  sim::MuLinkParams link;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.compare(0, 10, "--seconds=") == 0) {
+      seconds = atof(arg.c_str() + 10);
+    } else if (arg.compare(0, 11, "--estop-at=") == 0) {
+      estop_ms = atol(arg.c_str() + 11);
+    } else if (arg == "--verbose") {
+      verbose = true;
+    } else if (arg.compare(0, 7, "--drop=") == 0) {
+      link.drop_permille = atoi(arg.c_str() + 7);
+    } else if (arg.compare(0, 10, "--corrupt=") == 0) {
+      link.corrupt_permille = atoi(arg.c_str() + 10);
+    } else if (arg.compare(0, 5, "--ir=") == 0) {
+      link.ir_permille = atoi(arg.c_str() + 5);
+    } else if (arg.compare(0, 14, "--interferers=") == 0) {
+      interferers = atoi(arg.c_str() + 14);
+    } else if (arg.compare(0, 16, "--interferer-ms=") == 0) {
+      interferer_ms = atol(arg.c_str() + 16);
+    } else if (arg.compare(0, 7, "--seed=") == 0) {
+      link.seed = strtoul(arg.c_str() + 7, nullptr, 0);
+    } else if (arg.compare(0, 13, "--menu-every=") == 0) {
+      menu_ms = atol(arg.c_str() + 13);
+    } else if (arg.compare(0, 16, "--interferer-ch=") == 0) {
+      interferer_ch = (uint8_t)strtoul(arg.c_str() + 16, nullptr, 16);
+    } else if (arg.compare(0, 12, "--survey-at=") == 0) {
+      survey_ms = atol(arg.c_str() + 12);
+    } else if (arg == "--telemetry") {
+      telemetry = true;
+    } else if (arg.compare(0, 13, "--uart-noise=") == 0) {
+      noise_ms = atol(arg.c_str() + 13);
+    } else if (arg.compare(0, 13, "--record-out=") == 0) {
+      record_out = arg.substr(13);
+    } else if (arg.compare(0, 9, "--replay=") == 0) {
+      replay_in = arg.substr(9);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--seconds=N] [--estop-at=MS] [--verbose] [--drop=N] "
+              "[--corrupt=N] [--ir=N] [--interferers=N] [--interferer-ms=MS] "
+              "[--seed=N] [--menu-every=MS] [--interferer-ch=HEX] [--survey-at=MS] "
+              "[--telemetry] [--uart-noise=MS] [--record-out=FILE] [--replay=FILE]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  WiiClassicDevice pad0, pad1;
+  Ssd1306Device oled;
+  Wire.attach(0x52, &pad0);
+  Wire.attach(0x3c, &oled);
+  Wire1.attach(0x52, &pad1);
+
+  //送信機のMU-2(Serial1につながる)と、それを受ける受信機のMU-2(EI=01)
+  sim::MuChannel *channel = new sim::MuChannel(link);
+  sim::MuModule *tx = new sim::MuModule(*channel, 0x00);
+  sim::MuModule *rx = new sim::MuModule(*channel, 0x01);
+  ReceiverHost *receiver = new ReceiverHost();
+  tx->setHostSink([](const uint8_t *data, size_t len) { Serial1.inject(data, len); });
+  rx->setHostSink([receiver](const uint8_t *data, size_t len) {
+    receiver->parser.pushRawData(data, len);
+  });
+  //確認応答は送信機(EI=00)宛て
+  receiver->module = rx;
+  uint8_t di[] = {'@', 'D', 'I', '0', '0', '\r', '\n'};
+  rx->fromHost(di, sizeof(di), 0);
+  //別のグループ(GI=05)の送信機。受信機には届かないが電波は重なる
+  for (int i = 0; i < interferers; i++) {
+    Interferer *other = new Interferer(*channel, 0x10 + i, interferer_ms * 1000);
+    uint8_t gi[] = {'@', 'G', 'I', '0', '5', '\r', '\n'};
+    other->module.fromHost(gi, sizeof(gi), 0);
+    char ch[8];
+    snprintf(ch, sizeof(ch), "@CH%02X\r\n", interferer_ch);
+    other->module.fromHost((const uint8_t *)ch, 7, 1000);
+    other->start(interferer_ms * 1000 * (i + 1) / (interferers + 1) + 7919 * i);
+  }
+
+  UartSink *sink = new UartSink();
+  receiver->sent = sink;
+  Serial1.setSink([sink, tx](const uint8_t *data, size_t len, uint64_t done_us) {
+    (*sink)(data, len, done_us);
+    tx->fromHost(data, len, done_us);
+  });
+  //USBシリアルの出力のうち、MUの設定を変え終えた行、チャンネルの調査結果、記録と再生の結果は結果にも出す
+  //回線の統計の記録は読んで合計する(記録は行の途中に入るので、読んだら行を捨てる)
+  //最初の記録の後に記録以外のバイトがあれば文字が混ざっている
+  std::string *usb_line = new std::string();
+  std::vector<std::string> *config_lines = new std::vector<std::string>();
+  std::vector<std::string> *survey_lines = new std::vector<std::string>();
+  std::vector<std::string> *replay_lines = new std::vector<std::string>();
+  TelemetryDecoder *decoder = new TelemetryDecoder();
+  LinkCounters *link_total = new LinkCounters();
+  uint8_t *health_count = new uint8_t[3]();
+  uint32_t *telemetry_bytes = new uint32_t(0);
+  Serial.setSink([verbose, usb_line, config_lines, survey_lines, replay_lines,
+                  decoder, link_total, health_count, telemetry_bytes](const uint8_t *data, size_t len,
+                                            uint64_t done_us) {
+    (void)done_us;
+    if (verbose) {
+      fwrite(data, 1, len, stdout);
+    }
+    for (size_t i = 0; i < len; i++) {
+      if (decoder->records > 0) {
+        (*telemetry_bytes)++;
+      }
+      if (decoder->push(data[i])) {
+        const LinkSecond &s = decoder->record().second;
+        link_total->sent += s.sent;
+        link_total->received += s.received;
+        for (uint8_t e = 0; e < MU_ERR_COUNT; e++) {
+          link_total->errors[e] += s.errors[e];
+        }
+        link_total->queue_drops += s.queue_drops;
+        link_total->stale_drops += s.stale_drops;
+        if (decoder->record().health < 3 && health_count[decoder->record().health] < 255) {
+          health_count[decoder->record().health]++;
+        }
+        usb_line->clear();
+        continue;
+      }
+      if (data[i] != '\n') {
+        *usb_line += (char)data[i];
+        continue;
+      }
+      if (usb_line->compare(0, 10, "MU config ") == 0) {
+        config_lines->push_back(usb_line->substr(10));
+      } else if (usb_line->compare(0, 7, "SURVEY ") == 0) {
+        survey_lines->push_back(usb_line->substr(7));
+      } else if (usb_line->compare(0, 7, "REPLAY ") == 0 ||
+                 usb_line->compare(0, 7, "RECORD ") == 0) {
+        replay_lines->push_back(*usb_line);
+      }
+      usb_line->clear();
+    }
+  });
+
+  //非常停止スイッチは押されて(LOW)いる間が正常
+  sim::setPin(Emergency, LOW);
+  if (estop_ms >= 0) {
+    sink->estop_at_us = (uint64_t)estop_ms * 1000;
+    sim::setPinAt(sink->estop_at_us, Emergency, HIGH);
+    sim::setPinAt(sink->estop_at_us + 500000, Emergency, LOW);
+  }
+
+  //メニューを開き(SW7)、選んでいる項目の値を1つ増やし(SW4)、閉じる(SW7)と設定が送られる
+  //最初だけ項目をchannelまで進める(SW6を4回)
+  if (menu_ms > 0) {
+    std::vector<uint8_t> presses = {SW7, SW6, SW6, SW6, SW6, SW4, SW7};
+    for (uint64_t t = menu_ms * 1000; t < seconds * 1e6; t += menu_ms * 1000) {
+      for (size_t i = 0; i < presses.size(); i++) {
+        sim::setPinAt(t + i * 100000, presses[i], LOW);
+        sim::setPinAt(t + i * 100000 + 50000, presses[i], HIGH);
+      }
+      presses = {SW7, SW4, SW7};
+    }
+  }
+
+  if (survey_ms >= 0) {
+    uint64_t survey_us = (uint64_t)survey_ms * 1000;
+    sim::setPinAt(survey_us > 100000 ? survey_us - 100000 : 0, Emergency, HIGH);
+    sim::setPinAt(survey_us + (MU_SURVEY_MAX_MS + 500) * 1000, Emergency, LOW);
+    sim::at(survey_us, [tx] { tx->setHome(tx->ch()); });
+    sim::setPinAt(survey_us, SW6, LOW);
+    sim::setPinAt(survey_us + 50000, SW6, HIGH);
+  }
+
+  if (telemetry) {
+    sim::at(1000, [] { Serial.inject((const uint8_t *)"T", 1); });
+  }
+  if (!replay_in.empty()) {
+    FILE *f = fopen(replay_in.c_str(), "rb");
+    if (f == nullptr) {
+      fprintf(stderr, "cannot open %s\n", replay_in.c_str());
+      return 2;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+      data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+    sim::putFile("/input.rec", data);
+    sim::setPinAt(200000, Emergency, HIGH);
+    sim::at(300000, [] { Serial.inject((const uint8_t *)"F", 1); });
+    sim::at(450000, [] { Serial.inject((const uint8_t *)"P", 1); });
+    sim::setPinAt(460000, Emergency, LOW);
+  }
+  UartNoise *noise = new UartNoise();
+  if (noise_ms > 0) {
+    noise->period_us = noise_ms * 1000;
+    noise->start(noise->period_us);
+  }
+
+  setup();
+  uint64_t end_us = (uint64_t)(seconds * 1e6);
+  sim::run(end_us);
+
+  double s = end_us / 1e6;
+  StdoutPrint out;
+  printf("sim_seconds=%.3f\n", s);
+  printf("mu_frames=%u\n", sink->frames);
+  printf("mu_frames_per_s=%.1f\n", sink->frames / s);
+  printf("mu_estop_frames=%u\n", sink->estop_frames);
+  printf("mu_commands=%u\n", sink->commands);
+  printf("mu_payload_hash=%08x\n", sink->payload_hash);
+  printf("uart_bytes=%llu\n", (unsigned long long)Serial1.txBytes());
+  printf("uart_bytes_per_s=%.1f\n", Serial1.txBytes() / s);
+  printf("uart_utilization=%.3f\n", Serial1.txBusyUs() / (double)end_us);
+  const sim::MuChannelStats &air = channel->stats();
+  printf("air_transmitted=%u\n", air.transmitted);
+  printf("air_collided=%u\n", air.collided);
+  printf("air_dropped=%u\n", air.dropped);
+  printf("air_corrupted=%u\n", air.corrupted);
+  printf("air_deferred=%u\n", air.deferred);
+  printf("air_carrier_busy=%u\n", air.carrier_busy);
+  printf("air_ir_injected=%u\n", air.ir_injected);
+  printf("air_utilization=%.3f\n", air.airtime_us / (double)end_us);
+  printf("mu_tx_sent=%u\n", tx->stats().sent);
+  printf("mu_tx_ir=%u\n", tx->stats().ir);
+  printf("mu_tx_errors=%u\n", tx->stats().errors);
+  if (survey_ms >= 0) {
+    printf("survey_off_home_frames=%u\n", tx->stats().sent_off_home);
+  }
+  printf("rx_frames=%u\n", receiver->frames);
+  printf("rx_frames_per_s=%.1f\n", receiver->frames / s);
+  printf("rx_parse_errors=%u\n", receiver->errors);
+  const FrameCheckStats &check = receiver->checker.stats();
+  printf("rx_check_good=%u\n", check.good);
+  printf("rx_check_bad=%u\n", check.bad);
+  printf("rx_check_unchecked=%u\n", check.unchecked);
+  printf("rx_check_lost=%u\n", check.lost);
+  printf("rx_check_bad_permille=%u\n", check.badPermille());
+  printf("rx_undetected_corrupt=%u\n", receiver->undetected);
+  const ReliableStats &rs = mu_reliable.stats();
+  printf("reliable_queued=%u\n", rs.queued);
+  printf("reliable_superseded=%u\n", rs.superseded);
+  printf("reliable_transmissions=%u\n", rs.transmissions);
+  printf("reliable_retransmits=%u\n", rs.retransmits);
+  printf("reliable_delivered=%u\n", rs.delivered);
+  printf("reliable_expired=%u\n", rs.expired);
+  printf("reliable_tx_errors=%u\n", rs.tx_errors);
+  printf("reliable_stale_acks=%u\n", rs.stale_acks);
+  printf("reliable_delivery_permille=%u\n", rs.deliveryPermille());
+  printf("rx_reliable_received=%u\n", receiver->reliable.received);
+  printf("rx_reliable_duplicates=%u\n", receiver->reliable.duplicates);
+  printf("rx_configs=%u\n", receiver->configs);
+  printf("rx_channel_switches=%u\n", receiver->channel_switches);
+  printf("rx_channel=%02x\n", rx->ch());
+  printf("mu_tx_channel=%02x\n", tx->ch());
+  for (size_t i = 0; i < config_lines->size(); i++) {
+    printf("mu_config.%zu=%s\n", i, (*config_lines)[i].c_str());
+  }
+  for (size_t i = 0; i < survey_lines->size(); i++) {
+    printf("survey.%zu=%s\n", i, (*survey_lines)[i].c_str());
+  }
+  for (size_t i = 0; i < replay_lines->size(); i++) {
+    printf("replay.%zu=%s\n", i, (*replay_lines)[i].c_str());
+  }
+  printf("input_records=%u\n", (unsigned)input_recorder.count());
+  if (!record_out.empty()) {
+    HostFile out = {fopen(record_out.c_str(), "wb")};
+    bool ok = out.f != nullptr && input_recorder.save(out);
+    if (out.f != nullptr) {
+      fclose(out.f);
+    }
+    printf("record_out=%s\n", ok ? "ok" : "failed");
+  }
+  if (telemetry) {
+    printf("telemetry_records=%u\n", decoder->records);
+    printf("telemetry_crc_errors=%u\n", decoder->crc_errors);
+    uint32_t record_bytes = decoder->records > 0 ? (decoder->records - 1) * TELEMETRY_RECORD_LEN : 0;
+    printf("telemetry_stray_bytes=%u\n", *telemetry_bytes - record_bytes);
+    printf("telemetry_sent=%u\n", link_total->sent);
+    printf("telemetry_received=%u\n", link_total->received);
+    printf("telemetry_queue_drops=%u\n", link_total->queue_drops);
+    printf("telemetry_stale_drops=%u\n", link_total->stale_drops);
+    for (uint8_t e = MU_ERR_NONE + 1; e < MU_ERR_COUNT; e++) {
+      printf("telemetry_errors.%u=%u\n", e, link_total->errors[e]);
+    }
+    printf("telemetry_seconds_ok=%u\n", health_count[LINK_OK]);
+    printf("telemetry_seconds_warn=%u\n", health_count[LINK_WARN]);
+    printf("telemetry_seconds_bad=%u\n", health_count[LINK_BAD]);
+    if (decoder->records > 0) {
+      printf("telemetry_last_rssi_dbm=%d\n", decoder->record().second.rssi_dbm);
+    }
+  }
+  for (uint8_t e = MU_ERR_NONE + 1; e < MU_ERR_COUNT; e++) {
+    if (noise->injected[e] > 0) {
+      printf("uart_noise_injected.%u=%u\n", e, noise->injected[e]);
+    }
+  }
+  rs.latency.dump(out, "reliable send->ack");
+  air.latency.dump(out, "tx@->rx*DR");
+  if (sink->estop_done_us != 0) {
+    printf("estop_to_tx_done_us=%llu\n",
+           (unsigned long long)(sink->estop_done_us - sink->estop_at_us));
+  }
+  printf("i2c0_bytes=%llu\n", (unsigned long long)Wire.bytes());
+  printf("i2c0_transactions=%u\n", Wire.transactions());
+  printf("i2c0_utilization=%.3f\n", Wire.busyUs() / (double)end_us);
+  printf("i2c1_bytes=%llu\n", (unsigned long long)Wire1.bytes());
+  printf("i2c1_utilization=%.3f\n", Wire1.busyUs() / (double)end_us);
+  printf("oled_bytes=%llu\n", (unsigned long long)oled.bytes);
+  printf("pad_reads=%u\n", pad0.reads + pad1.reads);
+  for (const sim::TaskStats &t : sim::taskStats()) {
+    printf("task.%s.priority=%d\n", t.name, t.priority);
+    printf("task.%s.wakeups_per_s=%.1f\n", t.name, t.wakeups / s);
+    printf("task.%s.timeouts_per_s=%.1f\n", t.name, t.timeouts / s);
+    printf("task.%s.io_waits_per_s=%.1f\n", t.name, t.io_waits / s);
+    printf("task.%s.io_utilization=%.3f\n", t.name, t.io_us / (double)end_us);
+  }
+#ifdef LATENCY_TRACE
+  latencyTrace().dump(out);
+#endif
+  fflush(stdout);
+  // タスクのスレッドは待ったままなので終了処理をせずに終わる
+  _exit(tx->stats().sent_off_home > 0 ? 1 : 0);
+}
@@ -0,0 +1,193 @@
+/**
+ * @file Airtime.h
+ * @brief
+ * MU-2の送信時間(UART転送時間・電波を出している時間)の見積もりと、
+ * トークンバケットによる送信レート制限。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "MUwrapper.hpp"
+
+/**
+ * @brief 送信時間の見積もりに使う無線機のパラメータ
+ *
+ */
+struct MuRadioParams {
+  /// MUとのUART通信速度[bps]
+  uint32_t uart_baud = 19200;
+  /// 無線区間の通信速度[bps] MU-2-429は4800bps
+  uint32_t air_bps = 4800;
+  /// 無線区間でデータに付く分のバイト数(プリアンブル、同期語、ID、CRCなど)
+  uint8_t air_overhead_bytes = 12;
+  /// 送信前のキャリアセンスと送信立ち上がりの時間[us]
+  uint32_t tx_setup_us = 5000;
+};
+
+/**
+ * @brief "@DTxx<data>\r\n"をUARTで送り切るまでの時間[us]
+ *
+ * @param p
+ * @param payload_len
+ * @return uint32_t
+ */
+inline uint32_t muUartTimeUs(const MuRadioParams &p, uint8_t payload_len) {
+  // 8N1なので1バイト10ビット
+  return (uint32_t)((uint64_t)(payload_len + 7) * 10 * 1000000 / p.uart_baud);
+}
+
+/**
+ * @brief 1フレーム分の電波を出している時間[us]
+ *
+ * @param p
+ * @param payload_len
+ * @return uint32_t
+ */
+inline uint32_t muAirtimeUs(const MuRadioParams &p, uint8_t payload_len) {
+  return p.tx_setup_us +
+         (uint32_t)((uint64_t)(p.air_overhead_bytes + payload_len) * 8 *
+                    1000000 / p.air_bps);
+}
+
+/**
+ * @brief 送信レート制限の統計
+ *
+ */
+struct AirtimeStats {
+  /// offerされたフレーム数
+  uint32_t offered = 0;
+  /// 送信したフレーム数
+  uint32_t sent = 0;
+  /// 送る前に新しいフレームで上書きされたフレーム数
+  uint32_t dropped_stale = 0;
+  /// 送信したフレームの合計送信時間[us]
+  uint64_t airtime_us = 0;
+  /// 統計を取り始めてからの経過時間[us]
+  uint64_t elapsed_us = 0;
+  /// 送信時間の割合[‰]
+  uint16_t utilization() const {
+    return elapsed_us ? (uint16_t)(airtime_us * 1000 / elapsed_us) : 0;
+  }
+};
+
+/**
+ * @brief
+ * トークンバケットによる送信スケジューラ。トークンは送信可能な時間[us]で、
+ * duty_permille/1000の速さで溜まり、burst_usで頭打ちになる。
+ * 送れないうちに次のフレームが来たら古いほうを捨てて新しいほうを送る。
+ *
+ */
+class AirtimeScheduler {
+public:
+  /**
+   * @brief
+   *
+   * @param params 無線機のパラメータ
+   * @param duty_permille 送信時間の上限[‰]
+   * @param burst_us 連続して使える送信時間の上限[us]
+   */
+  AirtimeScheduler(const MuRadioParams &params, uint16_t duty_permille,
+                   uint32_t burst_us)
+      : params_(params), duty_permille_(duty_permille), burst_us_(burst_us),
+        tokens_us_(burst_us){};
+
+  /**
+   * @brief 送りたいフレームを渡す。送信待ちのフレームがあれば上書きする
+   *
+   * @param frame
+   * @param len MU_MAX_DATALEN以下
+   */
+  void offer(const uint8_t *frame, uint8_t len) {
+    if (pending_) {
+      stats_.dropped_stale++;
+    }
+    memcpy(pending_frame_, frame, len);
+    pending_len_ = len;
+    pending_ = true;
+    stats_.offered++;
+  }
+
+  /**
+   * @brief
+   * 送信待ちのフレームが今送れるか判定する。送れるときはトークンを消費し、
+   * frame,lenに送るデータを入れてtrueを返す。
+   *
+   * @param now_us 現在時刻[us]
+   * @param frame
+   * @param len
+   * @return true 送信する
+   * @return false 送るものがない、またはトークン不足
+   */
+  bool poll(uint32_t now_us, const uint8_t *&frame, uint8_t &len) {
+    refill(now_us);
+    if (!pending_) {
+      return false;
+    }
+    uint32_t cost = muAirtimeUs(params_, pending_len_);
+    if (tokens_us_ < cost) {
+      return false;
+    }
+    tokens_us_ -= cost;
+    pending_ = false;
+    stats_.sent++;
+    stats_.airtime_us += cost;
+    frame = pending_frame_;
+    len = pending_len_;
+    return true;
+  }
+
+  /**
+   * @brief
+   * 送信待ちとは別のフレーム(確認応答付きのものなど)を今送れるか判定し、
+   * 送れるときはトークンを消費する。送信待ちのフレームはそのまま残る。
+   *
+   * @param now_us 現在時刻[us]
+   * @param len
+   * @return true 送信する
+   * @return false トークン不足
+   */
+  bool spend(uint32_t now_us, uint8_t len) {
+    refill(now_us);
+    uint32_t cost = muAirtimeUs(params_, len);
+    if (tokens_us_ < cost) {
+      return false;
+    }
+    tokens_us_ -= cost;
+    stats_.sent++;
+    stats_.airtime_us += cost;
+    return true;
+  }
+
+  bool hasPending() const { return pending_; }
+  const AirtimeStats &stats() const { return stats_; }
+  void resetStats() { stats_ = AirtimeStats(); }
+  const MuRadioParams &params() const { return params_; }
+
+private:
+  MuRadioParams params_;
+  uint16_t duty_permille_;
+  uint32_t burst_us_;
+  uint32_t tokens_us_;
+  uint32_t last_us_ = 0;
+  bool started_ = false;
+  bool pending_ = false;
+  uint8_t pending_frame_[MU_MAX_DATALEN] = {0};
+  uint8_t pending_len_ = 0;
+  AirtimeStats stats_;
+
+  void refill(uint32_t now_us) {
+    if (!started_) {
+      started_ = true;
+      last_us_ = now_us;
+      return;
+    }
+    uint32_t elapsed = now_us - last_us_;
+    last_us_ = now_us;
+    stats_.elapsed_us += elapsed;
+    uint64_t tokens =
+        tokens_us_ + (uint64_t)elapsed * duty_permille_ / 1000;
+    tokens_us_ = tokens > burst_us_ ? burst_us_ : (uint32_t)tokens;
+  }
+};
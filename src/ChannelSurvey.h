@@ -0,0 +1,341 @@
+/**
+ * @file ChannelSurvey.h
+ * @brief
+ * MUのチャンネルを順に切り替えて混み具合を調べ、空いているチャンネルを選ぶ。
+ * 各チャンネルで一定時間、@RA(受信電波強度の読み出し)を繰り返して
+ * 強度の平均・最大と、しきい値を超えていた割合(他の送信機の電波が出ていた割合)を測り、
+ * その間に受信した*DR(同じグループの他の送信機)の数も数える。
+ * 終わったら元のチャンネルに戻す。全体の時間はmax_total_usで打ち切る(stop()でも途中でやめられる)。
+ * 戻す@CHは応答が来るまでreturn_attempts回まで送り直す。それでも応答がなければreturned()がfalseになるので、
+ * 呼ぶ側でMuConfigQueue::invalidate()などを使ってチャンネルを設定し直すこと。
+ * MuConfigQueueと同じく、コマンドは応答を待ってから次を送り、1つのタスクから使う。
+ * 調べている間はコントローラーのデータを送らないこと(送ると調べているチャンネルに出る)。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include "MUwrapper.hpp"
+
+/// 一度に調べられるチャンネル数の上限
+constexpr uint8_t SURVEY_MAX_CHANNELS = 8;
+
+/**
+ * @brief 調べ方の設定
+ *
+ */
+struct SurveyParams {
+  /// 1チャンネルを調べる時間[us]
+  uint32_t dwell_us = 400000;
+  /// @RAを送る間隔[us]
+  uint32_t sample_us = 20000;
+  /// 応答を待つ時間[us]
+  uint32_t timeout_us = 200000;
+  /// 全体の時間の上限[us] 超えたら残りのチャンネルは調べずに戻る
+  uint32_t max_total_us = 3000000;
+  /// 元のチャンネルに戻す@CHを送る回数の上限
+  uint8_t return_attempts = 3;
+  /// この強度[dBm]を超えていたら電波が出ているとみなす
+  int16_t busy_dbm = -95;
+};
+
+/**
+ * @brief 1チャンネルの結果
+ *
+ */
+struct ChannelReport {
+  uint8_t ch = 0;
+  /// @RAの応答の数。0なら調べられなかった
+  uint16_t samples = 0;
+  /// 受信電波強度の平均と最大[dBm]
+  int16_t rssi_mean_dbm = 0;
+  int16_t rssi_max_dbm = -128;
+  /// busy_dbmを超えていた割合[‰]
+  uint16_t busy_permille = 0;
+  /// 調べている間に受信した*DRの数
+  uint16_t frames = 0;
+
+  /// aのほうが空いているか。電波が出ていた割合、受信数、平均強度の順で比べる
+  static bool quieter(const ChannelReport &a, const ChannelReport &b) {
+    if ((a.samples == 0) != (b.samples == 0)) {
+      return b.samples == 0;
+    }
+    if (a.busy_permille != b.busy_permille) {
+      return a.busy_permille < b.busy_permille;
+    }
+    if (a.frames != b.frames) {
+      return a.frames < b.frames;
+    }
+    return a.rssi_mean_dbm < b.rssi_mean_dbm;
+  }
+};
+
+/**
+ * @brief チャンネルの混み具合の調査
+ *
+ */
+class ChannelSurvey {
+public:
+  ChannelSurvey(const SurveyParams &params = SurveyParams()) : params_(params) {}
+
+  /**
+   * @brief 調べ始める
+   *
+   * @param channels 調べるチャンネル
+   * @param count SURVEY_MAX_CHANNELS以下
+   * @param home_ch 終わったら戻るチャンネル(今のチャンネル)
+   * @param now_us
+   * @return true
+   * @return false 調べている途中、またはチャンネルが多すぎる
+   */
+  bool start(const uint8_t *channels, uint8_t count, uint8_t home_ch,
+             uint32_t now_us) {
+    if (running() || count == 0 || count > SURVEY_MAX_CHANNELS) {
+      return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+      reports_[i] = ChannelReport();
+      reports_[i].ch = channels[i];
+      rssi_sum_[i] = 0;
+      busy_[i] = 0;
+    }
+    count_ = count;
+    home_ch_ = home_ch;
+    index_ = 0;
+    returned_ = false;
+    start_us_ = now_us;
+    enter(STATE_SWITCH, now_us);
+    return true;
+  }
+
+  /**
+   * @brief 残りのチャンネルは調べずに元のチャンネルに戻す(戻すのはpollで送る)
+   *
+   * @param now_us
+   */
+  void stop(uint32_t now_us) {
+    if (!running() || state_ == STATE_RETURN) {
+      return;
+    }
+    if (state_ == STATE_SAMPLE) {
+      finishChannel();
+    }
+    enter(STATE_RETURN, now_us);
+  }
+
+  /**
+   * @brief 今送るコマンドがあれば送る。ループで毎回呼ぶ
+   *
+   * @param mu
+   * @param now_us
+   * @return true 調べている途中
+   */
+  bool poll(MUWrapper &mu, uint32_t now_us) {
+    if (!running()) {
+      return false;
+    }
+    if (now_us - start_us_ >= params_.max_total_us) {
+      stop(now_us);
+    }
+    switch (state_) {
+    case STATE_SWITCH:
+    case STATE_RETURN:
+      if (!waiting_) {
+        mu.configure("CH", state_ == STATE_SWITCH ? reports_[index_].ch : home_ch_);
+        waiting_ = true;
+        sent_us_ = now_us;
+        attempts_++;
+      } else if (now_us - sent_us_ >= params_.timeout_us) {
+        // 切り替えられなかったチャンネルは調べずに次へ。戻すほうは回数まで送り直す
+        if (state_ == STATE_SWITCH) {
+          next(now_us);
+        } else if (attempts_ < params_.return_attempts) {
+          waiting_ = false;
+        } else {
+          finish(now_us);
+        }
+      }
+      break;
+    case STATE_SAMPLE:
+      if (now_us - state_us_ >= params_.dwell_us) {
+        finishChannel();
+        next(now_us);
+        break;
+      }
+      if (waiting_ && now_us - sent_us_ >= params_.timeout_us) {
+        waiting_ = false;
+      }
+      if (!waiting_ && now_us - sample_us_ >= params_.sample_us) {
+        mu.query("RA");
+        waiting_ = true;
+        sent_us_ = sample_us_ = now_us;
+      }
+      break;
+    default:
+      break;
+    }
+    return running();
+  }
+
+  /**
+   * @brief MUからの応答(MU_EVENT_RESPONSEのデータ。"RA5A"など)を渡す
+   *
+   * @param data
+   * @param len
+   * @param now_us
+   */
+  void onResponse(const uint8_t *data, uint8_t len, uint32_t now_us) {
+    if (!running() || !waiting_ || len < 2) {
+      return;
+    }
+    if (data[0] == 'C' && data[1] == 'H' && state_ == STATE_SWITCH) {
+      enter(STATE_SAMPLE, now_us);
+    } else if (data[0] == 'C' && data[1] == 'H' && state_ == STATE_RETURN) {
+      // 途中でやめたときは、調べるチャンネルへの切り替えの応答が後から来ることがある
+      uint8_t v;
+      if (len != 4 || !parseHex(data + 2, v) || v != home_ch_) {
+        return;
+      }
+      returned_ = true;
+      finish(now_us);
+    } else if (data[0] == 'R' && data[1] == 'A' && len == 4 &&
+               state_ == STATE_SAMPLE) {
+      waiting_ = false;
+      uint8_t v;
+      if (!parseHex(data + 2, v)) {
+        return;
+      }
+      // *RA=xxは-dBmの値
+      int16_t dbm = -(int16_t)v;
+      ChannelReport &r = reports_[index_];
+      r.samples++;
+      rssi_sum_[index_] += dbm;
+      if (dbm > r.rssi_max_dbm) {
+        r.rssi_max_dbm = dbm;
+      }
+      if (dbm > params_.busy_dbm) {
+        busy_[index_]++;
+      }
+    }
+  }
+
+  /**
+   * @brief 受信した*DRの数を渡す(調べている途中のチャンネルの分として数える)
+   *
+   * @param n
+   */
+  void onFrames(uint32_t n) {
+    if (state_ == STATE_SAMPLE) {
+      uint32_t f = reports_[index_].frames + n;
+      reports_[index_].frames = f > 0xFFFF ? 0xFFFF : (uint16_t)f;
+    }
+  }
+
+  bool running() const { return state_ != STATE_IDLE && state_ != STATE_DONE; }
+  /// 結果が出ているか
+  bool done() const { return state_ == STATE_DONE; }
+  uint8_t count() const { return count_; }
+  /**
+   * @brief 空いている順の結果
+   *
+   * @param rank 0が一番空いている
+   * @return const ChannelReport&
+   */
+  const ChannelReport &ranked(uint8_t rank) const { return reports_[order_[rank]]; }
+  /// 一番空いているチャンネル。調べられたチャンネルがなければ元のチャンネル
+  uint8_t best() const {
+    return count_ > 0 && ranked(0).samples > 0 ? ranked(0).ch : home_ch_;
+  }
+  /// 調べ始めてから戻るまでの時間[us]
+  uint32_t elapsedUs() const { return elapsed_us_; }
+  /// 元のチャンネルに戻せたか(応答が来たか)
+  bool returned() const { return returned_; }
+
+private:
+  enum State : uint8_t {
+    STATE_IDLE,
+    STATE_SWITCH, // @CHの応答待ち
+    STATE_SAMPLE, // @RAを繰り返す
+    STATE_RETURN, // 元のチャンネルに戻す@CHの応答待ち
+    STATE_DONE,
+  };
+  SurveyParams params_;
+  State state_ = STATE_IDLE;
+  ChannelReport reports_[SURVEY_MAX_CHANNELS];
+  int32_t rssi_sum_[SURVEY_MAX_CHANNELS];
+  uint16_t busy_[SURVEY_MAX_CHANNELS];
+  uint8_t order_[SURVEY_MAX_CHANNELS];
+  uint8_t count_ = 0;
+  uint8_t index_ = 0;
+  uint8_t home_ch_ = 0;
+  bool waiting_ = false;
+  // 今の状態で@CHを送った回数
+  uint8_t attempts_ = 0;
+  bool returned_ = false;
+  uint32_t start_us_ = 0;
+  uint32_t state_us_ = 0;
+  uint32_t sent_us_ = 0;
+  uint32_t sample_us_ = 0;
+  uint32_t elapsed_us_ = 0;
+
+  static bool parseHex(const uint8_t *s, uint8_t &v) {
+    uint8_t n[2];
+    for (uint8_t i = 0; i < 2; i++) {
+      uint8_t c = s[i];
+      if (c >= '0' && c <= '9') {
+        n[i] = c - '0';
+      } else if (c >= 'A' && c <= 'F') {
+        n[i] = c - 'A' + 10;
+      } else {
+        return false;
+      }
+    }
+    v = n[0] << 4 | n[1];
+    return true;
+  }
+
+  void enter(State s, uint32_t now_us) {
+    state_ = s;
+    state_us_ = now_us;
+    sample_us_ = now_us - params_.sample_us;
+    waiting_ = false;
+    attempts_ = 0;
+  }
+
+  void finish(uint32_t now_us) {
+    state_ = STATE_DONE;
+    waiting_ = false;
+    elapsed_us_ = now_us - start_us_;
+    rank();
+  }
+
+  /// 次のチャンネルへ。なければ元のチャンネルに戻す
+  void next(uint32_t now_us) {
+    index_++;
+    enter(index_ < count_ ? STATE_SWITCH : STATE_RETURN, now_us);
+  }
+
+  void finishChannel() {
+    ChannelReport &r = reports_[index_];
+    if (r.samples > 0) {
+      r.rssi_mean_dbm = (int16_t)(rssi_sum_[index_] / r.samples);
+      r.busy_permille = (uint16_t)((uint32_t)busy_[index_] * 1000 / r.samples);
+    }
+  }
+
+  void rank() {
+    for (uint8_t i = 0; i < count_; i++) {
+      order_[i] = i;
+    }
+    // 挿入ソート(チャンネル数は少ない)
+    for (uint8_t i = 1; i < count_; i++) {
+      for (uint8_t j = i;
+           j > 0 && ChannelReport::quieter(reports_[order_[j]], reports_[order_[j - 1]]);
+           j--) {
+        uint8_t t = order_[j];
+        order_[j] = order_[j - 1];
+        order_[j - 1] = t;
+      }
+    }
+  }
+};
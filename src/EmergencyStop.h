@@ -0,0 +1,148 @@
+/**
+ * @file EmergencyStop.h
+ * @brief
+ * 非常停止フレームの連続送信の管理と、非常停止の遅延の記録。
+ * 非常停止の入力(割り込みの時刻)から、通常の送信を待たずにすぐ1フレーム送り、
+ * 解除されるまで一定間隔で送り続ける。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include "LatencyTrace.h"
+#include "MUwrapper.hpp"
+
+/**
+ * @brief 非常停止の統計
+ *
+ */
+struct EmergencyStats {
+  /// 非常停止になった回数
+  uint32_t triggers = 0;
+  /// 送った非常停止フレームの数
+  uint32_t frames = 0;
+  /// 入力の変化からUARTに書き終えるまで[us]
+  LatencyHistogram to_uart;
+  /// 入力の変化から送信が終わるまで[us]
+  LatencyHistogram to_tx_done;
+};
+
+/**
+ * @brief 非常停止フレームを送る時刻を決める
+ *
+ */
+class EmergencyBurst {
+public:
+  /**
+   * @brief
+   *
+   * @param repeat_us 非常停止フレームを送る間隔[us]
+   */
+  EmergencyBurst(uint32_t repeat_us) : repeat_us_(repeat_us) {
+    // 非常停止フレームは"@DT01E\r\n"のまま変わらないので先に作っておく
+    const uint8_t e = 'E';
+    frame_len_ = MUWrapper::encode(frame_, &e, 1);
+  };
+
+  /**
+   * @brief 非常停止にする。次のdue()ですぐ送る
+   *
+   * @param since_us 入力が変化した時刻
+   */
+  void start(uint32_t since_us) {
+    if (!active_) {
+      stats_.triggers++;
+    }
+    active_ = true;
+    since_us_ = since_us;
+    first_ = true;
+    next_us_ = since_us;
+  }
+
+  /**
+   * @brief 非常停止を解除する
+   *
+   */
+  void stop() { active_ = false; }
+
+  /**
+   * @brief
+   * 送るのを止める・再開する(MUが別のチャンネルを調べている間など)。
+   * 止めている間もdue()は間隔どおりに時刻を進めるので、呼ぶ側の待ち時間は変わらない
+   *
+   * @param held
+   */
+  void hold(bool held) { held_ = held; }
+
+  /**
+   * @brief 今送るべきか。送るならtrueを返し、次に送る時刻を進める
+   *
+   * @param now_us
+   * @return true
+   */
+  bool due(uint32_t now_us) {
+    if (!active_ || (int32_t)(now_us - next_us_) < 0) {
+      return false;
+    }
+    // 遅れても間隔は詰めない
+    next_us_ = now_us + repeat_us_;
+    if (held_) {
+      // 止めていた分の遅れは非常停止の遅延として記録しない
+      first_ = false;
+      return false;
+    }
+    stats_.frames++;
+    return true;
+  }
+
+  /**
+   * @brief 次に送るまでの時間[us]。非常停止でなければ0
+   *
+   * @param now_us
+   * @return uint32_t
+   */
+  uint32_t untilNext(uint32_t now_us) const {
+    if (!active_) {
+      return 0;
+    }
+    int32_t until = (int32_t)(next_us_ - now_us);
+    return until > 0 ? (uint32_t)until : 0;
+  }
+
+  /**
+   * @brief 非常停止になって最初のフレームなら遅延を記録する
+   *
+   * @param uart_us UARTに書き終えた時刻
+   * @param tx_done_us 送信が終わった時刻
+   * @return true 最初のフレームだった
+   */
+  bool recordFirst(uint32_t uart_us, uint32_t tx_done_us) {
+    if (!first_) {
+      return false;
+    }
+    first_ = false;
+    stats_.to_uart.add(uart_us - since_us_);
+    stats_.to_tx_done.add(tx_done_us - since_us_);
+    return true;
+  }
+
+  /// 最初のフレームをまだ送っていないか
+  bool isFirst() const { return first_; }
+  bool isActive() const { return active_; }
+  /// 非常停止になった時刻[us]
+  uint32_t since() const { return since_us_; }
+  const uint8_t *frame() const { return frame_; }
+  uint8_t frameLength() const { return frame_len_; }
+  const EmergencyStats &stats() const { return stats_; }
+
+private:
+  uint32_t repeat_us_;
+  bool active_ = false;
+  bool held_ = false;
+  bool first_ = false;
+  uint32_t since_us_ = 0;
+  uint32_t next_us_ = 0;
+  uint8_t frame_[MU_MAX_COMMANDBUF];
+  uint8_t frame_len_;
+  EmergencyStats stats_;
+};
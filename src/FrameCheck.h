@@ -0,0 +1,264 @@
+/**
+ * @file FrameCheck.h
+ * @brief
+ * コントローラーのフレームに連番とCRCを付け、受信側で化けたフレームを捨てる。
+ * 化けたアナログ値がそのまま届くとロボットがスティックを倒し切ったように動くので、
+ * 確かめられないフレームは使わずに捨てる(次のフレームはすぐ来る)。
+ *
+ * フレームの形式(MUのデータ部)
+ * [FRAME_TAG_CRC8 ][連番][元のフレーム...][CRC-8]
+ * [FRAME_TAG_CRC16][連番][元のフレーム...][CRC-16 上位,下位]
+ * CRCはタグから元のフレームの最後までにかける。
+ * CRC-8はCRC-8/SMBUS(多項式0x07,初期値0x00)、CRC-16はCRC-16/CCITT-FALSE(多項式0x1021,初期値0xFFFF)。
+ * 表はコンパイル時に作るので、1バイトあたり表引き1回で計算できる。
+ * タグは十字ボタンの上下左右がすべて押された状態(controller::FORMAT_TAG)の未使用の値。
+ *
+ * 受信側の使い方
+ * FrameChecker checker;
+ * const uint8_t *payload; uint8_t len;
+ * if (checker.open(frame, frame_len, payload, len)) data.unpacketize(payload, len);
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "MUwrapper.hpp"
+#include "controller.h"
+
+/**
+ * @brief フレームに付ける検査の種類
+ *
+ */
+enum FrameCheckKind : uint8_t {
+  FRAME_CHECK_NONE,
+  FRAME_CHECK_CRC8,
+  FRAME_CHECK_CRC16,
+};
+
+constexpr uint8_t FRAME_TAG_CRC8 = controller::FORMAT_TAG | 0x02;
+constexpr uint8_t FRAME_TAG_CRC16 = controller::FORMAT_TAG | 0x03;
+
+/// 検査を付けると増えるバイト数(タグ、連番、CRC)
+constexpr uint8_t frameCheckOverhead(FrameCheckKind kind) {
+  return kind == FRAME_CHECK_CRC8 ? 3 : kind == FRAME_CHECK_CRC16 ? 4 : 0;
+}
+
+namespace frame_check_detail {
+
+// 0~255の並びを作る(C++11にはstd::index_sequenceがない)
+template <uint16_t... I> struct Seq {};
+template <uint16_t N, uint16_t... I>
+struct MakeSeq : MakeSeq<N - 1, N - 1, I...> {};
+template <uint16_t... I> struct MakeSeq<0, I...> {
+  typedef Seq<I...> type;
+};
+
+constexpr uint8_t crc8Bits(uint8_t c, uint8_t bits) {
+  return bits == 0 ? c
+                   : crc8Bits((c & 0x80) ? (uint8_t)((c << 1) ^ 0x07)
+                                         : (uint8_t)(c << 1),
+                              bits - 1);
+}
+constexpr uint16_t crc16Bits(uint16_t c, uint8_t bits) {
+  return bits == 0 ? c
+                   : crc16Bits((c & 0x8000) ? (uint16_t)((c << 1) ^ 0x1021)
+                                            : (uint16_t)(c << 1),
+                               bits - 1);
+}
+
+template <class S> struct Tables;
+template <uint16_t... I> struct Tables<Seq<I...>> {
+  static constexpr uint8_t crc8[256] = {crc8Bits((uint8_t)I, 8)...};
+  static constexpr uint16_t crc16[256] = {crc16Bits((uint16_t)(I << 8), 8)...};
+};
+template <uint16_t... I> constexpr uint8_t Tables<Seq<I...>>::crc8[256];
+template <uint16_t... I> constexpr uint16_t Tables<Seq<I...>>::crc16[256];
+
+typedef Tables<MakeSeq<256>::type> CrcTables;
+
+// 表が正しくできているかをコンパイル時に確かめる(検査値は"123456789"のCRC)
+constexpr uint8_t crc8Check(const char *s, uint8_t n, uint8_t c) {
+  return n == 0 ? c : crc8Check(s + 1, n - 1, CrcTables::crc8[c ^ (uint8_t)*s]);
+}
+constexpr uint16_t crc16Check(const char *s, uint8_t n, uint16_t c) {
+  return n == 0 ? c
+                : crc16Check(s + 1, n - 1,
+                             (uint16_t)((c << 8) ^
+                                        CrcTables::crc16[(c >> 8) ^ (uint8_t)*s]));
+}
+static_assert(crc8Check("123456789", 9, 0x00) == 0xF4, "CRC-8 table");
+static_assert(crc16Check("123456789", 9, 0xFFFF) == 0x29B1, "CRC-16 table");
+
+} // namespace frame_check_detail
+
+/**
+ * @brief CRC-8/SMBUS
+ *
+ * @param data
+ * @param len
+ * @param crc 続きから計算するときは前回の値
+ * @return uint8_t
+ */
+inline uint8_t crc8(const uint8_t *data, size_t len, uint8_t crc = 0x00) {
+  const uint8_t *table = frame_check_detail::CrcTables::crc8;
+  while (len--) {
+    crc = table[crc ^ *data++];
+  }
+  return crc;
+}
+
+/**
+ * @brief CRC-16/CCITT-FALSE
+ *
+ * @param data
+ * @param len
+ * @param crc 続きから計算するときは前回の値
+ * @return uint16_t
+ */
+inline uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF) {
+  const uint16_t *table = frame_check_detail::CrcTables::crc16;
+  while (len--) {
+    crc = (uint16_t)((crc << 8) ^ table[(crc >> 8) ^ *data++]);
+  }
+  return crc;
+}
+
+/**
+ * @brief フレームに連番とCRCを付ける
+ *
+ * @param out MU_MAX_DATALENバイト以上
+ * @param frame 元のフレーム
+ * @param len
+ * @param seq 連番
+ * @param kind FRAME_CHECK_NONEならそのまま写す
+ * @return uint8_t 付けたあとの長さ。MU_MAX_DATALENに収まらなければ0
+ */
+inline uint8_t sealFrame(uint8_t *out, const uint8_t *frame, uint8_t len,
+                         uint8_t seq, FrameCheckKind kind) {
+  uint8_t total = len + frameCheckOverhead(kind);
+  if (total > MU_MAX_DATALEN) {
+    return 0;
+  }
+  if (kind == FRAME_CHECK_NONE) {
+    memcpy(out, frame, len);
+    return len;
+  }
+  out[0] = kind == FRAME_CHECK_CRC8 ? FRAME_TAG_CRC8 : FRAME_TAG_CRC16;
+  out[1] = seq;
+  memcpy(out + 2, frame, len);
+  if (kind == FRAME_CHECK_CRC8) {
+    out[2 + len] = crc8(out, 2 + len);
+  } else {
+    uint16_t crc = crc16(out, 2 + len);
+    out[2 + len] = crc >> 8;
+    out[3 + len] = crc & 0xFF;
+  }
+  return total;
+}
+
+/**
+ * @brief 受信側の検査の統計
+ *
+ */
+struct FrameCheckStats {
+  /// CRCが合ったフレーム数
+  uint32_t good = 0;
+  /// CRCが合わずに捨てたフレーム数
+  uint32_t bad = 0;
+  /// 検査の付いていないフレーム数
+  uint32_t unchecked = 0;
+  /// 連番の飛びから数えた、届かなかった(または捨てた)フレーム数
+  uint32_t lost = 0;
+  /// 連番が戻った回数(送信機の再起動など)
+  uint32_t resync = 0;
+
+  /// 検査したフレームのうち捨てた割合[‰]
+  uint16_t badPermille() const {
+    uint32_t n = good + bad;
+    return n ? (uint16_t)((uint64_t)bad * 1000 / n) : 0;
+  }
+};
+
+/**
+ * @brief 受信側の検査。CRCを確かめ、連番の飛びを数える
+ *
+ */
+class FrameChecker {
+public:
+  /**
+   * @brief
+   *
+   * @param require_check trueなら検査の付いていないフレームも捨てる
+   */
+  FrameChecker(bool require_check = false) : require_check_(require_check) {}
+
+  /// フレームに検査が付いているか
+  static bool isChecked(const uint8_t *frame, uint8_t len) {
+    return len >= 1 && (frame[0] == FRAME_TAG_CRC8 || frame[0] == FRAME_TAG_CRC16);
+  }
+
+  /**
+   * @brief 受信したフレームを確かめ、元のフレームを取り出す
+   *
+   * @param frame *DRのデータ部
+   * @param len
+   * @param payload 元のフレーム(frameを指す)
+   * @param payload_len
+   * @return true 使ってよい
+   * @return false 化けている(捨てる)
+   */
+  bool open(const uint8_t *frame, uint8_t len, const uint8_t *&payload,
+            uint8_t &payload_len) {
+    if (!isChecked(frame, len)) {
+      stats_.unchecked++;
+      payload = frame;
+      payload_len = len;
+      return !require_check_;
+    }
+    FrameCheckKind kind =
+        frame[0] == FRAME_TAG_CRC8 ? FRAME_CHECK_CRC8 : FRAME_CHECK_CRC16;
+    uint8_t overhead = frameCheckOverhead(kind);
+    if (len <= overhead) {
+      stats_.bad++;
+      return false;
+    }
+    uint8_t body = len - overhead;
+    bool ok;
+    if (kind == FRAME_CHECK_CRC8) {
+      ok = crc8(frame, 2 + body) == frame[2 + body];
+    } else {
+      ok = crc16(frame, 2 + body) ==
+           (uint16_t)(frame[2 + body] << 8 | frame[3 + body]);
+    }
+    if (!ok) {
+      stats_.bad++;
+      return false;
+    }
+    stats_.good++;
+    uint8_t seq = frame[1];
+    if (started_) {
+      uint8_t gap = seq - (uint8_t)(last_seq_ + 1);
+      if (gap < 128) {
+        stats_.lost += gap;
+      } else {
+        stats_.resync++;
+      }
+    }
+    started_ = true;
+    last_seq_ = seq;
+    payload = frame + 2;
+    payload_len = body;
+    return true;
+  }
+
+  const FrameCheckStats &stats() const { return stats_; }
+  void resetStats() { stats_ = FrameCheckStats(); }
+
+private:
+  bool require_check_;
+  bool started_ = false;
+  uint8_t last_seq_ = 0;
+  FrameCheckStats stats_;
+};
@@ -0,0 +1,254 @@
+/**
+ * @file I2cArbiter.h
+ * @brief
+ * 1本のI2Cバスを複数のクライアント(コントローラー、画面)で使うための調停。
+ * コントローラーは周期的に読むので、次に読む時刻の前後を予約枠として空けておき、
+ * 画面は予約枠にかからない短い送信だけをすき間に入れる。
+ * バスの使用率と、クライアントごとの待ち時間を記録する。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+
+/**
+ * @brief バスを使うクライアント
+ *
+ */
+enum I2cClient : uint8_t {
+  I2C_CONTROLLER, // 周期的に読む。予約枠を持つ
+  I2C_DISPLAY,    // すき間に送る
+  I2C_CLIENT_COUNT,
+};
+
+/**
+ * @brief クライアントごとの統計
+ *
+ */
+struct I2cClientStats {
+  /// バスを取った回数
+  uint32_t acquired = 0;
+  /// tryLockで断られた回数(使用中、または予約枠にかかる)
+  uint32_t deferred = 0;
+  /// 待ち時間の合計[us]
+  uint64_t wait_us = 0;
+  /// 最大の待ち時間[us]
+  uint32_t max_wait_us = 0;
+  /// バスを使っていた時間の合計[us]
+  uint64_t busy_us = 0;
+};
+
+/**
+ * @brief バスの統計
+ *
+ */
+struct I2cBusStats {
+  I2cClientStats client[I2C_CLIENT_COUNT];
+  /// 統計を取り始めてからの経過時間[us]
+  uint64_t elapsed_us = 0;
+  /// バスを使っていた時間の割合[‰]
+  uint16_t utilization() const {
+    uint64_t busy = 0;
+    for (uint8_t i = 0; i < I2C_CLIENT_COUNT; i++) {
+      busy += client[i].busy_us;
+    }
+    return elapsed_us ? (uint16_t)(busy * 1000 / elapsed_us) : 0;
+  }
+};
+
+/**
+ * @brief 排他をしないロック。1つのタスクからしか使わないときやPC上で使う
+ *
+ */
+class NullLock {
+public:
+  void lock() {}
+  bool tryLock() { return true; }
+  void unlock() {}
+};
+
+/**
+ * @brief I2Cバスの調停
+ *
+ * @tparam Wire TwoWireと同じ使い方ができるI2Cバス
+ * @tparam Lock lock(),tryLock(),unlock()を持つ排他
+ */
+template <class Wire, class Lock> class BasicI2cArbiter {
+public:
+  typedef uint32_t (*Clock)();
+
+  /**
+   * @brief
+   *
+   * @param wire このクラスを通してだけ使うバス
+   * @param clock 現在時刻[us]を返す関数
+   */
+  BasicI2cArbiter(Wire &wire, Clock clock) : wire_(wire), clock_(clock) {
+    for (uint8_t i = 0; i < I2C_CLIENT_COUNT; i++) {
+      client_hz_[i] = 100000;
+    }
+  };
+
+  /**
+   * @brief クライアントが使うI2Cクロック。バスを取ったときに切り替える
+   *
+   * @param client
+   * @param hz
+   */
+  void setClientClock(I2cClient client, uint32_t hz) { client_hz_[client] = hz; }
+
+  /**
+   * @brief コントローラーの予約枠を設定する
+   *
+   * @param period_us 読み出し周期[us]
+   * @param window_us 1回の読み出しにかかる時間の上限[us]
+   * @param guard_us 読み出し時刻のぶれの分だけ予約枠の前に空ける時間[us]
+   */
+  void reserve(uint32_t period_us, uint32_t window_us, uint32_t guard_us) {
+    period_us_ = period_us;
+    window_us_ = window_us;
+    guard_us_ = guard_us;
+  }
+
+  /**
+   * @brief バスが空くまで待って取る
+   *
+   * @param client
+   * @return Wire& 使い終わったらunlock()を呼ぶ
+   */
+  Wire &lock(I2cClient client) { return lock(client, clock_()); }
+
+  /**
+   * @brief バスが空くまで待って取る
+   *
+   * @param client
+   * @param since_us バスを使いたくなった時刻(周期タスクなら起きた時刻)。待ち時間はここから数える
+   * @return Wire& 使い終わったらunlock()を呼ぶ
+   */
+  Wire &lock(I2cClient client, uint32_t since_us) {
+    lock_.lock();
+    begin(client, since_us);
+    return wire_;
+  }
+
+  /**
+   * @brief 待たずにバスを取る。使用中のとき、または予約枠にかかるときは取らない
+   *
+   * @param client
+   * @param bytes 送受信するバイト数(アドレスを除く)。終わるまでの時間の見積もりに使う
+   * @return true 取った。使い終わったらunlock()を呼ぶ
+   * @return false 取れなかった
+   */
+  bool tryLock(I2cClient client, uint16_t bytes) {
+    uint32_t now = clock_();
+    if (!lock_.tryLock()) {
+      stats_.client[client].deferred++;
+      return false;
+    }
+    if (!fits(now, transferUs(bytes, client_hz_[client]))) {
+      lock_.unlock();
+      stats_.client[client].deferred++;
+      return false;
+    }
+    begin(client, now);
+    return true;
+  }
+
+  /**
+   * @brief バスを返す
+   *
+   */
+  void unlock() {
+    uint32_t now = clock_();
+    stats_.client[owner_].busy_us += now - start_us_;
+    lock_.unlock();
+  }
+
+  /**
+   * @brief 1回のI2C送受信にかかる時間の見積もり[us]
+   *
+   * @param bytes アドレスを除くバイト数
+   * @param hz
+   * @return uint32_t
+   */
+  static uint32_t transferUs(uint16_t bytes, uint32_t hz) {
+    // 1バイト9ビット(ACK込み)、アドレス1バイト、スタート・ストップ2ビット分
+    return (uint32_t)(((uint64_t)(bytes + 1) * 9 + 2) * 1000000 / hz) +
+           TXN_OVERHEAD_US;
+  }
+
+  Wire &wire() { return wire_; }
+  const I2cBusStats &stats() const { return stats_; }
+  void resetStats() { stats_ = I2cBusStats(); }
+
+private:
+  /// ドライバの処理など、1回の送受信ごとにかかる時間[us]
+  static constexpr uint32_t TXN_OVERHEAD_US = 50;
+
+  Wire &wire_;
+  Clock clock_;
+  Lock lock_;
+  uint32_t client_hz_[I2C_CLIENT_COUNT];
+  uint32_t current_hz_ = 0;
+  I2cClient owner_ = I2C_CONTROLLER;
+  uint32_t start_us_ = 0;
+  uint32_t period_us_ = 0;
+  uint32_t window_us_ = 0;
+  uint32_t guard_us_ = 0;
+  bool slot_known_ = false;
+  uint32_t next_slot_us_ = 0;
+  bool started_ = false;
+  uint32_t last_us_ = 0;
+  I2cBusStats stats_;
+
+  // ロックを取ったあとに呼ぶ
+  void begin(I2cClient client, uint32_t since_us) {
+    uint32_t now = clock_();
+    uint32_t wait = now - since_us;
+    I2cClientStats &st = stats_.client[client];
+    st.acquired++;
+    st.wait_us += wait;
+    if (wait > st.max_wait_us) {
+      st.max_wait_us = wait;
+    }
+    if (client == I2C_CONTROLLER && period_us_ != 0) {
+      // 遅れて取れても、次の予約は本来の周期で
+      next_slot_us_ = since_us + period_us_;
+      slot_known_ = true;
+    }
+    if (client_hz_[client] != current_hz_) {
+      wire_.setClock(client_hz_[client]);
+      current_hz_ = client_hz_[client];
+    }
+    if (started_) {
+      stats_.elapsed_us += now - last_us_;
+    }
+    started_ = true;
+    last_us_ = now;
+    owner_ = client;
+    start_us_ = now;
+  }
+
+  // duration_usかかる送受信を今始めても予約枠にかからないか
+  bool fits(uint32_t now, uint32_t duration_us) const {
+    if (!slot_known_) {
+      return true;
+    }
+    int32_t until = (int32_t)(next_slot_us_ - now);
+    if (until >= (int32_t)(duration_us + guard_us_)) {
+      return true;
+    }
+    // 予約枠を過ぎてもコントローラーが来ない(止まっている)ときは空いているとみなす
+    return until < -(int32_t)window_us_;
+  }
+};
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <Wire.h>
+#include "RtosMutex.h"
+
+inline uint32_t i2cMicros() { return micros(); }
+
+typedef BasicI2cArbiter<TwoWire, RtosMutex> I2cArbiter;
+#endif
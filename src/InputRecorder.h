@@ -0,0 +1,284 @@
+/**
+ * @file InputRecorder.h
+ * @brief
+ * 入力(2台のコントローラーと非常停止)を時刻付きでリングバッファに記録し、あとで元の間隔で再生する。
+ * バッファは外から渡す(ESP32ではPSRAM、PCではmalloc)。いっぱいになったら古いものから上書きするので、
+ * 「さっきの動きがおかしかった」というときは直前の分が残っている。
+ * 記録はsave()でファイル(フラッシュ、USB、PCのファイル)に書き出し、load()で読み込める。
+ * 形式はESP32とPCで同じなので、ロボットで記録したものをPCのシミュレーターでそのまま再生できる。
+ *
+ * ファイルの形式(リトルエンディアン)
+ * ヘッダ [INPUT_RECORD_MAGIC 4][版 1][1件のバイト数 1][0 2][件数 4][上書きで失った件数 4]
+ * 1件    [時刻 4(最初の1件からの経過[us])][bit0:1台目 bit1:2台目 bit7:非常停止 1]
+ *        [1台目 6][2台目 6](ControllerData::packBodyの高分解能形式)
+ * 書き出し・読み込みの相手はwrite(buf,len)・read(buf,len)を持つものなら何でもよい(File、HardwareSerialなど)。
+ * 1つのタスクから使う。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "controller.h"
+
+constexpr uint8_t INPUT_RECORD_MAGIC[4] = {'I', 'R', 'E', 'C'};
+constexpr uint8_t INPUT_RECORD_VERSION = 1;
+constexpr uint8_t INPUT_RECORD_HEADER_LEN = 16;
+constexpr uint8_t INPUT_RECORD_PAD_LEN = 6;
+/// 1件のバイト数
+constexpr uint8_t INPUT_RECORD_LEN = 4 + 1 + 2 * INPUT_RECORD_PAD_LEN;
+
+/**
+ * @brief 記録した1回分の入力
+ *
+ */
+struct InputFrame {
+  /// 取得した時刻[us]
+  uint32_t time_us;
+  /// bit0:pad[0] bit1:pad[1]
+  uint8_t connected;
+  bool emergency;
+  controller::ControllerData pad[2];
+};
+
+/**
+ * @brief 入力の記録
+ *
+ */
+class InputRecorder {
+public:
+  /**
+   * @brief 記録に使うバッファを渡す。それまでは何も記録しない
+   *
+   * @param storage
+   * @param bytes
+   */
+  void begin(uint8_t *storage, size_t bytes) {
+    storage_ = storage;
+    capacity_ = storage ? bytes / INPUT_RECORD_LEN : 0;
+    clear();
+  }
+
+  /// 記録を消す
+  void clear() {
+    head_ = 0;
+    count_ = 0;
+    overwritten_ = 0;
+  }
+
+  /**
+   * @brief 1回分を記録する。いっぱいなら一番古いものを上書きする
+   *
+   * @param frame
+   */
+  void add(const InputFrame &frame) {
+    if (capacity_ == 0) {
+      return;
+    }
+    uint8_t *p = storage_ + head_ * INPUT_RECORD_LEN;
+    put32(p, frame.time_us);
+    p[4] = (frame.connected & 0x03) | (frame.emergency ? 0x80 : 0);
+    controller::ControllerData pad[2] = {frame.pad[0], frame.pad[1]};
+    pad[0].packBody(p + 5, controller::FORMAT_HIRES);
+    pad[1].packBody(p + 5 + INPUT_RECORD_PAD_LEN, controller::FORMAT_HIRES);
+    head_ = head_ + 1 == capacity_ ? 0 : head_ + 1;
+    if (count_ < capacity_) {
+      count_++;
+    } else {
+      overwritten_++;
+    }
+  }
+
+  /**
+   * @brief 記録を読む
+   *
+   * @param index 0が一番古い。count()未満
+   * @param frame
+   */
+  void read(size_t index, InputFrame &frame) const {
+    const uint8_t *p = at(index);
+    frame.time_us = get32(p);
+    frame.connected = p[4] & 0x03;
+    frame.emergency = (p[4] & 0x80) != 0;
+    frame.pad[0].unpackBody(p + 5, controller::FORMAT_HIRES);
+    frame.pad[1].unpackBody(p + 5 + INPUT_RECORD_PAD_LEN, controller::FORMAT_HIRES);
+  }
+
+  /**
+   * @brief 記録をファイルの形式で書き出す。時刻は書き出す最初の1件からの経過にする
+   *
+   * @tparam Out write(const uint8_t*,size_t)を持つもの
+   * @param out
+   * @param last 書き出す件数の上限(新しいほうから)
+   * @return true
+   * @return false 書ききれなかった
+   */
+  template <class Out> bool save(Out &out, size_t last = (size_t)-1) const {
+    size_t first = count_ > last ? count_ - last : 0;
+    uint8_t header[INPUT_RECORD_HEADER_LEN] = {0};
+    memcpy(header, INPUT_RECORD_MAGIC, 4);
+    header[4] = INPUT_RECORD_VERSION;
+    header[5] = INPUT_RECORD_LEN;
+    put32(header + 8, (uint32_t)(count_ - first));
+    put32(header + 12, overwritten_ + (uint32_t)first);
+    if (out.write(header, sizeof(header)) != sizeof(header)) {
+      return false;
+    }
+    uint32_t origin = count_ > 0 ? get32(at(first)) : 0;
+    for (size_t i = first; i < count_; i++) {
+      uint8_t record[INPUT_RECORD_LEN];
+      memcpy(record, at(i), INPUT_RECORD_LEN);
+      put32(record, get32(record) - origin);
+      if (out.write(record, INPUT_RECORD_LEN) != INPUT_RECORD_LEN) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief ファイルの形式の記録を読み込む。今の記録は消える。入りきらない分は古いほうを捨てる
+   *
+   * @tparam In read(uint8_t*,size_t)を持つもの
+   * @param in
+   * @return true
+   * @return false 形式が違う、または途中で切れている(読めた分は残る)
+   */
+  template <class In> bool load(In &in) {
+    clear();
+    uint8_t header[INPUT_RECORD_HEADER_LEN];
+    if (in.read(header, sizeof(header)) != sizeof(header) ||
+        memcmp(header, INPUT_RECORD_MAGIC, 4) != 0 ||
+        header[4] != INPUT_RECORD_VERSION || header[5] != INPUT_RECORD_LEN ||
+        capacity_ == 0) {
+      return false;
+    }
+    uint32_t n = get32(header + 8);
+    for (uint32_t i = 0; i < n; i++) {
+      uint8_t *p = storage_ + head_ * INPUT_RECORD_LEN;
+      if (in.read(p, INPUT_RECORD_LEN) != INPUT_RECORD_LEN) {
+        return false;
+      }
+      head_ = head_ + 1 == capacity_ ? 0 : head_ + 1;
+      if (count_ < capacity_) {
+        count_++;
+      } else {
+        overwritten_++;
+      }
+    }
+    return true;
+  }
+
+  /// 記録している件数
+  size_t count() const { return count_; }
+  /// 記録できる件数。0ならバッファがない
+  size_t capacity() const { return capacity_; }
+  /// いっぱいになって上書きした件数
+  uint32_t overwritten() const { return overwritten_; }
+
+private:
+  uint8_t *storage_ = nullptr;
+  size_t capacity_ = 0;
+  size_t head_ = 0;
+  size_t count_ = 0;
+  uint32_t overwritten_ = 0;
+
+  const uint8_t *at(size_t index) const {
+    size_t slot = head_ + capacity_ - count_ + index;
+    return storage_ + (slot >= capacity_ ? slot - capacity_ : slot) * INPUT_RECORD_LEN;
+  }
+  static void put32(uint8_t *p, uint32_t v) {
+    for (uint8_t i = 0; i < 4; i++) {
+      p[i] = (uint8_t)(v >> (8 * i));
+    }
+  }
+  static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+           (uint32_t)p[3] << 24;
+  }
+};
+
+/**
+ * @brief 再生の統計
+ *
+ */
+struct ReplayStats {
+  /// 再生した件数
+  uint32_t played = 0;
+  /// 記録の時刻から遅れて渡した最大の時間[us]
+  uint32_t max_late_us = 0;
+};
+
+/**
+ * @brief 記録を元の間隔で取り出す
+ *
+ */
+class InputReplay {
+public:
+  InputReplay(const InputRecorder &recorder) : recorder_(recorder) {}
+
+  /**
+   * @brief 再生を始める。始めた時点の記録を最後まで再生する
+   *
+   * @param now_us
+   * @return true
+   * @return false 記録がない
+   */
+  bool start(uint32_t now_us) {
+    end_ = recorder_.count();
+    if (end_ == 0) {
+      return false;
+    }
+    index_ = 0;
+    stats_ = ReplayStats();
+    InputFrame first;
+    recorder_.read(0, first);
+    // 記録の時刻を今の時刻に置き換えるための差
+    offset_us_ = now_us - first.time_us;
+    running_ = true;
+    return true;
+  }
+
+  void stop() { running_ = false; }
+  bool running() const { return running_; }
+
+  /**
+   * @brief 次の1件の時刻になっていれば取り出す
+   *
+   * @param now_us
+   * @param frame time_usは今の時刻に置き換えた値
+   * @return true 取り出した
+   */
+  bool next(uint32_t now_us, InputFrame &frame) {
+    if (!running_) {
+      return false;
+    }
+    recorder_.read(index_, frame);
+    uint32_t due = frame.time_us + offset_us_;
+    if ((int32_t)(now_us - due) < 0) {
+      return false;
+    }
+    if (now_us - due > stats_.max_late_us) {
+      stats_.max_late_us = now_us - due;
+    }
+    frame.time_us = due;
+    stats_.played++;
+    if (++index_ >= end_) {
+      running_ = false;
+    }
+    return true;
+  }
+
+  const ReplayStats &stats() const { return stats_; }
+  /// 再生する件数
+  size_t length() const { return end_; }
+
+private:
+  const InputRecorder &recorder_;
+  bool running_ = false;
+  size_t index_ = 0;
+  size_t end_ = 0;
+  uint32_t offset_us_ = 0;
+  ReplayStats stats_;
+};
@@ -0,0 +1,319 @@
+/**
+ * @file InterruptButtonManager.h
+ * @brief
+ * GPIO割り込みでボタンの変化を拾うButtonManager。割り込みでは変化した時刻と
+ * レベルをリングバッファに積むだけで、チャタリング除去は読み出す側で行う。
+ * イベントを1つずつ受け取る(待つ・待たない)使い方と、ButtonManagerと同じ
+ * isPressed()/release()の使い方のどちらもできる。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#define BUTTON_ISR_ATTR IRAM_ATTR
+#else
+#define BUTTON_ISR_ATTR
+#endif
+
+/// wait()に渡すと、イベントが来るまで時間切れにしない
+const uint32_t BUTTON_WAIT_FOREVER = 0xffffffff;
+
+/**
+ * @brief チャタリング除去後のボタンイベント
+ *
+ */
+struct ButtonEvent {
+  enum Kind : uint8_t { PRESS, RELEASE } kind;
+  /// add()した順の番号
+  uint8_t index;
+  /// 変化した時刻[us]
+  uint32_t time_us;
+};
+
+/**
+ * @brief ボタンの統計
+ *
+ */
+struct ButtonStats {
+  /// 割り込みで拾った変化の数
+  uint32_t edges = 0;
+  /// チャタリングとして捨てた変化の数
+  uint32_t bounces = 0;
+  /// リングバッファがいっぱいで捨てた変化の数
+  uint32_t overflows = 0;
+  /// 割り込みを取りこぼしていて、ピンを読んで状態を直した回数
+  uint32_t resyncs = 0;
+};
+
+/**
+ * @brief 割り込みで変化を拾うボタン管理
+ *
+ * @tparam N ボタンの数
+ * @tparam Port ピンの設定・読み出し、割り込み、時刻、待ち合わせを提供するクラス
+ * (wait(BUTTON_WAIT_FOREVER)は割り込みから知らされるまで待つ)
+ * @tparam RingSize 変化を溜めるリングバッファの大きさ(2のべき乗)
+ */
+template <uint8_t N, class Port, uint8_t RingSize = 32>
+class BasicInterruptButtonManager {
+  static_assert((RingSize & (RingSize - 1)) == 0, "RingSize must be 2^n");
+
+public:
+  /**
+   * @brief ボタンを追加し割り込みを設定する。ボタンは押すとLOW(プルアップ)
+   *
+   * @param pin
+   * @param debouncetime チャタリングとみなす時間[ms]
+   * @return int ボタンの番号。いっぱいなら-1
+   */
+  int add(uint8_t pin, uint32_t debouncetime) {
+    if (count_ >= N) {
+      return -1;
+    }
+    uint8_t i = count_++;
+    Button &b = btn_[i];
+    b.pin = pin;
+    b.debounce_us = debouncetime * 1000;
+    b.slot.self = this;
+    b.slot.index = i;
+    port_.setup(pin);
+    b.stable = port_.read(pin) == 0;
+    b.lastchange_us = port_.nowUs() - b.debounce_us;
+    port_.attach(pin, onEdge, &b.slot);
+    return i;
+  }
+
+  /**
+   * @brief 次のイベントを待たずに取り出す
+   *
+   * @param e
+   * @return true イベントがあった
+   * @return false なかった
+   */
+  bool poll(ButtonEvent &e) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    while (tail != head_.load(std::memory_order_acquire)) {
+      Edge edge = ring_[tail & (RingSize - 1)];
+      tail_.store(++tail, std::memory_order_release);
+      if (accept(edge.index, edge.level == 0, edge.time_us, e)) {
+        return true;
+      }
+      stats_.bounces++;
+    }
+    return resync(e);
+  }
+
+  /**
+   * @brief 次のイベントを待って取り出す
+   *
+   * @param e
+   * @param timeout_ms BUTTON_WAIT_FOREVERなら時間切れにしない
+   * @return true イベントがあった
+   * @return false 時間切れ
+   */
+  bool wait(ButtonEvent &e, uint32_t timeout_ms) {
+    uint32_t start = port_.nowUs();
+    while (!poll(e)) {
+      uint32_t wait_ms = timeout_ms;
+      if (timeout_ms != BUTTON_WAIT_FOREVER) {
+        uint32_t elapsed_ms = (port_.nowUs() - start) / 1000;
+        if (elapsed_ms >= timeout_ms) {
+          return false;
+        }
+        wait_ms = timeout_ms - elapsed_ms;
+      }
+      // チャタリングとして変化を捨てたボタンは、除去時間が過ぎたときに1回だけピンを読み直す
+      uint32_t resync_ms = untilResync();
+      if (resync_ms < wait_ms) {
+        wait_ms = resync_ms;
+      }
+      port_.wait(wait_ms);
+    }
+    return true;
+  }
+
+  /**
+   * @brief
+   * 溜まっているイベントをすべて処理し、isPressed()などの状態を更新する(ButtonManagerと同じ使い方)
+   *
+   */
+  void update() {
+    ButtonEvent e;
+    while (poll(e)) {
+      Button &b = btn_[e.index];
+      b.rising = e.kind == ButtonEvent::PRESS;
+      b.falling = e.kind == ButtonEvent::RELEASE;
+    }
+  }
+
+  bool isPressed(uint8_t index) const { return btn_[index].rising; }
+  bool isReleased(uint8_t index) const { return btn_[index].falling; }
+  bool isHold(uint8_t index) const { return btn_[index].stable; }
+
+  /**
+   * @brief isPressed(),isReleased()を消す
+   *
+   */
+  void release() {
+    for (uint8_t i = 0; i < count_; i++) {
+      btn_[i].rising = false;
+      btn_[i].falling = false;
+    }
+  }
+
+  Port &port() { return port_; }
+  const ButtonStats &stats() const { return stats_; }
+
+private:
+  struct Slot {
+    BasicInterruptButtonManager *self;
+    uint8_t index;
+  };
+  struct Button {
+    uint8_t pin = 0;
+    uint32_t debounce_us = 0;
+    uint32_t lastchange_us = 0;
+    uint32_t lastedge_us = 0;
+    bool stable = false;
+    /// 変化をチャタリングとして捨てていて、まだピンを読み直していない
+    bool unsettled = false;
+    bool rising = false;
+    bool falling = false;
+    Slot slot;
+  };
+  struct Edge {
+    uint32_t time_us;
+    uint8_t index;
+    uint8_t level;
+  };
+
+  Port port_;
+  Button btn_[N];
+  uint8_t count_ = 0;
+  Edge ring_[RingSize];
+  // headは割り込みだけが、tailは読み出す側だけが進める
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+  std::atomic<uint32_t> overflows_{0};
+  ButtonStats stats_;
+
+  static void BUTTON_ISR_ATTR onEdge(void *arg) {
+    Slot *slot = (Slot *)arg;
+    BasicInterruptButtonManager *self = slot->self;
+    Edge edge;
+    edge.time_us = self->port_.nowUs();
+    edge.index = slot->index;
+    edge.level = self->port_.read(self->btn_[slot->index].pin);
+    uint32_t head = self->head_.load(std::memory_order_relaxed);
+    if (head - self->tail_.load(std::memory_order_acquire) >= RingSize) {
+      self->overflows_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    self->ring_[head & (RingSize - 1)] = edge;
+    self->head_.store(head + 1, std::memory_order_release);
+    self->port_.signalFromIsr();
+  }
+
+  // 変化がチャタリングでなければイベントにする
+  bool accept(uint8_t index, bool pressed, uint32_t time_us, ButtonEvent &e) {
+    Button &b = btn_[index];
+    stats_.edges++;
+    b.lastedge_us = time_us;
+    if (pressed == b.stable || time_us - b.lastchange_us < b.debounce_us) {
+      b.unsettled = true;
+      return false;
+    }
+    b.stable = pressed;
+    b.lastchange_us = time_us;
+    e.kind = pressed ? ButtonEvent::PRESS : ButtonEvent::RELEASE;
+    e.index = index;
+    e.time_us = time_us;
+    return true;
+  }
+
+  // 除去時間が過ぎたのにピンの状態と食い違っていたら直す
+  bool resync(ButtonEvent &e) {
+    stats_.overflows = overflows_.load(std::memory_order_relaxed);
+    uint32_t now = port_.nowUs();
+    for (uint8_t i = 0; i < count_; i++) {
+      Button &b = btn_[i];
+      if (now - b.lastchange_us < b.debounce_us) {
+        continue;
+      }
+      b.unsettled = false;
+      bool pressed = port_.read(b.pin) == 0;
+      if (pressed != b.stable) {
+        // 最後の変化をチャタリングとして捨てていたら、その時刻を使う
+        uint32_t since_edge = b.lastedge_us - b.lastchange_us;
+        uint32_t t = since_edge != 0 && since_edge < now - b.lastchange_us
+                         ? b.lastedge_us
+                         : now;
+        b.stable = pressed;
+        b.lastchange_us = t;
+        e.kind = pressed ? ButtonEvent::PRESS : ButtonEvent::RELEASE;
+        e.index = i;
+        e.time_us = t;
+        stats_.resyncs++;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // 次にピンを読み直すまでの時間[ms]。読み直すボタンがなければBUTTON_WAIT_FOREVER
+  uint32_t untilResync() {
+    uint32_t now = port_.nowUs();
+    uint32_t until_us = BUTTON_WAIT_FOREVER;
+    for (uint8_t i = 0; i < count_; i++) {
+      const Button &b = btn_[i];
+      if (!b.unsettled) {
+        continue;
+      }
+      uint32_t since = now - b.lastchange_us;
+      uint32_t left = since < b.debounce_us ? b.debounce_us - since : 0;
+      if (left < until_us) {
+        until_us = left;
+      }
+    }
+    return until_us == BUTTON_WAIT_FOREVER ? until_us : (until_us + 999) / 1000;
+  }
+};
+
+#ifdef ARDUINO
+/**
+ * @brief ESP32のGPIO割り込みとFreeRTOSのセマフォを使うPort
+ *
+ */
+class ArduinoButtonPort {
+public:
+  ArduinoButtonPort() : signal_(xSemaphoreCreateBinary()){};
+  void setup(uint8_t pin) { pinMode(pin, INPUT_PULLUP); }
+  int read(uint8_t pin) { return digitalRead(pin); }
+  uint32_t nowUs() { return micros(); }
+  void attach(uint8_t pin, void (*isr)(void *), void *arg) {
+    attachInterruptArg(pin, isr, arg, CHANGE);
+  }
+  void signalFromIsr() {
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(signal_, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+  void wait(uint32_t timeout_ms) {
+    xSemaphoreTake(signal_, timeout_ms == BUTTON_WAIT_FOREVER
+                                ? portMAX_DELAY
+                                : pdMS_TO_TICKS(timeout_ms));
+  }
+
+private:
+  SemaphoreHandle_t signal_;
+};
+
+template <uint8_t N>
+using InterruptButtonManager =
+    BasicInterruptButtonManager<N, ArduinoButtonPort>;
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file LatencyTrace.h
+ * @brief
+ * 入力から送信までの遅延の計測。各段階で時刻を記録し、段階間の遅延をヒストグラムに溜める。
+ * LATENCY_TRACEを定義したときだけ有効で、定義しなければマクロは空になり何も残らない。
+ * 時刻はマイクロ秒(ESP32はesp_timer)。CPUのサイクルカウンタはコアごとに別なので、
+ * 別コアのタスクをまたぐ段階間の差には使えない。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief 計測する段階
+ *
+ */
+enum LatencyStage : uint8_t {
+  LAT_I2C_READ, // WiiClassicでデータを読んだ
+  LAT_PACK,     // generate_mudataで送信データにした
+  LAT_HANDOFF,  // Muタスクが受け取った
+  LAT_SEND,     // MUWrapper::sendを呼んだ
+  LAT_TX_DONE,  // UARTの送信が終わった
+  LAT_STAGE_COUNT,
+};
+
+/**
+ * @brief
+ * 2のべき乗幅のビンを持つヒストグラム。ビンiには2^(i-1)以上2^i未満の値が入る(ビン0は0)。
+ * 最後のビンには2^(BINS-2)以上の値がすべて入る。
+ * addは複数タスクから同時に呼んでよい。
+ *
+ */
+class LatencyHistogram {
+public:
+  static constexpr uint8_t BINS = 24;
+
+  void add(uint32_t us) {
+    uint8_t bin = 0;
+    while (bin < BINS - 1 && (us >> bin) != 0) {
+      bin++;
+    }
+    bins_[bin].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    uint32_t max = max_.load(std::memory_order_relaxed);
+    while (us > max &&
+           !max_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+  }
+  void reset() {
+    for (uint8_t i = 0; i < BINS; i++) {
+      bins_[i].store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+  uint32_t bin(uint8_t i) const {
+    return bins_[i].load(std::memory_order_relaxed);
+  }
+  uint32_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint32_t max() const { return max_.load(std::memory_order_relaxed); }
+  /**
+   * @brief 割合pのサンプルがこの値未満に収まる(ビンの上端で近似。最後のビンなら最大値)
+   *
+   * @param permille
+   * @return uint32_t [us]
+   */
+  uint32_t percentile(uint16_t permille) const {
+    uint32_t total = count();
+    uint32_t target = (uint32_t)((uint64_t)total * permille / 1000);
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < BINS; i++) {
+      sum += bin(i);
+      if (sum > target) {
+        return i < BINS - 1 ? (uint32_t)1 << i : max();
+      }
+    }
+    return max();
+  }
+
+  /**
+   * @brief 1行で出力する。outはprintfを持つもの(Serialなど)
+   *
+   * @param out
+   * @param name
+   */
+  template <class Out> void dump(Out &out, const char *name) const {
+    out.printf("%s n=%u p50<%u p99<%u max=%u |", name, count(),
+               percentile(500), percentile(990), max());
+    for (uint8_t i = 0; i < BINS; i++) {
+      out.printf(" %u", bin(i));
+    }
+    out.printf("\n");
+  }
+
+private:
+  std::atomic<uint32_t> bins_[BINS] = {};
+  std::atomic<uint32_t> count_{0};
+  std::atomic<uint32_t> max_{0};
+};
+
+#ifdef LATENCY_TRACE
+#if defined(ARDUINO)
+#include <Arduino.h>
+inline uint32_t latencyNow() { return micros(); }
+#else
+#include <chrono>
+inline uint32_t latencyNow() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+
+/**
+ * @brief 1サンプルが各段階を通過した時刻
+ *
+ */
+struct LatencyStamps {
+  uint32_t t[LAT_STAGE_COUNT];
+};
+
+/**
+ * @brief 段階間の遅延(隣り合う段階の差と、全体)
+ *
+ */
+struct LatencyTrace {
+  LatencyHistogram stage[LAT_STAGE_COUNT - 1];
+  LatencyHistogram total;
+
+  void commit(const LatencyStamps &s) {
+    for (uint8_t i = 0; i + 1 < LAT_STAGE_COUNT; i++) {
+      stage[i].add(s.t[i + 1] - s.t[i]);
+    }
+    total.add(s.t[LAT_STAGE_COUNT - 1] - s.t[0]);
+  }
+  void reset() {
+    for (uint8_t i = 0; i + 1 < LAT_STAGE_COUNT; i++) {
+      stage[i].reset();
+    }
+    total.reset();
+  }
+  template <class Out> void dump(Out &out) const {
+    static const char *const names[LAT_STAGE_COUNT - 1] = {
+        "read->pack", "pack->handoff", "handoff->send", "send->txdone"};
+    for (uint8_t i = 0; i + 1 < LAT_STAGE_COUNT; i++) {
+      stage[i].dump(out, names[i]);
+    }
+    total.dump(out, "read->txdone");
+  }
+};
+
+inline LatencyTrace &latencyTrace() {
+  static LatencyTrace trace;
+  return trace;
+}
+
+// 時刻を記録する構造体に付けるメンバ
+#define LATENCY_FIELD LatencyStamps latency;
+// objが段階stageを通過した時刻を記録
+#define LATENCY_STAMP(obj, stage) ((obj).latency.t[stage] = latencyNow())
+// 時刻を指定して記録
+#define LATENCY_STAMP_AT(obj, stage, us) ((obj).latency.t[stage] = (us))
+// 記録した時刻を別の構造体に引き継ぐ
+#define LATENCY_COPY(dst, src) ((dst).latency = (src).latency)
+// 全段階を通過したのでヒストグラムに入れる
+#define LATENCY_COMMIT(obj) latencyTrace().commit((obj).latency)
+#else
+#define LATENCY_FIELD
+#define LATENCY_STAMP(obj, stage) ((void)0)
+#define LATENCY_STAMP_AT(obj, stage, us) ((void)0)
+#define LATENCY_COPY(dst, src) ((void)0)
+#define LATENCY_COMMIT(obj) ((void)0)
+#endif
@@ -0,0 +1,443 @@
+/**
+ * @file LinkTelemetry.h
+ * @brief
+ * 無線の回線の状態(送ったフレーム数、*IR、MUからの受信の解析エラー、キューで捨てた数、受信電波強度)を
+ * 1秒ごとに記録し、直近TELEMETRY_HISTORY秒分を固定の大きさの配列に残す。
+ * 各所の統計は累計のままLinkCountersにまとめて渡し、1秒分は前回との差から求める
+ * (数える側は今までどおり自分の統計を増やすだけでよい)。
+ * ロボットが反応しなくなる前に回線が悪くなっているのが分かるよう、直近の窓から状態(OK/WARN/BAD)を決める。
+ *
+ * USBに出すバイナリの形式(1秒ごと、リトルエンディアン)
+ * [0xA5][0x5A][種類][データ長][データ...][CRC-8]
+ * CRC-8(FrameCheck.hのcrc8)は種類からデータの最後までにかける。
+ * 種類TELEMETRY_RECORD_SECONDのデータ
+ * [秒の番号 4][送信 2][受信 2][エラーコード1~5の数 2x5][キューで捨てた数 2][上書きで捨てた数 2]
+ * [受信電波強度 1(dBm、測っていなければ-128)][状態 1]
+ * 受信側はTelemetryDecoderに1バイトずつ渡せば、途中から読み始めても区切りを見つけ直す。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "FrameCheck.h"
+#include "MUwrapper.hpp"
+
+/// 1秒ごとの記録を残す秒数
+constexpr uint8_t TELEMETRY_HISTORY = 60;
+/// 受信電波強度を測っていないときの値
+constexpr int8_t TELEMETRY_NO_RSSI = -128;
+
+constexpr uint8_t TELEMETRY_SYNC0 = 0xA5;
+constexpr uint8_t TELEMETRY_SYNC1 = 0x5A;
+constexpr uint8_t TELEMETRY_RECORD_SECOND = 0x01;
+constexpr uint8_t TELEMETRY_SECOND_LEN = 4 + 2 + 2 + 2 * (MU_ERR_COUNT - 1) + 2 + 2 + 1 + 1;
+/// 区切り2バイト、種類、データ長、CRC
+constexpr uint8_t TELEMETRY_RECORD_LEN = 2 + 1 + 1 + TELEMETRY_SECOND_LEN + 1;
+
+/**
+ * @brief 回線の状態
+ *
+ */
+enum LinkHealth : uint8_t {
+  LINK_OK,
+  /// 悪くなり始めている
+  LINK_WARN,
+  /// 届いていない可能性が高い
+  LINK_BAD,
+};
+
+/**
+ * @brief 各所の統計の累計
+ *
+ */
+struct LinkCounters {
+  /// MUに渡したフレーム数
+  uint32_t sent = 0;
+  /// *DRの受信数
+  uint32_t received = 0;
+  /// MUErrorのコードごとの数(MU_ERR_CATCH_IRは*IR)
+  uint32_t errors[MU_ERR_COUNT] = {};
+  /// タスク間のキューが一杯で捨てた受信イベント数
+  uint32_t queue_drops = 0;
+  /// 送る前に新しいフレームで上書きされたフレーム数
+  uint32_t stale_drops = 0;
+};
+
+/**
+ * @brief 1秒分の記録
+ *
+ */
+struct LinkSecond {
+  uint16_t sent;
+  uint16_t received;
+  uint16_t errors[MU_ERR_COUNT];
+  uint16_t queue_drops;
+  uint16_t stale_drops;
+  /// その1秒で一番強かった受信電波強度[dBm]
+  int8_t rssi_dbm;
+
+  /// *IRの数
+  uint16_t txErrors() const { return errors[MU_ERR_CATCH_IR]; }
+  /// *IR以外の解析エラーの数
+  uint16_t parseErrors() const {
+    uint16_t n = 0;
+    for (uint8_t e = MU_ERR_NONE + 1; e < MU_ERR_COUNT; e++) {
+      n += e == MU_ERR_CATCH_IR ? 0 : errors[e];
+    }
+    return n;
+  }
+};
+
+/**
+ * @brief 直近の何秒かの合計
+ *
+ */
+struct LinkWindow {
+  uint8_t seconds = 0;
+  uint32_t sent = 0;
+  uint32_t received = 0;
+  uint32_t tx_errors = 0;
+  uint32_t parse_errors = 0;
+  uint32_t queue_drops = 0;
+  uint32_t stale_drops = 0;
+  /// 一番強かった受信電波強度[dBm] 測っていなければTELEMETRY_NO_RSSI
+  int8_t rssi_max_dbm = TELEMETRY_NO_RSSI;
+
+  /// 送ったフレームのうち*IRが返った割合[‰]
+  uint16_t irPermille() const {
+    return sent ? (uint16_t)((uint64_t)tx_errors * 1000 / sent) : 0;
+  }
+};
+
+/**
+ * @brief 状態を決めるしきい値
+ *
+ */
+struct LinkThresholds {
+  /// 状態を決める窓の長さ[s]
+  uint8_t window_s = 10;
+  /// *IRの割合がこれ以上ならWARN、BAD[‰]
+  uint16_t warn_ir_permille = 50;
+  uint16_t bad_ir_permille = 300;
+  /// 受信電波強度がこれを超えたらWARN(他の送信機の電波や雑音が強い)[dBm]
+  int8_t warn_rssi_dbm = -95;
+};
+
+/**
+ * @brief 画面などに出す要約
+ *
+ */
+struct LinkSummary {
+  LinkHealth health;
+  /// 直近の窓の長さ[s]
+  uint8_t window_s;
+  /// 直近1秒の送信・受信数
+  uint16_t sent;
+  uint16_t received;
+  /// 直近の窓の*IRの割合[‰]
+  uint16_t ir_permille;
+  /// 直近の窓の解析エラー、捨てた数(キューと上書き)
+  uint16_t parse_errors;
+  uint16_t drops;
+  /// 最後に測った受信電波強度[dBm]
+  int8_t rssi_dbm;
+  /// 1秒ごとの送ったフレームのうち*IRが返らなかった割合[%] 古い順。送っていなければ255
+  uint8_t delivered_percent[TELEMETRY_HISTORY];
+};
+
+/**
+ * @brief 回線の状態の記録。1つのタスクから使う
+ *
+ */
+class LinkTelemetry {
+public:
+  LinkTelemetry(const LinkThresholds &thresholds = LinkThresholds())
+      : thresholds_(thresholds) {}
+
+  /**
+   * @brief MUからの応答(MU_EVENT_RESPONSEのデータ)を渡す。@RAの応答なら受信電波強度として使う
+   *
+   * @param data
+   * @param len
+   * @return true @RAの応答だった
+   */
+  bool onResponse(const uint8_t *data, uint8_t len) {
+    if (len != 4 || data[0] != 'R' || data[1] != 'A') {
+      return false;
+    }
+    uint8_t v = 0;
+    for (uint8_t i = 2; i < 4; i++) {
+      uint8_t c = data[i];
+      if (c >= '0' && c <= '9') {
+        v = v << 4 | (c - '0');
+      } else if (c >= 'A' && c <= 'F') {
+        v = v << 4 | (c - 'A' + 10);
+      } else {
+        return true;
+      }
+    }
+    // *RA=xxは-dBmの値
+    onRssi(v > 127 ? -127 : -(int8_t)v);
+    return true;
+  }
+
+  /**
+   * @brief 受信電波強度を渡す。次のsample()の1秒分に入る
+   *
+   * @param dbm
+   */
+  void onRssi(int8_t dbm) {
+    if (dbm > rssi_max_) {
+      rssi_max_ = dbm;
+    }
+    rssi_last_ = dbm;
+  }
+
+  /**
+   * @brief 1秒ごとに呼び、前回からの差を1秒分として記録する
+   *
+   * @param total 各所の統計の累計
+   */
+  void sample(const LinkCounters &total) {
+    LinkSecond &s = history_[head_];
+    if (!started_) {
+      // 最初は基準にするだけ
+      started_ = true;
+      last_ = total;
+      return;
+    }
+    s.sent = delta(total.sent, last_.sent);
+    s.received = delta(total.received, last_.received);
+    for (uint8_t e = 0; e < MU_ERR_COUNT; e++) {
+      s.errors[e] = delta(total.errors[e], last_.errors[e]);
+    }
+    s.queue_drops = delta(total.queue_drops, last_.queue_drops);
+    s.stale_drops = delta(total.stale_drops, last_.stale_drops);
+    s.rssi_dbm = rssi_max_;
+    last_ = total;
+    rssi_max_ = TELEMETRY_NO_RSSI;
+    head_ = (head_ + 1) % TELEMETRY_HISTORY;
+    if (count_ < TELEMETRY_HISTORY) {
+      count_++;
+    }
+    seconds_++;
+  }
+
+  /// 記録した秒数(TELEMETRY_HISTORYまで)
+  uint8_t count() const { return count_; }
+  /// 記録を始めてからの秒数(最新の記録の番号)
+  uint32_t seconds() const { return seconds_; }
+
+  /**
+   * @brief 記録を読む
+   *
+   * @param ago 0が最新。count()未満
+   * @return const LinkSecond&
+   */
+  const LinkSecond &second(uint8_t ago) const {
+    return history_[(head_ + TELEMETRY_HISTORY - 1 - ago) % TELEMETRY_HISTORY];
+  }
+
+  /**
+   * @brief 直近の何秒かを合計する
+   *
+   * @param seconds 記録が足りなければある分だけ
+   * @return LinkWindow
+   */
+  LinkWindow window(uint8_t seconds) const {
+    LinkWindow w;
+    w.seconds = seconds < count_ ? seconds : count_;
+    for (uint8_t i = 0; i < w.seconds; i++) {
+      const LinkSecond &s = second(i);
+      w.sent += s.sent;
+      w.received += s.received;
+      w.tx_errors += s.txErrors();
+      w.parse_errors += s.parseErrors();
+      w.queue_drops += s.queue_drops;
+      w.stale_drops += s.stale_drops;
+      if (s.rssi_dbm > w.rssi_max_dbm) {
+        w.rssi_max_dbm = s.rssi_dbm;
+      }
+    }
+    return w;
+  }
+
+  /// 直近の窓から決めた回線の状態
+  LinkHealth health() const {
+    LinkWindow w = window(thresholds_.window_s);
+    uint16_t ir = w.irPermille();
+    if (ir >= thresholds_.bad_ir_permille) {
+      return LINK_BAD;
+    }
+    if (ir >= thresholds_.warn_ir_permille || w.parse_errors > 0 ||
+        w.queue_drops > 0 || w.rssi_max_dbm > thresholds_.warn_rssi_dbm) {
+      return LINK_WARN;
+    }
+    return LINK_OK;
+  }
+
+  /**
+   * @brief 画面などに出す要約を作る
+   *
+   * @param out
+   */
+  void summarize(LinkSummary &out) const {
+    // 画面は前回と比べて描き直すので、詰め物も含めて毎回同じにする
+    memset(&out, 0, sizeof(out));
+    LinkWindow w = window(thresholds_.window_s);
+    out.health = health();
+    out.window_s = w.seconds;
+    if (count_ > 0) {
+      out.sent = second(0).sent;
+      out.received = second(0).received;
+    }
+    out.ir_permille = w.irPermille();
+    out.parse_errors = clamp16(w.parse_errors);
+    out.drops = clamp16(w.queue_drops + w.stale_drops);
+    out.rssi_dbm = rssi_last_;
+    for (uint8_t i = 0; i < TELEMETRY_HISTORY; i++) {
+      uint8_t ago = TELEMETRY_HISTORY - 1 - i;
+      if (ago >= count_ || second(ago).sent == 0) {
+        out.delivered_percent[i] = 255;
+        continue;
+      }
+      const LinkSecond &s = second(ago);
+      uint16_t ok = s.txErrors() < s.sent ? s.sent - s.txErrors() : 0;
+      out.delivered_percent[i] = (uint8_t)(ok * 100 / s.sent);
+    }
+  }
+
+  /**
+   * @brief 最新の1秒分をUSBに出す形式にする
+   *
+   * @param out TELEMETRY_RECORD_LENバイト以上
+   * @return uint8_t 長さ。まだ記録がなければ0
+   */
+  uint8_t encode(uint8_t *out) const {
+    if (count_ == 0) {
+      return 0;
+    }
+    const LinkSecond &s = second(0);
+    uint8_t *p = out;
+    *p++ = TELEMETRY_SYNC0;
+    *p++ = TELEMETRY_SYNC1;
+    *p++ = TELEMETRY_RECORD_SECOND;
+    *p++ = TELEMETRY_SECOND_LEN;
+    p = put32(p, seconds_);
+    p = put16(p, s.sent);
+    p = put16(p, s.received);
+    for (uint8_t e = MU_ERR_NONE + 1; e < MU_ERR_COUNT; e++) {
+      p = put16(p, s.errors[e]);
+    }
+    p = put16(p, s.queue_drops);
+    p = put16(p, s.stale_drops);
+    *p++ = (uint8_t)s.rssi_dbm;
+    *p++ = health();
+    *p = crc8(out + 2, TELEMETRY_SECOND_LEN + 2);
+    return TELEMETRY_RECORD_LEN;
+  }
+
+private:
+  LinkThresholds thresholds_;
+  LinkSecond history_[TELEMETRY_HISTORY];
+  uint8_t head_ = 0;
+  uint8_t count_ = 0;
+  uint32_t seconds_ = 0;
+  bool started_ = false;
+  LinkCounters last_;
+  int8_t rssi_max_ = TELEMETRY_NO_RSSI;
+  int8_t rssi_last_ = TELEMETRY_NO_RSSI;
+
+  static uint16_t delta(uint32_t now, uint32_t before) {
+    return clamp16(now - before);
+  }
+  static uint16_t clamp16(uint32_t v) { return v > 0xFFFF ? 0xFFFF : (uint16_t)v; }
+  static uint8_t *put16(uint8_t *p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+    return p + 2;
+  }
+  static uint8_t *put32(uint8_t *p, uint32_t v) {
+    return put16(put16(p, v & 0xFFFF), v >> 16);
+  }
+};
+
+/**
+ * @brief USBに出した記録を読むための受信側。PC側のツールやシミュレーターで使う
+ *
+ */
+class TelemetryDecoder {
+public:
+  /**
+   * @brief 1秒分の記録
+   *
+   */
+  struct Record {
+    uint32_t seconds;
+    LinkSecond second;
+    LinkHealth health;
+  };
+
+  /**
+   * @brief 受信した1バイトを渡す
+   *
+   * @param b
+   * @return true 記録を1つ読み終えた(record()で読む)
+   */
+  bool push(uint8_t b) {
+    if (len_ == 0 && b != TELEMETRY_SYNC0) {
+      return false;
+    }
+    if (len_ == 1 && b != TELEMETRY_SYNC1) {
+      len_ = b == TELEMETRY_SYNC0 ? 1 : 0;
+      return false;
+    }
+    if (len_ == 3 && b != TELEMETRY_SECOND_LEN) {
+      // 知らない種類・長さ。区切りを探し直す
+      len_ = 0;
+      return false;
+    }
+    buf_[len_++] = b;
+    if (len_ < TELEMETRY_RECORD_LEN) {
+      return false;
+    }
+    len_ = 0;
+    if (buf_[2] != TELEMETRY_RECORD_SECOND ||
+        crc8(buf_ + 2, TELEMETRY_SECOND_LEN + 2) != buf_[TELEMETRY_RECORD_LEN - 1]) {
+      crc_errors++;
+      return false;
+    }
+    const uint8_t *p = buf_ + 4;
+    record_.seconds = get16(p) | (uint32_t)get16(p + 2) << 16;
+    p += 4;
+    LinkSecond &s = record_.second;
+    memset(&s, 0, sizeof(s));
+    s.sent = get16(p);
+    s.received = get16(p + 2);
+    p += 4;
+    for (uint8_t e = MU_ERR_NONE + 1; e < MU_ERR_COUNT; e++, p += 2) {
+      s.errors[e] = get16(p);
+    }
+    s.queue_drops = get16(p);
+    s.stale_drops = get16(p + 2);
+    s.rssi_dbm = (int8_t)p[4];
+    record_.health = (LinkHealth)p[5];
+    records++;
+    return true;
+  }
+
+  const Record &record() const { return record_; }
+
+  /// 読み終えた記録の数
+  uint32_t records = 0;
+  /// CRCが合わずに捨てた記録の数
+  uint32_t crc_errors = 0;
+
+private:
+  uint8_t buf_[TELEMETRY_RECORD_LEN];
+  uint8_t len_ = 0;
+  Record record_;
+
+  static uint16_t get16(const uint8_t *p) { return (uint16_t)(p[0] | p[1] << 8); }
+};
@@ -1,264 +1,487 @@
-/**
- * @file mu_wrapper.hpp
- * @author K.Fukushima@nnct
- * @brief
- * MUの送信データの生成、受信データの解析を行う。送受信はライブラリ外部で行う。
- * @version 0.1
- * @date 2024-06-01
- * @copyright Copyright (c) 2024 改変自由
- *
- */
-// 
-#ifndef MU_H_
-#define MU_H_
-#include <stdint.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-/**
- * @brief エラーコード、コールバックでエラー発生時、dataのバイト0で通知
- *
- */
-enum MUError : uint8_t {
-  /// エラーなし
-  MU_ERR_NONE = 0,
-  /// 16進数以外の文字が含まれている
-  MU_ERR_LENGTH_NOT_HEX,
-  /// 識別できないコマンド
-  MU_ERR_INVALID_COMMAND,
-  /// IRコマンドを受信（送信エラー）
-  MU_ERR_CATCH_IR,
-  /// 受信データ長が最大値を超えている
-  MU_ERR_LENGTH_TOO_LONG,
-  /// フッタがCRLFでない
-  MU_ERR_TAIL_NOT_CRLF,
-};
-/**
- * @brief MUのコールバック条件
- *
- */
-enum MUEvent : uint8_t { // コールバックで通知されるイベント
-  /// イベントなし
-  MU_EVENT_NONE = 0,
-  /// 送信要求(data,lenに送信バイナリが格納されている)
-  MU_EVENT_SEND_REQUEST,
-  /// 受信完了,dataからデータ読み出し可能
-  MU_EVENT_RX_COMPLETE,
-  /// エラー発生,dataにエラーコード
-  MU_EVENT_ERROR,
-};
-
-/**
- * @brief MUのコールバック関数,イベントとデータを通知
- *
- */
-typedef void (*MUCallback)(MUEvent event, uint8_t *data, uint8_t len);
-
-// コンフィグ
-constexpr uint8_t MU_MAX_DATALEN = 12;
-// 送信データサイズ、
-constexpr uint8_t MU_MAX_COMMANDBUF = MU_MAX_DATALEN + 5;
-
-/**
- * @brief MUのデータ分析、生成を管理するクラス
- *
- */
-class MUWrapper {
-public:
-  /**
-   * @brief クラス生成時に呼び出し、コールバック関数を登録
-   *
-   * @param callback
-   */
-  MUWrapper(MUCallback callback) : callback(callback){};
-  /**
-   * @brief
-   * MUの初期化。チャンネル設定用データの生成とコールバック呼び出しを行う。
-   *
-   * @param ch MUのチャンネル。周波数との対応はMUのデータシートを参照。
-   */
-  void init(uint8_t ch) {
-    setParam("GI", 4);
-    setParam("CH", ch);
-    setParam("DI", 1);
-    setParam("EI", 0);
-  };
-  void setParams(uint8_t gi,uint8_t ch, uint8_t di,uint8_t ei){
-    setParam("GI", gi);
-    setParam("CH", ch);
-    setParam("DI", di);
-    setParam("EI", ei);
-  };
-  /**
-   * @brief
-   * MUからのデータを解析し、コールバックで通知する。エラー発生時はエラー通知を行う。
-   *
-   * @param data UARTからのデータ配列の先頭アドレスを渡す
-   * @param len データ長
-   * @return true 未使用
-   * @return false 未使用
-   */
-  bool pushRawData(uint8_t *data, uint8_t len) {
-    // staticのついた変数は初回実行時のみ初期化され、次回以降は前回実行時の値が保持される
-    static phase_t phase = PHASE_WAIT_HEAD;
-    static char command_char[4] = {0};
-    static char length_char[3] = {0};
-    static uint8_t buf[MU_MAX_DATALEN];
-    static uint8_t length_reported = 0;
-    static uint8_t length = 0;
-    static char footer_char[3] = {0};
-    while (len--) {          // 長さが0になるまで繰り返す
-      uint8_t d = *(data++); // ポインタを進めながらデータを読み出す
-      switch (phase) {       // 読み出しの段階で分岐
-      case PHASE_WAIT_HEAD: // 受信データの頭を検出
-        if (d == '*') {     // 受信開始は'*'で検出
-          phase = PHASE_COMMAND;
-          memset(length_char, 0, 3);
-          memset(command_char, 0, 4);
-          memset(footer_char, 0, 3);
-        }
-        break;
-      case PHASE_COMMAND: // 受信データの種類（エラー・データ受信）の区別
-        if (!((d >= 'A' && d <= 'Z') ||
-              d == '=')) { // コマンドは大文字アルファベットと'='のみ
-          error(MU_ERR_INVALID_COMMAND);
-          phase = PHASE_WAIT_HEAD;
-          break;
-        }
-        strcat(command_char, (char *)&d);
-        if (strncmp(command_char, "DR=", 3)==0) { // データ受信コマンド
-          phase = PHASE_LENGTH;
-          break;
-        }
-        if (strncmp(command_char, "IR", 2)==0) { // IRコマンドは送信エラーを示す
-          phase = PHASE_TAIL;
-          error(MU_ERR_CATCH_IR);
-          break;
-        }
-        if (strlen(command_char) == 3) {
-          error(MU_ERR_INVALID_COMMAND); // 区別されていないコマンド
-          phase = PHASE_WAIT_HEAD; // あきらめて次のデータを待つ
-        }
-        break;
-      case PHASE_LENGTH: // データ長の読み出し
-        if (!((d >= '0' && d <= '9') ||
-              (d >= 'A' && d <= 'F'))) { // データ長は16進数で表される
-          error(MU_ERR_LENGTH_NOT_HEX); // 不適切なデータ
-          phase = PHASE_WAIT_HEAD;
-          break;
-        }
-        strcat(length_char, (char *)&d); // 文字列に追加
-        if (strlen(length_char) == 2) {  // データ長は必ず2文字
-          phase = PHASE_DATA;
-          length_reported = (uint8_t)strtol(length_char, NULL,
-                                            16); // 16進数文字列を数値に変換
-          if (length_reported >
-              MU_MAX_DATALEN) { // データ長が設定の最大値を超えている
-            error(MU_ERR_LENGTH_TOO_LONG);
-            phase = PHASE_WAIT_HEAD;
-            break;
-          }
-          length = 0;
-        }
-        break;
-      case PHASE_DATA:     // データ部分の読み出し
-        buf[length++] = d; // 代入後にインクリメント
-        if (length_reported == length) {
-          phase =
-              PHASE_TAIL_HASDATA; // データ後に改行コードのフッタがあるためフッタ検出まで待機
-        }
-        break;
-      case PHASE_TAIL:         // 改行コード検出
-      case PHASE_TAIL_HASDATA: // データ後の改行コード検出
-        strcat(footer_char, (char *)&d);
-        if (strlen(footer_char) == 2) {
-          if (strncmp(footer_char, "\r\n", 2)==0) {
-            // 受信完了後の処理を書く
-            if (phase == PHASE_TAIL_HASDATA) { // データありの場合はデータを通知
-              callback(MU_EVENT_RX_COMPLETE, buf, length_reported);
-            }
-            phase = PHASE_WAIT_HEAD;
-            break;
-          }
-          error(MU_ERR_TAIL_NOT_CRLF); // 改行コードがCRLFでない！？
-        }
-        break;
-      }
-    }
-    return true;
-  }
-  /**
-   * @brief
-   * MUへのデータ送信。送信用データの生成と送信コールバック呼び出しを行う。
-   *
-   * @param data
-   * @param len
-   * @return true
-   * @return false
-   */
-  bool send(uint8_t *data, uint8_t len) { // MUにデータ送信
-    uint8_t buf[6] = {0};
-    sprintf((char *)buf, "@DT%02X", len);
-    callback(MU_EVENT_SEND_REQUEST, buf, 5);
-    callback(MU_EVENT_SEND_REQUEST, data, len);
-    sprintf((char *)buf, "\r\n");
-    callback(MU_EVENT_SEND_REQUEST, buf, 2);
-    return true;
-  }
-
-private:
-  /**
-   * @brief データの解析の段階
-   *
-   */
-  enum phase_t : uint8_t {
-    PHASE_WAIT_HEAD,
-    PHASE_COMMAND,
-    PHASE_LENGTH,
-    PHASE_DATA,
-    PHASE_TAIL,
-    PHASE_TAIL_HASDATA,
-  };
-  /**
-   * @brief コールバック関数のポインタ保管
-   *
-   */
-  MUCallback callback = nullptr;
-  /**
-   * @brief 設定などのコマンド生成
-   *
-   * @param command
-   * @param value
-   * @param valueLength
-   */
-  void sendCommand(const char command[3], char *value, uint8_t valueLength) {
-    uint8_t buffer[16];
-    buffer[0] = (uint8_t)'@';
-    memcpy(buffer + 1, command, 2);
-    memcpy(buffer + 3, value, valueLength);
-    buffer[3 + valueLength] = '\r';
-    buffer[4 + valueLength] = '\n';
-    callback(MU_EVENT_SEND_REQUEST, buffer, 5 + valueLength);
-  }
-  /**
-   * @brief チャンネルなどパラメータの設定
-   *
-   * @param param
-   * @param value
-   */
-  void setParam(const char param[3], uint8_t value) {
-    char value_char[3] = {0};
-    sprintf(value_char, "%02X", value);
-    sendCommand(param, value_char, 2);
-  }
-  /**
-   * @brief エラー通知
-   *
-   * @param e
-   */
-  void error(MUError e) {
-    uint8_t err = (uint8_t)e;
-    callback(MU_EVENT_ERROR, &err, 1);
-  }
-};
-#endif /* MU_H_ */
+/**
+ * @file mu_wrapper.hpp
+ * @author K.Fukushima@nnct
+ * @brief
+ * MUの送信データの生成、受信データの解析を行う。送受信はライブラリ外部で行う。
+ * @version 0.1
+ * @date 2024-06-01
+ * @copyright Copyright (c) 2024 改変自由
+ *
+ */
+// 
+#ifndef MU_H_
+#define MU_H_
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/**
+ * @brief エラーコード、コールバックでエラー発生時、dataのバイト0で通知
+ *
+ */
+enum MUError : uint8_t {
+  /// エラーなし
+  MU_ERR_NONE = 0,
+  /// 16進数以外の文字が含まれている
+  MU_ERR_LENGTH_NOT_HEX,
+  /// 識別できないコマンド
+  MU_ERR_INVALID_COMMAND,
+  /// IRコマンドを受信（送信エラー）
+  MU_ERR_CATCH_IR,
+  /// 受信データ長が最大値を超えている
+  MU_ERR_LENGTH_TOO_LONG,
+  /// フッタがCRLFでない
+  MU_ERR_TAIL_NOT_CRLF,
+  /// エラーコードの数(コードごとに数えるときの配列の大きさ)
+  MU_ERR_COUNT,
+};
+/**
+ * @brief MUのコールバック条件
+ *
+ */
+enum MUEvent : uint8_t { // コールバックで通知されるイベント
+  /// イベントなし
+  MU_EVENT_NONE = 0,
+  /// 送信要求(data,lenに送信バイナリが格納されている)
+  MU_EVENT_SEND_REQUEST,
+  /// 受信完了,dataからデータ読み出し可能
+  MU_EVENT_RX_COMPLETE,
+  /// エラー発生,dataにエラーコード
+  MU_EVENT_ERROR,
+  /// コマンド応答受信('*CH=08'など),dataにコマンド2文字と'='以降の値
+  MU_EVENT_RESPONSE,
+};
+
+/**
+ * @brief MUのコールバック関数,イベントとデータを通知
+ *
+ */
+typedef void (*MUCallback)(MUEvent event, uint8_t *data, uint8_t len);
+/**
+ * @brief 登録時のポインタを一緒に受け取るコールバック関数。複数のMUを扱うときに使う
+ *
+ */
+typedef void (*MUContextCallback)(void *context, MUEvent event, uint8_t *data,
+                                  uint8_t len);
+
+// コンフィグ
+constexpr uint8_t MU_MAX_DATALEN = 12;
+// 送信データサイズ、"@DT"+データ長2文字+データ+CRLF
+constexpr uint8_t MU_MAX_COMMANDBUF = MU_MAX_DATALEN + 7;
+// 数値を16進数文字に変換する表
+constexpr char MU_HEX_DIGITS[] = "0123456789ABCDEF";
+
+/**
+ * @brief MUのデータ分析、生成を管理するクラス
+ *
+ */
+class MUWrapper {
+public:
+  /**
+   * @brief クラス生成時に呼び出し、コールバック関数を登録
+   *
+   * @param callback
+   */
+  MUWrapper(MUCallback callback) : callback(callback){};
+  /**
+   * @brief コールバック関数と、コールバックに渡すポインタを登録
+   *
+   * @param callback
+   * @param context コールバックの第1引数になる
+   */
+  MUWrapper(MUContextCallback callback, void *context)
+      : context_callback(callback), context(context){};
+  /**
+   * @brief
+   * MUの初期化。チャンネル設定用データの生成とコールバック呼び出しを行う。
+   *
+   * @param ch MUのチャンネル。周波数との対応はMUのデータシートを参照。
+   */
+  void init(uint8_t ch) {
+    setParam("GI", 4);
+    setParam("CH", ch);
+    setParam("DI", 1);
+    setParam("EI", 0);
+  };
+  void setParams(uint8_t gi,uint8_t ch, uint8_t di,uint8_t ei){
+    setParam("GI", gi);
+    setParam("CH", ch);
+    setParam("DI", di);
+    setParam("EI", ei);
+  };
+  /**
+   * @brief
+   * パラメータを1つ設定する。応答(*CH=0Eなど)はMU_EVENT_RESPONSEで"CH0E"として通知される。
+   *
+   * @param param "GI","CH","DI","EI"など
+   * @param value
+   */
+  void configure(const char param[3], uint8_t value) { setParam(param, value); }
+  /**
+   * @brief
+   * 値のないコマンド(@RAなど)を送る。応答(*RA=5Aなど)はMU_EVENT_RESPONSEで"RA5A"として通知される。
+   *
+   * @param command
+   */
+  void query(const char command[3]) {
+    uint8_t none = 0;
+    sendCommand(command, &none, 0);
+  }
+  /**
+   * @brief
+   * MUからのデータを解析し、コールバックで通知する。エラー発生時はエラー通知を行う。
+   * 解析の状態はインスタンスごとに保持されるため、複数のMUを同時に扱える。
+   * 任意の長さに分割されたデータを渡してよい(フレームの途中で切れていても続きから解析する)。
+   *
+   * @param data UARTからのデータ配列の先頭アドレスを渡す
+   * @param len データ長
+   * @return true 未使用
+   * @return false 未使用
+   */
+  bool pushRawData(const uint8_t *data, size_t len) {
+    const uint8_t *end = data + len;
+    while (data < end) {
+      if (phase == PHASE_DATA) { // データ部分はまとめてコピー
+        size_t n = (size_t)(end - data);
+        if (n > (size_t)(length_reported - length)) {
+          n = length_reported - length;
+        }
+        memcpy(buf + length, data, n);
+        data += n;
+        length += n;
+        if (length == length_reported) {
+          phase = PHASE_TAIL_CR; // データ後に改行コードのフッタがあるためフッタ検出まで待機
+        }
+        continue;
+      }
+      uint8_t d = *(data++); // ポインタを進めながらデータを読み出す
+      const transition_t &t = transition(phase, d);
+      if (t.err != MU_ERR_NONE) { // 遷移表にない文字
+        error(t.err);
+        phase = (d == '*') ? PHASE_CMD0 : PHASE_WAIT_HEAD; // '*'なら次のフレームとして読み直す
+        continue;
+      }
+      switch (phase) { // 遷移前の段階ごとの処理
+      case PHASE_CMD0:
+        command_char[0] = d;
+        break;
+      case PHASE_CMD1:
+        command_char[1] = d;
+        length = 0;
+        if (command_char[0] == 'D' && command_char[1] == 'R') { // データ受信コマンド
+          phase = PHASE_DR_EQ;
+          continue;
+        }
+        break;
+      case PHASE_LEN_HI:
+        length_reported = hexValue(d) << 4;
+        break;
+      case PHASE_LEN_LO:
+        length_reported |= hexValue(d);
+        if (length_reported > MU_MAX_DATALEN) { // データ長が設定の最大値を超えている
+          error(MU_ERR_LENGTH_TOO_LONG);
+          phase = PHASE_WAIT_HEAD;
+          continue;
+        }
+        if (length_reported == 0) {
+          phase = PHASE_TAIL_CR;
+          continue;
+        }
+        break;
+      case PHASE_RESP: // '*IR=03'などの応答本体
+        if ((d == '=' && length == 0) || d == '\r') { // '='とフッタのCRは含めない
+          break;
+        }
+        if (length >= MU_MAX_DATALEN - 2) { // 先頭2バイトはコマンド用
+          error(MU_ERR_LENGTH_TOO_LONG);
+          phase = PHASE_WAIT_HEAD;
+          continue;
+        }
+        buf[2 + length++] = d;
+        break;
+      case PHASE_TAIL_LF:
+        complete();
+        break;
+      default:
+        break;
+      }
+      phase = t.next;
+    }
+    return true;
+  }
+  /**
+   * @brief
+   * MUへのデータ送信。送信用データの生成と送信コールバック呼び出しを行う。
+   * フレーム全体を1つのバッファに組み立て、コールバックは1フレームにつき1回だけ呼ばれる。
+   *
+   * @param data
+   * @param len MU_MAX_DATALEN以下
+   * @return true
+   * @return false データ長が最大値を超えている
+   */
+  bool send(const uint8_t *data, uint8_t len) { // MUにデータ送信
+    if (len > MU_MAX_DATALEN) {
+      return false;
+    }
+    notify(MU_EVENT_SEND_REQUEST, txbuf, encode(txbuf, data, len));
+    return true;
+  }
+  /**
+   * @brief
+   * 送信フレーム"@DTxx<data>\r\n"を呼び出し側のバッファに組み立てる。
+   *
+   * @param out len+7バイト以上のバッファ
+   * @param data
+   * @param len
+   * @return uint8_t 組み立てたフレームの長さ
+   */
+  static uint8_t encode(uint8_t *out, const uint8_t *data, uint8_t len) {
+    uint8_t value[2] = {(uint8_t)MU_HEX_DIGITS[len >> 4],
+                        (uint8_t)MU_HEX_DIGITS[len & 0x0F]};
+    uint8_t n = encodeCommand(out, "DT", value, 2, false);
+    memcpy(out + n, data, len);
+    n += len;
+    out[n++] = '\r';
+    out[n++] = '\n';
+    return n;
+  }
+  /**
+   * @brief
+   * 設定コマンド"@XXvalue\r\n"を呼び出し側のバッファに組み立てる。
+   *
+   * @param out valueLength+5バイト以上のバッファ
+   * @param command コマンド2文字
+   * @param value
+   * @param valueLength
+   * @param crlf falseならフッタを付けない(@DTのデータ部を後ろに続けるとき)
+   * @return uint8_t 組み立てたフレームの長さ
+   */
+  static uint8_t encodeCommand(uint8_t *out, const char command[3],
+                               const uint8_t *value, uint8_t valueLength,
+                               bool crlf = true) {
+    out[0] = (uint8_t)'@';
+    out[1] = (uint8_t)command[0];
+    out[2] = (uint8_t)command[1];
+    memcpy(out + 3, value, valueLength);
+    uint8_t n = 3 + valueLength;
+    if (crlf) {
+      out[n++] = '\r';
+      out[n++] = '\n';
+    }
+    return n;
+  }
+
+private:
+  /**
+   * @brief データの解析の段階
+   *
+   */
+  enum phase_t : uint8_t {
+    PHASE_WAIT_HEAD,
+    PHASE_CMD0,
+    PHASE_CMD1,
+    PHASE_DR_EQ,
+    PHASE_LEN_HI,
+    PHASE_LEN_LO,
+    PHASE_DATA,
+    PHASE_RESP,
+    PHASE_TAIL_CR,
+    PHASE_TAIL_LF,
+    PHASE_COUNT,
+  };
+  /**
+   * @brief 文字の種類。遷移表の列になる
+   *
+   */
+  enum charclass_t : uint8_t {
+    CC_STAR,   // '*'
+    CC_HEX,    // 'A'~'F'
+    CC_UPPER,  // 'G'~'Z'
+    CC_DIGIT,  // '0'~'9'
+    CC_EQUAL,  // '='
+    CC_CR,     // '\r'
+    CC_LF,     // '\n'
+    CC_OTHER,
+    CC_COUNT,
+  };
+  /**
+   * @brief 遷移表の要素。errがMU_ERR_NONE以外ならエラー通知して先頭待ちに戻る
+   *
+   */
+  struct transition_t {
+    phase_t next;
+    MUError err;
+  };
+  static constexpr charclass_t classify(uint8_t c) {
+    return c == '*'               ? CC_STAR
+           : (c >= 'A' && c <= 'F') ? CC_HEX
+           : (c >= 'G' && c <= 'Z') ? CC_UPPER
+           : (c >= '0' && c <= '9') ? CC_DIGIT
+           : c == '='               ? CC_EQUAL
+           : c == '\r'              ? CC_CR
+           : c == '\n'              ? CC_LF
+                                    : CC_OTHER;
+  }
+  /**
+   * @brief 現在の段階と受信文字から次の段階を引く
+   *
+   * @param p 現在の段階
+   * @param c 受信文字
+   * @return const transition_t&
+   */
+  static const transition_t &transition(phase_t p, uint8_t c) {
+#define MU_CC4(n) classify(n), classify(n + 1), classify(n + 2), classify(n + 3)
+#define MU_CC16(n) MU_CC4(n), MU_CC4(n + 4), MU_CC4(n + 8), MU_CC4(n + 12)
+#define MU_CC64(n) MU_CC16(n), MU_CC16(n + 16), MU_CC16(n + 32), MU_CC16(n + 48)
+    static constexpr charclass_t char_class[256] = {
+        MU_CC64(0), MU_CC64(64), MU_CC64(128), MU_CC64(192)};
+#undef MU_CC64
+#undef MU_CC16
+#undef MU_CC4
+    // エラー時の遷移先はpushRawData側で決めるため、nextは使われない
+#define MU_ERR(e) {PHASE_WAIT_HEAD, e}
+#define MU_GO(p) {p, MU_ERR_NONE}
+    static constexpr transition_t table[PHASE_COUNT][CC_COUNT] = {
+        // '*', 'A'~'F', 'G'~'Z', '0'~'9', '=', CR, LF, その他
+        {// PHASE_WAIT_HEAD 受信開始は'*'で検出
+         MU_GO(PHASE_CMD0), MU_GO(PHASE_WAIT_HEAD), MU_GO(PHASE_WAIT_HEAD),
+         MU_GO(PHASE_WAIT_HEAD), MU_GO(PHASE_WAIT_HEAD), MU_GO(PHASE_WAIT_HEAD),
+         MU_GO(PHASE_WAIT_HEAD), MU_GO(PHASE_WAIT_HEAD)},
+        {// PHASE_CMD0 コマンドは大文字アルファベット2文字
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_GO(PHASE_CMD1), MU_GO(PHASE_CMD1),
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_ERR(MU_ERR_INVALID_COMMAND),
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_ERR(MU_ERR_INVALID_COMMAND),
+         MU_ERR(MU_ERR_INVALID_COMMAND)},
+        {// PHASE_CMD1 'DR'以外は応答として本体を読む
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_GO(PHASE_RESP), MU_GO(PHASE_RESP),
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_ERR(MU_ERR_INVALID_COMMAND),
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_ERR(MU_ERR_INVALID_COMMAND),
+         MU_ERR(MU_ERR_INVALID_COMMAND)},
+        {// PHASE_DR_EQ
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_ERR(MU_ERR_INVALID_COMMAND),
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_ERR(MU_ERR_INVALID_COMMAND),
+         MU_GO(PHASE_LEN_HI), MU_ERR(MU_ERR_INVALID_COMMAND),
+         MU_ERR(MU_ERR_INVALID_COMMAND), MU_ERR(MU_ERR_INVALID_COMMAND)},
+        {// PHASE_LEN_HI データ長は16進数2文字
+         MU_ERR(MU_ERR_LENGTH_NOT_HEX), MU_GO(PHASE_LEN_LO),
+         MU_ERR(MU_ERR_LENGTH_NOT_HEX), MU_GO(PHASE_LEN_LO),
+         MU_ERR(MU_ERR_LENGTH_NOT_HEX), MU_ERR(MU_ERR_LENGTH_NOT_HEX),
+         MU_ERR(MU_ERR_LENGTH_NOT_HEX), MU_ERR(MU_ERR_LENGTH_NOT_HEX)},
+        {// PHASE_LEN_LO
+         MU_ERR(MU_ERR_LENGTH_NOT_HEX), MU_GO(PHASE_DATA),
+         MU_ERR(MU_ERR_LENGTH_NOT_HEX), MU_GO(PHASE_DATA),
+         MU_ERR(MU_ERR_LENGTH_NOT_HEX), MU_ERR(MU_ERR_LENGTH_NOT_HEX),
+         MU_ERR(MU_ERR_LENGTH_NOT_HEX), MU_ERR(MU_ERR_LENGTH_NOT_HEX)},
+        {// PHASE_DATA pushRawData内でまとめて処理するため未使用
+         MU_GO(PHASE_DATA), MU_GO(PHASE_DATA), MU_GO(PHASE_DATA),
+         MU_GO(PHASE_DATA), MU_GO(PHASE_DATA), MU_GO(PHASE_DATA),
+         MU_GO(PHASE_DATA), MU_GO(PHASE_DATA)},
+        {// PHASE_RESP CRまで読む
+         MU_GO(PHASE_RESP), MU_GO(PHASE_RESP), MU_GO(PHASE_RESP),
+         MU_GO(PHASE_RESP), MU_GO(PHASE_RESP), MU_GO(PHASE_TAIL_LF),
+         MU_ERR(MU_ERR_TAIL_NOT_CRLF), MU_GO(PHASE_RESP)},
+        {// PHASE_TAIL_CR
+         MU_ERR(MU_ERR_TAIL_NOT_CRLF), MU_ERR(MU_ERR_TAIL_NOT_CRLF),
+         MU_ERR(MU_ERR_TAIL_NOT_CRLF), MU_ERR(MU_ERR_TAIL_NOT_CRLF),
+         MU_ERR(MU_ERR_TAIL_NOT_CRLF), MU_GO(PHASE_TAIL_LF),
+         MU_ERR(MU_ERR_TAIL_NOT_CRLF), MU_ERR(MU_ERR_TAIL_NOT_CRLF)},
+        {// PHASE_TAIL_LF
+         MU_ERR(MU_ERR_TAIL_NOT_CRLF), MU_ERR(MU_ERR_TAIL_NOT_CRLF),
+         MU_ERR(MU_ERR_TAIL_NOT_CRLF), MU_ERR(MU_ERR_TAIL_NOT_CRLF),
+         MU_ERR(MU_ERR_TAIL_NOT_CRLF), MU_ERR(MU_ERR_TAIL_NOT_CRLF),
+         MU_GO(PHASE_WAIT_HEAD), MU_ERR(MU_ERR_TAIL_NOT_CRLF)},
+    };
+#undef MU_GO
+#undef MU_ERR
+    return table[p][char_class[c]];
+  }
+  // 解析の状態。インスタンスごとに持つ
+  phase_t phase = PHASE_WAIT_HEAD;
+  uint8_t command_char[2] = {0};
+  uint8_t buf[MU_MAX_DATALEN] = {0};
+  uint8_t length_reported = 0;
+  uint8_t length = 0;
+  /**
+   * @brief コールバック関数のポインタ保管
+   *
+   */
+  MUCallback callback = nullptr;
+  MUContextCallback context_callback = nullptr;
+  void *context = nullptr;
+  /**
+   * @brief 登録されたコールバック関数を呼び出す
+   *
+   * @param event
+   * @param data
+   * @param len
+   */
+  void notify(MUEvent event, uint8_t *data, uint8_t len) {
+    if (context_callback) {
+      context_callback(context, event, data, len);
+      return;
+    }
+    callback(event, data, len);
+  }
+  /**
+   * @brief 送信フレームの組み立て用バッファ
+   *
+   */
+  uint8_t txbuf[MU_MAX_COMMANDBUF] = {0};
+  /**
+   * @brief 設定などのコマンド生成
+   *
+   * @param command
+   * @param value
+   * @param valueLength
+   */
+  void sendCommand(const char command[3], const uint8_t *value, uint8_t valueLength) {
+    notify(MU_EVENT_SEND_REQUEST, txbuf,
+             encodeCommand(txbuf, command, value, valueLength));
+  }
+  /**
+   * @brief チャンネルなどパラメータの設定
+   *
+   * @param param
+   * @param value
+   */
+  void setParam(const char param[3], uint8_t value) {
+    uint8_t value_char[2] = {(uint8_t)MU_HEX_DIGITS[value >> 4],
+                             (uint8_t)MU_HEX_DIGITS[value & 0x0F]};
+    sendCommand(param, value_char, 2);
+  }
+  /**
+   * @brief 16進数1文字を数値に変換(文字種は遷移表で確認済み)
+   *
+   * @param c
+   * @return uint8_t
+   */
+  static uint8_t hexValue(uint8_t c) { return c <= '9' ? c - '0' : c - 'A' + 10; }
+  /**
+   * @brief フッタまで受信したフレームの通知
+   *
+   */
+  void complete() {
+    if (command_char[0] == 'D' && command_char[1] == 'R') { // データありの場合はデータを通知
+      notify(MU_EVENT_RX_COMPLETE, buf, length_reported);
+      return;
+    }
+    if (command_char[0] == 'I' && command_char[1] == 'R') { // IRコマンドは送信エラーを示す
+      error(MU_ERR_CATCH_IR);
+      return;
+    }
+    // それ以外は設定・送信コマンドへの応答
+    buf[0] = command_char[0];
+    buf[1] = command_char[1];
+    notify(MU_EVENT_RESPONSE, buf, 2 + length);
+  }
+  /**
+   * @brief エラー通知
+   *
+   * @param e
+   */
+  void error(MUError e) {
+    uint8_t err = (uint8_t)e;
+    notify(MU_EVENT_ERROR, &err, 1);
+  }
+};
+#endif /* MU_H_ */
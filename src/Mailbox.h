@@ -0,0 +1,65 @@
+/**
+ * @file Mailbox.h
+ * @brief
+ * タスク間で最新の値だけを受け渡す箱(トリプルバッファ)。書き込み1タスク・読み出し1タスク用。
+ * 書き込みも読み出しも待たずに終わり、書き込み側は最新の値を失わず、
+ * 読み出し側は新しい値があれば必ずそれを受け取る(途中まで書かれた値を読むことはない)。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+template <typename T> class Mailbox {
+public:
+  /**
+   * @brief 値を書き込む。読まれていない前の値は上書きされる
+   *
+   * @param value
+   */
+  void publish(const T &value) {
+    slots_[back_] = value;
+    uint32_t old = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel);
+    back_ = old & INDEX;
+    published_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief 前回読んでから新しい値が書かれていれば読み出す
+   *
+   * @param out 新しい値がなければ変更しない
+   * @return true 新しい値を読んだ
+   * @return false 新しい値はない
+   */
+  bool read(T &out) {
+    if (!(middle_.load(std::memory_order_acquire) & FRESH)) {
+      return false;
+    }
+    uint32_t old = middle_.exchange(front_, std::memory_order_acq_rel);
+    front_ = old & INDEX;
+    out = slots_[front_];
+    return true;
+  }
+
+  /**
+   * @brief 書き込まれた回数(読まれずに上書きされた分も含む)
+   *
+   * @return uint32_t
+   */
+  uint32_t published() const {
+    return published_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static constexpr uint32_t INDEX = 0x03;
+  static constexpr uint32_t FRESH = 0x04;
+  T slots_[3] = {};
+  // 書き込み側だけが使う
+  uint32_t back_ = 0;
+  // 受け渡し用。下位2ビットが番号、FRESHは未読の印
+  std::atomic<uint32_t> middle_{1};
+  // 読み出し側だけが使う
+  uint32_t front_ = 2;
+  std::atomic<uint32_t> published_{0};
+};
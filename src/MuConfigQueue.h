@@ -0,0 +1,233 @@
+/**
+ * @file MuConfigQueue.h
+ * @brief
+ * MUの設定(@GI/@CH/@DI/@EI)を動作中に変えるためのコマンドキュー。
+ * 今の設定と新しい設定の差分だけを1つずつ送り、応答(*GI=04など)を待ってから次を送る。
+ * 応答を待つ間もコントローラーのデータはそのまま送り続けられる(待つのはこのキューだけ)。
+ * MUはコマンドを順に処理するので、送信待ちの@DTがあると応答はその後になる。
+ * 応答が来ないときは送り直し、決めた回数でだめならあきらめて、その設定は次のapply()まで送らない。
+ * *ERは前に送った別のコマンド(@DTなど)への応答のこともあるので、それだけでは送り直さない。
+ * 1つのタスクから使う。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include "LatencyTrace.h"
+#include "MUwrapper.hpp"
+
+/**
+ * @brief MUの設定
+ *
+ */
+struct MuConfig {
+  /// グループID
+  uint8_t gi;
+  /// 周波数チャンネル
+  uint8_t ch;
+  /// 宛先ID
+  uint8_t di;
+  /// 機器ID
+  uint8_t ei;
+};
+
+/**
+ * @brief 設定変更の統計
+ *
+ */
+struct MuConfigStats {
+  /// 設定し終えた回数
+  uint32_t switches = 0;
+  /// 送ったコマンド数(送り直しを含む)
+  uint32_t commands = 0;
+  /// 応答が来ずに送り直した数
+  uint32_t retries = 0;
+  /// 送り直してもだめであきらめた数
+  uint32_t failures = 0;
+  /// 最後に設定し終えたときの、apply()してからすべての応答が来るまで[us]
+  uint32_t last_switch_us = 0;
+  /// apply()してからすべての応答が来るまで[us]
+  LatencyHistogram time_to_switch;
+};
+
+/**
+ * @brief MUの設定変更のコマンドキュー
+ *
+ */
+class MuConfigQueue {
+public:
+  static constexpr uint8_t PARAM_COUNT = 4;
+
+  /**
+   * @brief
+   *
+   * @param current MUの今の設定(MUWrapper::initで設定した値)
+   * @param timeout_us 応答を待つ時間[us]
+   * @param max_attempts 1つのコマンドを送る回数の上限
+   */
+  MuConfigQueue(const MuConfig &current, uint32_t timeout_us,
+                uint8_t max_attempts)
+      : timeout_us_(timeout_us), max_attempts_(max_attempts) {
+    toArray(current, current_);
+    toArray(current, target_);
+  }
+
+  /**
+   * @brief 新しい設定を渡す。今の設定と違うものだけを送る
+   *
+   * @param target
+   * @param now_us
+   */
+  void apply(const MuConfig &target, uint32_t now_us) {
+    toArray(target, target_);
+    if (!busy()) {
+      return;
+    }
+    if (!switching_) {
+      switching_ = true;
+      since_us_ = now_us;
+    }
+  }
+
+  /**
+   * @brief 今送るコマンドがあれば送る。ループで毎回呼ぶ
+   *
+   * @param mu
+   * @param now_us
+   * @return true コマンドを送った
+   */
+  bool poll(MUWrapper &mu, uint32_t now_us) {
+    if (in_flight_ >= 0) {
+      if (now_us - sent_us_ < timeout_us_) {
+        return false;
+      }
+      stats_.retries++;
+      retry();
+    }
+    for (uint8_t i = 0; i < PARAM_COUNT; i++) {
+      if (pending(i)) {
+        in_flight_ = i;
+        value_ = target_[i];
+        sent_us_ = now_us;
+        attempts_++;
+        stats_.commands++;
+        mu.configure(name(i), value_);
+        return true;
+      }
+    }
+    if (switching_) {
+      switching_ = false;
+      if (failed_mask_ == 0) {
+        stats_.switches++;
+        stats_.last_switch_us = now_us - since_us_;
+        stats_.time_to_switch.add(stats_.last_switch_us);
+      }
+      failed_mask_ = 0;
+    }
+    return false;
+  }
+
+  /**
+   * @brief MUからの応答(MU_EVENT_RESPONSEのデータ。"CH0E"など)を渡す
+   *
+   * @param data
+   * @param len
+   * @return true 待っていた応答だった
+   */
+  bool onResponse(const uint8_t *data, uint8_t len) {
+    if (in_flight_ < 0 || len < 2) {
+      return false;
+    }
+    // *ERは送ったコマンドへの応答とは限らない。本当に失敗していれば時間切れで送り直す
+    const char *param = name(in_flight_);
+    if (data[0] != param[0] || data[1] != param[1]) {
+      return false;
+    }
+    current_[in_flight_] = value_;
+    unknown_mask_ &= ~(1 << in_flight_);
+    in_flight_ = -1;
+    attempts_ = 0;
+    return true;
+  }
+
+  /// 送っていない・応答を待っている設定があるか
+  bool busy() const {
+    if (in_flight_ >= 0) {
+      return true;
+    }
+    for (uint8_t i = 0; i < PARAM_COUNT; i++) {
+      if (pending(i)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief
+   * MUの設定がわからなくなったとき(ほかで@CHを送って応答がなかったなど)に呼ぶ。
+   * 今の設定と同じでも、その設定を送り直す
+   *
+   * @param param "GI","CH","DI","EI"
+   * @param now_us
+   */
+  void invalidate(const char param[3], uint32_t now_us) {
+    for (uint8_t i = 0; i < PARAM_COUNT; i++) {
+      if (name(i)[0] == param[0] && name(i)[1] == param[1]) {
+        unknown_mask_ |= 1 << i;
+      }
+    }
+    if (busy() && !switching_) {
+      switching_ = true;
+      since_us_ = now_us;
+    }
+  }
+  /// 応答で確かめたMUの設定
+  MuConfig current() const {
+    MuConfig c = {current_[0], current_[1], current_[2], current_[3]};
+    return c;
+  }
+  const MuConfigStats &stats() const { return stats_; }
+
+private:
+  uint32_t timeout_us_;
+  uint8_t max_attempts_;
+  uint8_t current_[PARAM_COUNT];
+  uint8_t target_[PARAM_COUNT];
+  int8_t in_flight_ = -1;
+  uint8_t value_ = 0;
+  uint8_t attempts_ = 0;
+  // 今の切り替えであきらめた設定(ビットごと)
+  uint8_t failed_mask_ = 0;
+  // MUの設定がわからないので送り直す設定(ビットごと)
+  uint8_t unknown_mask_ = 0;
+  uint32_t sent_us_ = 0;
+  bool switching_ = false;
+  uint32_t since_us_ = 0;
+  MuConfigStats stats_;
+
+  static void toArray(const MuConfig &c, uint8_t *a) {
+    a[0] = c.gi;
+    a[1] = c.ch;
+    a[2] = c.di;
+    a[3] = c.ei;
+  }
+  static const char *name(uint8_t i) {
+    static const char *const names[PARAM_COUNT] = {"GI", "CH", "DI", "EI"};
+    return names[i];
+  }
+  bool pending(uint8_t i) const {
+    return current_[i] != target_[i] || (unknown_mask_ & (1 << i));
+  }
+  /// 送っているコマンドをもう一度送れるようにする。回数を超えたらあきらめ、今の設定のままにする
+  void retry() {
+    if (attempts_ >= max_attempts_) {
+      target_[in_flight_] = current_[in_flight_];
+      unknown_mask_ &= ~(1 << in_flight_);
+      failed_mask_ |= 1 << in_flight_;
+      stats_.failures++;
+      attempts_ = 0;
+    }
+    in_flight_ = -1;
+  }
+};
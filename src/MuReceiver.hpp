@@ -0,0 +1,129 @@
+/**
+ * @file MuReceiver.hpp
+ * @brief
+ * MUからの受信データをUARTからまとめて読み出し、MUWrapperで解析してイベントとして通知する。
+ * UARTはavailable()とread(buf,len)を持つクラスなら何でもよい(HardwareSerial、FakeUartなど)。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "MUwrapper.hpp"
+
+/**
+ * @brief 解析済みの受信イベント。タスク間で受け渡すためデータは値で持つ
+ *
+ */
+struct MuRxEvent {
+  /// MU_EVENT_RX_COMPLETE,MU_EVENT_RESPONSE,MU_EVENT_ERRORのいずれか
+  MUEvent event;
+  uint8_t len;
+  uint8_t data[MU_MAX_DATALEN];
+};
+
+/**
+ * @brief 受信処理の統計
+ *
+ */
+struct MuRxStats {
+  /// UARTから読み出したバイト数
+  uint32_t bytes = 0;
+  /// 読み出し回数
+  uint32_t chunks = 0;
+  /// *DRの受信数
+  uint32_t frames = 0;
+  /// コマンド応答の受信数
+  uint32_t responses = 0;
+  /// *IR(送信エラー)の受信数
+  uint32_t ir_errors = 0;
+  /// IR以外の解析エラー数
+  uint32_t parse_errors = 0;
+  /// エラーコードごとの数(*IRを含む)
+  uint32_t errors[MU_ERR_COUNT] = {};
+  /// 通知先が受け取れず捨てたイベント数
+  uint32_t dropped = 0;
+};
+
+/**
+ * @brief イベントの通知先。受け取れなかったときはfalseを返す
+ *
+ */
+typedef bool (*MuRxSink)(void *context, const MuRxEvent &event);
+
+/**
+ * @brief UARTの受信データをまとめてMUWrapperに流し込むクラス
+ *
+ * @tparam Uart
+ * @tparam ChunkSize 1回に読み出す最大バイト数
+ */
+template <class Uart, size_t ChunkSize = 64> class MuReceiver {
+public:
+  MuReceiver(Uart &uart, MuRxSink sink, void *context = nullptr)
+      : uart_(uart), sink_(sink), context_(context), mu_(onParsed, this){};
+
+  /**
+   * @brief UARTに溜まっているデータをすべて読み出して解析する
+   *
+   * @return size_t 読み出したバイト数
+   */
+  size_t drain() {
+    size_t total = 0;
+    int available;
+    while ((available = uart_.available()) > 0) {
+      size_t n = (size_t)available < ChunkSize ? (size_t)available : ChunkSize;
+      n = uart_.read(chunk_, n);
+      if (n == 0) {
+        break;
+      }
+      stats_.bytes += n;
+      stats_.chunks++;
+      mu_.pushRawData(chunk_, n);
+      total += n;
+    }
+    return total;
+  }
+
+  const MuRxStats &stats() const { return stats_; }
+
+private:
+  Uart &uart_;
+  MuRxSink sink_;
+  void *context_;
+  MUWrapper mu_;
+  MuRxStats stats_;
+  uint8_t chunk_[ChunkSize];
+
+  static void onParsed(void *context, MUEvent event, uint8_t *data,
+                       uint8_t len) {
+    MuReceiver *self = (MuReceiver *)context;
+    switch (event) {
+    case MU_EVENT_RX_COMPLETE:
+      self->stats_.frames++;
+      break;
+    case MU_EVENT_RESPONSE:
+      self->stats_.responses++;
+      break;
+    case MU_EVENT_ERROR:
+      if (data[0] < MU_ERR_COUNT) {
+        self->stats_.errors[data[0]]++;
+      }
+      if (data[0] == MU_ERR_CATCH_IR) {
+        self->stats_.ir_errors++;
+      } else {
+        self->stats_.parse_errors++;
+      }
+      break;
+    default:
+      return;
+    }
+    MuRxEvent e;
+    e.event = event;
+    e.len = len;
+    memcpy(e.data, data, len);
+    if (!self->sink_(self->context_, e)) {
+      self->stats_.dropped++;
+    }
+  }
+};
@@ -0,0 +1,207 @@
+/**
+ * @file OledRenderer.h
+ * @brief
+ * SSD1306のフレームバッファのうち、前回送った内容から変わったページ(8行ずつの帯)だけを送る。
+ * 画面のI2Cは入力(P1)と同じバスなので、送る量と回数を減らし、
+ * 短く分けた送信をI2cArbiterを通してコントローラー読み出しのすき間に入れる。
+ * フレームバッファへの描画はAdafruit_SSD1306で行い、display()の代わりにflush()を呼ぶ。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "I2cArbiter.h"
+
+/**
+ * @brief 送信の統計
+ *
+ */
+struct OledStats {
+  /// update()で変化を調べた回数
+  uint32_t updates = 0;
+  /// 実際に送信した回数
+  uint32_t flushes = 0;
+  /// 送信したページ数
+  uint32_t pages = 0;
+  /// I2Cに書いたバイト数(アドレスを除く)
+  uint32_t bytes = 0;
+};
+
+/**
+ * @brief 変わったページだけを送るSSD1306の送信部
+ *
+ * @tparam Bus BasicI2cArbiterと同じ使い方ができるバスの調停
+ */
+template <class Bus> class BasicOledRenderer {
+public:
+  static constexpr uint8_t WIDTH = 128;
+  static constexpr uint8_t PAGES = 8;
+  /// 1回のI2C送信で送るデータの最大バイト数。長くするとその間P1の読み出しが待たされる
+  static constexpr uint8_t CHUNK = 32;
+
+  /**
+   * @brief
+   *
+   * @param bus
+   * @param addr SSD1306のI2Cアドレス
+   * @param buffer Adafruit_SSD1306::getBuffer()
+   * @param min_interval_ms 送信を始める最小間隔[ms]
+   */
+  BasicOledRenderer(Bus &bus, uint8_t addr, const uint8_t *buffer,
+                    uint32_t min_interval_ms)
+      : bus_(bus), addr_(addr), buffer_(buffer),
+        min_interval_ms_(min_interval_ms){};
+
+  /**
+   * @brief フレームバッファに描画し直したら呼ぶ。前回送った内容と比べて変わったページを記録する
+   *
+   * @return uint8_t 送信待ちのページ(ビットごと)
+   */
+  uint8_t update() {
+    stats_.updates++;
+    for (uint8_t p = 0; p < PAGES; p++) {
+      if (memcmp(buffer_ + p * WIDTH, sent_[p], WIDTH) != 0) {
+        dirty_ |= 1 << p;
+      }
+    }
+    return dirty_;
+  }
+
+  /**
+   * @brief 画面の中身がわからないとき(起動直後など)にすべてのページを送信待ちにする
+   *
+   */
+  void invalidateAll() { dirty_ = 0xff; }
+
+  /**
+   * @brief
+   * 送信待ちのページを送る。前回送信を始めてからmin_interval_ms経っていなければ始めない。
+   * バスが取れない(コントローラーの予約枠にかかる)ところで止め、続きは次の呼び出しで送る。
+   *
+   * @param now_ms
+   * @return true 送り終わった
+   * @return false 送るものがない、間隔が短い、または送信の途中
+   */
+  bool flush(uint32_t now_ms) {
+    if (sending_ == 0) {
+      if (dirty_ == 0) {
+        return false;
+      }
+      if (flushed_ && now_ms - last_flush_ms_ < min_interval_ms_) {
+        return false;
+      }
+      sending_ = dirty_;
+      dirty_ = 0;
+      pos_ = 0;
+      flushed_ = true;
+      last_flush_ms_ = now_ms;
+    }
+    while (sending_ != 0) {
+      uint8_t p = 0;
+      while (!(sending_ & (1 << p))) {
+        p++;
+      }
+      if (pos_ == 0) {
+        // 送り始めるときの内容を送る。送信中に描き直されたらupdate()で再び送信待ちになる
+        memcpy(sent_[p], buffer_ + p * WIDTH, WIDTH);
+        if (!sendWindow(p)) {
+          return false;
+        }
+      }
+      if (!sendChunk(p)) {
+        return false;
+      }
+      if (pos_ >= WIDTH) {
+        sending_ &= ~(1 << p);
+        pos_ = 0;
+        stats_.pages++;
+      }
+    }
+    stats_.flushes++;
+    return true;
+  }
+
+  /// 送信の途中か
+  bool busy() const { return sending_ != 0; }
+  uint8_t dirty() const { return dirty_; }
+  const OledStats &stats() const { return stats_; }
+  void resetStats() { stats_ = OledStats(); }
+
+private:
+  Bus &bus_;
+  uint8_t addr_;
+  const uint8_t *buffer_;
+  uint32_t min_interval_ms_;
+  uint8_t dirty_ = 0xff;
+  // 送信中のページと、送信中のページの送った位置
+  uint8_t sending_ = 0;
+  uint8_t pos_ = 0;
+  bool window_sent_ = false;
+  bool flushed_ = false;
+  uint32_t last_flush_ms_ = 0;
+  // 最後に送った(送っている)内容
+  uint8_t sent_[PAGES][WIDTH] = {};
+  OledStats stats_;
+
+  /**
+   * @brief ページpの書き込み範囲を設定する(水平アドレッシングモード前提)
+   *
+   * @param p
+   * @return true 送った(送ってあった)
+   * @return false バスが取れなかった
+   */
+  bool sendWindow(uint8_t p) {
+    if (window_sent_) {
+      return true;
+    }
+    // 0x22:PAGEADDR 0x21:COLUMNADDR
+    const uint8_t window[] = {0x22, p, p, 0x21, 0, WIDTH - 1};
+    if (!bus_.tryLock(I2C_DISPLAY, 1 + sizeof(window))) {
+      return false;
+    }
+    auto &wire = bus_.wire();
+    wire.beginTransmission(addr_);
+    wire.write((uint8_t)0x00); // 以降はコマンド
+    for (uint8_t i = 0; i < sizeof(window); i++) {
+      wire.write(window[i]);
+    }
+    wire.endTransmission();
+    bus_.unlock();
+    stats_.bytes += 1 + sizeof(window);
+    window_sent_ = true;
+    return true;
+  }
+
+  /**
+   * @brief ページpの続きをCHUNKバイト送る
+   *
+   * @param p
+   * @return true 送った
+   * @return false バスが取れなかった
+   */
+  bool sendChunk(uint8_t p) {
+    uint8_t n = WIDTH - pos_ < CHUNK ? WIDTH - pos_ : CHUNK;
+    if (!bus_.tryLock(I2C_DISPLAY, 1 + n)) {
+      return false;
+    }
+    auto &wire = bus_.wire();
+    wire.beginTransmission(addr_);
+    wire.write((uint8_t)0x40); // 以降は表示データ
+    for (uint8_t i = 0; i < n; i++) {
+      wire.write(sent_[p][pos_ + i]);
+    }
+    wire.endTransmission();
+    bus_.unlock();
+    stats_.bytes += 1 + n;
+    pos_ += n;
+    if (pos_ >= WIDTH) {
+      window_sent_ = false;
+    }
+    return true;
+  }
+};
+
+#ifdef ARDUINO
+typedef BasicOledRenderer<I2cArbiter> OledRenderer;
+#endif
@@ -0,0 +1,336 @@
+/**
+ * @file ReliableLink.h
+ * @brief
+ * 取りこぼしてはいけないフレーム(非常停止・モード変更・設定)を確認応答付きで送る。
+ * フレームに連番と種類を付け、受信側は*DRで受け取ったら確認応答を送り返す。
+ * 送信側は確認応答が来るまで一定間隔で送り直し、期限を過ぎたらあきらめて数える。
+ * コントローラーの状態は今までどおり最新の値だけを送る(ここは通さない)。
+ *
+ * フレームの形式(MUのデータ部)
+ * データ    : [RELIABLE_TAG_DATA][連番][種類][セッション(2バイト、上位から)][データ...]
+ * 確認応答  : [RELIABLE_TAG_ACK][連番][種類][セッション(2バイト、上位から)]
+ * タグは十字ボタンの上下左右がすべて押された状態(controller::FORMAT_TAG)の未使用の値。
+ * セッションは送信側の起動ごとに変わり、受信側は変わったら重複の判定をやり直す。
+ * 再起動しても連番は0からなので、同じセッションが続くと新しいフレームを受け取り済みとして捨ててしまう。
+ * そのため16ビットにして、起動ごとの乱数が前回と重なりにくくしている。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "LatencyTrace.h"
+#include "MUwrapper.hpp"
+#include "controller.h"
+
+/**
+ * @brief 確認応答付きで送るフレームの種類。値が小さいほど優先して送る
+ *
+ */
+enum MsgClass : uint8_t {
+  MSG_EMERGENCY,
+  MSG_MODE,
+  MSG_CONFIG,
+  MSG_CLASS_COUNT,
+};
+
+constexpr uint8_t RELIABLE_TAG_DATA = controller::FORMAT_TAG | 0x0C;
+constexpr uint8_t RELIABLE_TAG_ACK = controller::FORMAT_TAG | 0x0D;
+/// タグ、連番、種類、セッション(2バイト)
+constexpr uint8_t RELIABLE_HEADER_LEN = 5;
+constexpr uint8_t RELIABLE_MAX_DATALEN = MU_MAX_DATALEN - RELIABLE_HEADER_LEN;
+
+/**
+ * @brief 確認応答付き送信の統計
+ *
+ */
+struct ReliableStats {
+  /// send()で渡された数
+  uint32_t queued = 0;
+  /// 届く前に同じ種類の新しいものに置き換えられた数
+  uint32_t superseded = 0;
+  /// 送信した回数(送り直しを含む)
+  uint32_t transmissions = 0;
+  /// そのうち送り直し
+  uint32_t retransmits = 0;
+  /// 確認応答が来た数
+  uint32_t delivered = 0;
+  /// 期限までに確認応答が来なかった数
+  uint32_t expired = 0;
+  /// MUが送信できなかった(*IR)数
+  uint32_t tx_errors = 0;
+  /// 待っていない確認応答(重複・古いもの)の数
+  uint32_t stale_acks = 0;
+  /// send()してから確認応答が来るまで[us]
+  LatencyHistogram latency;
+
+  /// 結果が出たもののうち届いた割合[‰]
+  uint16_t deliveryPermille() const {
+    uint32_t done = delivered + expired;
+    return done ? (uint16_t)((uint64_t)delivered * 1000 / done) : 1000;
+  }
+};
+
+/**
+ * @brief
+ * 確認応答付きの送信側。種類ごとに1つまで保持し、同じ種類の新しいものが来たら置き換える。
+ * 送信はpeek()で送るフレームを受け取り、実際に送ったらsent()を呼ぶ
+ * (送信時間の制限などで送れなかったときは呼ばない)。1つのタスクから使う。
+ *
+ */
+class ReliableSender {
+public:
+  /**
+   * @brief
+   *
+   * @param rto_us 確認応答を待ってから送り直すまでの時間[us]
+   * @param deadline_us send()からこの時間が過ぎたらあきらめる[us]
+   * @param session 起動ごとに変わる値
+   */
+  ReliableSender(uint32_t rto_us, uint32_t deadline_us, uint16_t session = 0)
+      : rto_us_(rto_us), deadline_us_(deadline_us), session_(session) {}
+
+  void setSession(uint16_t session) { session_ = session; }
+
+  /**
+   * @brief 確認応答付きで送るものを渡す
+   *
+   * @param cls
+   * @param data
+   * @param len RELIABLE_MAX_DATALEN以下
+   * @param now_us
+   * @return true
+   * @return false 長すぎる
+   */
+  bool send(MsgClass cls, const uint8_t *data, uint8_t len, uint32_t now_us) {
+    if (len > RELIABLE_MAX_DATALEN || cls >= MSG_CLASS_COUNT) {
+      return false;
+    }
+    Slot &s = slots_[cls];
+    if (s.used) {
+      stats_.superseded++;
+    }
+    s.used = true;
+    s.seq = next_seq_++;
+    s.frame[0] = RELIABLE_TAG_DATA;
+    s.frame[1] = s.seq;
+    s.frame[2] = cls;
+    s.frame[3] = (uint8_t)(session_ >> 8);
+    s.frame[4] = (uint8_t)session_;
+    memcpy(s.frame + RELIABLE_HEADER_LEN, data, len);
+    s.len = RELIABLE_HEADER_LEN + len;
+    s.queued_us = now_us;
+    s.attempts = 0;
+    stats_.queued++;
+    return true;
+  }
+
+  /**
+   * @brief 今送るフレームがあれば返す。期限を過ぎたものはここで捨てる
+   *
+   * @param now_us
+   * @param frame
+   * @param len
+   * @return true 送るフレームがある
+   */
+  bool peek(uint32_t now_us, const uint8_t *&frame, uint8_t &len) {
+    peeked_ = -1;
+    for (uint8_t c = 0; c < MSG_CLASS_COUNT; c++) {
+      Slot &s = slots_[c];
+      if (!s.used) {
+        continue;
+      }
+      if (now_us - s.queued_us >= deadline_us_) {
+        s.used = false;
+        stats_.expired++;
+        continue;
+      }
+      if (peeked_ < 0 && (s.attempts == 0 || now_us - s.sent_us >= rto_us_)) {
+        peeked_ = c;
+      }
+    }
+    if (peeked_ < 0) {
+      return false;
+    }
+    frame = slots_[peeked_].frame;
+    len = slots_[peeked_].len;
+    return true;
+  }
+
+  /**
+   * @brief peek()で受け取ったフレームを送った
+   *
+   * @param now_us
+   */
+  void sent(uint32_t now_us) {
+    if (peeked_ < 0) {
+      return;
+    }
+    Slot &s = slots_[peeked_];
+    if (s.attempts > 0) {
+      stats_.retransmits++;
+    }
+    s.attempts++;
+    s.sent_us = now_us;
+    stats_.transmissions++;
+    last_sent_ = peeked_;
+    peeked_ = -1;
+  }
+
+  /**
+   * @brief MUが最後に送ったフレームを送れなかった(*IR)。待たずに送り直す
+   *
+   */
+  void onTxError() {
+    stats_.tx_errors++;
+    if (last_sent_ >= 0 && slots_[last_sent_].used) {
+      slots_[last_sent_].sent_us -= rto_us_;
+    }
+  }
+
+  /**
+   * @brief 受信したフレームが確認応答なら処理する
+   *
+   * @param frame *DRのデータ部
+   * @param len
+   * @param now_us
+   * @return true 確認応答だった(待っていたかどうかによらない)
+   */
+  bool onAck(const uint8_t *frame, uint8_t len, uint32_t now_us) {
+    if (len != RELIABLE_HEADER_LEN || frame[0] != RELIABLE_TAG_ACK) {
+      return false;
+    }
+    uint8_t cls = frame[2];
+    if (cls >= MSG_CLASS_COUNT || readSession(frame) != session_) {
+      stats_.stale_acks++;
+      return true;
+    }
+    Slot &s = slots_[cls];
+    if (!s.used || s.seq != frame[1]) {
+      stats_.stale_acks++;
+      return true;
+    }
+    s.used = false;
+    stats_.delivered++;
+    stats_.latency.add(now_us - s.queued_us);
+    return true;
+  }
+
+  /// その種類で確認応答を待っているものがあるか
+  bool pending(MsgClass cls) const { return slots_[cls].used; }
+  /// 確認応答を待っているものがあるか
+  bool pending() const {
+    for (uint8_t c = 0; c < MSG_CLASS_COUNT; c++) {
+      if (slots_[c].used) {
+        return true;
+      }
+    }
+    return false;
+  }
+  const ReliableStats &stats() const { return stats_; }
+  /// フレームのセッション
+  static uint16_t readSession(const uint8_t *frame) {
+    return (uint16_t)(frame[3] << 8 | frame[4]);
+  }
+  void resetStats() {
+    ReliableStats &s = stats_;
+    s.queued = s.superseded = s.transmissions = s.retransmits = 0;
+    s.delivered = s.expired = s.tx_errors = s.stale_acks = 0;
+    s.latency.reset();
+  }
+
+private:
+  struct Slot {
+    bool used = false;
+    uint8_t seq = 0;
+    uint8_t attempts = 0;
+    uint8_t len = 0;
+    uint8_t frame[MU_MAX_DATALEN];
+    uint32_t queued_us = 0;
+    uint32_t sent_us = 0;
+  };
+  uint32_t rto_us_;
+  uint32_t deadline_us_;
+  uint16_t session_;
+  uint8_t next_seq_ = 0;
+  int8_t peeked_ = -1;
+  int8_t last_sent_ = -1;
+  Slot slots_[MSG_CLASS_COUNT];
+  ReliableStats stats_;
+};
+
+/**
+ * @brief
+ * 確認応答付きの受信側。届いたフレームには毎回確認応答を返し(確認応答が失われることがあるため)、
+ * 中身は初めて受け取ったときだけ渡す。
+ *
+ */
+class ReliableReceiver {
+public:
+  /**
+   * @brief 受け取ったデータ
+   *
+   */
+  struct Message {
+    MsgClass cls;
+    const uint8_t *data;
+    uint8_t len;
+  };
+
+  /// フレームが確認応答付きのデータか
+  static bool isData(const uint8_t *frame, uint8_t len) {
+    return len >= RELIABLE_HEADER_LEN && frame[0] == RELIABLE_TAG_DATA;
+  }
+  /// フレームが確認応答か
+  static bool isAck(const uint8_t *frame, uint8_t len) {
+    return len == RELIABLE_HEADER_LEN && frame[0] == RELIABLE_TAG_ACK;
+  }
+
+  /**
+   * @brief 受信したフレームを処理する
+   *
+   * @param frame *DRのデータ部
+   * @param len
+   * @param ack 確認応答付きのデータなら、送り返す確認応答(RELIABLE_HEADER_LENバイト)を入れる
+   * @param msg 初めて受け取ったものなら中身を入れる(frameを指す)
+   * @return true 初めて受け取った
+   * @return false 確認応答付きのデータでない、または受け取り済み
+   */
+  bool accept(const uint8_t *frame, uint8_t len, uint8_t *ack, Message &msg) {
+    if (!isData(frame, len)) {
+      return false;
+    }
+    uint8_t seq = frame[1];
+    uint16_t session = ReliableSender::readSession(frame);
+    memcpy(ack, frame, RELIABLE_HEADER_LEN);
+    ack[0] = RELIABLE_TAG_ACK;
+    if (!started_ || session != session_) {
+      memset(seen_, 0, sizeof(seen_));
+      session_ = session;
+      started_ = true;
+    }
+    if (seen_[seq >> 3] & (1 << (seq & 7))) {
+      duplicates++;
+      return false;
+    }
+    seen_[seq >> 3] |= 1 << (seq & 7);
+    // 半周先の連番は次に使われるまでに消しておく
+    uint8_t old = seq + 128;
+    seen_[old >> 3] &= ~(1 << (old & 7));
+    received++;
+    msg.cls = (MsgClass)frame[2];
+    msg.data = frame + RELIABLE_HEADER_LEN;
+    msg.len = len - RELIABLE_HEADER_LEN;
+    return true;
+  }
+
+  /// 初めて受け取った数
+  uint32_t received = 0;
+  /// 受け取り済みだった数(確認応答が失われて送り直されたもの)
+  uint32_t duplicates = 0;
+
+private:
+  bool started_ = false;
+  uint16_t session_ = 0;
+  uint8_t seen_[32] = {0};
+};
@@ -0,0 +1,25 @@
+/**
+ * @file RtosMutex.h
+ * @brief
+ * FreeRTOSのミューテックス。I2cArbiterやUARTの排他に使う。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * @brief FreeRTOSのミューテックス(優先度継承あり)
+ *
+ */
+class RtosMutex {
+public:
+  RtosMutex() : handle_(xSemaphoreCreateMutex()){};
+  void lock() { xSemaphoreTake(handle_, portMAX_DELAY); }
+  bool tryLock() { return xSemaphoreTake(handle_, 0) == pdTRUE; }
+  void unlock() { xSemaphoreGive(handle_); }
+
+private:
+  SemaphoreHandle_t handle_;
+};
@@ -0,0 +1,91 @@
+/**
+ * @file TxPolicy.h
+ * @brief
+ * 送信フレームを送るかどうかの判定。内容が変わったときはすぐ送り、
+ * 変わらない間はハートビート間隔ごとにだけ送る。
+ * @version 0.1
+ *
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "MUwrapper.hpp"
+
+/**
+ * @brief 送信判定の統計
+ *
+ */
+struct TxPolicyStats {
+  /// 内容が変わったので送ったフレーム数
+  uint32_t sent = 0;
+  /// 内容が変わらないので送らなかったフレーム数
+  uint32_t suppressed = 0;
+  /// 内容は同じだがハートビートとして送ったフレーム数
+  uint32_t forced = 0;
+};
+
+class TxPolicy {
+public:
+  /**
+   * @brief
+   *
+   * @param heartbeat_ms 内容が変わらないときの送信間隔[ms]
+   */
+  TxPolicy(uint32_t heartbeat_ms) : heartbeat_ms_(heartbeat_ms){};
+
+  void setHeartbeat(uint32_t heartbeat_ms) { heartbeat_ms_ = heartbeat_ms; }
+
+  /**
+   * @brief
+   * フレームを送るべきか判定する。trueを返したときは送ったものとして記録する。
+   * ボタン・アナログ値はフレームに詰めた後のバイト列で比較する。
+   *
+   * @param frame
+   * @param len MU_MAX_DATALEN以下
+   * @param now 現在時刻[ms]
+   * @return true 送る
+   * @return false 送らない
+   */
+  bool check(const uint8_t *frame, uint8_t len, uint32_t now) {
+    if (len != last_len_ || memcmp(frame, last_, len) != 0) {
+      memcpy(last_, frame, len);
+      last_len_ = len;
+      last_sent_ = now;
+      stats_.sent++;
+      return true;
+    }
+    if (now - last_sent_ >= heartbeat_ms_) {
+      last_sent_ = now;
+      stats_.forced++;
+      return true;
+    }
+    stats_.suppressed++;
+    return false;
+  }
+
+  /**
+   * @brief
+   * 新しいフレームがなくてもcheckを呼ぶべきか(ハートビートの時刻か、invalidate後)。
+   * checkは呼ぶたびに統計を数えるので、新しいフレームが来たときとこれがtrueのときだけ呼ぶ
+   *
+   * @param now 現在時刻[ms]
+   * @return true
+   */
+  bool due(uint32_t now) const { return last_len_ == 0xFF || now - last_sent_ >= heartbeat_ms_; }
+
+  /**
+   * @brief 次のcheckで必ず送るようにする(設定変更後など)
+   *
+   */
+  void invalidate() { last_len_ = 0xFF; }
+
+  const TxPolicyStats &stats() const { return stats_; }
+  void resetStats() { stats_ = TxPolicyStats(); }
+
+private:
+  uint32_t heartbeat_ms_;
+  uint32_t last_sent_ = 0;
+  uint8_t last_[MU_MAX_DATALEN] = {0};
+  uint8_t last_len_ = 0xFF;
+  TxPolicyStats stats_;
+};
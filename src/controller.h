@@ -42,6 +42,16 @@ ControllerManagerは入手したControllerDataを活用しやすくするため
 
 ボタン、スティックの座標などにはIDが割り当てられ、controller::Indexでアクセスする。
 
+送信形式は2種類
+FORMAT_LEGACY:5バイト。アナログ値はすべて4ビット(旧受信機と互換)
+FORMAT_HIRES :7バイト。先頭に形式タグ、アナログ値はコントローラー本来の分解能(スティック左6ビット、右5ビット、トリガー5ビット)
+形式タグは十字ボタンの上下左右がすべて押された状態(旧形式では起こりえない値)を使うので、受信側は先頭バイトで判別できる。
+2台のコントローラーを1フレームにまとめるときはpackControllers/unpackControllersを使う。
+先頭の形式タグの下位2ビットがコントローラーの有無(bit0:1台目 bit1:2台目)で、いないコントローラーの分は詰めない。
+タグのbit2が旧形式5バイト×台数、bit3が高分解能6バイト(タグなし)×台数。2台とも高分解能だと12バイトを超えるので旧形式になる。
+高分解能の値はsetAnalogFine/analogfineで扱う。setAnalogFineは4ビットの値も合わせて更新する。
+受信側ではControllerManager::getValueFineで分解能の高い値を取得できる(旧形式を受信したときは4ビットの値を引き伸ばしたもの。トリガーは旧形式の7が最大)。
+
 使い方の例
 ControllerManager manager;
 ControllerData data;
@@ -94,6 +104,27 @@ namespace controller
         TriggerL,
         TriggerR,
     };
+    //送信形式
+    enum Format : uint8_t
+    {
+        FORMAT_LEGACY,//5バイト、アナログ値4ビット
+        FORMAT_HIRES,//7バイト、アナログ値本来の分解能
+    };
+    //形式タグ 上位4ビットは十字ボタン上下左右の同時押し(旧形式ではありえない)、下位4ビットが形式
+    constexpr uint8_t FORMAT_TAG = 0xF0;
+    constexpr uint8_t FORMAT_TAG_HIRES = FORMAT_TAG | 0x01;
+    constexpr uint8_t FORMAT_TAG_MULTI_LEGACY = FORMAT_TAG | 0x04;//下位2ビットにコントローラーの有無
+    constexpr uint8_t FORMAT_TAG_MULTI_HIRES = FORMAT_TAG | 0x08;//下位2ビットにコントローラーの有無
+    //1フレームの最大バイト数(MUの最大データ長)
+    constexpr uint8_t FRAME_MAXLEN = 12;
+    //高分解能のアナログ値のビット数(LstickX~TriggerRの順)
+    constexpr uint8_t ANALOG_FINE_BITS[6] = {6, 6, 5, 5, 5, 5};
+#ifdef USE_PACKETIZER
+    //旧形式のフィールド:ボタン16ビット,アナログ値4ビット×6
+    typedef PacketSchema<PACKET_MAX_DATALEN, uint16_t, uint8_t[3]> LegacySchema;
+    //高分解能形式のタグ以降のフィールド:ボタン16ビット,アナログ値を詰めた32ビット
+    typedef PacketSchema<PACKET_MAX_DATALEN, uint16_t, uint32_t> HiresBodySchema;
+#endif
     // using namespace NRcomm;
     class ControllerData
     {
@@ -103,21 +134,85 @@ namespace controller
             return button(i);
         }
         #ifdef USE_PACKETIZER
-        packet_t packetize(Packetizer &p)
+        /**
+         * @brief 送信データの生成。フィールドの並びはLegacySchema/HiresBodySchemaで決まる
+         * 
+         * @param format 
+         * @return packet_t 
+         */
+        packet_t packetize(Format format = FORMAT_LEGACY)
         {
             packet_t packet;
-            p.init(packet);
-            p
-                .pack(Button)
-                .pack(Analogue, 3);
+            packet.length = pack(packet.data, format);
             return packet;
         }
+        packet_t packetize(Packetizer &p, Format format = FORMAT_LEGACY)
+        {
+            (void)p;
+            return packetize(format);
+        }
+        /**
+         * @brief 送信データを直接バッファに詰める(packetizeと同じ内容。packet_tを作らない)
+         * 
+         * @param out FORMAT_HIRESなら1+HiresBodySchema::sizeバイト以上
+         * @param format 
+         * @return uint8_t 詰めたバイト数
+         */
+        uint8_t pack(uint8_t *out, Format format = FORMAT_LEGACY);
+        /**
+         * @brief 形式タグを除いたデータ部を詰める
+         * 
+         * @param out 
+         * @param format 
+         * @return uint8_t 詰めたバイト数
+         */
+        uint8_t packBody(uint8_t *out, Format format);
+        /**
+         * @brief 形式タグを除いたデータ部を取り出す
+         * 
+         * @param in 
+         * @param format 
+         */
+        void unpackBody(const uint8_t *in, Format format);
+        /**
+         * @brief 受信データの展開。形式は先頭バイトと長さで判別する
+         * 
+         * @param data 
+         * @param len 
+         * @return true 
+         * @return false 形式が分からない
+         */
+        bool unpacketize(const uint8_t *data, uint8_t len);
+        /**
+         * @brief 受信データの展開。形式は先頭バイトで判別する
+         * 
+         * @param p 
+         * @return true 
+         * @return false 
+         */
         bool unpacketize(Packetizer &p)
         {
-            return p
+            uint8_t tag = 0;
+            p.peek(tag);
+            if (tag == FORMAT_TAG_HIRES)
+            {
+                uint32_t fine = 0;
+                if (!p
+                    .unpack(tag)
+                    .unpack(Button)
+                    .unpack(fine)
+                    .success())
+                    return false;
+                unpackFine(fine);
+                return true;
+            }
+            if (!p
                 .unpack(Button)
                 .unpack(Analogue, 3)
-                .success();
+                .success())
+                return false;
+            widenLegacy();
+            return true;
         }
         #endif
         inline bool button(controller::Index i)
@@ -161,14 +256,183 @@ namespace controller
             }
             return (i % 2 == 0) ? Analogue[(i-64) / 2] & 0x0F : Analogue[( i-64) / 2] >> 4;
         }
+        /**
+         * @brief 高分解能のアナログ値を設定。4ビットの値も上位ビットで更新する
+         * 
+         * @param i 
+         * @param a ANALOG_FINE_BITSのビット数の値
+         */
+        void setAnalogFine(controller::Index i, uint8_t a)
+        {
+            if (i > TriggerR || i < LstickX)
+                return;
+            uint8_t bits = ANALOG_FINE_BITS[i - LstickX];
+            if (a >= (1 << bits))
+                a = (1 << bits) - 1;
+            Fine[i - LstickX] = a;
+            setAnalog(i, a >> (bits - 4));
+        }
+        /**
+         * @brief 高分解能のアナログ値を取得
+         * 
+         * @param i 
+         * @return uint8_t ANALOG_FINE_BITSのビット数の値
+         */
+        inline uint8_t analogfine(controller::Index i)
+        {
+            if (i > TriggerR || i < LstickX)
+                return 0;
+            return Fine[i - LstickX];
+        }
 
         uint16_t Button;
         // uint8_t Lstick;  // Y,X
         uint8_t Analogue[3];
+        //高分解能のアナログ値(LstickX~TriggerRの順)
+        uint8_t Fine[6];
     private:
+        //高分解能のアナログ値を下位ビットから順に32ビットに詰める
+        uint32_t packFine()
+        {
+            uint32_t v = 0;
+            uint8_t shift = 0;
+            for (uint8_t i = 0; i < 6; i++)
+            {
+                v |= (uint32_t)(Fine[i] & ((1 << ANALOG_FINE_BITS[i]) - 1)) << shift;
+                shift += ANALOG_FINE_BITS[i];
+            }
+            return v;
+        }
+        /**
+         * @brief 旧形式の値を引き伸ばして高分解能の値とする
+         * スティックは中央(8)を高分解能の中央に、0と15を両端に合わせる(上位ビットを繰り返すと中央がずれる)。
+         * トリガーは旧形式では押し込みを0/7で表すので3ビットの値とみなし、上位ビットを下位に繰り返して7を最大にする。
+         */
+        void widenLegacy()
+        {
+            for (uint8_t i = 0; i < 4; i++)
+            {
+                uint8_t bits = ANALOG_FINE_BITS[i];
+                uint8_t center = 1 << (bits - 1);
+                uint8_t v = analograw((Index)(LstickX + i));
+                Fine[i] = v < 8 ? v << (bits - 4) : center + (v - 8) * (center - 1) / 7;
+            }
+            for (uint8_t i = 4; i < 6; i++)
+            {
+                uint8_t bits = ANALOG_FINE_BITS[i];
+                uint8_t v = analograw((Index)(LstickX + i));
+                if (v > 7)
+                    v = 7;
+                Fine[i] = v << (bits - 3) | v >> (6 - bits);
+            }
+        }
+        void unpackFine(uint32_t v)
+        {
+            for (uint8_t i = 0; i < 6; i++)
+            {
+                setAnalogFine((Index)(LstickX + i), v & ((1 << ANALOG_FINE_BITS[i]) - 1));
+                v >>= ANALOG_FINE_BITS[i];
+            }
+        }
         // uint8_t Rstick;  // Y,X
         // uint8_t Trigger; // L,R
     };
+#ifdef USE_PACKETIZER
+    inline uint8_t ControllerData::packBody(uint8_t *out, Format format)
+    {
+        if (format == FORMAT_HIRES)
+            return HiresBodySchema::pack(out, Button, packFine());
+        return LegacySchema::pack(out, Button, Analogue);
+    }
+    inline uint8_t ControllerData::pack(uint8_t *out, Format format)
+    {
+        if (format == FORMAT_HIRES)
+        {
+            out[0] = FORMAT_TAG_HIRES;
+            return 1 + packBody(out + 1, FORMAT_HIRES);
+        }
+        return packBody(out, FORMAT_LEGACY);
+    }
+    inline void ControllerData::unpackBody(const uint8_t *in, Format format)
+    {
+        if (format == FORMAT_HIRES)
+        {
+            uint32_t fine;
+            HiresBodySchema::unpack(in, Button, fine);
+            unpackFine(fine);
+            return;
+        }
+        LegacySchema::unpack(in, Button, Analogue);
+        widenLegacy();
+    }
+    inline bool ControllerData::unpacketize(const uint8_t *data, uint8_t len)
+    {
+        if (len == 1 + HiresBodySchema::size && data[0] == FORMAT_TAG_HIRES)
+        {
+            unpackBody(data + 1, FORMAT_HIRES);
+            return true;
+        }
+        if (len == LegacySchema::size)
+        {
+            unpackBody(data, FORMAT_LEGACY);
+            return true;
+        }
+        return false;
+    }
+    /**
+     * @brief 2台のコントローラーを1フレームに詰める
+     * 
+     * @param buf FRAME_MAXLENバイト以上
+     * @param pads 2台分のデータ
+     * @param mask コントローラーの有無 bit0:pads[0] bit1:pads[1]
+     * @param format 高分解能が収まらないときは旧形式になる
+     * @return uint8_t フレームの長さ
+     */
+    inline uint8_t packControllers(uint8_t *buf, ControllerData *pads, uint8_t mask, Format format)
+    {
+        mask &= 0x03;
+        uint8_t count = (mask & 1) + (mask >> 1);
+        bool hires = format == FORMAT_HIRES && 1 + HiresBodySchema::size * count <= FRAME_MAXLEN;
+        uint8_t len = 0;
+        buf[len++] = (hires ? FORMAT_TAG_MULTI_HIRES : FORMAT_TAG_MULTI_LEGACY) | mask;
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            if (mask & (1 << i))
+                len += pads[i].packBody(buf + len, hires ? FORMAT_HIRES : FORMAT_LEGACY);
+        }
+        return len;
+    }
+    /**
+     * @brief packControllersで詰めたフレームを展開する
+     * 
+     * @param buf 
+     * @param len 
+     * @param pads 2台分のデータ 含まれていないコントローラーは変更しない
+     * @return int8_t 含まれていたコントローラー(bit0,bit1) 形式が違う、長さが合わないときは-1
+     */
+    inline int8_t unpackControllers(const uint8_t *buf, uint8_t len, ControllerData *pads)
+    {
+        if (len == 0 || (buf[0] & 0xF0) != FORMAT_TAG)
+            return -1;
+        uint8_t kind = buf[0] & 0x0C;
+        if (kind != (FORMAT_TAG_MULTI_LEGACY & 0x0C) && kind != (FORMAT_TAG_MULTI_HIRES & 0x0C))
+            return -1;
+        Format format = kind == (FORMAT_TAG_MULTI_HIRES & 0x0C) ? FORMAT_HIRES : FORMAT_LEGACY;
+        uint8_t mask = buf[0] & 0x03;
+        uint8_t body = format == FORMAT_HIRES ? +HiresBodySchema::size : +LegacySchema::size;
+        if (len != 1 + body * ((mask & 1) + (mask >> 1)))
+            return -1;
+        buf++;
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            if (!(mask & (1 << i)))
+                continue;
+            pads[i].unpackBody(buf, format);
+            buf += body;
+        }
+        return mask;
+    }
+#endif
     class ControllerManager
     {
     public:
@@ -217,6 +481,39 @@ namespace controller
             }
         }
 
+        /**
+         * @brief 分解能の高い値を取得。旧形式のデータでも使える
+         * 
+         * @param i 
+         * @return int16_t スティックは-127~127,トリガーは0~255,ボタンは0,1
+         */
+        int16_t getValueFine(Index i)
+        {
+            switch(i){
+                case LstickX:
+                case LstickY:
+                case RstickX:
+                case RstickY:
+                {
+                    if (ctrl.button(Index::FLAG_STICK_POLAR))
+                        return getValue(i) * 127 / 14;
+                    //中央から下はcenter段、上はcenter-1段あるので、それぞれで割って両端を±127にそろえる
+                    uint8_t bits = ANALOG_FINE_BITS[i - LstickX];
+                    int16_t center = 1 << (bits - 1);
+                    int16_t d = (int16_t)ctrl.analogfine(i) - center;
+                    return d < 0 ? d * 127 / center : d * 127 / (center - 1);
+                }
+                case TriggerL:
+                case TriggerR:
+                {
+                    uint8_t bits = ANALOG_FINE_BITS[i - LstickX];
+                    return (int16_t)ctrl.analogfine(i) * 255 / ((1 << bits) - 1);
+                }
+                default:
+                    return getRaw(i);
+            }
+        }
+
         /**
          * @brief 生の値を取得
          * 
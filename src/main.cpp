@@ -1,364 +1,1115 @@
-#include <Arduino.h>
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
-#include "esp_task_wdt.h"
-#include <Adafruit_GFX.h>
-#include <Adafruit_SSD1306.h>
-#include <ButtonManager.h>
-#include "pin.h"
-#include <MUwrapper.hpp>
-#include <wiiClassic.h>
-#include <controller.h>
-
-TaskHandle_t Main_Handle = NULL;
-TaskHandle_t Mu_Handle = NULL;
-TaskHandle_t Display_Handle = NULL;
-
-QueueHandle_t controller_TO_mainQueue = NULL;
-QueueHandle_t controller1_TO_mainQueue = NULL;
-QueueHandle_t config_TO_mainQueue = NULL;
-QueueHandle_t main_TO_MuQueue = NULL;
-
-
-
-controller::ControllerData controller_main[2];
-Packetizer packetizer;
-
-struct QueueData{
-  uint8_t Mudata[12];
-  uint8_t len;
-  int config[5];
-
-};
-enum mu_config_items{
-  userid,
-  groupid,
-  deviceid,
-  targetid,
-  channel ,
-  mode
-};
-
-struct ConfigData{
-  int configdata[5];
-};
-
-uint8_t generate_mudata(uint8_t *buf, bool emergency){//最大１２バイト
-
-  if(emergency){  //非常停止aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa
-    buf[0] = 'E';
-    return 1;
-  }else{
-    packet_t p;
-    packetizer.init(p);
-    p=controller_main[0].packetize(packetizer);
-    memcpy(buf,p.data,5);
-    buf[5] = 0x0;
-    // packetizer.init(p);
-    // p=controller_main[1].packetize(packetizer);
-    // memcpy(buf+6,p.data,5);
-    // buf[11] = 0x0;
-
-    return 5;
-  }
-}
-
-
-//Mu2にシリアルで文字を送る関数Muwrapperのコールバックを受けて実行される
-void SendData(MUEvent event, uint8_t *data, uint8_t len){
-  if (event == MU_EVENT_ERROR){
-    Serial.write("MU_EVENT_ERROR");
-  }
-  if (event == MU_EVENT_SEND_REQUEST){
-      Serial1.write(data,len);
-        
-  }
-}
-
-
-
-//↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓タスク↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓
-
-//mainタスク
-void main_task(void *pvParameters) {
-  Serial.begin(9600);
-
-  ButtonManager btn2;
-  btn2.add(Emergency, 15);
-
-  uint8_t Mudata[12];
-  
-  QueueData queue_send_data;
-  ConfigData result_config;
-  char inchar;
-
-  int lasttime = 0;
-    
-  while (1){
-    if (millis() - lasttime > 15){
-      btn2.update();
-
-      xQueueReceive(controller_TO_mainQueue, &controller_main[0],1);
-      xQueueReceive(controller1_TO_mainQueue, &controller_main[1],1);
-      xQueueReceive(config_TO_mainQueue, &result_config,1);
-
-      queue_send_data.len = generate_mudata(Mudata, !btn2.isHold(0));
-      memcpy(&queue_send_data.config, &result_config.configdata, sizeof(result_config.configdata));
-      memcpy(&queue_send_data.Mudata, &Mudata, sizeof(Mudata));
-      
-
-      //出力
-      xQueueSend(main_TO_MuQueue,&queue_send_data,0);
-      lasttime = millis();
-    }
-    
-
-    
-
-  if (Serial1.available()) {
-
-    inchar = Serial1.read();
-    // Serial.printf("%c",inchar);
-
-  }
-  vTaskDelay(1);
-  }
-}
-
-
-
-
-
-//Mu2のタスク
-void Mu(void *pvParameters){
-  Serial1.begin(19200,SERIAL_8N1,Mu_TXD,Mu_RXD);
-
-  int lasttime = 0;
-  int lastconfig[5];
-
-  MUWrapper mu(SendData);
-
-  mu.init(8);
-
-  QueueData queue_data;
-
-  while (1){
-
-    if (millis() - lasttime > 20){
-      
-      xQueueReceive(main_TO_MuQueue,&queue_data,0);
-
-      for (int i = 0; i < queue_data.len; i++){
-        Serial.printf("%d ",queue_data.Mudata[i]);
-      }
-      Serial.print("\n");
-
-      if (lastconfig != queue_data.config){
-        // mu.setParams(queue_data.config[groupid],queue_data.config[channel],queue_data.config[targetid],queue_data.config[deviceid]);
-      }
-
-      //送信
-      mu.send(queue_data.Mudata,queue_data.len);
-      lasttime = millis();
-    }
-    
-    vTaskDelay(1);
-
-  }
-
-}
-
-//画面タスク
-void Display(void *pvParameters){
-
-  #define SCREEN_I2C_ADDR 0x3c // or 0x3C
-  #define OLED_RST_PIN -1      // Reset pin (-1 if not available)
-  
-  bool menu = false;
-  int lasttime = 0;
-  int wiilasttime = 0;
-  int page = 0;
-
-  
-  String menu_items[6] = {
-    "userid",
-    "groupid",
-    "deviceid",
-    "targetid",
-    "channel" ,
-    "mode"
-  };
-  int config_items[6][4] ={
-    {1, 2, 3, 4},
-    {1, 2, 3, 4},
-    {0, 1, 2, 4},
-    {0, 1, 2, 4},
-    {8, 14, 31, 46},
-    {5,12,5,12}
-  };
-
-  ConfigData result_config;
-
-
-  int config[6] ={0,3,0,1,0,0};
-  int select_menu_count = 0;
-  
-  //コントローラー
-  controller::ControllerData controllerdata[2] ;
-  WiiClassic wii(Wire);
-  WiiClassic wii1(Wire1);
-  
-  Adafruit_SSD1306 display(128, 64, &Wire, OLED_RST_PIN);
-  Wire.setPins(OLED_SDA, OLED_SCL); 
-  Wire1.setPins(P2_SDA,P2_SCL);
-  Wire.begin();
-  Wire1.begin();
-  display.begin(SSD1306_SWITCHCAPVCC, SCREEN_I2C_ADDR);
-  display.setRotation(2);
-  
-
-  wii.init();
-  wii1.init();
-
-  ButtonManager btn;
-  btn.add(SW7,20);
-  btn.add(SW6,20);
-  btn.add(SW5,20);
-  btn.add(SW4,20);
-
-  enum btn_name{
-    FRONT_BTNA = 0,//SW7
-    FRONT_BTNB = 1,//SW6
-    FRONT_BTNC = 2,//SW5
-    FRONT_BTND = 3//SW4
-  };
-
-  
-
-  while (1){
-    btn.update();
-    
-    if (millis() - lasttime  > 100){
-      display.clearDisplay();
-      if (menu == false){
-        display.setTextSize(2);               //フォントサイズは2(番目に小さい)
-        display.setTextColor(SSD1306_WHITE);  //色指定はできないが必要
-        display.setCursor(0, 0);            //テキストの表示開始位置
-        display.print("CH");         //表示文字列
-        display.setCursor(0, 25);
-        display.printf("%02x",config_items[channel][config[4]]);
-
-      }else if (menu == true){
-
-
-        display.setTextSize(1);               //フォントサイズは2(番目に小さい)
-        display.setTextColor(SSD1306_WHITE);  //色指定はできないが必要
-        display.setCursor(0, 0); 
-        display.print("MENU");
-        display.drawLine(0,10,128,10,WHITE);
-
-        for (int i =page*5; i < (page+1)*5; i++){
-
-          display.setCursor(2, 10*(i+1)+1);
-
-          if (i == select_menu_count){
-            display.fillRect(0, 10*(i+1), 52, 10, WHITE);
-            display.setTextColor(INVERSE);  //色指定はできないが必要
-            display.print(menu_items[i]);
-
-          }else{
-            display.setTextColor(SSD1306_WHITE);
-            display.print(menu_items[i]);
-            
-          }
-
-          display.fillRect(98, 10*(i+1), 14, 10, WHITE);
-          display.setTextColor(SSD1306_INVERSE);
-          display.setCursor(100, 10*(i+1)+1);
-          display.printf("%02x",config_items[i][config[i]]);
-
-          display.drawLine(0,10*(i+2),128,10*(i+2),WHITE);
-        }
-      }
-
-      
-
-      lasttime = millis();
-    }
-
-    if (millis() - wiilasttime  > 15){
-      // if (wii.update(controllerdata[0]) == true){
-      //   xQueueOverwrite(controller_TO_mainQueue,&controllerdata[0]);
-      // }
-
-      // if (wii1.update(controllerdata[1]) == true){
-      //   xQueueOverwrite(controller1_TO_mainQueue,&controllerdata[1]);
-      // }
-
-      wiilasttime = millis();
-    }
-    
-
-    if (btn.isPressed(FRONT_BTNA)){
-      menu = !menu;
-      if (menu == false){
-
-        Serial.printf("UI = %02x\nGI = %02x\nEI = %02x\nDI = %02x\nCH = %02x\nMODE = %02x\n",config_items[userid][config[0]]
-        ,config_items[groupid][config[1]],config_items[deviceid][config[2]],config_items[targetid][config[3]],config_items[channel][config[4]],config_items[mode][config[5]]);
-
-
-        for (int i = 0;i < 5;i++){
-          result_config.configdata[i] = config_items[i][config[i]];
-        }
-        
-        xQueueOverwrite(config_TO_mainQueue,&result_config);
-      }
-
-
-    }
-    if (menu == true){
-      if (btn.isPressed(FRONT_BTNB)){
-        select_menu_count++;
-        page = select_menu_count/5;
-        select_menu_count = select_menu_count % 6;
-
-      }
-      if (btn.isPressed(FRONT_BTNC)){
-        config[select_menu_count]--;
-        if (config[select_menu_count] < 0){
-          config[select_menu_count] = 3;
-        }
-
-      }
-      if (btn.isPressed(FRONT_BTND)){
-        config[select_menu_count]++;
-        config[select_menu_count] = config[select_menu_count] % 4;
-      }
-    }
-
-    
-
-    display.display();
-    btn.release();
-    vTaskDelay(1);
-
-  }
-}
-
-void setup() {
-  
-//Queueを作ってからタスクを召喚する
-  controller_TO_mainQueue = xQueueCreate(1,sizeof(controller::ControllerData));
-  controller1_TO_mainQueue = xQueueCreate(1,sizeof(controller::ControllerData));
-  config_TO_mainQueue = xQueueCreate(1,sizeof(ConfigData));
-  main_TO_MuQueue = xQueueCreate(1,sizeof(QueueData));
-
-
-  xTaskCreateUniversal(main_task,"main", 8192, NULL, 2, &Main_Handle, CONFIG_ARDUINO_RUNNING_CORE);
-  xTaskCreateUniversal(Mu,"Mu", 8192, NULL, 2, &Mu_Handle, CONFIG_ARDUINO_RUNNING_CORE);
-  xTaskCreateUniversal(Display,"Display", 8192, NULL, 2, &Display_Handle, CONFIG_ARDUINO_RUNNING_CORE);
-
-}
-
-void loop() {
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "esp_task_wdt.h"
+#include <Adafruit_GFX.h>
+#include <Adafruit_SSD1306.h>
+#include <LittleFS.h>
+#include <InterruptButtonManager.h>
+#include "pin.h"
+#include <MUwrapper.hpp>
+#include <MuReceiver.hpp>
+#include <TxPolicy.h>
+#include <Airtime.h>
+#include <Mailbox.h>
+#include <LatencyTrace.h>
+#include <I2cArbiter.h>
+#include <OledRenderer.h>
+#include <RtosMutex.h>
+#include <EmergencyStop.h>
+#include <ReliableLink.h>
+#include <FrameCheck.h>
+#include <MuConfigQueue.h>
+#include <ChannelSurvey.h>
+#include <LinkTelemetry.h>
+#include <InputRecorder.h>
+#include <wiiClassic.h>
+#include <controller.h>
+
+TaskHandle_t Main_Handle = NULL;
+TaskHandle_t Mu_Handle = NULL;
+TaskHandle_t Display_Handle = NULL;
+TaskHandle_t MuRx_Handle = NULL;
+TaskHandle_t Input_Handle = NULL;
+TaskHandle_t EStop_Handle = NULL;
+
+QueueHandle_t mu_TO_mainQueue = NULL;
+QueueHandle_t mu_TO_MuQueue = NULL;
+
+
+
+controller::ControllerData controller_main[2];
+
+//入力が変わらないときの送信間隔[ms]
+#ifndef MU_HEARTBEAT_MS
+#define MU_HEARTBEAT_MS 100
+#endif
+//送信時間の上限[‰]と連続して使える送信時間[us]
+#ifndef MU_AIRTIME_DUTY_PERMILLE
+#define MU_AIRTIME_DUTY_PERMILLE 800
+#endif
+#ifndef MU_AIRTIME_BURST_US
+#define MU_AIRTIME_BURST_US 100000
+#endif
+//1にすると1秒ごとに送信の統計(送信数、捨てた数、送信時間の割合、送信判定の内訳、確認応答付き送信の結果)をUSBに出す
+#ifndef MU_STATS_PRINT
+#define MU_STATS_PRINT 0
+#endif
+
+//コントローラーデータの送信形式 controller::FORMAT_LEGACYは旧受信機と互換の5バイト
+#ifndef MU_CONTROLLER_FORMAT
+#define MU_CONTROLLER_FORMAT controller::FORMAT_LEGACY
+#endif
+//1にすると2台のコントローラーを1フレームで送る(受信側はcontroller::unpackControllersで展開)
+#ifndef MU_DUAL_CONTROLLER
+#define MU_DUAL_CONTROLLER 0
+#endif
+//コントローラーのフレームに付ける連番とCRC FRAME_CHECK_NONEは旧受信機と互換(受信側はFrameCheckerで確かめる)
+#ifndef MU_FRAME_CHECK
+#define MU_FRAME_CHECK FRAME_CHECK_NONE
+#endif
+#if MU_DUAL_CONTROLLER
+//2台分のフレームに検査を付けるとMU_MAX_DATALENに収まらない
+static_assert(MU_FRAME_CHECK == FRAME_CHECK_NONE, "MU_FRAME_CHECK needs MU_DUAL_CONTROLLER 0");
+#endif
+//1にすると設定の変更を確認応答付きで送る(受信側はReliableReceiverで受けて確認応答を返す)
+#ifndef MU_RELIABLE_CONFIG
+#define MU_RELIABLE_CONFIG 0
+#endif
+//確認応答が来ないときに送り直すまでの時間[us]と、あきらめるまでの時間[us]
+#ifndef MU_RELIABLE_RTO_US
+#define MU_RELIABLE_RTO_US 200000
+#endif
+#ifndef MU_RELIABLE_DEADLINE_US
+#define MU_RELIABLE_DEADLINE_US 2000000
+#endif
+//MUの設定変更の応答を待つ時間[us]と送る回数 送信待ちの@DTのあとに処理されるので長めにする
+#ifndef MU_CONFIG_TIMEOUT_US
+#define MU_CONFIG_TIMEOUT_US 500000
+#endif
+#ifndef MU_CONFIG_ATTEMPTS
+#define MU_CONFIG_ATTEMPTS 3
+#endif
+//1にすると起動時にチャンネルの混み具合を調べる。非常停止中に起動したときだけ調べる(非常停止中なら画面のSW6でも調べられる)
+#ifndef MU_SURVEY_AT_BOOT
+#define MU_SURVEY_AT_BOOT 0
+#endif
+//1にすると調べ終わったら一番空いているチャンネルに切り替える(0なら画面に出すだけ)
+#ifndef MU_SURVEY_AUTO
+#define MU_SURVEY_AUTO 0
+#endif
+//調べるチャンネル(既定はメニューで選べるチャンネル)と、1チャンネルを調べる時間[ms]、全体の上限[ms]
+#ifndef MU_SURVEY_CHANNELS
+#define MU_SURVEY_CHANNELS {0x08, 0x0E, 0x1F, 0x2E}
+#endif
+#ifndef MU_SURVEY_DWELL_MS
+#define MU_SURVEY_DWELL_MS 400
+#endif
+#ifndef MU_SURVEY_MAX_MS
+#define MU_SURVEY_MAX_MS 3000
+#endif
+//回線の状態を測るために@RAを送る間隔[ms] 0なら受信電波強度は測らない
+#ifndef MU_TELEMETRY_RSSI_MS
+#define MU_TELEMETRY_RSSI_MS 1000
+#endif
+//1にすると起動時から回線の統計をUSBにバイナリで出す(USBから'T'でいつでも切り替えられる)
+//出している間はUSBに文字を出さない
+#ifndef MU_TELEMETRY_STREAM
+#define MU_TELEMETRY_STREAM 0
+#endif
+//入力を記録するPSRAMのバイト数 0かPSRAMがなければ記録しない(1件17バイト、入力取得が10ms周期なら4MBで約40分)
+#ifndef INPUT_RECORD_BYTES
+#define INPUT_RECORD_BYTES (4 * 1024 * 1024)
+#endif
+//1にすると非常停止中にUSBから'S'で記録をフラッシュ(LittleFS)に書き出し、'F'で読み込める
+#ifndef INPUT_RECORD_SPILL
+#define INPUT_RECORD_SPILL 1
+#endif
+//フラッシュに書き出す件数の上限(最後の分) 10ms周期なら30000件で5分、約500KB
+#ifndef INPUT_RECORD_SPILL_MAX
+#define INPUT_RECORD_SPILL_MAX 30000
+#endif
+#define INPUT_RECORD_PATH "/input.rec"
+//この時間データが来ないコントローラーはつながっていないとみなす[ms]
+#define PAD_TIMEOUT_MS 100
+//入力取得タスクの周期[ms]と動かすコア(画面・送信と別のコア)
+#ifndef INPUT_PERIOD_MS
+#define INPUT_PERIOD_MS 10
+#endif
+#if CONFIG_ARDUINO_RUNNING_CORE == 0
+#define INPUT_TASK_CORE 1
+#else
+#define INPUT_TASK_CORE 0
+#endif
+//画面を送る最小間隔[ms] 画面はP1と同じI2Cバスなので送りすぎない
+#ifndef OLED_MIN_FLUSH_MS
+#define OLED_MIN_FLUSH_MS 50
+#endif
+//非常停止フレームを送る間隔[ms] 1フレームの送信に約27msかかるのでそれより長くする
+#ifndef ESTOP_REPEAT_MS
+#define ESTOP_REPEAT_MS 50
+#endif
+//非常停止スイッチのチャタリング除去時間[ms] 最初の変化はすぐ通すので遅延にはならない
+#define ESTOP_DEBOUNCE_MS 15
+//コントローラー1回の読み出しに空けておく時間[us]と、その前に空ける余裕[us]
+#define I2C_CONTROLLER_WINDOW_US 2000
+#define I2C_CONTROLLER_GUARD_US 300
+//画面を送るときのI2Cクロック
+#define OLED_I2C_CLOCK 400000
+//1にすると1秒ごとにI2Cバス0の統計(使用率、コントローラーの最大待ち時間、画面の送信数)をUSBに出す
+#ifndef I2C_STATS_PRINT
+#define I2C_STATS_PRINT 0
+#endif
+
+struct QueueData{
+  uint8_t Mudata[12];
+  uint8_t len;
+  int config[5];
+  uint32_t config_seq;//設定が変わるたびに増える
+  LATENCY_FIELD
+
+};
+enum mu_config_items{
+  userid,
+  groupid,
+  deviceid,
+  targetid,
+  channel ,
+  mode
+};
+
+//入力取得タスクが一定周期で出すデータ
+struct InputSample{
+  uint32_t time_us;//取得した時刻
+  uint32_t seq;//連番
+  controller::ControllerData pad[2];
+  uint8_t connected;//bit0:pad[0] bit1:pad[1]
+  bool emergency;
+  LATENCY_FIELD
+};
+
+struct ConfigData{
+  int configdata[5];
+};
+
+//チャンネル調査の状態と結果(画面に出す)
+struct SurveyResult{
+  bool running;
+  uint8_t best;//一番空いているチャンネル 0:まだ調べていない
+  uint16_t busy_permille;//そのチャンネルで電波が出ていた割合
+  bool applied;//切り替えたか
+};
+
+//タスク間の受け渡しは最新の値だけを残す(待たない・新しい値を捨てない)
+Mailbox<InputSample> input_TO_main;
+Mailbox<ConfigData> config_TO_main;
+Mailbox<QueueData> main_TO_Mu;
+Mailbox<SurveyResult> survey_TO_display;
+Mailbox<LinkSummary> link_TO_display;
+
+//画面からチャンネル調査を頼む(起動時に調べるときは非常停止タスクが非常停止中か見てから頼む)
+std::atomic<bool> survey_request{false};
+//チャンネルを調べていて、元のチャンネルに戻ったと確かめられていない間はtrue。非常停止フレームも送らない
+std::atomic<bool> survey_hold{false};
+//回線の統計をUSBに出すか
+std::atomic<bool> telemetry_stream{MU_TELEMETRY_STREAM != 0};
+
+//USBに文字を出す。回線の統計をバイナリで出している間は、記録の間に文字が混ざらないよう捨てる
+void usbPrintf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+void usbPrintf(const char *format, ...){
+  if (telemetry_stream.load()){
+    return;
+  }
+  char buf[128];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  Serial.print(buf);
+}
+
+//入力の記録(バッファはsetupでPSRAMから取る)。mainタスクだけが使う
+InputRecorder input_recorder;
+//記録を再生しているか(画面に出す)
+std::atomic<bool> replay_active{false};
+//フラッシュに書き出せるか
+bool input_spill_ready = false;
+
+//非常停止中か。非常停止タスクだけが書く。入力が来るまでは非常停止
+std::atomic<bool> estop_active{true};
+//Serial1への書き込みは非常停止タスクとMuタスクで共用する
+RtosMutex uart_lock;
+
+//I2Cバスはこれを通して使う。WireはP1と画面で共用
+I2cArbiter i2c_bus0(Wire, i2cMicros);
+I2cArbiter i2c_bus1(Wire1, i2cMicros);
+
+//確認応答付きの送信。Muタスクだけが使う
+ReliableSender mu_reliable(MU_RELIABLE_RTO_US, MU_RELIABLE_DEADLINE_US);
+
+uint8_t generate_mudata(uint8_t *buf, bool emergency, uint8_t pad_mask){//最大１２バイト
+
+  if(emergency){  //非常停止aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa
+    buf[0] = 'E';
+    return 1;
+  }else if(MU_DUAL_CONTROLLER){
+    //2台分を1フレームに詰める、つながっていないコントローラーは詰めない
+    return controller::packControllers(buf,controller_main,pad_mask,MU_CONTROLLER_FORMAT);
+  }else{
+    //packet_tを経由せずbufに直接詰める
+    return controller_main[0].pack(buf,MU_CONTROLLER_FORMAT);
+  }
+}
+
+
+//Mu2にシリアルで文字を送る関数Muwrapperのコールバックを受けて実行される
+void SendData(MUEvent event, uint8_t *data, uint8_t len){
+  if (event == MU_EVENT_ERROR){
+    usbPrintf("MU_EVENT_ERROR");
+  }
+  if (event == MU_EVENT_SEND_REQUEST){
+      uart_lock.lock();
+      Serial1.write(data,len);
+      uart_lock.unlock();
+  }
+}
+
+
+//Mu2からの受信イベントを他のタスクに渡す。キューが一杯なら捨てる
+//確認応答と*IRは確認応答付きの送信のために、設定コマンドの応答は設定変更のためにMuタスクにも渡す
+bool PublishMuEvent(void *context, const MuRxEvent &event){
+  bool ack = event.event == MU_EVENT_RX_COMPLETE && ReliableReceiver::isAck(event.data, event.len);
+  bool ir = event.event == MU_EVENT_ERROR && event.data[0] == MU_ERR_CATCH_IR;
+  bool config = event.event == MU_EVENT_RESPONSE && !(event.data[0] == 'D' && event.data[1] == 'T');
+  if (ack || ir || config){
+    bool queued = xQueueSend(mu_TO_MuQueue, &event, 0) == pdTRUE;
+    if (Mu_Handle != NULL){
+      xTaskNotifyGive(Mu_Handle);
+    }
+    if (!ir){
+      return queued;
+    }
+  }
+  return xQueueSend(mu_TO_mainQueue, &event, 0) == pdTRUE;
+}
+
+MuReceiver<HardwareSerial> mu_rx(Serial1, PublishMuEvent);
+
+//↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓タスク↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓↓
+
+//mainタスク
+void main_task(void *pvParameters) {
+  Serial.begin(9600);
+
+  uint8_t Mudata[12];
+  
+  QueueData queue_send_data;
+  ConfigData result_config;
+  memset(&result_config, 0, sizeof(result_config));
+  MuRxEvent mu_event;
+  InputSample sample;
+  memset(&sample, 0, sizeof(sample));
+  sample.emergency = true;//最初の入力が来るまでは非常停止
+  InputSample live;
+
+  //入力の記録と再生。再生したものは記録しない
+  //フラッシュから読み込んだら、再生し終わるまで記録を止める(読み込んだ記録に今の入力が混ざらないように)
+  InputReplay replay(input_recorder);
+  InputFrame frame;
+  bool recording = true;
+
+  int lasttime = 0;
+  uint32_t sampletime = 0;
+  uint8_t pad_mask = 0;
+  uint32_t config_seq = 0;
+    
+  while (1){
+    //入力取得タスクから新しい入力が来るか1tick経つまで待つ
+    ulTaskNotifyTake(pdTRUE, 1);
+    bool fresh = input_TO_main.read(live);
+    if (replay.running()){
+      //再生中は入力取得タスクの入力の代わりに記録を元の間隔で使う
+      fresh = replay.next(micros(), frame);
+      if (fresh){
+        sample.time_us = frame.time_us;
+        memcpy(sample.pad, frame.pad, sizeof(sample.pad));
+        sample.connected = frame.connected;
+        sample.emergency = frame.emergency;
+        LATENCY_STAMP(sample, LAT_I2C_READ);
+      }
+      if (!replay.running()){
+        const ReplayStats &st = replay.stats();
+        usbPrintf("REPLAY done %u samples, late max %uus\n", st.played, st.max_late_us);
+        replay_active.store(false);
+        recording = true;
+      }
+    }else if (fresh){
+      sample = live;
+      if (recording){
+        frame.time_us = sample.time_us;
+        memcpy(frame.pad, sample.pad, sizeof(frame.pad));
+        frame.connected = sample.connected;
+        frame.emergency = sample.emergency;
+        input_recorder.add(frame);
+      }
+    }
+    if (config_TO_main.read(result_config)){
+      config_seq++;
+    }
+
+    //新しい入力はすぐ送信データにする、入力が途絶えても15ms毎には作る
+    if (fresh || millis() - lasttime > 15){
+      if (fresh){
+        memcpy(controller_main, sample.pad, sizeof(controller_main));
+        sampletime = millis();
+      }
+
+      //入力が途絶えたらコントローラーはつながっていないとみなす
+      pad_mask = millis() - sampletime < PAD_TIMEOUT_MS ? sample.connected : 0;
+
+      queue_send_data.len = generate_mudata(Mudata, sample.emergency, pad_mask);
+      memcpy(&queue_send_data.config, &result_config.configdata, sizeof(result_config.configdata));
+      queue_send_data.config_seq = config_seq;
+      memcpy(&queue_send_data.Mudata, &Mudata, sizeof(Mudata));
+      LATENCY_COPY(queue_send_data, sample);
+      LATENCY_STAMP(queue_send_data, LAT_PACK);
+      
+
+      //出力
+      main_TO_Mu.publish(queue_send_data);
+      if (Mu_Handle != NULL){
+        xTaskNotifyGive(Mu_Handle);
+      }
+      lasttime = millis();
+    }
+    
+
+    
+
+  //USBから'T'で回線の統計のバイナリ出力を切り替え、'P'で記録の再生を停止
+  //非常停止中は'P'で記録の再生を開始、'D'で記録をUSBに出力、'S'でフラッシュに書き出し、'F'でフラッシュから読み込み
+  //(再生中は操作を記録のとおりに送るので、非常停止を解除して始めさせる。書き出し・読み込みの間は送信データを作れない)
+  //計測時は'L'で遅延のヒストグラムを出力、'R'でリセット
+  //(回線の統計のバイナリ出力中は'D'と'L'の出力が混ざるので受け付けない)
+  if (Serial.available()){
+    char c = Serial.read();
+    bool pit = estop_active.load() && !replay.running();
+    if (c == 'T'){
+      telemetry_stream.store(!telemetry_stream.load());
+    }else if (c == 'P'){
+      if (replay.running()){
+        replay.stop();
+        usbPrintf("REPLAY stop %u samples\n", replay.stats().played);
+        replay_active.store(false);
+        recording = true;
+      }else if (pit && replay.start(micros())){
+        usbPrintf("REPLAY start %u samples\n", (unsigned)replay.length());
+        replay_active.store(true);
+      }
+    }else if (c == 'D' && pit && !telemetry_stream.load()){
+      input_recorder.save(Serial);
+    }
+#if INPUT_RECORD_SPILL
+    else if (c == 'S' && pit && input_spill_ready){
+      File f = LittleFS.open(INPUT_RECORD_PATH, FILE_WRITE);
+      bool ok = f && input_recorder.save(f, INPUT_RECORD_SPILL_MAX);
+      f.close();
+      usbPrintf("RECORD save %s\n", ok ? "ok" : "failed");
+    }else if (c == 'F' && pit && input_spill_ready){
+      File f = LittleFS.open(INPUT_RECORD_PATH, FILE_READ);
+      bool ok = f && input_recorder.load(f);
+      f.close();
+      recording = !ok;
+      usbPrintf("RECORD load %s %u samples\n", ok ? "ok" : "failed", (unsigned)input_recorder.count());
+    }
+#endif
+#ifdef LATENCY_TRACE
+    if (c == 'L' && !telemetry_stream.load()){
+      latencyTrace().dump(Serial);
+    }else if (c == 'R'){
+      latencyTrace().reset();
+    }
+#endif
+  }
+
+  //Mu2からの受信イベント
+  while (xQueueReceive(mu_TO_mainQueue, &mu_event, 0) == pdTRUE){
+    if (mu_event.event == MU_EVENT_ERROR && mu_event.data[0] == MU_ERR_CATCH_IR){
+      usbPrintf("MU_IR\n");
+    }
+  }
+  }
+}
+
+
+
+
+
+//Mu2のタスク
+void Mu(void *pvParameters){
+
+  MUWrapper mu(SendData);
+  //変化したらすぐ送信、変化がなければハートビート間隔で送信
+  TxPolicy policy(MU_HEARTBEAT_MS);
+  //送信時間の見積もりに基づくレート制限。送れない間は最新のフレームだけ残す
+  MuRadioParams radio;
+  //検査は送る直前に付けるので、その分も送信時間に含める
+  radio.air_overhead_bytes += frameCheckOverhead(MU_FRAME_CHECK);
+  AirtimeScheduler scheduler(radio, MU_AIRTIME_DUTY_PERMILLE, MU_AIRTIME_BURST_US);
+  const uint8_t *send_frame;
+  uint8_t send_len;
+  uint32_t statstime = 0;
+  //回線の統計。送ったフレーム数と上書きで捨てた数はここで数え、受信側は受信タスクの統計を使う
+  LinkTelemetry telemetry;
+  LinkCounters link_counters;
+  uint8_t telemetry_record[TELEMETRY_RECORD_LEN];
+  uint32_t rssitime = 0;
+  //検査を付けたフレームと連番。連番は送ったフレームごとに増やすので、受信側で飛びが数えられる
+  uint8_t sealed_frame[MU_MAX_DATALEN];
+  uint8_t frame_seq = 0;
+  //確認応答付きで送ったのが最後の送信か(*IRがどちらのものかの判断に使う)
+  bool reliable_last = false;
+  MuRxEvent mu_event;
+
+  mu.init(8);
+  //MUの設定はinitの値から始め、メニューで変わったら差分だけを応答を待ちながら送る
+  MuConfig mu_config = {4, 8, 1, 0};
+  MuConfigQueue config_queue(mu_config, MU_CONFIG_TIMEOUT_US, MU_CONFIG_ATTEMPTS);
+  uint32_t config_seq = 0;
+  uint32_t config_switches = 0;
+  //受信機への設定の通知が終わってからMUの設定を変える
+  bool config_waiting = false;
+#if MU_RELIABLE_CONFIG
+  //受信機に知らせる設定(メニューの項目の順)。userid(0)は未設定
+  uint8_t config_frame[5] = {0, mu_config.gi, mu_config.ei, mu_config.di, mu_config.ch};
+#endif
+
+  //チャンネル調査 調べている間はコントローラーのデータを送らない
+  SurveyParams survey_params;
+  survey_params.dwell_us = MU_SURVEY_DWELL_MS * 1000;
+  survey_params.max_total_us = MU_SURVEY_MAX_MS * 1000;
+  ChannelSurvey survey(survey_params);
+  const uint8_t survey_channels[] = MU_SURVEY_CHANNELS;
+  uint32_t survey_frames = 0;
+  bool surveying = false;
+
+  QueueData queue_data;
+  queue_data.len = 0;
+  queue_data.config_seq = 0;
+  //まだ送信判定をしていない新しいフレームがあるか
+  bool fresh = false;
+#ifdef LATENCY_TRACE
+  //送信待ちのフレームの計測時刻
+  QueueData queue_trace;
+#endif
+
+  while (1){
+
+    //新しいデータが来るか1tick経つまで待つ
+    ulTaskNotifyTake(pdTRUE, 1);
+    if (main_TO_Mu.read(queue_data)){
+      LATENCY_STAMP(queue_data, LAT_HANDOFF);
+      fresh = true;
+    }
+    //受信タスクからの確認応答、*IR、設定コマンドの応答
+    while (xQueueReceive(mu_TO_MuQueue, &mu_event, 0) == pdTRUE){
+      if (mu_event.event == MU_EVENT_RX_COMPLETE){
+        mu_reliable.onAck(mu_event.data, mu_event.len, micros());
+      }else if (mu_event.event == MU_EVENT_RESPONSE){
+        if (survey.running()){
+          survey.onResponse(mu_event.data, mu_event.len, micros());
+        }else if (!telemetry.onResponse(mu_event.data, mu_event.len)){
+          config_queue.onResponse(mu_event.data, mu_event.len);
+        }
+      }else if (reliable_last){
+        mu_reliable.onTxError();
+      }
+    }
+
+    //1秒ごとの統計 チャンネルの調査中も止めない
+    if (millis() - statstime > 1000){
+      const AirtimeStats &st = scheduler.stats();
+#if MU_STATS_PRINT
+      usbPrintf("air %u/%u sent, %u stale, %u permille\n",st.sent,st.offered,st.dropped_stale,st.utilization());
+      const TxPolicyStats &ps = policy.stats();
+      usbPrintf("policy %u changed, %u heartbeat, %u suppressed\n",ps.sent,ps.forced,ps.suppressed);
+#endif
+      link_counters.stale_drops += st.dropped_stale;
+      scheduler.resetStats();
+      policy.resetStats();
+#if MU_STATS_PRINT
+      const ReliableStats &rs = mu_reliable.stats();
+      if (rs.queued > 0){
+        usbPrintf("reliable %u/%u delivered, %u expired, %u retransmits, %u permille, max %uus\n",
+          rs.delivered,rs.queued,rs.expired,rs.retransmits,rs.deliveryPermille(),rs.latency.max());
+      }
+#endif
+      const MuRxStats &rx = mu_rx.stats();
+      link_counters.received = rx.frames;
+      memcpy(link_counters.errors, rx.errors, sizeof(link_counters.errors));
+      link_counters.queue_drops = rx.dropped;
+      telemetry.sample(link_counters);
+      LinkSummary summary;
+      telemetry.summarize(summary);
+      link_TO_display.publish(summary);
+      uint8_t n = telemetry.encode(telemetry_record);
+      if (n > 0 && telemetry_stream.load()){
+        Serial.write(telemetry_record, n);
+      }
+      statstime = millis();
+    }
+    //受信電波強度 コマンドの応答を待っている間は送らない
+    if (MU_TELEMETRY_RSSI_MS > 0 && !surveying && !config_queue.busy() && millis() - rssitime > MU_TELEMETRY_RSSI_MS){
+      mu.query("RA");
+      rssitime = millis();
+    }
+
+    //設定を変えている途中でなければ調べ始める。調べている間は何も送れないので、非常停止中の頼みだけ受ける
+    if (!survey.running() && !config_queue.busy() && !config_waiting && survey_request.exchange(false) && estop_active.load()){
+      //非常停止タスクが@CHの後に非常停止フレームを書かないよう、先に止める
+      survey_hold.store(true);
+      surveying = survey.start(survey_channels, sizeof(survey_channels), config_queue.current().ch, micros());
+      survey_frames = mu_rx.stats().frames;
+      SurveyResult result = {true, 0, 0, false};
+      survey_TO_display.publish(result);
+    }
+    if (surveying){
+      //調べているチャンネルで受信した*DR(同じグループの他の送信機)
+      uint32_t frames = mu_rx.stats().frames;
+      survey.onFrames(frames - survey_frames);
+      survey_frames = frames;
+      //非常停止が解除されたら残りは調べずに戻る(戻るまではコントローラーのデータも送れない)
+      if (!estop_active.load()){
+        survey.stop(micros());
+      }
+      if (survey.poll(mu, micros())){
+        policy.invalidate();
+        continue;
+      }
+      //終わった(最後の応答で終わることもあるのでpollの戻り値で見る)
+      surveying = false;
+      //元のチャンネルに戻せたかわからなければ、設定のキューから送り直す
+      if (!survey.returned()){
+        config_queue.invalidate("CH", micros());
+      }
+      for (uint8_t i = 0; i < survey.count(); i++){
+        const ChannelReport &r = survey.ranked(i);
+        usbPrintf("SURVEY ch=%02x samples=%u busy=%u mean=%d max=%d frames=%u\n",
+          r.ch, r.samples, r.busy_permille, r.rssi_mean_dbm, r.rssi_max_dbm, r.frames);
+      }
+      SurveyResult result = {false, survey.best(), survey.ranked(0).busy_permille, false};
+#if MU_SURVEY_AUTO
+      if (survey.best() != mu_config.ch){
+        mu_config.ch = survey.best();
+#if MU_RELIABLE_CONFIG
+        config_frame[channel] = mu_config.ch;
+        mu_reliable.send(MSG_CONFIG, config_frame, sizeof(config_frame), micros());
+#endif
+        config_waiting = true;
+        result.applied = true;
+      }
+#endif
+      usbPrintf("SURVEY best=%02x in %uus\n", survey.best(), survey.elapsedUs());
+      survey_TO_display.publish(result);
+    }
+    //元のチャンネルに戻ったと確かめられたら(戻せなかったときは設定のキューが送り直し終えたら)非常停止フレームを再開する
+    if (survey_hold.load() && !surveying && !config_queue.busy()){
+      survey_hold.store(false);
+    }
+
+    if (queue_data.len == 0){
+      continue;
+    }
+
+    //設定はピットで非常停止中に変えることが多いので、非常停止中も処理する
+    if (queue_data.config_seq != config_seq){
+      config_seq = queue_data.config_seq;
+      mu_config.gi = queue_data.config[groupid];
+      mu_config.ch = queue_data.config[channel];
+      mu_config.di = queue_data.config[targetid];
+      mu_config.ei = queue_data.config[deviceid];
+#if MU_RELIABLE_CONFIG
+      //確認応答付きで受信機に知らせる。届く前に変わったら新しいほうだけ送る
+      for (int i = 0; i < 5; i++){
+        config_frame[i] = queue_data.config[i];
+      }
+      mu_reliable.send(MSG_CONFIG, config_frame, sizeof(config_frame), micros());
+#endif
+      config_waiting = true;
+    }
+
+    //確認応答付きのフレームはコントローラーのデータより先に送る
+    if (mu_reliable.peek(micros(),send_frame,send_len) && scheduler.spend(micros(),send_len)){
+      mu.send(send_frame,send_len);
+      link_counters.sent++;
+      mu_reliable.sent(micros());
+      reliable_last = true;
+    }
+
+    //受信機に届いたか、あきらめたらMUの設定を変える
+    if (config_waiting && !mu_reliable.pending(MSG_CONFIG)){
+      config_queue.apply(mu_config, micros());
+      config_waiting = false;
+    }
+    config_queue.poll(mu, micros());
+    if (config_queue.stats().switches != config_switches){
+      config_switches = config_queue.stats().switches;
+      MuConfig c = config_queue.current();
+      usbPrintf("MU config GI=%02x CH=%02x DI=%02x EI=%02x in %uus\n",
+        c.gi, c.ch, c.di, c.ei, config_queue.stats().last_switch_us);
+    }
+
+    //非常停止中は非常停止タスクが送るので通常の送信はしない。解除後の最初のフレームはすぐ送る
+    //チャンネルの調査のあと元のチャンネルに戻ったと確かめるまでも送らない
+    if (estop_active.load() || survey_hold.load()){
+      policy.invalidate();
+      continue;
+    }
+
+    //起きるたびに判定すると送らなかった数がループの回数になるので、新しいフレームかハートビートの時だけ判定する
+    if ((fresh || policy.due(millis())) && policy.check(queue_data.Mudata,queue_data.len,millis())){
+      scheduler.offer(queue_data.Mudata,queue_data.len);
+      LATENCY_COPY(queue_trace, queue_data);
+    }
+    fresh = false;
+
+    if (scheduler.poll(micros(),send_frame,send_len)){
+      if (MU_FRAME_CHECK != FRAME_CHECK_NONE){
+        send_len = sealFrame(sealed_frame,send_frame,send_len,frame_seq++,MU_FRAME_CHECK);
+        send_frame = sealed_frame;
+      }
+      for (int i = 0; i < send_len; i++){
+        usbPrintf("%d ",send_frame[i]);
+      }
+      usbPrintf("\n");
+
+      //送信
+      LATENCY_STAMP(queue_trace, LAT_SEND);
+      mu.send(send_frame,send_len);
+      link_counters.sent++;
+      reliable_last = false;
+#ifdef LATENCY_TRACE
+      //計測時のみ送信完了まで待つ
+      Serial1.flush();
+#endif
+      LATENCY_STAMP(queue_trace, LAT_TX_DONE);
+      LATENCY_COMMIT(queue_trace);
+    }
+
+  }
+
+}
+
+//入力取得タスク 一定周期でコントローラーと非常停止を読み、時刻付きで渡す
+void Input(void *pvParameters){
+  WiiClassic wii(i2c_bus0.wire());
+  WiiClassic wii1(i2c_bus1.wire());
+  i2c_bus0.lock(I2C_CONTROLLER);
+  wii.init();
+  i2c_bus0.unlock();
+  i2c_bus1.lock(I2C_CONTROLLER);
+  wii1.init();
+  i2c_bus1.unlock();
+
+  InputSample sample;
+  memset(&sample, 0, sizeof(sample));
+  TickType_t wake = xTaskGetTickCount();
+
+  while (1){
+    //前回起きた時刻から一定周期で起きる(処理時間によって周期がずれない)
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(INPUT_PERIOD_MS));
+    uint32_t woke = micros();
+
+    //画面の送信中なら終わるまで待つ(画面は予約枠の前で止まるので待ちは短い)
+    i2c_bus0.lock(I2C_CONTROLLER, woke);
+    wii.sample(sample.pad[0]);
+    i2c_bus0.unlock();
+    i2c_bus1.lock(I2C_CONTROLLER, woke);
+    wii1.sample(sample.pad[1]);
+    i2c_bus1.unlock();
+
+    sample.time_us = micros();
+    sample.seq++;
+    sample.connected = (wii.isConnected() ? 1 : 0) | (wii1.isConnected() ? 2 : 0);
+    LATENCY_STAMP_AT(sample, LAT_I2C_READ, wii.readTime());
+    sample.emergency = estop_active.load();
+    input_TO_main.publish(sample);
+    xTaskNotifyGive(Main_Handle);
+  }
+}
+
+//非常停止タスク 非常停止スイッチの割り込みで起き、通常の送信を待たずに非常停止フレームを送る
+//解除されるまでESTOP_REPEAT_MS毎に送り続ける
+void EStop(void *pvParameters){
+  //非常停止スイッチは押されて(LOW)いる間が正常、離れると非常停止
+  InterruptButtonManager<1> btn;
+  btn.add(Emergency, ESTOP_DEBOUNCE_MS);
+  EmergencyBurst burst(ESTOP_REPEAT_MS * 1000);
+  if (!btn.isHold(0)){
+    burst.start(micros());
+  }
+  estop_active.store(burst.isActive());
+  //起動時の調査は非常停止中だけ(走れる状態で調べると、その間コントローラーのデータが届かない)
+  if (MU_SURVEY_AT_BOOT && burst.isActive()){
+    survey_request.store(true);
+  }
+  ButtonEvent e;
+
+  while (1){
+    //非常停止中でなければスイッチが変化するまで寝ている
+    uint32_t timeout_ms = burst.isActive() ? (burst.untilNext(micros()) + 999) / 1000 : BUTTON_WAIT_FOREVER;
+    if (btn.wait(e, timeout_ms)){
+      if (e.kind == ButtonEvent::RELEASE){
+        burst.start(e.time_us);
+        estop_active.store(true);
+      }else{
+        burst.stop();
+        estop_active.store(false);
+      }
+    }
+
+    if (burst.untilNext(micros()) > 0 || !burst.isActive()){
+      continue;
+    }
+    uart_lock.lock();
+    //チャンネルの調査中は調べているチャンネルに出てしまうので送らない
+    //Muタスクは止めてから@CHを書くので、同じロックの中で見れば調べるチャンネルには出ない
+    burst.hold(survey_hold.load());
+    bool send = burst.due(micros());
+    uint32_t uart_us = 0;
+    if (send){
+      Serial1.write(burst.frame(), burst.frameLength());
+      uart_us = micros();
+      //最初のフレームだけは送信完了まで待って遅延を測る
+      if (burst.isFirst()){
+        Serial1.flush();
+      }
+    }
+    uart_lock.unlock();
+    if (send){
+      uint32_t done_us = micros();
+      if (burst.recordFirst(uart_us, done_us)){
+        const EmergencyStats &st = burst.stats();
+        usbPrintf("ESTOP %uus to UART, %uus to TX done (worst %uus/%uus)\n",
+          uart_us - burst.since(), done_us - burst.since(), st.to_uart.max(), st.to_tx_done.max());
+      }
+    }
+  }
+}
+
+//Mu2の受信タスク UARTの受信イベントで起き、溜まったデータをまとめて解析する
+void MuRx(void *pvParameters){
+  while (1){
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    mu_rx.drain();
+  }
+}
+
+//画面タスク
+void Display(void *pvParameters){
+
+  #define SCREEN_I2C_ADDR 0x3c // or 0x3C
+  #define OLED_RST_PIN -1      // Reset pin (-1 if not available)
+  
+  bool menu = false;
+  int page = 0;
+  //メニューの外ではSW5で回線の状態の画面に切り替える
+  bool status = false;
+
+  
+  String menu_items[6] = {
+    "userid",
+    "groupid",
+    "deviceid",
+    "targetid",
+    "channel" ,
+    "mode"
+  };
+  int config_items[6][4] ={
+    {1, 2, 3, 4},
+    {1, 2, 3, 4},
+    {0, 1, 2, 4},
+    {0, 1, 2, 4},
+    {8, 14, 31, 46},
+    {5,12,5,12}
+  };
+
+  ConfigData result_config;
+
+
+  int config[6] ={0,3,0,1,0,0};
+  int select_menu_count = 0;
+  
+  Adafruit_SSD1306 display(128, 64, &Wire, OLED_RST_PIN);
+  //初期化は一度だけなのでまとめて送る(この間だけP1の読み出しが待たされる)
+  i2c_bus0.lock(I2C_DISPLAY);
+  display.begin(SSD1306_SWITCHCAPVCC, SCREEN_I2C_ADDR);
+  i2c_bus0.unlock();
+  display.setRotation(2);
+  //display()は使わず、変わったページだけをP1の読み出しのすき間に送る
+  OledRenderer renderer(i2c_bus0, SCREEN_I2C_ADDR, display.getBuffer(), OLED_MIN_FLUSH_MS);
+  uint32_t statstime = 0;
+
+  //画面に出す内容。これが変わったときだけ描き直す
+  struct DisplayModel{
+    bool menu;
+    int page;
+    int select_menu_count;
+    int config[6];
+    SurveyResult survey;
+    bool status;
+    LinkSummary link;
+    bool replay;
+  };
+  SurveyResult survey;
+  memset(&survey, 0, sizeof(survey));
+  LinkSummary link;
+  memset(&link, 0, sizeof(link));
+  DisplayModel shown;
+  bool drawn = false;
+
+  InterruptButtonManager<4> btn;
+  btn.add(SW7,20);
+  btn.add(SW6,20);
+  btn.add(SW5,20);
+  btn.add(SW4,20);
+
+  enum btn_name{
+    FRONT_BTNA = 0,//SW7
+    FRONT_BTNB = 1,//SW6
+    FRONT_BTNC = 2,//SW5
+    FRONT_BTND = 3//SW4
+  };
+
+  
+
+  while (1){
+    btn.update();
+    survey_TO_display.read(survey);
+    link_TO_display.read(link);
+    
+    DisplayModel model;
+    memset(&model, 0, sizeof(model));
+    model.menu = menu;
+    model.page = page;
+    model.select_menu_count = select_menu_count;
+    memcpy(model.config, config, sizeof(model.config));
+    model.survey = survey;
+    model.status = status;
+    model.replay = replay_active.load();
+    //回線の状態の画面でなければ状態だけ比べる(1秒ごとに描き直さない)
+    if (status){
+      model.link = link;
+    }else{
+      model.link.health = link.health;
+    }
+
+    if (!drawn || memcmp(&model, &shown, sizeof(model)) != 0){
+      display.clearDisplay();
+      if (menu == false && status == false){
+        display.setTextSize(2);               //フォントサイズは2(番目に小さい)
+        display.setTextColor(SSD1306_WHITE);  //色指定はできないが必要
+        display.setCursor(0, 0);            //テキストの表示開始位置
+        display.print("CH");         //表示文字列
+        display.setCursor(0, 25);
+        display.printf("%02x",config_items[channel][config[4]]);
+
+        //チャンネル調査の結果 切り替えていなければメニューで選ぶ
+        display.setTextSize(1);
+        display.setCursor(64, 0);
+        if (survey.running){
+          display.print("SCAN...");
+        }else if (survey.best != 0){
+          display.print(survey.applied ? "AUTO" : "BEST");
+          display.setCursor(64, 45);
+          display.printf("busy %u",survey.busy_permille/10);
+          display.setTextSize(2);
+          display.setCursor(64, 25);
+          display.printf("%02x",survey.best);
+        }
+
+        display.setTextSize(1);
+        display.setCursor(0, 56);
+        display.print(link.health == LINK_OK ? "LINK OK" : link.health == LINK_WARN ? "LINK WARN" : "LINK BAD");
+        //記録の再生中はコントローラーの操作ではなく記録を送っている
+        if (model.replay){
+          display.setCursor(104, 56);
+          display.print("PLAY");
+        }
+
+      }else if (menu == false){
+        //回線の状態 直近の窓の値と、1秒ごとの*IRが返らなかった割合のグラフ
+        display.setTextSize(1);
+        display.setTextColor(SSD1306_WHITE);
+        display.setCursor(0, 0);
+        display.print(link.health == LINK_OK ? "LINK OK" : link.health == LINK_WARN ? "LINK WARN" : "LINK BAD");
+        display.setCursor(92, 0);
+        display.printf("%us",link.window_s);
+        display.drawLine(0,10,128,10,WHITE);
+        display.setCursor(0, 13);
+        display.printf("tx %u/s ir %u.%u%%",link.sent,link.ir_permille/10,link.ir_permille%10);
+        display.setCursor(0, 23);
+        if (link.rssi_dbm == TELEMETRY_NO_RSSI){
+          display.printf("rx %u/s rssi --",link.received);
+        }else{
+          display.printf("rx %u/s rssi %d",link.received,link.rssi_dbm);
+        }
+        display.setCursor(0, 33);
+        display.printf("err %u drop %u",link.parse_errors,link.drops);
+        for (int i = 0; i < TELEMETRY_HISTORY; i++){
+          if (link.delivered_percent[i] <= 100){
+            int h = 1 + link.delivered_percent[i] * 18 / 100;
+            display.fillRect(4 + i*2, 64 - h, 2, h, WHITE);
+          }
+        }
+
+      }else if (menu == true){
+
+
+        display.setTextSize(1);               //フォントサイズは2(番目に小さい)
+        display.setTextColor(SSD1306_WHITE);  //色指定はできないが必要
+        display.setCursor(0, 0); 
+        display.print("MENU");
+        display.drawLine(0,10,128,10,WHITE);
+
+        for (int i =page*5; i < (page+1)*5; i++){
+
+          display.setCursor(2, 10*(i+1)+1);
+
+          if (i == select_menu_count){
+            display.fillRect(0, 10*(i+1), 52, 10, WHITE);
+            display.setTextColor(INVERSE);  //色指定はできないが必要
+            display.print(menu_items[i]);
+
+          }else{
+            display.setTextColor(SSD1306_WHITE);
+            display.print(menu_items[i]);
+            
+          }
+
+          display.fillRect(98, 10*(i+1), 14, 10, WHITE);
+          display.setTextColor(SSD1306_INVERSE);
+          display.setCursor(100, 10*(i+1)+1);
+          display.printf("%02x",config_items[i][config[i]]);
+
+          display.drawLine(0,10*(i+2),128,10*(i+2),WHITE);
+        }
+      }
+
+      
+      shown = model;
+      drawn = true;
+      renderer.update();
+    }
+    renderer.flush(millis());
+
+    if (millis() - statstime > 1000){
+#if I2C_STATS_PRINT
+      const I2cBusStats &st = i2c_bus0.stats();
+      usbPrintf("i2c0 %u permille, pad wait max %uus, oled %u sent %u deferred\n",st.utilization(),
+        st.client[I2C_CONTROLLER].max_wait_us,st.client[I2C_DISPLAY].acquired,st.client[I2C_DISPLAY].deferred);
+#endif
+      i2c_bus0.resetStats();
+      statstime = millis();
+    }
+
+    
+
+    if (btn.isPressed(FRONT_BTNA)){
+      menu = !menu;
+      if (menu == false){
+
+        usbPrintf("UI = %02x\nGI = %02x\nEI = %02x\nDI = %02x\nCH = %02x\nMODE = %02x\n",config_items[userid][config[0]]
+        ,config_items[groupid][config[1]],config_items[deviceid][config[2]],config_items[targetid][config[3]],config_items[channel][config[4]],config_items[mode][config[5]]);
+
+
+        for (int i = 0;i < 5;i++){
+          result_config.configdata[i] = config_items[i][config[i]];
+        }
+        
+        config_TO_main.publish(result_config);
+      }
+
+
+    }
+    //メニューの外ではSW6でチャンネルの混み具合を調べる
+    //調べている間はコントローラーのデータを送れないので、ピットで非常停止中だけ受け付ける
+    if (menu == false && btn.isPressed(FRONT_BTNB) && estop_active.load()){
+      survey_request.store(true);
+    }
+    if (menu == false && btn.isPressed(FRONT_BTNC)){
+      status = !status;
+    }
+    if (menu == true){
+      if (btn.isPressed(FRONT_BTNB)){
+        select_menu_count++;
+        page = select_menu_count/5;
+        select_menu_count = select_menu_count % 6;
+
+      }
+      if (btn.isPressed(FRONT_BTNC)){
+        config[select_menu_count]--;
+        if (config[select_menu_count] < 0){
+          config[select_menu_count] = 3;
+        }
+
+      }
+      if (btn.isPressed(FRONT_BTND)){
+        config[select_menu_count]++;
+        config[select_menu_count] = config[select_menu_count] % 4;
+      }
+    }
+
+    
+
+    btn.release();
+    vTaskDelay(1);
+
+  }
+}
+
+void setup() {
+  
+  //I2Cは画面と入力取得タスクで共用するのでタスクより先に設定する
+  Wire.setPins(OLED_SDA, OLED_SCL); 
+  Wire1.setPins(P2_SDA,P2_SCL);
+  Wire.begin();
+  Wire1.begin();
+  //P1は入力取得の周期で読むので、その時刻を画面の送信に使わせない
+  i2c_bus0.reserve(INPUT_PERIOD_MS * 1000, I2C_CONTROLLER_WINDOW_US, I2C_CONTROLLER_GUARD_US);
+  i2c_bus0.setClientClock(I2C_DISPLAY, OLED_I2C_CLOCK);
+
+//Queueを作ってからタスクを召喚する
+  mu_TO_mainQueue = xQueueCreate(8,sizeof(MuRxEvent));
+  mu_TO_MuQueue = xQueueCreate(4,sizeof(MuRxEvent));
+  //起動ごとに変える。受信側は変わったら連番の記録をやり直す
+  mu_reliable.setSession((uint16_t)esp_random());
+  //入力の記録はPSRAMに置く。内部RAMは足りないので、PSRAMがなければ記録しない
+  if (INPUT_RECORD_BYTES > 0 && psramFound()){
+    uint8_t *record_buf = (uint8_t *)ps_malloc(INPUT_RECORD_BYTES);
+    input_recorder.begin(record_buf, record_buf ? INPUT_RECORD_BYTES : 0);
+  }
+#if INPUT_RECORD_SPILL
+  input_spill_ready = LittleFS.begin(true);
+#endif
+
+  //UARTはMuタスクと非常停止タスクで共用するのでタスクより先に設定する
+  Serial1.begin(19200,SERIAL_8N1,Mu_TXD,Mu_RXD);
+  //受信FIFOが溜まったとき、または受信が途切れたときに受信タスクを起こす
+  Serial1.onReceive([](){ if (MuRx_Handle != NULL) xTaskNotifyGive(MuRx_Handle); });
+
+
+  xTaskCreateUniversal(main_task,"main", 8192, NULL, 2, &Main_Handle, CONFIG_ARDUINO_RUNNING_CORE);
+  xTaskCreateUniversal(Mu,"Mu", 8192, NULL, 2, &Mu_Handle, CONFIG_ARDUINO_RUNNING_CORE);
+  xTaskCreateUniversal(MuRx,"MuRx", 4096, NULL, 3, &MuRx_Handle, CONFIG_ARDUINO_RUNNING_CORE);
+  xTaskCreateUniversal(Display,"Display", 8192, NULL, 2, &Display_Handle, CONFIG_ARDUINO_RUNNING_CORE);
+  //入力取得は他のタスクに邪魔されないよう別コア・最高優先度
+  xTaskCreatePinnedToCore(Input,"Input", 4096, NULL, 4, &Input_Handle, INPUT_TASK_CORE);
+  //非常停止は送信まわりのタスクより優先する
+  xTaskCreateUniversal(EStop,"EStop", 4096, NULL, 5, &EStop_Handle, CONFIG_ARDUINO_RUNNING_CORE);
+
+}
+
+void loop() {
 }
\ No newline at end of file
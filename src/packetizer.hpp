@@ -17,13 +17,15 @@
 #else
 #define LittleEndian 1
 #endif
+//パケットの最大バイト数(MUの最大データ長に合わせる)
+constexpr uint8_t PACKET_MAX_DATALEN = 12;
 //パケットを取り込んで、順次処理をおこなう。
 struct packet_t {
     packet_t() : id(0),length(0) {
-        memset(data, 0, 8);
+        memset(data, 0, PACKET_MAX_DATALEN);
     }
     uint16_t id;
-    uint8_t data[8];
+    uint8_t data[PACKET_MAX_DATALEN];
     uint8_t length;
 };
 class Packetizer
@@ -49,7 +51,7 @@ public:
     {
         error=false;
         packet_=&packet;
-        if(clear)memset(packet_->data, 0, 8);
+        if(clear)memset(packet_->data, 0, PACKET_MAX_DATALEN);
         packet_->length = 0;
         // packet_->id = 0;
         unpackIndex = 0;
@@ -68,17 +70,16 @@ public:
     {
         if(error)return *this;
 #if LittleEndian
-        if (packet_->length + sizeof(T) > 8)
+        if (packet_->length + sizeof(T) > PACKET_MAX_DATALEN)
         {
-            errcallback(ERR_BUFFER_OVERFLOW);
-            error=true;
+            fail(ERR_BUFFER_OVERFLOW);
             return *this;
         }
         memcpy(packet_->data + packet_->length, &data, sizeof(T));
 #else
-        if (packet_->length + sizeof(T) > 8)
+        if (packet_->length + sizeof(T) > PACKET_MAX_DATALEN)
         {
-            errcallback(ERR_BUFFER_OVERFLOW);
+            fail(ERR_BUFFER_OVERFLOW);
             return *this;
         }
         for (int i = 0; i < sizeof(T); i++)
@@ -93,10 +94,9 @@ public:
     Packetizer &pack(uint8_t *data, uint8_t length)
     {
         if(error)return *this;
-        if (packet_->length + length > 8)
+        if (packet_->length + length > PACKET_MAX_DATALEN)
         {
-            errcallback(ERR_BUFFER_OVERFLOW);
-            error=true;
+            fail(ERR_BUFFER_OVERFLOW);
             return *this;
         }
         memcpy(packet_->data + packet_->length, data, length);
@@ -108,9 +108,9 @@ public:
     Packetizer &unpack(T &data)
     {
         if(error)return *this;
-        if (unpackIndex + sizeof(T) > 8)
+        if (unpackIndex + sizeof(T) > PACKET_MAX_DATALEN)
         {
-            errcallback(ERR_INVALID_LENGTH);
+            fail(ERR_INVALID_LENGTH);
             return *this;
         }
 #if LittleEndian
@@ -125,12 +125,23 @@ public:
 #endif
         return *this;
     };
+    /**
+     * @brief 読み出し位置を進めずにunpackする(形式の判別用)
+     */
+    template <typename T>
+    Packetizer &peek(T &data)
+    {
+        uint8_t index = unpackIndex;
+        unpack(data);
+        unpackIndex = index;
+        return *this;
+    };
     Packetizer &unpack(uint8_t *data, uint8_t length)
     {
         if(error)return *this;
-        if (unpackIndex + length > 8)
+        if (unpackIndex + length > PACKET_MAX_DATALEN)
         {
-            errcallback(ERR_INVALID_LENGTH);
+            fail(ERR_INVALID_LENGTH);
             return *this;
         }
         memcpy(data, packet_->data + unpackIndex, length);
@@ -143,6 +154,111 @@ public:
 private:
     packet_t* packet_=nullptr;
     uint8_t unpackIndex;
-    void (*errcallback)(error_t err);
+    void (*errcallback)(error_t err)=nullptr;
     bool error=true;
+    void fail(error_t err)
+    {
+        if(errcallback)errcallback(err);
+        error=true;
+    }
+};
+
+/*
+PacketSchemaはフィールドの並びをコンパイル時に決めておき、1回の呼び出しでまとめて詰める/取り出す。
+合計サイズはstatic_assertで容量と比較するので、実行時の範囲チェックはない。
+エンディアンはコンパイル時に決まり、バイト列は常にリトルエンディアン(Packetizerと同じ)。
+
+使い方の例
+typedef PacketSchema<PACKET_MAX_DATALEN, uint16_t, uint8_t[3]> Schema;
+uint8_t buf[Schema::size];
+Schema::pack(buf, button, analogue);
+Schema::unpack(buf, button, analogue);
+*/
+template <uint8_t Capacity, typename... Fields>
+struct PacketSchema
+{
+    template <typename... T>
+    struct sum;
+    template <typename T, typename... Rest>
+    struct sum<T, Rest...>
+    {
+        static constexpr uint8_t value = sizeof(T) + sum<Rest...>::value;
+    };
+    template <typename... T>
+    struct sum
+    {
+        static constexpr uint8_t value = 0;
+    };
+    //全フィールドの合計バイト数
+    static constexpr uint8_t size = sum<Fields...>::value;
+    static_assert(size <= Capacity, "PacketSchema: fields exceed packet capacity");
+
+    /**
+     * @brief フィールドを順に詰める
+     * 
+     * @param out size以上のバッファ
+     * @return uint8_t 詰めたバイト数(=size)
+     */
+    static uint8_t pack(uint8_t *out, const Fields &...fields)
+    {
+        packFields(out, fields...);
+        return size;
+    }
+    /**
+     * @brief フィールドを順に取り出す
+     * 
+     * @param in size以上のデータ
+     */
+    static void unpack(const uint8_t *in, Fields &...fields)
+    {
+        unpackFields(in, fields...);
+    }
+
+private:
+    template <typename T>
+    static void put(uint8_t *out, const T &v)
+    {
+#if LittleEndian
+        memcpy(out, &v, sizeof(T));
+#else
+        for (uint8_t i = 0; i < sizeof(T); i++)
+            out[i] = ((const uint8_t *)&v)[sizeof(T) - i - 1];
+#endif
+    }
+    template <typename T, size_t N>
+    static void put(uint8_t *out, const T (&v)[N])
+    {
+        for (size_t i = 0; i < N; i++)
+            put(out + i * sizeof(T), v[i]);
+    }
+    template <typename T>
+    static void get(const uint8_t *in, T &v)
+    {
+#if LittleEndian
+        memcpy(&v, in, sizeof(T));
+#else
+        for (uint8_t i = 0; i < sizeof(T); i++)
+            ((uint8_t *)&v)[i] = in[sizeof(T) - i - 1];
+#endif
+    }
+    template <typename T, size_t N>
+    static void get(const uint8_t *in, T (&v)[N])
+    {
+        for (size_t i = 0; i < N; i++)
+            get(in + i * sizeof(T), v[i]);
+    }
+    static void packFields(uint8_t *) {}
+    template <typename T, typename... Rest>
+    static void packFields(uint8_t *out, const T &v, const Rest &...rest)
+    {
+        put(out, v);
+        packFields(out + sizeof(T), rest...);
+    }
+    static void unpackFields(const uint8_t *) {}
+    template <typename T, typename... Rest>
+    static void unpackFields(const uint8_t *in, T &v, Rest &...rest)
+    {
+        get(in, v);
+        unpackFields(in + sizeof(T), rest...);
+    }
 };
@@ -1,18 +1,18 @@
-#define OLED_SDA 1
-#define OLED_SCL 2
-#define P1_SDA 1
-#define P1_SCL 2
-#define P2_SDA 4
-#define P2_SCL 5
-#define J5_TXD 9
-#define J5_RXD 10
-#define J6_TXD 11
-#define J6_RXD 12
-#define SW4 15
-#define SW5 16
-#define SW6 17
-#define SW7 18
-#define Mu_TXD 35
-#define Mu_RXD 36
-#define Buzzer 38
+#define OLED_SDA 1
+#define OLED_SCL 2
+#define P1_SDA 1
+#define P1_SCL 2
+#define P2_SDA 4
+#define P2_SCL 5
+#define J5_TXD 9
+#define J5_RXD 10
+#define J6_TXD 11
+#define J6_RXD 12
+#define SW4 15
+#define SW5 16
+#define SW6 17
+#define SW7 18
+#define Mu_TXD 35
+#define Mu_RXD 36
+#define Buzzer 38
 #define Emergency 37
\ No newline at end of file
@@ -3,21 +3,178 @@
 #include <Wire.h>
 
 const uint8_t CLASSIC_ADDR = 0x52;
+// 初期化コマンドの間隔[us]
+#ifndef CLASSIC_INIT_WAIT_US
+#define CLASSIC_INIT_WAIT_US 5000
+#endif
+// 読み出しアドレスを書いてからデータがそろうまでの時間[us]
+#ifndef CLASSIC_CONVERT_US
+#define CLASSIC_CONVERT_US 1000
+#endif
+// 読み出し周期[us]
+#ifndef CLASSIC_PERIOD_US
+#define CLASSIC_PERIOD_US 15000
+#endif
 
-class WiiClassic {
+/**
+ * @brief
+ * Wiiクラシックコントローラーの読み出し。updateは待ち時間を持たず、
+ * 読み出しアドレスの書き込み→(変換時間)→6バイト読み出しを呼ばれるたびに1段階ずつ進める。
+ * Wireはbegin/beginTransmission/write/endTransmission/requestFrom/available/readを持つクラス。
+ *
+ * @tparam Wire
+ */
+template <class Wire> class BasicWiiClassic {
 public:
-  WiiClassic(TwoWire &wire) : wire_(wire){};
-  void init() {
-    connect();
-    controller::ControllerData c;
-
-    update(c);
-  }
+  BasicWiiClassic(Wire &wire) : wire_(wire){};
+  void init() { connect(); }
+  /**
+   * @brief 読み出しを1段階進める。待ち時間中は何もせず戻る
+   *
+   * @param c
+   * @return true cを更新した(切断時はクリアした)
+   * @return false
+   */
   bool update(controller::ControllerData &c) {
-    if (millis() - lastUpdate_ < 15) {
+    uint32_t now = micros();
+    switch (state_) {
+    case STATE_INIT_1:
+      if (now - stateTime_ < CLASSIC_INIT_WAIT_US) {
+        return false;
+      }
+      send(0xFB, 0x00);
+      setState(STATE_INIT_2, now);
+      return false;
+    case STATE_INIT_2:
+      if (now - stateTime_ < CLASSIC_INIT_WAIT_US) {
+        return false;
+      }
+      setState(STATE_IDLE, now);
+      lastUpdate_ = now - CLASSIC_PERIOD_US;
+      // fallthrough
+    case STATE_IDLE:
+      if (now - lastUpdate_ < CLASSIC_PERIOD_US) {
+        return false;
+      }
+      send(0, 0); // 読み出しアドレスを先頭に
+      lastUpdate_ = now;
+      setState(STATE_CONVERT, now);
       return false;
+    case STATE_CONVERT:
+      if (now - stateTime_ < CLASSIC_CONVERT_US) {
+        return false;
+      }
+      setState(STATE_IDLE, now);
+      return read(c);
+    }
+    return false;
+  }
+  /**
+   * @brief
+   * 一定周期で呼ぶとき用。前回書いた読み出しアドレスのデータを読み、すぐ次の読み出しアドレスを書く。
+   * 呼び出し周期がCLASSIC_CONVERT_US以上なら毎回新しいデータが得られる(周期はCLASSIC_PERIOD_USによらない)。
+   *
+   * @param c
+   * @return true cを更新した(切断時はクリアした)
+   * @return false
+   */
+  bool sample(controller::ControllerData &c) {
+    uint32_t now = micros();
+    bool updated = false;
+    if (state_ == STATE_CONVERT) {
+      if (now - stateTime_ < CLASSIC_CONVERT_US) {
+        return false;
+      }
+      setState(STATE_IDLE, now);
+      updated = read(c);
+    }
+    if (state_ == STATE_IDLE) {
+      send(0, 0); // 次の読み出しアドレスを先頭に
+      lastUpdate_ = now;
+      setState(STATE_CONVERT, now);
+      return updated;
     }
-    wire_.requestFrom(CLASSIC_ADDR, 8);
+    return update(c) || updated; // 初期化中
+  }
+  bool isConnected() { return connected; }
+  // 最後にデータを読んだ時刻[us]
+  uint32_t readTime() { return readTime_; }
+
+  /**
+   * @brief 読み出した6バイトをControllerDataにする(ボタンは押されると0)
+   *
+   * @param raw
+   * @param c
+   */
+  static void mapButton(const uint8_t raw[6], controller::ControllerData &c) {
+    uint8_t buf[6];
+    memcpy(buf, raw, 6);
+    buf[4] = ~buf[4];
+    buf[5] = ~buf[5];
+    auto b = [&buf](int i, int j) -> bool { return bitRead(buf[i], j); };
+    c.setButton(controller::X, b(5, 5));
+    c.setButton(controller::Y, b(5, 3));
+    c.setButton(controller::A, b(5, 6));
+    c.setButton(controller::B, b(5, 4));
+    c.setButton(controller::UP, b(5, 0));
+    c.setButton(controller::DOWN, b(4, 6));
+    c.setButton(controller::LEFT, b(5, 1));
+    c.setButton(controller::RIGHT, b(4, 7));
+    c.setButton(controller::L, b(4, 5));
+    c.setButton(controller::R, b(4, 1));
+    c.setButton(controller::BACK, b(4, 4));
+    c.setButton(controller::START, b(4, 2));
+    c.setButton(controller::XBOX, b(4, 3));
+    c.setButton(controller::SL, 0);
+    c.setButton(controller::SR, 0);
+    c.setButton(controller::FLAG_STICK_POLAR, 0);
+    // 本来の分解能の値(4bitの値は上位ビットから作られる)
+    c.setAnalogFine(controller::LstickX, buf[0] & 0x3f); // 6bit
+    c.setAnalogFine(controller::LstickY, buf[1] & 0x3f); // 6bit
+    c.setAnalogFine(controller::RstickX,
+                    ((buf[0] & 0b11000000) >> 3) |
+                        ((buf[1] & 0b11000000) >> 5) |
+                        (buf[2] >> 7)); // 5bit
+    c.setAnalogFine(controller::RstickY, buf[2] & 0x1f); // 5bit
+    c.setAnalogFine(controller::TriggerL,
+                    ((buf[2] & 0b01100000) >> 2) | (buf[3] >> 5)); // 5bit
+    c.setAnalogFine(controller::TriggerR, buf[3] & 0x1f);              // 5bit
+    // 旧形式のトリガーはボタンの押し込みを0/7で表す
+    c.setAnalog(controller::TriggerL, b(5, 7) * 7);
+    c.setAnalog(controller::TriggerR, b(5, 2) * 7);
+    if (c.analograw(controller::LstickX) == 7)
+      c.setAnalog(controller::LstickX, 8);
+    if (c.analograw(controller::LstickY) == 7)
+      c.setAnalog(controller::LstickY, 8);
+    if (c.analograw(controller::RstickX) == 7)
+      c.setAnalog(controller::RstickX, 8);
+    if (c.analograw(controller::RstickY) == 7)
+      c.setAnalog(controller::RstickY, 8);
+  }
+
+private:
+  enum state_t : uint8_t {
+    STATE_INIT_1,  // 0xF0←0x55を書いた
+    STATE_INIT_2,  // 0xFB←0x00を書いた
+    STATE_IDLE,    // 次の読み出し周期待ち
+    STATE_CONVERT, // 読み出しアドレスを書いた
+  };
+  controller::ControllerData c;
+  Wire &wire_;
+  bool connected = false;
+  uint8_t buffer_[6];
+  uint32_t lastUpdate_ = 0;
+  uint32_t stateTime_ = 0;
+  uint32_t readTime_ = 0;
+  state_t state_ = STATE_INIT_1;
+  uint8_t err = 0;
+  void setState(state_t state, uint32_t now) {
+    state_ = state;
+    stateTime_ = now;
+  }
+  bool read(controller::ControllerData &c) {
+    wire_.requestFrom(CLASSIC_ADDR, (uint8_t)6);
+    readTime_ = micros();
     uint8_t count = 0;
     memset(buffer_, 0, 6);
     while (wire_.available()) {
@@ -35,31 +192,20 @@ public:
         connect();
         err = 0;
         c = controller::ControllerData(); // clear
-        connected=false;
+        connected = false;
         return true;
       }
       return false;
     }
     connected = true;
-    mapButton(c);
-    send(0, 0);
-    lastUpdate_ = millis();
-
+    mapButton(buffer_, c);
     return true;
   }
-  bool isConnected() { return connected; }
-
-private:
-  controller::ControllerData c;
-  TwoWire &wire_;
-  bool connected = false;
-  uint8_t buffer_[6];
-  uint32_t lastUpdate_ = 0;
-  uint8_t err = 0;
+  // 初期化を始める。続きはupdateで進める
   void connect() {
     wire_.begin();
     send(0xF0, 0x55);
-    send(0xFB, 0x00);
+    setState(STATE_INIT_1, micros());
   }
   void send(uint8_t addr, uint8_t data) {
 
@@ -67,44 +213,6 @@ private:
     wire_.write(addr);
     wire_.write(data);
     wire_.endTransmission();
-    delay(5);
-  }
-  bool b(int i, int j) { return bitRead(buffer_[i], j); }
-  void mapButton(controller::ControllerData &c) {
-   
-    buffer_[4] = ~buffer_[4];
-    buffer_[5] = ~buffer_[5];
-    c.setButton(controller::X, b(5, 5));
-    c.setButton(controller::Y, b(5, 3));
-    c.setButton(controller::A, b(5, 6));
-    c.setButton(controller::B, b(5, 4));
-    c.setButton(controller::UP, b(5, 0));
-    c.setButton(controller::DOWN, b(4, 6));
-    c.setButton(controller::LEFT, b(5, 1));
-    c.setButton(controller::RIGHT, b(4, 7));
-    c.setButton(controller::L, b(4, 5));
-    c.setButton(controller::R, b(4, 1));
-    c.setButton(controller::BACK, b(4, 4));
-    c.setButton(controller::START, b(4, 2));
-    c.setButton(controller::XBOX, b(4, 3));
-    c.setButton(controller::SL, 0);
-    c.setButton(controller::SR, 0);
-    c.setButton(controller::FLAG_STICK_POLAR, 0);
-    c.setAnalog(controller::TriggerL, b(5, 7) * 7);
-    c.setAnalog(controller::TriggerR, b(5, 2) * 7);
-    c.setAnalog(controller::LstickX, buffer_[0] >> 2 & 0x0f); // 6bit to 4bit
-    c.setAnalog(controller::LstickY, buffer_[1] >> 2 & 0x0f); // 6bit to 4bit
-    c.setAnalog(controller::RstickX,
-                ((buffer_[0] & 0b11000000) >> 4) |
-                    ((buffer_[1] & 0b11000000) >> 6)); // 5bit to 4bit
-    c.setAnalog(controller::RstickY, buffer_[2] >> 1 & 0x0f);
-    if (c.analograw(controller::LstickX) == 7)
-      c.setAnalog(controller::LstickX, 8);
-    if (c.analograw(controller::LstickY) == 7)
-      c.setAnalog(controller::LstickY, 8);
-    if (c.analograw(controller::RstickX) == 7)
-      c.setAnalog(controller::RstickX, 8);
-    if (c.analograw(controller::RstickY) == 7)
-      c.setAnalog(controller::RstickY, 8);
   }
-};
\ No newline at end of file
+};
+typedef BasicWiiClassic<TwoWire> WiiClassic;
\ No newline at end of file
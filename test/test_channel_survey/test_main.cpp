@@ -0,0 +1,183 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * ChannelSurveyのテスト。チャンネルを順に調べて空いている順に並べること、
+ * 元のチャンネルに戻す@CHを応答が来るまで送り直すこと、途中でやめたときに
+ * 後から来た切り替えの応答を戻った応答と取り違えないことを確かめる。
+ * pio test -e native -f test_channel_survey
+ * @version 0.1
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include <ChannelSurvey.h>
+#include <MUwrapper.hpp>
+
+namespace {
+
+/// MUに送ったコマンド
+struct Sent {
+  char last[16];
+  uint32_t count = 0;
+};
+
+void record(void *context, MUEvent event, uint8_t *data, uint8_t len) {
+  Sent *sent = (Sent *)context;
+  if (event != MU_EVENT_SEND_REQUEST || len >= sizeof(sent->last)) {
+    return;
+  }
+  memcpy(sent->last, data, len);
+  sent->last[len] = 0;
+  sent->count++;
+}
+
+void respond(ChannelSurvey &survey, const char *response, uint32_t now_us) {
+  survey.onResponse((const uint8_t *)response, strlen(response), now_us);
+}
+
+SurveyParams params() {
+  SurveyParams p;
+  p.dwell_us = 100000;
+  p.sample_us = 20000;
+  p.timeout_us = 50000;
+  p.max_total_us = 1000000;
+  return p;
+}
+
+/**
+ * @brief 1チャンネル分、切り替えの応答とdwell_usの間の@RAの応答を返す
+ *
+ * @return uint32_t 次のチャンネルに移った時刻
+ */
+uint32_t survey(ChannelSurvey &s, MUWrapper &mu, Sent &sent, uint32_t now,
+                const char *ch, const char *ra) {
+  TEST_ASSERT_TRUE(s.poll(mu, now));
+  char expect[8];
+  snprintf(expect, sizeof(expect), "@CH%s\r\n", ch);
+  TEST_ASSERT_EQUAL_STRING(expect, sent.last);
+  char response[8];
+  snprintf(response, sizeof(response), "CH%s", ch);
+  respond(s, response, now);
+  uint32_t start = now;
+  while (now - start < params().dwell_us) {
+    uint32_t count = sent.count;
+    s.poll(mu, now);
+    if (sent.count != count && strcmp(sent.last, "@RA\r\n") == 0) {
+      respond(s, ra, now);
+    }
+    now += 10000;
+  }
+  s.poll(mu, now);
+  return now;
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_ranks_channels_and_returns() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  ChannelSurvey s(params());
+  const uint8_t channels[] = {0x1F, 0x2E};
+  TEST_ASSERT_TRUE(s.start(channels, 2, 0x0E, 0));
+  TEST_ASSERT_FALSE(s.start(channels, 2, 0x0E, 0));
+  uint32_t now = survey(s, mu, sent, 0, "1F", "RA3C"); // -60dBm 混んでいる
+  now = survey(s, mu, sent, now, "2E", "RA72");        // -114dBm 空いている
+  TEST_ASSERT_TRUE(s.poll(mu, now));
+  TEST_ASSERT_EQUAL_STRING("@CH0E\r\n", sent.last);
+  TEST_ASSERT_TRUE(s.running());
+  respond(s, "CH0E", now);
+  TEST_ASSERT_FALSE(s.running());
+  TEST_ASSERT_TRUE(s.done());
+  TEST_ASSERT_TRUE(s.returned());
+  TEST_ASSERT_EQUAL_HEX8(0x2E, s.best());
+  TEST_ASSERT_EQUAL_HEX8(0x2E, s.ranked(0).ch);
+  TEST_ASSERT_EQUAL(-114, s.ranked(0).rssi_mean_dbm);
+  TEST_ASSERT_EQUAL(0, s.ranked(0).busy_permille);
+  TEST_ASSERT_EQUAL(1000, s.ranked(1).busy_permille);
+  TEST_ASSERT_GREATER_THAN(0, s.ranked(1).samples);
+}
+
+void test_return_resent_until_acked() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  ChannelSurvey s(params());
+  const uint8_t channels[] = {0x1F};
+  s.start(channels, 1, 0x0E, 0);
+  uint32_t now = survey(s, mu, sent, 0, "1F", "RA72");
+  s.poll(mu, now);
+  TEST_ASSERT_EQUAL_STRING("@CH0E\r\n", sent.last);
+  uint32_t count = sent.count;
+  // 応答がなければ送り直す。2回目の応答で戻ったことにする
+  now += params().timeout_us;
+  TEST_ASSERT_TRUE(s.poll(mu, now));
+  TEST_ASSERT_TRUE(s.poll(mu, now));
+  TEST_ASSERT_EQUAL(count + 1, sent.count);
+  TEST_ASSERT_EQUAL_STRING("@CH0E\r\n", sent.last);
+  respond(s, "CH0E", now);
+  TEST_ASSERT_TRUE(s.done());
+  TEST_ASSERT_TRUE(s.returned());
+}
+
+void test_return_gives_up_after_attempts() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  SurveyParams p = params();
+  ChannelSurvey s(p);
+  const uint8_t channels[] = {0x1F};
+  s.start(channels, 1, 0x0E, 0);
+  uint32_t now = survey(s, mu, sent, 0, "1F", "RA72");
+  s.poll(mu, now);
+  TEST_ASSERT_EQUAL_STRING("@CH0E\r\n", sent.last);
+  uint32_t count = sent.count;
+  for (uint8_t i = 1; i < p.return_attempts; i++) {
+    now += p.timeout_us;
+    s.poll(mu, now);
+    s.poll(mu, now);
+  }
+  TEST_ASSERT_EQUAL(count + p.return_attempts - 1, sent.count);
+  TEST_ASSERT_TRUE(s.running());
+  now += p.timeout_us;
+  TEST_ASSERT_FALSE(s.poll(mu, now));
+  // 戻せたかわからないまま終わる。呼ぶ側で設定し直す
+  TEST_ASSERT_TRUE(s.done());
+  TEST_ASSERT_FALSE(s.returned());
+  TEST_ASSERT_EQUAL_HEX8(0x1F, s.best());
+}
+
+void test_stop_returns_and_ignores_late_switch_ack() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  ChannelSurvey s(params());
+  const uint8_t channels[] = {0x1F, 0x2E};
+  s.start(channels, 2, 0x0E, 0);
+  TEST_ASSERT_TRUE(s.poll(mu, 0));
+  TEST_ASSERT_EQUAL_STRING("@CH1F\r\n", sent.last);
+  // 切り替えの応答が来る前にやめる(非常停止が解除されたときなど)
+  s.stop(1000);
+  TEST_ASSERT_TRUE(s.poll(mu, 1000));
+  TEST_ASSERT_EQUAL_STRING("@CH0E\r\n", sent.last);
+  respond(s, "CH1F", 2000);
+  TEST_ASSERT_TRUE(s.running());
+  TEST_ASSERT_FALSE(s.returned());
+  respond(s, "CH0E", 3000);
+  TEST_ASSERT_TRUE(s.done());
+  TEST_ASSERT_TRUE(s.returned());
+  // やめたあとにstopしても何もしない
+  uint32_t count = sent.count;
+  s.stop(4000);
+  TEST_ASSERT_FALSE(s.poll(mu, 4000));
+  TEST_ASSERT_EQUAL(count, sent.count);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ranks_channels_and_returns);
+  RUN_TEST(test_return_resent_until_acked);
+  RUN_TEST(test_return_gives_up_after_attempts);
+  RUN_TEST(test_stop_returns_and_ignores_late_switch_ack);
+  return UNITY_END();
+}
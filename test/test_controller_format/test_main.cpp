@@ -0,0 +1,196 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * 送信フレームの形式(受信機が展開する形式)のテスト。1台分のpack/unpacketize、
+ * 2台分のpackControllers/unpackControllersの往復、2台の高分解能が収まらないときの旧形式、
+ * 旧形式の値の引き伸ばし、形式タグや長さが違うフレームを捨てることを確かめる。
+ * pio test -e native -f test_controller_format
+ * @version 0.1
+ *
+ */
+#include <string.h>
+#include <unity.h>
+#include <controller.h>
+
+using namespace controller;
+
+namespace {
+
+/// ボタンと高分解能のアナログ値をseedから決める(4ビットの値もsetAnalogFineで揃う)
+void fill(ControllerData &c, uint8_t seed) {
+  memset(&c, 0, sizeof(c));
+  c.Button = (uint16_t)(0x1234 * (seed + 1)) & 0x7fff;
+  for (uint8_t i = 0; i < 6; i++) {
+    c.setAnalogFine((Index)(LstickX + i), (uint8_t)(seed * 7 + i * 11));
+  }
+}
+
+void assertSameLegacy(ControllerData &expected, ControllerData &actual) {
+  TEST_ASSERT_EQUAL_HEX16(expected.Button, actual.Button);
+  for (uint8_t i = 0; i < 6; i++) {
+    TEST_ASSERT_EQUAL(expected.analograw((Index)(LstickX + i)),
+                      actual.analograw((Index)(LstickX + i)));
+  }
+}
+
+void assertSameFine(ControllerData &expected, ControllerData &actual) {
+  assertSameLegacy(expected, actual);
+  for (uint8_t i = 0; i < 6; i++) {
+    TEST_ASSERT_EQUAL(expected.analogfine((Index)(LstickX + i)),
+                      actual.analogfine((Index)(LstickX + i)));
+  }
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_single_round_trip() {
+  ControllerData pad;
+  fill(pad, 3);
+  uint8_t frame[FRAME_MAXLEN];
+
+  uint8_t len = pad.pack(frame, FORMAT_LEGACY);
+  TEST_ASSERT_EQUAL(LegacySchema::size, len);
+  ControllerData legacy;
+  fill(legacy, 9);
+  TEST_ASSERT_TRUE(legacy.unpacketize(frame, len));
+  assertSameLegacy(pad, legacy);
+
+  len = pad.pack(frame, FORMAT_HIRES);
+  TEST_ASSERT_EQUAL(1 + HiresBodySchema::size, len);
+  TEST_ASSERT_EQUAL_HEX8(FORMAT_TAG_HIRES, frame[0]);
+  ControllerData hires;
+  fill(hires, 9);
+  TEST_ASSERT_TRUE(hires.unpacketize(frame, len));
+  assertSameFine(pad, hires);
+
+  // packetizeはpackと同じ内容
+  packet_t p = pad.packetize(FORMAT_HIRES);
+  TEST_ASSERT_EQUAL(len, p.length);
+  TEST_ASSERT_EQUAL_MEMORY(frame, p.data, len);
+}
+
+void test_dual_round_trip() {
+  ControllerData pads[2];
+  fill(pads[0], 1);
+  fill(pads[1], 2);
+  const Format formats[2] = {FORMAT_LEGACY, FORMAT_HIRES};
+  for (uint8_t f = 0; f < 2; f++) {
+    for (uint8_t mask = 0; mask < 4; mask++) {
+      uint8_t frame[FRAME_MAXLEN];
+      uint8_t len = packControllers(frame, pads, mask, formats[f]);
+      TEST_ASSERT_TRUE(len <= FRAME_MAXLEN);
+      TEST_ASSERT_EQUAL_HEX8(FORMAT_TAG, frame[0] & 0xF0);
+      TEST_ASSERT_EQUAL(mask, frame[0] & 0x03);
+
+      ControllerData out[2];
+      fill(out[0], 7);
+      fill(out[1], 8);
+      ControllerData untouched[2] = {out[0], out[1]};
+      TEST_ASSERT_EQUAL(mask, unpackControllers(frame, len, out));
+      bool hires = (frame[0] & 0x0C) == (FORMAT_TAG_MULTI_HIRES & 0x0C);
+      for (uint8_t i = 0; i < 2; i++) {
+        if (!(mask & (1 << i))) {
+          // 含まれていないコントローラーは変えない
+          assertSameFine(untouched[i], out[i]);
+        } else if (hires) {
+          assertSameFine(pads[i], out[i]);
+        } else {
+          assertSameLegacy(pads[i], out[i]);
+        }
+      }
+    }
+  }
+}
+
+void test_two_hires_pads_fall_back_to_legacy() {
+  ControllerData pads[2];
+  fill(pads[0], 4);
+  fill(pads[1], 5);
+  uint8_t frame[FRAME_MAXLEN];
+
+  // 1台なら高分解能のまま
+  uint8_t len = packControllers(frame, pads, 1, FORMAT_HIRES);
+  TEST_ASSERT_EQUAL_HEX8(FORMAT_TAG_MULTI_HIRES | 1, frame[0]);
+  TEST_ASSERT_EQUAL(1 + HiresBodySchema::size, len);
+
+  // 2台の高分解能(1+6*2=13バイト)はMUの最大データ長を超えるので旧形式になる
+  len = packControllers(frame, pads, 3, FORMAT_HIRES);
+  TEST_ASSERT_EQUAL_HEX8(FORMAT_TAG_MULTI_LEGACY | 3, frame[0]);
+  TEST_ASSERT_EQUAL(1 + LegacySchema::size * 2, len);
+  ControllerData out[2];
+  TEST_ASSERT_EQUAL(3, unpackControllers(frame, len, out));
+  assertSameLegacy(pads[0], out[0]);
+  assertSameLegacy(pads[1], out[1]);
+}
+
+void test_legacy_values_are_widened() {
+  ControllerData pad;
+  memset(&pad, 0, sizeof(pad));
+  pad.setAnalog(LstickX, 0);
+  pad.setAnalog(LstickY, 8);
+  pad.setAnalog(RstickX, 15);
+  pad.setAnalog(RstickY, 8);
+  pad.setAnalog(TriggerL, 7);
+  pad.setAnalog(TriggerR, 0);
+  uint8_t frame[FRAME_MAXLEN];
+  uint8_t len = pad.pack(frame, FORMAT_LEGACY);
+  ControllerData out;
+  TEST_ASSERT_TRUE(out.unpacketize(frame, len));
+  // スティックは0と15が両端、8が中央
+  TEST_ASSERT_EQUAL(0, out.analogfine(LstickX));
+  TEST_ASSERT_EQUAL(32, out.analogfine(LstickY));
+  TEST_ASSERT_EQUAL(31, out.analogfine(RstickX));
+  TEST_ASSERT_EQUAL(16, out.analogfine(RstickY));
+  // トリガーは旧形式の7が最大
+  TEST_ASSERT_EQUAL(31, out.analogfine(TriggerL));
+  TEST_ASSERT_EQUAL(0, out.analogfine(TriggerR));
+}
+
+void test_bad_tag_or_length_rejected() {
+  ControllerData pads[2];
+  fill(pads[0], 1);
+  fill(pads[1], 2);
+  uint8_t frame[FRAME_MAXLEN];
+  uint8_t len = packControllers(frame, pads, 3, FORMAT_LEGACY);
+  ControllerData out[2];
+  fill(out[0], 7);
+  fill(out[1], 8);
+  ControllerData untouched[2] = {out[0], out[1]};
+
+  TEST_ASSERT_EQUAL(-1, unpackControllers(frame, 0, out));
+  TEST_ASSERT_EQUAL(-1, unpackControllers(frame, len - 1, out));
+  TEST_ASSERT_EQUAL(-1, unpackControllers(frame, len + 1, out));
+  uint8_t bad[FRAME_MAXLEN];
+  memcpy(bad, frame, len);
+  // 旧形式の1台分のフレーム(先頭は十字ボタンの同時押しではない)
+  bad[0] = 0x01;
+  TEST_ASSERT_EQUAL(-1, unpackControllers(bad, len, out));
+  // 知らない種類
+  bad[0] = FORMAT_TAG | 0x0C | 3;
+  TEST_ASSERT_EQUAL(-1, unpackControllers(bad, len, out));
+  bad[0] = FORMAT_TAG_HIRES;
+  TEST_ASSERT_EQUAL(-1, unpackControllers(bad, len, out));
+  // 捨てたフレームではコントローラーを変えない
+  assertSameFine(untouched[0], out[0]);
+  assertSameFine(untouched[1], out[1]);
+
+  // 1台分の形式も長さが合わなければ捨てる
+  len = pads[0].pack(frame, FORMAT_HIRES);
+  TEST_ASSERT_FALSE(out[0].unpacketize(frame, len - 1));
+  frame[0] = FORMAT_TAG_MULTI_HIRES | 1;
+  TEST_ASSERT_FALSE(out[0].unpacketize(frame, len));
+  assertSameFine(untouched[0], out[0]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_single_round_trip);
+  RUN_TEST(test_dual_round_trip);
+  RUN_TEST(test_two_hires_pads_fall_back_to_legacy);
+  RUN_TEST(test_legacy_values_are_widened);
+  RUN_TEST(test_bad_tag_or_length_rejected);
+  return UNITY_END();
+}
@@ -0,0 +1,224 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * 非常停止の速い経路のテスト。main.cppのEStopタスクと同じループを、
+ * 予定した時刻にGPIOの変化を起こすPortで動かし、非常停止フレームを送る時刻を確かめる。
+ * チャンネル調査中に送るのを止めたときの間隔も確かめる。
+ * pio test -e native -f test_emergency_stop
+ * @version 0.1
+ *
+ */
+#include <string.h>
+#include <unity.h>
+#include <EmergencyStop.h>
+#include <InterruptButtonManager.h>
+
+namespace {
+
+/**
+ * @brief 予定した時刻にピンを変えて割り込みを呼ぶPort。wait()は次の変化か時間切れまで時計を進める
+ *
+ */
+class FakePort {
+public:
+  static const uint8_t MAX_EDGES = 16;
+
+  void setup(uint8_t pin) { (void)pin; }
+  int read(uint8_t pin) { return pin == 0 ? level : 1; }
+  uint32_t nowUs() { return now_us; }
+  void attach(uint8_t pin, void (*isr)(void *), void *arg) {
+    (void)pin;
+    isr_ = isr;
+    arg_ = arg;
+  }
+  void signalFromIsr() {}
+  void wait(uint32_t timeout_ms) {
+    wakeups++;
+    if (next_ < edges_ && (timeout_ms == BUTTON_WAIT_FOREVER ||
+                           edge_[next_].time_us - now_us <= timeout_ms * 1000)) {
+      now_us = edge_[next_].time_us;
+      level = edge_[next_++].level;
+      isr_(arg_);
+      return;
+    }
+    TEST_ASSERT_NOT_EQUAL(BUTTON_WAIT_FOREVER, timeout_ms);
+    now_us += timeout_ms * 1000;
+  }
+  /// time_usにピンを変える予定を入れる(時刻順に入れること)
+  void schedule(uint32_t time_us, uint8_t l) {
+    edge_[edges_].time_us = time_us;
+    edge_[edges_++].level = l;
+  }
+  /// 予定した変化をすべて起こしたか
+  bool done() const { return next_ >= edges_; }
+
+  uint32_t now_us = 1000000;
+  /// 非常停止スイッチ。押されて(LOW)いる間が正常
+  uint8_t level = 0;
+  uint32_t wakeups = 0;
+
+private:
+  struct Edge {
+    uint32_t time_us;
+    uint8_t level;
+  };
+  void (*isr_)(void *) = nullptr;
+  void *arg_ = nullptr;
+  Edge edge_[MAX_EDGES];
+  uint8_t edges_ = 0;
+  uint8_t next_ = 0;
+};
+
+const uint32_t REPEAT_MS = 50;
+const uint32_t DEBOUNCE_MS = 15;
+// "@DT01E\r\n"を115200bpsで送る時間
+const uint32_t TX_US = 8 * 10 * 1000000 / 115200;
+
+struct Sent {
+  uint32_t time_us[32];
+  uint8_t count = 0;
+};
+
+/**
+ * @brief main.cppのEStopタスクと同じループを、予定した変化がなくなり非常停止が解除されるまで回す
+ *
+ * @param btn
+ * @param burst
+ * @param sent 非常停止フレームを送った時刻
+ */
+void runEStop(BasicInterruptButtonManager<1, FakePort> &btn,
+              EmergencyBurst &burst, Sent &sent) {
+  FakePort &port = btn.port();
+  ButtonEvent e;
+  while (!port.done() || burst.isActive()) {
+    uint32_t timeout_ms =
+        burst.isActive() ? (burst.untilNext(port.now_us) + 999) / 1000
+                         : BUTTON_WAIT_FOREVER;
+    if (btn.wait(e, timeout_ms)) {
+      if (e.kind == ButtonEvent::RELEASE) {
+        burst.start(e.time_us);
+      } else {
+        burst.stop();
+      }
+    }
+    if (burst.due(port.now_us)) {
+      TEST_ASSERT_LESS_THAN(32, sent.count);
+      sent.time_us[sent.count++] = port.now_us;
+      burst.recordFirst(port.now_us, port.now_us + TX_US);
+    }
+  }
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_frame_is_fixed() {
+  EmergencyBurst burst(REPEAT_MS * 1000);
+  TEST_ASSERT_EQUAL(8, burst.frameLength());
+  TEST_ASSERT_EQUAL_MEMORY("@DT01E\r\n", burst.frame(), 8);
+  TEST_ASSERT_FALSE(burst.isActive());
+  TEST_ASSERT_FALSE(burst.due(0));
+  TEST_ASSERT_EQUAL_UINT32(0, burst.untilNext(0));
+}
+
+void test_edge_sends_at_once_and_repeats() {
+  BasicInterruptButtonManager<1, FakePort> btn;
+  btn.add(0, DEBOUNCE_MS);
+  EmergencyBurst burst(REPEAT_MS * 1000);
+  FakePort &port = btn.port();
+  uint32_t t = port.now_us + 100000;
+  // 離れて非常停止(チャタリング付き)、275ms後に押し直して解除
+  port.schedule(t, 1);
+  port.schedule(t + 1000, 0);
+  port.schedule(t + 2000, 1);
+  port.schedule(t + 275000, 0);
+  Sent sent;
+  runEStop(btn, burst, sent);
+  TEST_ASSERT_EQUAL(6, sent.count);
+  // 最初のフレームは割り込みの時刻にすぐ送る
+  TEST_ASSERT_EQUAL_UINT32(t, sent.time_us[0]);
+  for (uint8_t i = 1; i < sent.count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(REPEAT_MS * 1000,
+                             sent.time_us[i] - sent.time_us[i - 1]);
+  }
+  const EmergencyStats &st = burst.stats();
+  TEST_ASSERT_EQUAL(1, st.triggers);
+  TEST_ASSERT_EQUAL(6, st.frames);
+  TEST_ASSERT_EQUAL(1, st.to_uart.count());
+  TEST_ASSERT_EQUAL_UINT32(0, st.to_uart.max());
+  TEST_ASSERT_EQUAL_UINT32(TX_US, st.to_tx_done.max());
+  TEST_ASSERT_EQUAL(2, btn.stats().bounces);
+}
+
+void test_idle_task_sleeps() {
+  BasicInterruptButtonManager<1, FakePort> btn;
+  btn.add(0, DEBOUNCE_MS);
+  EmergencyBurst burst(REPEAT_MS * 1000);
+  FakePort &port = btn.port();
+  // 非常停止でない間は、10秒後の変化まで一度も起きない
+  port.schedule(port.now_us + 10000000, 1);
+  port.schedule(port.now_us + 10100000, 0);
+  Sent sent;
+  runEStop(btn, burst, sent);
+  TEST_ASSERT_EQUAL(2, sent.count);
+  // 起きるのは変化2回と、非常停止中に次のフレームを待った1回だけ
+  TEST_ASSERT_EQUAL(3, port.wakeups);
+}
+
+void test_retrigger_restarts_burst() {
+  BasicInterruptButtonManager<1, FakePort> btn;
+  btn.add(0, DEBOUNCE_MS);
+  EmergencyBurst burst(REPEAT_MS * 1000);
+  FakePort &port = btn.port();
+  uint32_t t = port.now_us + 100000;
+  port.schedule(t, 1);
+  port.schedule(t + 20000, 0);
+  port.schedule(t + 40000, 1);
+  port.schedule(t + 60000, 0);
+  Sent sent;
+  runEStop(btn, burst, sent);
+  // 解除してすぐ非常停止になっても、その時刻にすぐ送る
+  TEST_ASSERT_EQUAL(2, sent.count);
+  TEST_ASSERT_EQUAL_UINT32(t, sent.time_us[0]);
+  TEST_ASSERT_EQUAL_UINT32(t + 40000, sent.time_us[1]);
+  TEST_ASSERT_EQUAL(2, burst.stats().triggers);
+  TEST_ASSERT_EQUAL(2, burst.stats().to_uart.count());
+}
+
+void test_hold_skips_frames_and_keeps_interval() {
+  EmergencyBurst burst(REPEAT_MS * 1000);
+  const uint32_t repeat = REPEAT_MS * 1000;
+  burst.start(0);
+  TEST_ASSERT_TRUE(burst.due(0));
+  // 止めている間は送らないが、次の時刻は間隔どおりに進む(待つ側が空回りしない)
+  burst.hold(true);
+  TEST_ASSERT_FALSE(burst.due(repeat));
+  TEST_ASSERT_EQUAL_UINT32(repeat, burst.untilNext(repeat));
+  TEST_ASSERT_FALSE(burst.due(2 * repeat));
+  burst.hold(false);
+  TEST_ASSERT_FALSE(burst.due(2 * repeat));
+  TEST_ASSERT_TRUE(burst.due(3 * repeat));
+  TEST_ASSERT_EQUAL(2, burst.stats().frames);
+
+  // 止めている間に非常停止になったら、遅れは最初のフレームの遅延として記録しない
+  burst.stop();
+  burst.start(4 * repeat);
+  burst.hold(true);
+  TEST_ASSERT_FALSE(burst.due(4 * repeat));
+  burst.hold(false);
+  TEST_ASSERT_TRUE(burst.due(5 * repeat));
+  TEST_ASSERT_FALSE(burst.isFirst());
+  TEST_ASSERT_FALSE(burst.recordFirst(5 * repeat, 5 * repeat + TX_US));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_is_fixed);
+  RUN_TEST(test_edge_sends_at_once_and_repeats);
+  RUN_TEST(test_idle_task_sleeps);
+  RUN_TEST(test_retrigger_restarts_burst);
+  RUN_TEST(test_hold_skips_frames_and_keeps_interval);
+  return UNITY_END();
+}
@@ -0,0 +1,153 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * sealFrame/FrameCheckerのテスト。CRC-8/CRC-16の往復、1ビットの化けと短すぎるフレームを捨てること、
+ * 連番の飛びと戻りの数え方、検査の付いていないフレームの扱いを確かめる。
+ * pio test -e native -f test_frame_check
+ * @version 0.1
+ *
+ */
+#include <string.h>
+#include <unity.h>
+#include <FrameCheck.h>
+
+namespace {
+
+const uint8_t FRAME[5] = {0x12, 0x34, 0x56, 0x78, 0x9a};
+
+/// 連番seqで封をしてcheckerに渡す
+bool deliver(FrameChecker &checker, uint8_t seq,
+             FrameCheckKind kind = FRAME_CHECK_CRC8) {
+  uint8_t sealed[MU_MAX_DATALEN];
+  uint8_t len = sealFrame(sealed, FRAME, sizeof(FRAME), seq, kind);
+  const uint8_t *payload;
+  uint8_t payload_len;
+  return checker.open(sealed, len, payload, payload_len);
+}
+
+void roundTrip(FrameCheckKind kind, uint8_t tag) {
+  uint8_t sealed[MU_MAX_DATALEN];
+  uint8_t len = sealFrame(sealed, FRAME, sizeof(FRAME), 42, kind);
+  TEST_ASSERT_EQUAL(sizeof(FRAME) + frameCheckOverhead(kind), len);
+  TEST_ASSERT_EQUAL_HEX8(tag, sealed[0]);
+  TEST_ASSERT_EQUAL(42, sealed[1]);
+
+  FrameChecker checker;
+  const uint8_t *payload;
+  uint8_t payload_len;
+  TEST_ASSERT_TRUE(checker.open(sealed, len, payload, payload_len));
+  TEST_ASSERT_EQUAL(sizeof(FRAME), payload_len);
+  TEST_ASSERT_EQUAL_MEMORY(FRAME, payload, sizeof(FRAME));
+  TEST_ASSERT_EQUAL(1, checker.stats().good);
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_round_trip() {
+  roundTrip(FRAME_CHECK_CRC8, FRAME_TAG_CRC8);
+  roundTrip(FRAME_CHECK_CRC16, FRAME_TAG_CRC16);
+
+  // 検査なしはそのまま写す。MUの最大データ長を超えるなら0
+  uint8_t out[MU_MAX_DATALEN];
+  TEST_ASSERT_EQUAL(sizeof(FRAME), sealFrame(out, FRAME, sizeof(FRAME), 0, FRAME_CHECK_NONE));
+  TEST_ASSERT_EQUAL_MEMORY(FRAME, out, sizeof(FRAME));
+  uint8_t big[MU_MAX_DATALEN] = {0};
+  TEST_ASSERT_EQUAL(0, sealFrame(out, big, MU_MAX_DATALEN - 2, 0, FRAME_CHECK_CRC8));
+}
+
+void test_single_bit_corruption_rejected() {
+  const FrameCheckKind kinds[2] = {FRAME_CHECK_CRC8, FRAME_CHECK_CRC16};
+  for (uint8_t k = 0; k < 2; k++) {
+    uint8_t sealed[MU_MAX_DATALEN];
+    uint8_t len = sealFrame(sealed, FRAME, sizeof(FRAME), 7, kinds[k]);
+    FrameChecker checker;
+    // タグ以外のどの1ビットが化けても捨てる(タグが化けると検査なしのフレームに見える)
+    for (uint8_t i = 1; i < len; i++) {
+      for (uint8_t b = 0; b < 8; b++) {
+        uint8_t bad[MU_MAX_DATALEN];
+        memcpy(bad, sealed, len);
+        bad[i] ^= (uint8_t)(1 << b);
+        const uint8_t *payload;
+        uint8_t payload_len;
+        TEST_ASSERT_FALSE(checker.open(bad, len, payload, payload_len));
+      }
+    }
+    TEST_ASSERT_EQUAL((len - 1) * 8, checker.stats().bad);
+    TEST_ASSERT_EQUAL(0, checker.stats().good);
+    TEST_ASSERT_EQUAL(1000, checker.stats().badPermille());
+  }
+}
+
+void test_truncated_frame_rejected() {
+  uint8_t sealed[MU_MAX_DATALEN];
+  uint8_t len = sealFrame(sealed, FRAME, sizeof(FRAME), 0, FRAME_CHECK_CRC16);
+  FrameChecker checker;
+  const uint8_t *payload;
+  uint8_t payload_len;
+  // 検査の分しかない(元のフレームが空)
+  for (uint8_t n = 1; n <= frameCheckOverhead(FRAME_CHECK_CRC16); n++) {
+    TEST_ASSERT_FALSE(checker.open(sealed, n, payload, payload_len));
+  }
+  // 途中で切れたフレームはCRCが合わない
+  TEST_ASSERT_FALSE(checker.open(sealed, len - 1, payload, payload_len));
+  TEST_ASSERT_EQUAL(frameCheckOverhead(FRAME_CHECK_CRC16) + 1, checker.stats().bad);
+  TEST_ASSERT_EQUAL(0, checker.stats().unchecked);
+}
+
+void test_sequence_gap_and_resync() {
+  FrameChecker checker;
+  TEST_ASSERT_TRUE(deliver(checker, 10));
+  TEST_ASSERT_TRUE(deliver(checker, 11));
+  // 12,13,14が届かなかった
+  TEST_ASSERT_TRUE(deliver(checker, 15));
+  TEST_ASSERT_EQUAL(3, checker.stats().lost);
+  TEST_ASSERT_EQUAL(0, checker.stats().resync);
+
+  // 255から0への周回は飛びではない
+  FrameChecker wrap;
+  TEST_ASSERT_TRUE(deliver(wrap, 254));
+  TEST_ASSERT_TRUE(deliver(wrap, 255));
+  TEST_ASSERT_TRUE(deliver(wrap, 0));
+  TEST_ASSERT_TRUE(deliver(wrap, 1));
+  TEST_ASSERT_EQUAL(0, wrap.stats().lost);
+  TEST_ASSERT_EQUAL(0, wrap.stats().resync);
+
+  // 送信機の再起動で連番が戻ったら、失ったとは数えずに数え直す(CRC-16でも同じ)
+  FrameChecker restart;
+  TEST_ASSERT_TRUE(deliver(restart, 100, FRAME_CHECK_CRC16));
+  TEST_ASSERT_TRUE(deliver(restart, 3, FRAME_CHECK_CRC16));
+  TEST_ASSERT_EQUAL(1, restart.stats().resync);
+  TEST_ASSERT_EQUAL(0, restart.stats().lost);
+  TEST_ASSERT_TRUE(deliver(restart, 5, FRAME_CHECK_CRC16));
+  TEST_ASSERT_EQUAL(1, restart.stats().lost);
+}
+
+void test_unchecked_frames() {
+  const uint8_t *payload;
+  uint8_t payload_len;
+  FrameChecker loose;
+  TEST_ASSERT_TRUE(loose.open(FRAME, sizeof(FRAME), payload, payload_len));
+  TEST_ASSERT_TRUE(payload == FRAME);
+  TEST_ASSERT_EQUAL(sizeof(FRAME), payload_len);
+  TEST_ASSERT_EQUAL(1, loose.stats().unchecked);
+
+  // 検査を必須にすると検査のないフレームは捨てる(検査付きは通す)
+  FrameChecker strict(true);
+  TEST_ASSERT_FALSE(strict.open(FRAME, sizeof(FRAME), payload, payload_len));
+  TEST_ASSERT_EQUAL(1, strict.stats().unchecked);
+  TEST_ASSERT_TRUE(deliver(strict, 0));
+  TEST_ASSERT_EQUAL(1, strict.stats().good);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_single_bit_corruption_rejected);
+  RUN_TEST(test_truncated_frame_rejected);
+  RUN_TEST(test_sequence_gap_and_resync);
+  RUN_TEST(test_unchecked_frames);
+  return UNITY_END();
+}
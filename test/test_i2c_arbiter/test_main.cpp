@@ -0,0 +1,198 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * BasicI2cArbiterのテスト。画面の送信が予約枠にかからないこと、
+ * 画面を送り続けてもコントローラーの待ち時間が抑えられることを確かめる。
+ * pio test -e native -f test_i2c_arbiter
+ * @version 0.1
+ *
+ */
+#include <unity.h>
+#include <I2cArbiter.h>
+#include <MockWire.h>
+#include <OledRenderer.h>
+
+namespace {
+
+uint32_t now_us = 0;
+uint32_t fakeClock() { return now_us; }
+/// 次にコントローラーを読む時刻[us]
+uint32_t next_pad_us = 0;
+
+/**
+ * @brief
+ * コントローラーのタスクの方が優先度が高いときのRtosMutexの代わり。
+ * コントローラーを読む時刻になったら、画面の送信の区切りでコントローラーがロックを取るので、
+ * 画面のtryLockは失敗する
+ */
+class PadFirstLock {
+public:
+  void lock() {}
+  bool tryLock() { return (int32_t)(now_us - next_pad_us) < 0; }
+  void unlock() {}
+};
+
+/// 書いたバイト数とクロックから送受信の時間を見積もり、その分だけ時計を進めるバス
+class TimedWire : public MockWire {
+public:
+  TimedWire() : MockWire(fakeClock){};
+  void beginTransmission(uint8_t addr) {
+    bytes_ = 0;
+    MockWire::beginTransmission(addr);
+  }
+  size_t write(uint8_t d) {
+    bytes_++;
+    return MockWire::write(d);
+  }
+  uint8_t endTransmission(bool stop = true) {
+    now_us += transferUs(bytes_);
+    return MockWire::endTransmission(stop);
+  }
+  uint8_t requestFrom(uint8_t addr, uint8_t len) {
+    now_us += transferUs(len);
+    return MockWire::requestFrom(addr, len);
+  }
+
+private:
+  uint16_t bytes_ = 0;
+  uint32_t transferUs(uint16_t bytes);
+};
+
+typedef BasicI2cArbiter<TimedWire, PadFirstLock> Bus;
+
+uint32_t TimedWire::transferUs(uint16_t bytes) {
+  return Bus::transferUs(bytes, clock_hz);
+}
+
+// main.cppと同じ設定
+const uint32_t PERIOD_US = 10000;
+const uint32_t WINDOW_US = 2000;
+const uint32_t GUARD_US = 300;
+const uint32_t OLED_HZ = 400000;
+const uint8_t PAD_ADDR = 0x52;
+const uint8_t OLED_ADDR = 0x3c;
+
+/// コントローラー1回分の読み出し(読み出しアドレスを書き、6バイト読む)
+void readPad(TimedWire &wire) {
+  wire.beginTransmission(PAD_ADDR);
+  wire.write(0);
+  wire.write(0);
+  wire.endTransmission();
+  wire.requestFrom(PAD_ADDR, 6);
+}
+
+/**
+ * @brief 1秒間、コントローラーをPERIOD_USごとに読み、すき間で画面を送り続ける
+ *
+ * @param bus
+ * @return uint32_t 画面を送り終えた回数
+ */
+uint32_t run(Bus &bus) {
+  static uint8_t buffer[BasicOledRenderer<Bus>::PAGES *
+                        BasicOledRenderer<Bus>::WIDTH];
+  BasicOledRenderer<Bus> renderer(bus, OLED_ADDR, buffer, 0);
+  next_pad_us = now_us;
+  uint32_t end = now_us + 1000000;
+  uint32_t flushes = 0;
+  while ((int32_t)(end - now_us) > 0) {
+    if ((int32_t)(now_us - next_pad_us) >= 0) {
+      bus.lock(I2C_CONTROLLER, next_pad_us);
+      readPad(bus.wire());
+      bus.unlock();
+      next_pad_us += PERIOD_US;
+      continue;
+    }
+    if (!renderer.busy()) {
+      // 毎回全画面を描き直す(いちばん送る量が多い)
+      renderer.invalidateAll();
+    }
+    uint32_t deferred = bus.stats().client[I2C_DISPLAY].deferred;
+    if (renderer.flush(now_us / 1000)) {
+      flushes++;
+    }
+    int32_t until = (int32_t)(next_pad_us - now_us);
+    if (bus.stats().client[I2C_DISPLAY].deferred != deferred && until > 0) {
+      // 取れなかったら少し後でやり直す(表示タスクの待ちの代わり)
+      now_us += until < 100 ? until : 100;
+    }
+  }
+  return flushes;
+}
+
+} // namespace
+
+void setUp() { now_us = 1000; }
+void tearDown() {}
+
+void test_transfer_estimate() {
+  // (バイト数+アドレス)*9ビット+スタート・ストップ、それに1回ごとの処理時間
+  TEST_ASSERT_EQUAL_UINT32((34 * 9 + 2) * 10 + 50, Bus::transferUs(33, 100000));
+  TEST_ASSERT_EQUAL_UINT32((34 * 9 + 2) * 10 / 4 + 50,
+                           Bus::transferUs(33, 400000));
+}
+
+void test_display_deferred_before_reserved_slot() {
+  TimedWire wire;
+  Bus bus(wire, fakeClock);
+  bus.reserve(PERIOD_US, WINDOW_US, GUARD_US);
+  bus.setClientClock(I2C_DISPLAY, OLED_HZ);
+  uint32_t slot = now_us + PERIOD_US;
+  next_pad_us = slot + PERIOD_US;
+  bus.lock(I2C_CONTROLLER, now_us);
+  readPad(wire);
+  bus.unlock();
+  uint32_t chunk = Bus::transferUs(33, OLED_HZ);
+  // 予約枠の前にguardを残して終わるなら取れる
+  now_us = slot - GUARD_US - chunk;
+  TEST_ASSERT_TRUE(bus.tryLock(I2C_DISPLAY, 33));
+  bus.unlock();
+  TEST_ASSERT_EQUAL(OLED_HZ, wire.clock_hz);
+  now_us = slot - GUARD_US - chunk + 1;
+  TEST_ASSERT_FALSE(bus.tryLock(I2C_DISPLAY, 33));
+  // 短い送信ならまだ入る
+  TEST_ASSERT_TRUE(bus.tryLock(I2C_DISPLAY, 7));
+  bus.unlock();
+  TEST_ASSERT_EQUAL(1, bus.stats().client[I2C_DISPLAY].deferred);
+  // コントローラーが予約枠を過ぎても来ないときは止まっているとみなす
+  now_us = slot + WINDOW_US;
+  TEST_ASSERT_FALSE(bus.tryLock(I2C_DISPLAY, 33));
+  now_us = slot + WINDOW_US + 1;
+  TEST_ASSERT_TRUE(bus.tryLock(I2C_DISPLAY, 33));
+  bus.unlock();
+}
+
+void test_controller_wait_bounded_while_display_streams() {
+  TimedWire wire;
+  Bus bus(wire, fakeClock);
+  bus.reserve(PERIOD_US, WINDOW_US, GUARD_US);
+  bus.setClientClock(I2C_DISPLAY, OLED_HZ);
+  uint32_t flushes = run(bus);
+  const I2cBusStats &st = bus.stats();
+  TEST_ASSERT_EQUAL(100, st.client[I2C_CONTROLLER].acquired);
+  // 画面は予約枠の前で止まるので、コントローラーは待たされない
+  TEST_ASSERT_EQUAL_UINT32(0, st.client[I2C_CONTROLLER].max_wait_us);
+  TEST_ASSERT_GREATER_THAN(0, st.client[I2C_DISPLAY].deferred);
+  TEST_ASSERT_GREATER_THAN(10, flushes);
+  TEST_ASSERT_GREATER_THAN(0, st.utilization());
+  TEST_ASSERT_LESS_OR_EQUAL(1000, st.utilization());
+}
+
+void test_controller_waits_without_reservation() {
+  TimedWire wire;
+  Bus bus(wire, fakeClock);
+  bus.setClientClock(I2C_DISPLAY, OLED_HZ);
+  run(bus);
+  // 予約枠がなければ、画面の送信1回分(32バイト)待たされることがある
+  uint32_t max_wait = bus.stats().client[I2C_CONTROLLER].max_wait_us;
+  TEST_ASSERT_GREATER_THAN(0, max_wait);
+  TEST_ASSERT_LESS_OR_EQUAL(Bus::transferUs(33, OLED_HZ), max_wait);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_transfer_estimate);
+  RUN_TEST(test_display_deferred_before_reserved_slot);
+  RUN_TEST(test_controller_wait_bounded_while_display_streams);
+  RUN_TEST(test_controller_waits_without_reservation);
+  return UNITY_END();
+}
@@ -0,0 +1,235 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * InputRecorder/InputReplayのテスト。いっぱいになったら古いものから上書きすること、
+ * 書き出しの時刻とヘッダの件数、形式の違う・途中で切れた記録を読み込まないこと、
+ * 再生が記録の間隔どおりに取り出し、遅れを数えることを確かめる。
+ * pio test -e native -f test_input_recorder
+ * @version 0.1
+ *
+ */
+#include <string.h>
+#include <unity.h>
+#include <InputRecorder.h>
+
+namespace {
+
+/// メモリ上のファイル。書いた分をそのまま読める
+struct MemoryFile {
+  uint8_t data[1024];
+  size_t size = 0;
+  size_t pos = 0;
+  /// これより先は書けない
+  size_t limit = sizeof(data);
+
+  size_t write(const uint8_t *buf, size_t len) {
+    size_t n = size + len > limit ? limit - size : len;
+    memcpy(data + size, buf, n);
+    size += n;
+    return n;
+  }
+  size_t read(uint8_t *buf, size_t len) {
+    size_t n = pos + len > size ? size - pos : len;
+    memcpy(buf, data + pos, n);
+    pos += n;
+    return n;
+  }
+};
+
+/// i件目の入力。時刻は10ms間隔、ボタンはi
+InputFrame frameAt(uint32_t i) {
+  InputFrame f;
+  memset(&f, 0, sizeof(f));
+  f.time_us = 1000000 + i * 10000;
+  f.connected = (uint8_t)(i & 3);
+  f.emergency = (i % 5) == 0;
+  f.pad[0].Button = (uint16_t)i;
+  f.pad[1].Button = (uint16_t)(0x100 + i);
+  f.pad[0].setAnalogFine(controller::LstickX, (uint8_t)(i & 63));
+  f.pad[1].setAnalogFine(controller::TriggerR, (uint8_t)(i & 31));
+  return f;
+}
+
+uint32_t get32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_ring_overwrites_oldest() {
+  uint8_t storage[INPUT_RECORD_LEN * 4 + 3];
+  InputRecorder rec;
+  rec.begin(storage, sizeof(storage));
+  TEST_ASSERT_EQUAL(4, rec.capacity());
+  for (uint32_t i = 0; i < 6; i++) {
+    rec.add(frameAt(i));
+  }
+  TEST_ASSERT_EQUAL(4, rec.count());
+  TEST_ASSERT_EQUAL(2, rec.overwritten());
+  // 一番古いものから読める(0と1は上書きされた)
+  for (uint32_t i = 0; i < 4; i++) {
+    InputFrame f;
+    rec.read(i, f);
+    InputFrame expected = frameAt(i + 2);
+    TEST_ASSERT_EQUAL_UINT32(expected.time_us, f.time_us);
+    TEST_ASSERT_EQUAL(expected.connected, f.connected);
+    TEST_ASSERT_EQUAL(expected.emergency, f.emergency);
+    TEST_ASSERT_EQUAL_HEX16(expected.pad[0].Button, f.pad[0].Button);
+    TEST_ASSERT_EQUAL_HEX16(expected.pad[1].Button, f.pad[1].Button);
+    TEST_ASSERT_EQUAL(expected.pad[0].analogfine(controller::LstickX),
+                      f.pad[0].analogfine(controller::LstickX));
+    TEST_ASSERT_EQUAL(expected.pad[1].analogfine(controller::TriggerR),
+                      f.pad[1].analogfine(controller::TriggerR));
+  }
+
+  // バッファがなければ何も記録しない
+  InputRecorder none;
+  none.add(frameAt(0));
+  TEST_ASSERT_EQUAL(0, none.count());
+}
+
+void test_save_rebases_time_and_counts() {
+  uint8_t storage[INPUT_RECORD_LEN * 4];
+  InputRecorder rec;
+  rec.begin(storage, sizeof(storage));
+  for (uint32_t i = 0; i < 6; i++) {
+    rec.add(frameAt(i));
+  }
+  MemoryFile file;
+  // 新しいほうから3件だけ書き出す
+  TEST_ASSERT_TRUE(rec.save(file, 3));
+  TEST_ASSERT_EQUAL(INPUT_RECORD_HEADER_LEN + 3 * INPUT_RECORD_LEN, file.size);
+  TEST_ASSERT_EQUAL_MEMORY(INPUT_RECORD_MAGIC, file.data, 4);
+  TEST_ASSERT_EQUAL(INPUT_RECORD_VERSION, file.data[4]);
+  TEST_ASSERT_EQUAL(INPUT_RECORD_LEN, file.data[5]);
+  TEST_ASSERT_EQUAL_UINT32(3, get32(file.data + 8));
+  // 上書きした2件と、書き出さなかった1件
+  TEST_ASSERT_EQUAL_UINT32(3, get32(file.data + 12));
+  // 時刻は書き出した最初の1件からの経過
+  for (uint32_t i = 0; i < 3; i++) {
+    const uint8_t *record = file.data + INPUT_RECORD_HEADER_LEN + i * INPUT_RECORD_LEN;
+    TEST_ASSERT_EQUAL_UINT32(i * 10000, get32(record));
+  }
+
+  // 読み込むと同じ内容になる
+  uint8_t storage2[INPUT_RECORD_LEN * 4];
+  InputRecorder loaded;
+  loaded.begin(storage2, sizeof(storage2));
+  TEST_ASSERT_TRUE(loaded.load(file));
+  TEST_ASSERT_EQUAL(3, loaded.count());
+  InputFrame f;
+  loaded.read(2, f);
+  TEST_ASSERT_EQUAL_UINT32(20000, f.time_us);
+  TEST_ASSERT_EQUAL_HEX16(frameAt(5).pad[0].Button, f.pad[0].Button);
+
+  // 書ききれなければfalse
+  MemoryFile small;
+  small.limit = INPUT_RECORD_HEADER_LEN + INPUT_RECORD_LEN;
+  TEST_ASSERT_FALSE(rec.save(small));
+}
+
+void test_load_rejects_bad_input() {
+  uint8_t storage[INPUT_RECORD_LEN * 8];
+  InputRecorder rec;
+  rec.begin(storage, sizeof(storage));
+  for (uint32_t i = 0; i < 4; i++) {
+    rec.add(frameAt(i));
+  }
+  MemoryFile good;
+  TEST_ASSERT_TRUE(rec.save(good));
+
+  uint8_t storage2[INPUT_RECORD_LEN * 8];
+  InputRecorder loaded;
+  loaded.begin(storage2, sizeof(storage2));
+
+  MemoryFile bad = good;
+  bad.data[0] = 'X';
+  TEST_ASSERT_FALSE(loaded.load(bad));
+  TEST_ASSERT_EQUAL(0, loaded.count());
+
+  bad = good;
+  bad.data[4] = INPUT_RECORD_VERSION + 1;
+  TEST_ASSERT_FALSE(loaded.load(bad));
+
+  bad = good;
+  bad.data[5] = INPUT_RECORD_LEN + 1;
+  TEST_ASSERT_FALSE(loaded.load(bad));
+
+  // ヘッダの途中で切れている
+  bad = good;
+  bad.size = INPUT_RECORD_HEADER_LEN - 1;
+  TEST_ASSERT_FALSE(loaded.load(bad));
+  TEST_ASSERT_EQUAL(0, loaded.count());
+
+  // 記録の途中で切れている。読めた分は残る
+  bad = good;
+  bad.size = INPUT_RECORD_HEADER_LEN + 2 * INPUT_RECORD_LEN + 5;
+  TEST_ASSERT_FALSE(loaded.load(bad));
+  TEST_ASSERT_EQUAL(2, loaded.count());
+
+  // 入りきらない分は古いほうを捨てる
+  uint8_t storage3[INPUT_RECORD_LEN * 3];
+  InputRecorder small;
+  small.begin(storage3, sizeof(storage3));
+  good.pos = 0;
+  TEST_ASSERT_TRUE(small.load(good));
+  TEST_ASSERT_EQUAL(3, small.count());
+  TEST_ASSERT_EQUAL(1, small.overwritten());
+  InputFrame f;
+  small.read(0, f);
+  TEST_ASSERT_EQUAL_HEX16(frameAt(1).pad[0].Button, f.pad[0].Button);
+}
+
+void test_replay_timing() {
+  uint8_t storage[INPUT_RECORD_LEN * 8];
+  InputRecorder rec;
+  rec.begin(storage, sizeof(storage));
+  InputReplay replay(rec);
+  TEST_ASSERT_FALSE(replay.start(0));
+  for (uint32_t i = 0; i < 3; i++) {
+    rec.add(frameAt(i));
+  }
+
+  const uint32_t t0 = 5000000;
+  TEST_ASSERT_TRUE(replay.start(t0));
+  TEST_ASSERT_EQUAL(3, replay.length());
+  InputFrame f;
+  // 最初の1件は始めた時刻に出る
+  TEST_ASSERT_TRUE(replay.next(t0, f));
+  TEST_ASSERT_EQUAL_UINT32(t0, f.time_us);
+  TEST_ASSERT_EQUAL_HEX16(0, f.pad[0].Button);
+  // 2件目は10ms後。早すぎれば出さない
+  TEST_ASSERT_FALSE(replay.next(t0 + 9999, f));
+  TEST_ASSERT_TRUE(replay.next(t0 + 10000, f));
+  TEST_ASSERT_EQUAL_UINT32(t0 + 10000, f.time_us);
+  TEST_ASSERT_EQUAL_UINT32(0, replay.stats().max_late_us);
+  // 3件目を1.5ms遅れて取り出すと、時刻は記録どおりで遅れを数える
+  TEST_ASSERT_TRUE(replay.next(t0 + 21500, f));
+  TEST_ASSERT_EQUAL_UINT32(t0 + 20000, f.time_us);
+  TEST_ASSERT_EQUAL_HEX16(2, f.pad[0].Button);
+  TEST_ASSERT_EQUAL_UINT32(1500, replay.stats().max_late_us);
+  TEST_ASSERT_EQUAL(3, replay.stats().played);
+  // 最後まで出したら終わる
+  TEST_ASSERT_FALSE(replay.running());
+  TEST_ASSERT_FALSE(replay.next(t0 + 30000, f));
+
+  // 時計が一周しても間隔どおり
+  TEST_ASSERT_TRUE(replay.start(0xFFFFF000));
+  TEST_ASSERT_TRUE(replay.next(0xFFFFF000, f));
+  TEST_ASSERT_FALSE(replay.next(0xFFFFFFFF, f));
+  TEST_ASSERT_TRUE(replay.next(0xFFFFF000 + 10000, f));
+  TEST_ASSERT_EQUAL_UINT32(0xFFFFF000 + 10000, f.time_us);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_overwrites_oldest);
+  RUN_TEST(test_save_rebases_time_and_counts);
+  RUN_TEST(test_load_rejects_bad_input);
+  RUN_TEST(test_replay_timing);
+  return UNITY_END();
+}
@@ -0,0 +1,229 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * BasicInterruptButtonManagerのテスト。ピンの変化を割り込みとして起こすPortを使い、
+ * チャタリング除去、読み直し、wait()の待ち方(変化がなければ寝たまま)を確かめる。
+ * pio test -e native -f test_interrupt_button
+ * @version 0.1
+ *
+ */
+#include <unity.h>
+#include <InterruptButtonManager.h>
+
+namespace {
+
+/**
+ * @brief
+ * ピンのレベルと時計を持ち、予定した時刻にピンを変えて割り込みを呼ぶPort。
+ * wait()は次の変化か時間切れまで時計を進める。
+ */
+class FakePort {
+public:
+  static const uint8_t PINS = 4;
+  static const uint8_t MAX_EDGES = 16;
+  static const uint8_t MAX_WAITS = 16;
+
+  void setup(uint8_t pin) { (void)pin; }
+  int read(uint8_t pin) { return level[pin]; }
+  uint32_t nowUs() { return now_us; }
+  void attach(uint8_t pin, void (*isr)(void *), void *arg) {
+    isr_[pin] = isr;
+    arg_[pin] = arg;
+  }
+  void signalFromIsr() { signals++; }
+  void wait(uint32_t timeout_ms) {
+    if (waits < MAX_WAITS) {
+      wait_ms[waits] = timeout_ms;
+    }
+    waits++;
+    if (next_ < edges_) {
+      Edge &e = edge_[next_];
+      if (timeout_ms == BUTTON_WAIT_FOREVER ||
+          e.time_us - now_us <= timeout_ms * 1000) {
+        next_++;
+        now_us = e.time_us;
+        change(e.pin, e.level);
+        return;
+      }
+    }
+    // 変化の予定がないのに時間切れなしで待つと戻ってこない
+    TEST_ASSERT_NOT_EQUAL(BUTTON_WAIT_FOREVER, timeout_ms);
+    now_us += timeout_ms * 1000;
+  }
+
+  /// ピンを変えて割り込みを呼ぶ
+  void change(uint8_t pin, uint8_t l) {
+    level[pin] = l;
+    isr_[pin](arg_[pin]);
+  }
+  /// time_usにピンを変える予定を入れる(時刻順に入れること)
+  void schedule(uint32_t time_us, uint8_t pin, uint8_t l) {
+    edge_[edges_++] = Edge{time_us, pin, l};
+  }
+
+  uint32_t now_us = 1000000;
+  uint8_t level[PINS] = {1, 1, 1, 1};
+  uint32_t signals = 0;
+  uint32_t waits = 0;
+  uint32_t wait_ms[MAX_WAITS];
+
+private:
+  struct Edge {
+    uint32_t time_us;
+    uint8_t pin;
+    uint8_t level;
+  };
+  void (*isr_[PINS])(void *) = {};
+  void *arg_[PINS] = {};
+  Edge edge_[MAX_EDGES];
+  uint8_t edges_ = 0;
+  uint8_t next_ = 0;
+};
+
+typedef BasicInterruptButtonManager<2, FakePort, 8> Buttons;
+
+const uint32_t DEBOUNCE_MS = 15;
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_first_edge_passes_immediately() {
+  Buttons btn;
+  TEST_ASSERT_EQUAL(0, btn.add(0, DEBOUNCE_MS));
+  TEST_ASSERT_EQUAL(1, btn.add(1, DEBOUNCE_MS));
+  TEST_ASSERT_EQUAL(-1, btn.add(2, DEBOUNCE_MS));
+  FakePort &port = btn.port();
+  ButtonEvent e;
+  TEST_ASSERT_FALSE(btn.poll(e));
+  uint32_t t = port.now_us;
+  port.change(1, 0);
+  port.now_us += 3000; // 読み出しが遅れても時刻は割り込みの時刻
+  TEST_ASSERT_TRUE(btn.poll(e));
+  TEST_ASSERT_EQUAL(ButtonEvent::PRESS, e.kind);
+  TEST_ASSERT_EQUAL(1, e.index);
+  TEST_ASSERT_EQUAL_UINT32(t, e.time_us);
+  TEST_ASSERT_TRUE(btn.isHold(1));
+  TEST_ASSERT_FALSE(btn.isHold(0));
+  TEST_ASSERT_EQUAL(1, port.signals);
+}
+
+void test_bounces_are_dropped() {
+  Buttons btn;
+  btn.add(0, DEBOUNCE_MS);
+  FakePort &port = btn.port();
+  ButtonEvent e;
+  port.change(0, 0);
+  port.now_us += 1000;
+  port.change(0, 1);
+  port.now_us += 1000;
+  port.change(0, 0);
+  TEST_ASSERT_TRUE(btn.poll(e));
+  TEST_ASSERT_EQUAL(ButtonEvent::PRESS, e.kind);
+  // 最後は押されたままなので、読み直しても変わらない
+  TEST_ASSERT_FALSE(btn.poll(e));
+  port.now_us += DEBOUNCE_MS * 1000;
+  TEST_ASSERT_FALSE(btn.poll(e));
+  TEST_ASSERT_EQUAL(3, btn.stats().edges);
+  TEST_ASSERT_EQUAL(2, btn.stats().bounces);
+  TEST_ASSERT_EQUAL(0, btn.stats().resyncs);
+}
+
+void test_idle_wait_blocks_until_edge() {
+  Buttons btn;
+  btn.add(0, DEBOUNCE_MS);
+  FakePort &port = btn.port();
+  uint32_t t = port.now_us + 2000000;
+  port.schedule(t, 0, 0);
+  ButtonEvent e;
+  TEST_ASSERT_TRUE(btn.wait(e, BUTTON_WAIT_FOREVER));
+  TEST_ASSERT_EQUAL(ButtonEvent::PRESS, e.kind);
+  TEST_ASSERT_EQUAL_UINT32(t, e.time_us);
+  // 変化が来るまで一度も起きない
+  TEST_ASSERT_EQUAL(1, port.waits);
+  TEST_ASSERT_EQUAL_UINT32(BUTTON_WAIT_FOREVER, port.wait_ms[0]);
+}
+
+void test_wait_timeout() {
+  Buttons btn;
+  btn.add(0, DEBOUNCE_MS);
+  FakePort &port = btn.port();
+  uint32_t start = port.now_us;
+  ButtonEvent e;
+  TEST_ASSERT_FALSE(btn.wait(e, 50));
+  TEST_ASSERT_EQUAL(1, port.waits);
+  TEST_ASSERT_EQUAL_UINT32(50, port.wait_ms[0]);
+  TEST_ASSERT_EQUAL_UINT32(50000, port.now_us - start);
+}
+
+void test_dropped_release_is_resynced_once() {
+  Buttons btn;
+  btn.add(0, DEBOUNCE_MS);
+  FakePort &port = btn.port();
+  uint32_t t0 = port.now_us + 1000;
+  // 押したあと除去時間内に離された(離したことはチャタリングとして捨てられる)
+  port.schedule(t0, 0, 0);
+  port.schedule(t0 + 4000, 0, 1);
+  ButtonEvent e;
+  TEST_ASSERT_TRUE(btn.wait(e, BUTTON_WAIT_FOREVER));
+  TEST_ASSERT_EQUAL(ButtonEvent::PRESS, e.kind);
+  // 除去時間が過ぎたところで1回だけ起きてピンを読み直す。時刻は捨てた変化の時刻
+  TEST_ASSERT_TRUE(btn.wait(e, BUTTON_WAIT_FOREVER));
+  TEST_ASSERT_EQUAL(ButtonEvent::RELEASE, e.kind);
+  TEST_ASSERT_EQUAL_UINT32(t0 + 4000, e.time_us);
+  TEST_ASSERT_EQUAL(1, btn.stats().resyncs);
+  TEST_ASSERT_EQUAL(3, port.waits);
+  TEST_ASSERT_EQUAL_UINT32(BUTTON_WAIT_FOREVER, port.wait_ms[1]);
+  TEST_ASSERT_EQUAL_UINT32(DEBOUNCE_MS - 4, port.wait_ms[2]);
+  // 読み直したあとは、また変化が来るまで寝る
+  port.schedule(port.now_us + 500000, 0, 0);
+  TEST_ASSERT_TRUE(btn.wait(e, BUTTON_WAIT_FOREVER));
+  TEST_ASSERT_EQUAL(4, port.waits);
+  TEST_ASSERT_EQUAL_UINT32(BUTTON_WAIT_FOREVER, port.wait_ms[3]);
+}
+
+void test_ring_overflow() {
+  Buttons btn;
+  btn.add(0, DEBOUNCE_MS);
+  FakePort &port = btn.port();
+  for (int i = 0; i < 10; i++) {
+    port.change(0, i % 2 == 0 ? 0 : 1);
+  }
+  ButtonEvent e;
+  TEST_ASSERT_TRUE(btn.poll(e));
+  TEST_ASSERT_FALSE(btn.poll(e));
+  TEST_ASSERT_EQUAL(2, btn.stats().overflows);
+  TEST_ASSERT_EQUAL(8, btn.stats().edges);
+}
+
+void test_update_like_button_manager() {
+  Buttons btn;
+  btn.add(0, DEBOUNCE_MS);
+  btn.add(1, DEBOUNCE_MS);
+  FakePort &port = btn.port();
+  port.change(0, 0);
+  btn.update();
+  TEST_ASSERT_TRUE(btn.isPressed(0));
+  TEST_ASSERT_FALSE(btn.isPressed(1));
+  btn.release();
+  TEST_ASSERT_FALSE(btn.isPressed(0));
+  TEST_ASSERT_TRUE(btn.isHold(0));
+  port.now_us += DEBOUNCE_MS * 1000;
+  port.change(0, 1);
+  btn.update();
+  TEST_ASSERT_TRUE(btn.isReleased(0));
+  TEST_ASSERT_FALSE(btn.isHold(0));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_edge_passes_immediately);
+  RUN_TEST(test_bounces_are_dropped);
+  RUN_TEST(test_idle_wait_blocks_until_edge);
+  RUN_TEST(test_wait_timeout);
+  RUN_TEST(test_dropped_release_is_resynced_once);
+  RUN_TEST(test_ring_overflow);
+  RUN_TEST(test_update_like_button_manager);
+  return UNITY_END();
+}
@@ -0,0 +1,178 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * LatencyHistogram/LatencyTraceのテスト。ビンの境界、範囲を超えた値、
+ * パーセンタイル、リセット、段階間の差(時刻の桁あふれを含む)を確かめる。
+ * pio test -e native -f test_latency_trace
+ * @version 0.1
+ *
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <unity.h>
+#include <LatencyTrace.h>
+
+namespace {
+uint32_t now_us = 0;
+} // namespace
+
+// LATENCY_STAMPが使う時計(sim/のmicros()はリンクしない)
+uint32_t micros() { return now_us; }
+
+namespace {
+
+/// dump()の出力を溜める
+struct StringOut {
+  char text[512];
+  size_t len = 0;
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text + len, sizeof(text) - len, format, args);
+    va_end(args);
+    len += n;
+    return n;
+  }
+};
+
+struct Sample {
+  LATENCY_FIELD
+};
+
+} // namespace
+
+void setUp() { now_us = 0; }
+void tearDown() {}
+
+void test_bin_boundaries() {
+  LatencyHistogram h;
+  // ビン0は0、ビンiは2^(i-1)以上2^i未満
+  const uint32_t values[] = {0, 1, 2, 3, 4, 7, 8, 1023, 1024};
+  const uint8_t bins[] = {0, 1, 2, 2, 3, 3, 4, 10, 11};
+  for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    LatencyHistogram one;
+    one.add(values[i]);
+    TEST_ASSERT_EQUAL_UINT32(1, one.bin(bins[i]));
+    TEST_ASSERT_EQUAL_UINT32(values[i], one.max());
+    h.add(values[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(9, h.count());
+  TEST_ASSERT_EQUAL_UINT32(2, h.bin(2));
+  TEST_ASSERT_EQUAL_UINT32(2, h.bin(3));
+  TEST_ASSERT_EQUAL_UINT32(1024, h.max());
+}
+
+void test_overflow_goes_to_last_bin() {
+  LatencyHistogram h;
+  const uint8_t last = LatencyHistogram::BINS - 1;
+  h.add(((uint32_t)1 << (last - 1)) - 1);
+  TEST_ASSERT_EQUAL_UINT32(1, h.bin(last - 1));
+  // 2^(BINS-2)以上はすべて最後のビン
+  h.add((uint32_t)1 << (last - 1));
+  h.add(0x80000000u);
+  h.add(0xffffffffu);
+  TEST_ASSERT_EQUAL_UINT32(3, h.bin(last));
+  TEST_ASSERT_EQUAL_UINT32(4, h.count());
+  TEST_ASSERT_EQUAL_UINT32(0xffffffffu, h.max());
+  // 最後のビンにかかる割合は上端の代わりに最大値を返す
+  TEST_ASSERT_EQUAL_UINT32(0xffffffffu, h.percentile(990));
+}
+
+void test_percentile() {
+  LatencyHistogram h;
+  TEST_ASSERT_EQUAL_UINT32(0, h.percentile(500));
+  for (uint32_t i = 0; i < 99; i++) {
+    h.add(100); // ビン7 [64,128)
+  }
+  h.add(5000); // ビン13 [4096,8192)
+  TEST_ASSERT_EQUAL_UINT32(128, h.percentile(500));
+  TEST_ASSERT_EQUAL_UINT32(128, h.percentile(980));
+  TEST_ASSERT_EQUAL_UINT32(8192, h.percentile(990));
+  TEST_ASSERT_EQUAL_UINT32(5000, h.max());
+}
+
+void test_reset() {
+  LatencyHistogram h;
+  h.add(3);
+  h.add(70000);
+  h.reset();
+  TEST_ASSERT_EQUAL_UINT32(0, h.count());
+  TEST_ASSERT_EQUAL_UINT32(0, h.max());
+  for (uint8_t i = 0; i < LatencyHistogram::BINS; i++) {
+    TEST_ASSERT_EQUAL_UINT32(0, h.bin(i));
+  }
+  h.add(5);
+  TEST_ASSERT_EQUAL_UINT32(1, h.bin(3));
+  TEST_ASSERT_EQUAL_UINT32(5, h.max());
+}
+
+void test_dump() {
+  LatencyHistogram h;
+  h.add(0);
+  h.add(6);
+  StringOut out;
+  h.dump(out, "x");
+  TEST_ASSERT_EQUAL_STRING(
+      "x n=2 p50<8 p99<8 max=6 | 1 0 0 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+      out.text);
+}
+
+void test_concurrent_add() {
+  LatencyHistogram h;
+  std::thread threads[4];
+  for (uint32_t t = 0; t < 4; t++) {
+    threads[t] = std::thread([&h, t]() {
+      for (uint32_t i = 0; i < 100000; i++) {
+        h.add(t * 1000 + (i & 7));
+      }
+    });
+  }
+  for (uint32_t t = 0; t < 4; t++) {
+    threads[t].join();
+  }
+  TEST_ASSERT_EQUAL_UINT32(400000, h.count());
+  TEST_ASSERT_EQUAL_UINT32(3007, h.max());
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < LatencyHistogram::BINS; i++) {
+    sum += h.bin(i);
+  }
+  TEST_ASSERT_EQUAL_UINT32(400000, sum);
+}
+
+void test_trace_stages() {
+  LatencyTrace trace;
+  Sample s;
+  // 時刻が途中で桁あふれしても差は正しい
+  now_us = 0xfffffff0u;
+  LATENCY_STAMP(s, LAT_I2C_READ);
+  LATENCY_STAMP_AT(s, LAT_PACK, 0xfffffff0u + 100);
+  LATENCY_STAMP_AT(s, LAT_HANDOFF, 0xfffffff0u + 100);
+  Sample copy;
+  LATENCY_COPY(copy, s);
+  LATENCY_STAMP_AT(copy, LAT_SEND, 0xfffffff0u + 2100);
+  LATENCY_STAMP_AT(copy, LAT_TX_DONE, 0xfffffff0u + 6100);
+  trace.commit(copy.latency);
+  TEST_ASSERT_EQUAL_UINT32(100, trace.stage[0].max());
+  TEST_ASSERT_EQUAL_UINT32(1, trace.stage[1].bin(0));
+  TEST_ASSERT_EQUAL_UINT32(2000, trace.stage[2].max());
+  TEST_ASSERT_EQUAL_UINT32(4000, trace.stage[3].max());
+  TEST_ASSERT_EQUAL_UINT32(6100, trace.total.max());
+  TEST_ASSERT_EQUAL_UINT32(1, trace.total.count());
+  trace.reset();
+  TEST_ASSERT_EQUAL_UINT32(0, trace.total.count());
+  TEST_ASSERT_EQUAL_UINT32(0, trace.stage[2].max());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bin_boundaries);
+  RUN_TEST(test_overflow_goes_to_last_bin);
+  RUN_TEST(test_percentile);
+  RUN_TEST(test_reset);
+  RUN_TEST(test_dump);
+  RUN_TEST(test_concurrent_add);
+  RUN_TEST(test_trace_stages);
+  return UNITY_END();
+}
@@ -0,0 +1,263 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * LinkTelemetry/TelemetryDecoderのテスト。MUからの応答の流れをFakeUartとMuReceiverで作り、
+ * main.cppのMuタスクと同じように累計を渡して、1秒分の差、60秒の履歴の周回、状態のしきい値、
+ * @RAの応答の読み取り、USBに出す形式の往復(途中からの読み始めとCRCの不一致を含む)を確かめる。
+ * pio test -e native -f test_link_telemetry
+ * @version 0.1
+ *
+ */
+#include <string.h>
+#include <unity.h>
+#include <FakeUart.h>
+#include <LinkTelemetry.h>
+#include <MuReceiver.hpp>
+
+namespace {
+
+/**
+ * @brief 模擬のMUからの受信と回線の統計。main.cppのMuタスクと同じ渡し方をする
+ *
+ */
+struct Link {
+  FakeUart<256> uart;
+  MuReceiver<FakeUart<256>> rx;
+  LinkTelemetry telemetry;
+  LinkCounters counters;
+
+  Link(const LinkThresholds &thresholds = LinkThresholds())
+      : rx(uart, publish, this), telemetry(thresholds) {
+    uart.onReceive([this]() { rx.drain(); });
+  }
+
+  static bool publish(void *context, const MuRxEvent &event) {
+    Link *link = (Link *)context;
+    if (event.event == MU_EVENT_RESPONSE) {
+      link->telemetry.onResponse(event.data, event.len);
+    }
+    return true;
+  }
+
+  /// 1秒の間にsent回送り、MUからstreamが届いたとして記録する
+  void second(uint16_t sent, const char *stream = "") {
+    uart.inject((const uint8_t *)stream, strlen(stream));
+    counters.sent += sent;
+    const MuRxStats &st = rx.stats();
+    counters.received = st.frames;
+    memcpy(counters.errors, st.errors, sizeof(counters.errors));
+    counters.queue_drops = st.dropped;
+    telemetry.sample(counters);
+  }
+};
+
+/// 1秒分の累計を直接渡す(しきい値の確認用)
+void sampleOnce(LinkTelemetry &t, LinkCounters &c, uint16_t sent, uint16_t ir) {
+  c.sent += sent;
+  c.errors[MU_ERR_CATCH_IR] += ir;
+  t.sample(c);
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_sample_takes_deltas() {
+  Link link;
+  // 最初は基準にするだけ
+  link.second(0);
+  TEST_ASSERT_EQUAL(0, link.telemetry.count());
+  TEST_ASSERT_EQUAL(0, link.telemetry.window(10).seconds);
+
+  link.second(10, "*DR=02\xab\xcd\r\n*DR=01\x42\r\n*IR=03\r\n");
+  TEST_ASSERT_EQUAL(1, link.telemetry.count());
+  const LinkSecond &s = link.telemetry.second(0);
+  TEST_ASSERT_EQUAL(10, s.sent);
+  TEST_ASSERT_EQUAL(2, s.received);
+  TEST_ASSERT_EQUAL(1, s.txErrors());
+  TEST_ASSERT_EQUAL(0, s.parseErrors());
+  TEST_ASSERT_EQUAL(TELEMETRY_NO_RSSI, s.rssi_dbm);
+
+  // 累計から前回の分を引いた値になる
+  link.second(5, "*DR=01\x42\r\n*DR=G1");
+  TEST_ASSERT_EQUAL(2, link.telemetry.count());
+  TEST_ASSERT_EQUAL(5, link.telemetry.second(0).sent);
+  TEST_ASSERT_EQUAL(1, link.telemetry.second(0).received);
+  TEST_ASSERT_EQUAL(0, link.telemetry.second(0).txErrors());
+  TEST_ASSERT_EQUAL(1, link.telemetry.second(0).parseErrors());
+  TEST_ASSERT_EQUAL(1, link.telemetry.second(0).errors[MU_ERR_LENGTH_NOT_HEX]);
+  TEST_ASSERT_EQUAL(10, link.telemetry.second(1).sent);
+
+  LinkWindow w = link.telemetry.window(10);
+  TEST_ASSERT_EQUAL(2, w.seconds);
+  TEST_ASSERT_EQUAL_UINT32(15, w.sent);
+  TEST_ASSERT_EQUAL_UINT32(3, w.received);
+  TEST_ASSERT_EQUAL_UINT32(1, w.tx_errors);
+  TEST_ASSERT_EQUAL_UINT32(1, w.parse_errors);
+  TEST_ASSERT_EQUAL(66, w.irPermille());
+}
+
+void test_history_wraps_after_60s() {
+  LinkTelemetry t;
+  LinkCounters c;
+  t.sample(c);
+  for (uint16_t i = 1; i <= TELEMETRY_HISTORY + 10; i++) {
+    sampleOnce(t, c, i, 0);
+  }
+  TEST_ASSERT_EQUAL(TELEMETRY_HISTORY, t.count());
+  TEST_ASSERT_EQUAL_UINT32(TELEMETRY_HISTORY + 10, t.seconds());
+  // 最新は70秒目、一番古いのは11秒目
+  TEST_ASSERT_EQUAL(TELEMETRY_HISTORY + 10, t.second(0).sent);
+  TEST_ASSERT_EQUAL(11, t.second(TELEMETRY_HISTORY - 1).sent);
+  LinkWindow w = t.window(255);
+  TEST_ASSERT_EQUAL(TELEMETRY_HISTORY, w.seconds);
+  uint32_t sum = 0;
+  for (uint16_t i = 11; i <= TELEMETRY_HISTORY + 10; i++) {
+    sum += i;
+  }
+  TEST_ASSERT_EQUAL_UINT32(sum, w.sent);
+
+  // 画面の履歴は古い順。送っていない秒は255
+  LinkSummary summary;
+  t.summarize(summary);
+  TEST_ASSERT_EQUAL(100, summary.delivered_percent[0]);
+  TEST_ASSERT_EQUAL(TELEMETRY_HISTORY + 10, summary.sent);
+  LinkTelemetry fresh;
+  LinkCounters c2;
+  fresh.sample(c2);
+  sampleOnce(fresh, c2, 4, 1);
+  fresh.summarize(summary);
+  TEST_ASSERT_EQUAL(255, summary.delivered_percent[0]);
+  TEST_ASSERT_EQUAL(75, summary.delivered_percent[TELEMETRY_HISTORY - 1]);
+}
+
+void test_health_thresholds() {
+  LinkThresholds th;
+  th.window_s = 2;
+  LinkTelemetry t(th);
+  LinkCounters c;
+  t.sample(c);
+  TEST_ASSERT_EQUAL(LINK_OK, t.health());
+
+  // *IRの割合 49‰はOK、50‰でWARN、300‰でBAD
+  sampleOnce(t, c, 1000, 49);
+  TEST_ASSERT_EQUAL(LINK_OK, t.health());
+  sampleOnce(t, c, 1000, 51);
+  TEST_ASSERT_EQUAL(LINK_WARN, t.health());
+  sampleOnce(t, c, 1000, 550);
+  TEST_ASSERT_EQUAL(LINK_BAD, t.health());
+  // 窓から外れたら戻る
+  sampleOnce(t, c, 1000, 0);
+  sampleOnce(t, c, 1000, 0);
+  TEST_ASSERT_EQUAL(LINK_OK, t.health());
+
+  // 解析エラー、キューで捨てた数があればWARN
+  c.errors[MU_ERR_TAIL_NOT_CRLF]++;
+  sampleOnce(t, c, 100, 0);
+  TEST_ASSERT_EQUAL(LINK_WARN, t.health());
+  sampleOnce(t, c, 100, 0);
+  sampleOnce(t, c, 100, 0);
+  TEST_ASSERT_EQUAL(LINK_OK, t.health());
+  c.queue_drops++;
+  sampleOnce(t, c, 100, 0);
+  TEST_ASSERT_EQUAL(LINK_WARN, t.health());
+  sampleOnce(t, c, 100, 0);
+  sampleOnce(t, c, 100, 0);
+  TEST_ASSERT_EQUAL(LINK_OK, t.health());
+
+  // 受信電波強度がしきい値を超えたらWARN(しきい値ちょうどはOK)
+  t.onRssi(th.warn_rssi_dbm);
+  sampleOnce(t, c, 100, 0);
+  TEST_ASSERT_EQUAL(LINK_OK, t.health());
+  t.onRssi(th.warn_rssi_dbm + 1);
+  sampleOnce(t, c, 100, 0);
+  TEST_ASSERT_EQUAL(LINK_WARN, t.health());
+}
+
+void test_ra_response() {
+  Link link;
+  link.second(0);
+  // *RA=xxは-dBm。1秒の中では一番強い値を残す
+  link.second(1, "*RA=5A\r\n*RA=64\r\n");
+  TEST_ASSERT_EQUAL(-90, link.telemetry.second(0).rssi_dbm);
+  LinkSummary summary;
+  link.telemetry.summarize(summary);
+  TEST_ASSERT_EQUAL(-100, summary.rssi_dbm);
+  // 測らなかった秒は測っていない値
+  link.second(1);
+  TEST_ASSERT_EQUAL(TELEMETRY_NO_RSSI, link.telemetry.second(0).rssi_dbm);
+
+  LinkTelemetry t;
+  TEST_ASSERT_TRUE(t.onResponse((const uint8_t *)"RAFF", 4));
+  LinkCounters c;
+  t.sample(c);
+  t.sample(c);
+  TEST_ASSERT_EQUAL(-127, t.second(0).rssi_dbm);
+  // @RAの応答だが値が読めない
+  TEST_ASSERT_TRUE(t.onResponse((const uint8_t *)"RAZZ", 4));
+  t.sample(c);
+  TEST_ASSERT_EQUAL(TELEMETRY_NO_RSSI, t.second(0).rssi_dbm);
+  // @RAの応答ではない
+  TEST_ASSERT_FALSE(t.onResponse((const uint8_t *)"CH0E", 4));
+  TEST_ASSERT_FALSE(t.onResponse((const uint8_t *)"RA5", 3));
+}
+
+void test_encode_decode_round_trip() {
+  Link link;
+  uint8_t record[TELEMETRY_RECORD_LEN];
+  link.second(0);
+  TEST_ASSERT_EQUAL(0, link.telemetry.encode(record));
+  link.second(20, "*DR=01\x42\r\n*IR=03\r\n*RA=5A\r\n*DR=01x\n");
+  TEST_ASSERT_EQUAL(TELEMETRY_RECORD_LEN, link.telemetry.encode(record));
+  TEST_ASSERT_EQUAL_HEX8(TELEMETRY_SYNC0, record[0]);
+  TEST_ASSERT_EQUAL_HEX8(TELEMETRY_SYNC1, record[1]);
+
+  // 前に関係のないバイト(同期の1バイト目と紛らわしいものを含む)があっても読める
+  TelemetryDecoder decoder;
+  const uint8_t garbage[] = {'M', 'U', '\n', TELEMETRY_SYNC0, TELEMETRY_SYNC0, 0x00,
+                             TELEMETRY_SYNC0, TELEMETRY_SYNC1, TELEMETRY_RECORD_SECOND, 0x03};
+  for (size_t i = 0; i < sizeof(garbage); i++) {
+    TEST_ASSERT_FALSE(decoder.push(garbage[i]));
+  }
+  bool done = false;
+  for (uint8_t i = 0; i < TELEMETRY_RECORD_LEN; i++) {
+    done = decoder.push(record[i]);
+    TEST_ASSERT_EQUAL(i == TELEMETRY_RECORD_LEN - 1, done);
+  }
+  const TelemetryDecoder::Record &r = decoder.record();
+  TEST_ASSERT_EQUAL_UINT32(1, r.seconds);
+  TEST_ASSERT_EQUAL(20, r.second.sent);
+  TEST_ASSERT_EQUAL(1, r.second.received);
+  TEST_ASSERT_EQUAL(1, r.second.errors[MU_ERR_CATCH_IR]);
+  TEST_ASSERT_EQUAL(1, r.second.errors[MU_ERR_TAIL_NOT_CRLF]);
+  TEST_ASSERT_EQUAL(-90, r.second.rssi_dbm);
+  TEST_ASSERT_EQUAL(link.telemetry.health(), r.health);
+  TEST_ASSERT_EQUAL(LINK_WARN, r.health);
+  TEST_ASSERT_EQUAL(1, decoder.records);
+  TEST_ASSERT_EQUAL(0, decoder.crc_errors);
+
+  // 化けた記録はCRCで捨て、次の記録は読める
+  uint8_t bad[TELEMETRY_RECORD_LEN];
+  memcpy(bad, record, sizeof(bad));
+  bad[6] ^= 0x01;
+  for (uint8_t i = 0; i < TELEMETRY_RECORD_LEN; i++) {
+    TEST_ASSERT_FALSE(decoder.push(bad[i]));
+  }
+  TEST_ASSERT_EQUAL(1, decoder.crc_errors);
+  for (uint8_t i = 0; i < TELEMETRY_RECORD_LEN; i++) {
+    done = decoder.push(record[i]);
+  }
+  TEST_ASSERT_TRUE(done);
+  TEST_ASSERT_EQUAL(2, decoder.records);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_sample_takes_deltas);
+  RUN_TEST(test_history_wraps_after_60s);
+  RUN_TEST(test_health_thresholds);
+  RUN_TEST(test_ra_response);
+  RUN_TEST(test_encode_decode_round_trip);
+  return UNITY_END();
+}
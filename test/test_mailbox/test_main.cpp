@@ -0,0 +1,139 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * Mailboxのテスト。書き込みと読み出しを別のスレッドで同時に動かし、
+ * 途中まで書かれた値を読まないこと、読む値が古くならないこと、最後には最新の値を読めることを確かめる。
+ * pio test -e native -f test_mailbox
+ * @version 0.1
+ *
+ */
+#include <atomic>
+#include <thread>
+#include <unity.h>
+#include <Mailbox.h>
+
+namespace {
+
+/// 全部の値が連番から決まる値。途中まで書かれていればどこかが食い違う
+struct Value {
+  uint32_t seq;
+  uint32_t words[15];
+
+  void set(uint32_t s) {
+    seq = s;
+    for (uint32_t i = 0; i < 15; i++) {
+      words[i] = s * 2654435761u + i;
+    }
+  }
+  bool consistent() const {
+    for (uint32_t i = 0; i < 15; i++) {
+      if (words[i] != seq * 2654435761u + i) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+const uint32_t STRESS_COUNT = 1000000;
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_read_only_new_values() {
+  Mailbox<Value> box;
+  Value v;
+  v.set(0);
+  TEST_ASSERT_FALSE(box.read(v));
+  Value in;
+  in.set(1);
+  box.publish(in);
+  in.set(2);
+  box.publish(in);
+  // 読まれていない値は上書きされ、最新の値だけを読む
+  TEST_ASSERT_TRUE(box.read(v));
+  TEST_ASSERT_EQUAL_UINT32(2, v.seq);
+  TEST_ASSERT_FALSE(box.read(v));
+  TEST_ASSERT_EQUAL_UINT32(2, v.seq);
+  in.set(3);
+  box.publish(in);
+  TEST_ASSERT_TRUE(box.read(v));
+  TEST_ASSERT_EQUAL_UINT32(3, v.seq);
+  TEST_ASSERT_EQUAL_UINT32(3, box.published());
+}
+
+void test_concurrent_publish_read() {
+  Mailbox<Value> box;
+  std::atomic<bool> done{false};
+  std::thread writer([&]() {
+    Value v;
+    for (uint32_t s = 1; s <= STRESS_COUNT; s++) {
+      v.set(s);
+      box.publish(v);
+    }
+    done.store(true);
+  });
+  uint32_t reads = 0;
+  uint32_t torn = 0;
+  uint32_t backwards = 0;
+  uint32_t last = 0;
+  Value v;
+  // 書き込みが終わったのを見てからもう一度読む(最後の値が残っているはず)
+  bool finished = false;
+  while (!finished) {
+    finished = done.load();
+    while (box.read(v)) {
+      reads++;
+      if (!v.consistent()) {
+        torn++;
+      }
+      if (v.seq <= last) {
+        backwards++;
+      }
+      last = v.seq;
+    }
+  }
+  writer.join();
+  TEST_ASSERT_EQUAL_UINT32(0, torn);
+  TEST_ASSERT_EQUAL_UINT32(0, backwards);
+  TEST_ASSERT_GREATER_THAN(0, reads);
+  TEST_ASSERT_EQUAL_UINT32(STRESS_COUNT, last);
+  TEST_ASSERT_EQUAL_UINT32(STRESS_COUNT, box.published());
+  TEST_ASSERT_FALSE(box.read(v));
+}
+
+void test_concurrent_slow_reader_sees_latest() {
+  Mailbox<Value> box;
+  std::atomic<uint32_t> written{0};
+  std::atomic<bool> stop{false};
+  std::thread writer([&]() {
+    Value v;
+    for (uint32_t s = 1; !stop.load(); s++) {
+      v.set(s);
+      box.publish(v);
+      written.store(s, std::memory_order_release);
+    }
+  });
+  Value v;
+  for (uint32_t i = 0; i < 1000; i++) {
+    // 読む前に書き終わっていた値より古い値は読まない
+    uint32_t before = written.load(std::memory_order_acquire);
+    if (box.read(v)) {
+      TEST_ASSERT_TRUE(v.consistent());
+      TEST_ASSERT_TRUE(v.seq >= before);
+    }
+    std::this_thread::yield();
+  }
+  stop.store(true);
+  writer.join();
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_read_only_new_values);
+  RUN_TEST(test_concurrent_publish_read);
+  RUN_TEST(test_concurrent_slow_reader_sees_latest);
+  return UNITY_END();
+}
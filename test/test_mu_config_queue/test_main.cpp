@@ -0,0 +1,171 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * MuConfigQueueのテスト。差分だけを送ること、応答を待って次を送ること、
+ * 送り直してもだめな設定をあきらめること、関係のない*ERで送り直さないこと、
+ * わからなくなった設定を送り直すことを確かめる。
+ * pio test -e native -f test_mu_config_queue
+ * @version 0.1
+ *
+ */
+#include <string.h>
+#include <unity.h>
+#include <MUwrapper.hpp>
+#include <MuConfigQueue.h>
+
+namespace {
+
+const uint32_t TIMEOUT_US = 500000;
+const uint8_t ATTEMPTS = 3;
+const MuConfig INITIAL = {0x04, 0x0E, 0x01, 0x00};
+
+/// MUに送ったコマンド
+struct Sent {
+  char last[16];
+  uint32_t count = 0;
+};
+
+void record(void *context, MUEvent event, uint8_t *data, uint8_t len) {
+  Sent *sent = (Sent *)context;
+  if (event != MU_EVENT_SEND_REQUEST || len >= sizeof(sent->last)) {
+    return;
+  }
+  memcpy(sent->last, data, len);
+  sent->last[len] = 0;
+  sent->count++;
+}
+
+bool respond(MuConfigQueue &queue, const char *response) {
+  return queue.onResponse((const uint8_t *)response, strlen(response));
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_sends_only_changes_in_order() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  MuConfigQueue queue(INITIAL, TIMEOUT_US, ATTEMPTS);
+  TEST_ASSERT_FALSE(queue.busy());
+  MuConfig target = INITIAL;
+  target.ch = 0x1A;
+  target.ei = 0x02;
+  queue.apply(target, 0);
+  TEST_ASSERT_TRUE(queue.busy());
+  TEST_ASSERT_TRUE(queue.poll(mu, 0));
+  TEST_ASSERT_EQUAL_STRING("@CH1A\r\n", sent.last);
+  // 応答を待つ間は次を送らない
+  TEST_ASSERT_FALSE(queue.poll(mu, 1000));
+  TEST_ASSERT_FALSE(respond(queue, "DT05"));
+  TEST_ASSERT_TRUE(respond(queue, "CH1A"));
+  TEST_ASSERT_TRUE(queue.poll(mu, 2000));
+  TEST_ASSERT_EQUAL_STRING("@EI02\r\n", sent.last);
+  TEST_ASSERT_TRUE(respond(queue, "EI02"));
+  TEST_ASSERT_FALSE(queue.poll(mu, 3000));
+  TEST_ASSERT_FALSE(queue.busy());
+  TEST_ASSERT_EQUAL(2, sent.count);
+  TEST_ASSERT_EQUAL(1, queue.stats().switches);
+  TEST_ASSERT_EQUAL_UINT32(3000, queue.stats().last_switch_us);
+  TEST_ASSERT_EQUAL_HEX8(0x1A, queue.current().ch);
+  TEST_ASSERT_EQUAL_HEX8(0x02, queue.current().ei);
+}
+
+void test_gives_up_after_max_attempts() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  MuConfigQueue queue(INITIAL, TIMEOUT_US, ATTEMPTS);
+  MuConfig target = INITIAL;
+  target.ch = 0x1A;
+  queue.apply(target, 0);
+  uint32_t now = 0;
+  for (uint8_t i = 0; i < ATTEMPTS; i++) {
+    TEST_ASSERT_TRUE(queue.poll(mu, now));
+    TEST_ASSERT_EQUAL_STRING("@CH1A\r\n", sent.last);
+    now += TIMEOUT_US;
+  }
+  // 応答がないまま回数を使い切ったら、今の設定のままにして送るのをやめる
+  TEST_ASSERT_FALSE(queue.poll(mu, now));
+  TEST_ASSERT_FALSE(queue.busy());
+  TEST_ASSERT_EQUAL(ATTEMPTS, sent.count);
+  TEST_ASSERT_EQUAL(1, queue.stats().failures);
+  TEST_ASSERT_EQUAL(0, queue.stats().switches);
+  TEST_ASSERT_EQUAL_HEX8(0x0E, queue.current().ch);
+  for (uint8_t i = 0; i < 10; i++) {
+    now += TIMEOUT_US;
+    TEST_ASSERT_FALSE(queue.poll(mu, now));
+  }
+  TEST_ASSERT_EQUAL(ATTEMPTS, sent.count);
+  // 次のapply()でまた試す
+  queue.apply(target, now);
+  TEST_ASSERT_TRUE(queue.busy());
+  TEST_ASSERT_TRUE(queue.poll(mu, now));
+  TEST_ASSERT_TRUE(respond(queue, "CH1A"));
+  TEST_ASSERT_FALSE(queue.poll(mu, now + 1000));
+  TEST_ASSERT_EQUAL(1, queue.stats().switches);
+  TEST_ASSERT_EQUAL_HEX8(0x1A, queue.current().ch);
+}
+
+void test_stray_error_is_not_blamed() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  MuConfigQueue queue(INITIAL, TIMEOUT_US, ATTEMPTS);
+  // 何も送っていないときの*ERは関係ない
+  TEST_ASSERT_FALSE(respond(queue, "ER"));
+  MuConfig target = INITIAL;
+  target.gi = 0x05;
+  queue.apply(target, 0);
+  TEST_ASSERT_TRUE(queue.poll(mu, 0));
+  // 前に送った@DTへの*ERが先に来ても、送り直さずに自分の応答を待つ
+  TEST_ASSERT_FALSE(respond(queue, "ER"));
+  TEST_ASSERT_FALSE(queue.poll(mu, 1000));
+  TEST_ASSERT_EQUAL(1, sent.count);
+  TEST_ASSERT_TRUE(respond(queue, "GI05"));
+  TEST_ASSERT_FALSE(queue.poll(mu, 2000));
+  TEST_ASSERT_EQUAL(0, queue.stats().retries);
+  TEST_ASSERT_EQUAL(1, queue.stats().switches);
+}
+
+void test_rejected_command_retried_after_timeout() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  MuConfigQueue queue(INITIAL, TIMEOUT_US, ATTEMPTS);
+  MuConfig target = INITIAL;
+  target.di = 0x09;
+  queue.apply(target, 0);
+  TEST_ASSERT_TRUE(queue.poll(mu, 0));
+  respond(queue, "ER");
+  TEST_ASSERT_FALSE(queue.poll(mu, TIMEOUT_US - 1));
+  TEST_ASSERT_TRUE(queue.poll(mu, TIMEOUT_US));
+  TEST_ASSERT_EQUAL_STRING("@DI09\r\n", sent.last);
+  TEST_ASSERT_EQUAL(1, queue.stats().retries);
+  TEST_ASSERT_TRUE(respond(queue, "DI09"));
+  TEST_ASSERT_FALSE(queue.busy());
+}
+
+void test_invalidate_resends_same_value() {
+  Sent sent;
+  MUWrapper mu(record, &sent);
+  MuConfigQueue queue(INITIAL, TIMEOUT_US, ATTEMPTS);
+  // チャンネルの調査が元のチャンネルに戻せたかわからないまま終わった
+  queue.invalidate("CH", 0);
+  TEST_ASSERT_TRUE(queue.busy());
+  TEST_ASSERT_TRUE(queue.poll(mu, 0));
+  TEST_ASSERT_EQUAL_STRING("@CH0E\r\n", sent.last);
+  TEST_ASSERT_TRUE(respond(queue, "CH0E"));
+  TEST_ASSERT_FALSE(queue.poll(mu, 1000));
+  TEST_ASSERT_FALSE(queue.busy());
+  TEST_ASSERT_EQUAL(1, sent.count);
+  TEST_ASSERT_EQUAL(1, queue.stats().switches);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_sends_only_changes_in_order);
+  RUN_TEST(test_gives_up_after_max_attempts);
+  RUN_TEST(test_stray_error_is_not_blamed);
+  RUN_TEST(test_rejected_command_retried_after_timeout);
+  RUN_TEST(test_invalidate_resends_same_value);
+  return UNITY_END();
+}
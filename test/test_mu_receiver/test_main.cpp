@@ -0,0 +1,147 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * MuReceiverの受信経路のテスト。FakeUartのonReceiveからdrain()を呼ぶ
+ * (main.cppのSerial1.onReceive→MuRxタスク→drain()と同じ流れ)。
+ * pio test -e native -f test_mu_receiver
+ * @version 0.1
+ *
+ */
+#include <string.h>
+#include <unity.h>
+#include <FakeUart.h>
+#include <MuReceiver.hpp>
+
+namespace {
+
+/// 受け取ったイベントを溜める通知先
+struct EventLog {
+  MuRxEvent events[32];
+  uint8_t count = 0;
+  /// これを超えたら受け取らない
+  uint8_t limit = 32;
+};
+
+bool record(void *context, const MuRxEvent &event) {
+  EventLog *log = (EventLog *)context;
+  if (log->count >= log->limit) {
+    return false;
+  }
+  log->events[log->count++] = event;
+  return true;
+}
+
+void inject(FakeUart<256> &uart, const char *s) {
+  uart.inject((const uint8_t *)s, strlen(s));
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_frame_split_across_reads() {
+  FakeUart<256> uart;
+  EventLog log;
+  MuReceiver<FakeUart<256>> rx(uart, record, &log);
+  uart.onReceive([&]() { rx.drain(); });
+  inject(uart, "*D");
+  inject(uart, "R=05\x12\x34");
+  inject(uart, "\x56\x78\x9a\r");
+  TEST_ASSERT_EQUAL(0, log.count);
+  inject(uart, "\n");
+  TEST_ASSERT_EQUAL(1, log.count);
+  TEST_ASSERT_EQUAL(MU_EVENT_RX_COMPLETE, log.events[0].event);
+  TEST_ASSERT_EQUAL(5, log.events[0].len);
+  const uint8_t expected[5] = {0x12, 0x34, 0x56, 0x78, 0x9a};
+  TEST_ASSERT_EQUAL_MEMORY(expected, log.events[0].data, 5);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().frames);
+  TEST_ASSERT_EQUAL_UINT32(13, rx.stats().bytes);
+  TEST_ASSERT_EQUAL_UINT32(4, rx.stats().chunks);
+}
+
+void test_responses_and_send_errors() {
+  FakeUart<256> uart;
+  EventLog log;
+  MuReceiver<FakeUart<256>> rx(uart, record, &log);
+  uart.onReceive([&]() { rx.drain(); });
+  inject(uart, "*CH=0E\r\n*IR=03\r\n*DT=05\r\n");
+  TEST_ASSERT_EQUAL(3, log.count);
+  TEST_ASSERT_EQUAL(MU_EVENT_RESPONSE, log.events[0].event);
+  TEST_ASSERT_EQUAL(4, log.events[0].len);
+  TEST_ASSERT_EQUAL_MEMORY("CH0E", log.events[0].data, 4);
+  TEST_ASSERT_EQUAL(MU_EVENT_ERROR, log.events[1].event);
+  TEST_ASSERT_EQUAL(MU_ERR_CATCH_IR, log.events[1].data[0]);
+  TEST_ASSERT_EQUAL(MU_EVENT_RESPONSE, log.events[2].event);
+  TEST_ASSERT_EQUAL_UINT32(2, rx.stats().responses);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().ir_errors);
+  TEST_ASSERT_EQUAL_UINT32(0, rx.stats().parse_errors);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().errors[MU_ERR_CATCH_IR]);
+}
+
+void test_resync_after_garbage() {
+  FakeUart<256> uart;
+  EventLog log;
+  MuReceiver<FakeUart<256>> rx(uart, record, &log);
+  uart.onReceive([&]() { rx.drain(); });
+  // 長さが16進数でない・長すぎる・フッタが違う、のあとに正しいフレーム
+  inject(uart, "*DR=G1*DR=20*DR=01x\n\r*DR=01\x42\r\n");
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().frames);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().errors[MU_ERR_LENGTH_NOT_HEX]);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().errors[MU_ERR_LENGTH_TOO_LONG]);
+  TEST_ASSERT_EQUAL_UINT32(1, rx.stats().errors[MU_ERR_TAIL_NOT_CRLF]);
+  TEST_ASSERT_EQUAL(MU_EVENT_RX_COMPLETE, log.events[log.count - 1].event);
+  TEST_ASSERT_EQUAL_HEX8(0x42, log.events[log.count - 1].data[0]);
+}
+
+void test_dropped_when_sink_full() {
+  FakeUart<256> uart;
+  EventLog log;
+  log.limit = 1;
+  MuReceiver<FakeUart<256>> rx(uart, record, &log);
+  uart.onReceive([&]() { rx.drain(); });
+  inject(uart, "*DR=01A\r\n*DR=01B\r\n*DR=01C\r\n");
+  TEST_ASSERT_EQUAL(1, log.count);
+  TEST_ASSERT_EQUAL_UINT32(3, rx.stats().frames);
+  TEST_ASSERT_EQUAL_UINT32(2, rx.stats().dropped);
+}
+
+void test_uart_overflow_without_drain() {
+  FakeUart<16> uart;
+  uint8_t data[20];
+  memset(data, 'x', sizeof(data));
+  TEST_ASSERT_EQUAL(16, uart.inject(data, sizeof(data)));
+  TEST_ASSERT_EQUAL(4, uart.overflow);
+  TEST_ASSERT_EQUAL(16, uart.available());
+}
+
+void test_two_radios_independent() {
+  FakeUart<256> uart[2];
+  EventLog log[2];
+  MuReceiver<FakeUart<256>> rx0(uart[0], record, &log[0]);
+  MuReceiver<FakeUart<256>> rx1(uart[1], record, &log[1]);
+  uart[0].onReceive([&]() { rx0.drain(); });
+  uart[1].onReceive([&]() { rx1.drain(); });
+  // フレームの途中で交互に届いても、解析の状態は混ざらない
+  inject(uart[0], "*DR=02\x01");
+  inject(uart[1], "*CH=");
+  inject(uart[0], "\x02\r\n");
+  inject(uart[1], "07\r\n");
+  TEST_ASSERT_EQUAL(1, log[0].count);
+  TEST_ASSERT_EQUAL(MU_EVENT_RX_COMPLETE, log[0].events[0].event);
+  TEST_ASSERT_EQUAL(2, log[0].events[0].len);
+  TEST_ASSERT_EQUAL(1, log[1].count);
+  TEST_ASSERT_EQUAL(MU_EVENT_RESPONSE, log[1].events[0].event);
+  TEST_ASSERT_EQUAL_MEMORY("CH07", log[1].events[0].data, 4);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_split_across_reads);
+  RUN_TEST(test_responses_and_send_errors);
+  RUN_TEST(test_resync_after_garbage);
+  RUN_TEST(test_dropped_when_sink_full);
+  RUN_TEST(test_uart_overflow_without_drain);
+  RUN_TEST(test_two_radios_independent);
+  return UNITY_END();
+}
@@ -0,0 +1,150 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * BasicOledRendererのテスト。変わったページだけを送ること、送信間隔、
+ * 毎回全画面を送っていたときと比べたI2Cのバイト数/秒を確かめる。
+ * pio test -e native -f test_oled_renderer
+ * @version 0.1
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include <I2cArbiter.h>
+#include <MockWire.h>
+#include <OledRenderer.h>
+
+namespace {
+
+uint32_t now_us = 0;
+uint32_t fakeClock() { return now_us; }
+
+typedef BasicI2cArbiter<MockWire, NullLock> Bus;
+typedef BasicOledRenderer<Bus> Renderer;
+
+const uint8_t ADDR = 0x3c;
+const uint32_t MIN_INTERVAL_MS = 50;
+// 1ページ送るバイト数(範囲の設定 1+6、データ 128バイトを32バイトずつ 4*(1+32))
+const uint32_t PAGE_BYTES = 7 + 4 * 33;
+
+uint8_t buffer[Renderer::PAGES * Renderer::WIDTH];
+
+// 画面の1か所(数字の表示など)だけを書き換える
+void redrawCounter(uint8_t page, uint8_t value) {
+  memset(buffer + page * Renderer::WIDTH, value, 8);
+}
+
+// 予約枠がなければ1回のflush()で送り終わる
+void flushAll(Renderer &r, uint32_t now_ms) {
+  r.flush(now_ms);
+  TEST_ASSERT_FALSE(r.busy());
+}
+
+} // namespace
+
+void setUp() {
+  now_us = 0;
+  memset(buffer, 0, sizeof(buffer));
+}
+void tearDown() {}
+
+void test_first_flush_sends_all_pages() {
+  MockWire wire(fakeClock);
+  Bus bus(wire, fakeClock);
+  Renderer r(bus, ADDR, buffer, MIN_INTERVAL_MS);
+  TEST_ASSERT_EQUAL_HEX8(0xff, r.dirty());
+  TEST_ASSERT_TRUE(r.flush(0));
+  TEST_ASSERT_EQUAL(8, r.stats().pages);
+  TEST_ASSERT_EQUAL(8 * PAGE_BYTES, r.stats().bytes);
+  // 1ページあたり範囲の設定1回とデータ4回
+  TEST_ASSERT_EQUAL(8 * 5, wire.count);
+  TEST_ASSERT_EQUAL(8 * 5, bus.stats().client[I2C_DISPLAY].acquired);
+}
+
+void test_only_dirty_pages_are_sent() {
+  MockWire wire(fakeClock);
+  Bus bus(wire, fakeClock);
+  Renderer r(bus, ADDR, buffer, MIN_INTERVAL_MS);
+  flushAll(r, 0);
+  r.resetStats();
+  // 変わっていなければ送らない
+  TEST_ASSERT_EQUAL_HEX8(0, r.update());
+  TEST_ASSERT_FALSE(r.flush(100));
+  TEST_ASSERT_EQUAL(0, r.stats().bytes);
+  redrawCounter(3, 0x5a);
+  TEST_ASSERT_EQUAL_HEX8(1 << 3, r.update());
+  size_t first = wire.count;
+  TEST_ASSERT_TRUE(r.flush(100));
+  TEST_ASSERT_EQUAL(1, r.stats().pages);
+  TEST_ASSERT_EQUAL(PAGE_BYTES, r.stats().bytes);
+  // 範囲の設定: コマンド, PAGEADDR 3 3
+  const MockWire::Event &window = wire.log[first % MockWire::LOG_SIZE];
+  TEST_ASSERT_EQUAL(ADDR, window.addr);
+  TEST_ASSERT_EQUAL_HEX8(0x00, window.data[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x22, window.data[1]);
+  TEST_ASSERT_EQUAL(3, window.data[2]);
+  TEST_ASSERT_EQUAL(3, window.data[3]);
+  // 表示データ: 書き換えた8バイトのあと、前の内容(0)
+  const MockWire::Event &data = wire.log[(first + 1) % MockWire::LOG_SIZE];
+  TEST_ASSERT_EQUAL_HEX8(0x40, data.data[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x5a, data.data[1]);
+  TEST_ASSERT_EQUAL_HEX8(0x5a, data.data[7]);
+  // 元に戻したらまた送る
+  redrawCounter(3, 0);
+  TEST_ASSERT_EQUAL_HEX8(1 << 3, r.update());
+}
+
+void test_min_interval() {
+  MockWire wire(fakeClock);
+  Bus bus(wire, fakeClock);
+  Renderer r(bus, ADDR, buffer, MIN_INTERVAL_MS);
+  flushAll(r, 1000);
+  redrawCounter(0, 1);
+  r.update();
+  TEST_ASSERT_FALSE(r.flush(1000 + MIN_INTERVAL_MS - 1));
+  TEST_ASSERT_EQUAL_HEX8(1, r.dirty());
+  // 間隔を空ける間に描き直されたものはまとめて送る
+  redrawCounter(7, 1);
+  r.update();
+  TEST_ASSERT_TRUE(r.flush(1000 + MIN_INTERVAL_MS));
+  TEST_ASSERT_EQUAL(8 + 2, r.stats().pages);
+}
+
+void test_bytes_per_second_against_full_redraw() {
+  MockWire wire(fakeClock);
+  Bus bus(wire, fakeClock);
+  Renderer dirty(bus, ADDR, buffer, MIN_INTERVAL_MS);
+  Renderer full(bus, ADDR, buffer, MIN_INTERVAL_MS);
+  flushAll(dirty, 0);
+  flushAll(full, 0);
+  dirty.resetStats();
+  full.resetStats();
+  // 1秒間、10msごとに数字を1つ描き直す(表示タスクと同じ)
+  for (uint32_t ms = 10; ms <= 1000; ms += 10) {
+    redrawCounter(2, (uint8_t)ms);
+    dirty.update();
+    dirty.flush(ms);
+    // 以前: 描き直すたびにdisplay()で全画面を送る(ただし送信間隔は同じにする)
+    full.update();
+    full.invalidateAll();
+    full.flush(ms);
+  }
+  uint32_t sends = 1000 / MIN_INTERVAL_MS;
+  TEST_ASSERT_EQUAL(sends, dirty.stats().flushes);
+  TEST_ASSERT_EQUAL(sends, full.stats().flushes);
+  TEST_ASSERT_EQUAL(sends * PAGE_BYTES, dirty.stats().bytes);
+  TEST_ASSERT_EQUAL(sends * 8 * PAGE_BYTES, full.stats().bytes);
+  char line[64];
+  snprintf(line, sizeof(line), "OLED bytes/s: full redraw %u, dirty pages %u",
+           (unsigned)full.stats().bytes, (unsigned)dirty.stats().bytes);
+  TEST_MESSAGE(line);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_flush_sends_all_pages);
+  RUN_TEST(test_only_dirty_pages_are_sent);
+  RUN_TEST(test_min_interval);
+  RUN_TEST(test_bytes_per_second_against_full_redraw);
+  return UNITY_END();
+}
@@ -0,0 +1,122 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * ReliableSender/ReliableReceiverのテスト。確認応答、重複の判定、
+ * 送信側が再起動したとき(セッションが変わる)に新しいフレームを捨てないことを確かめる。
+ * pio test -e native -f test_reliable_link
+ * @version 0.1
+ *
+ */
+#include <unity.h>
+#include <ReliableLink.h>
+
+namespace {
+
+const uint32_t RTO_US = 200000;
+const uint32_t DEADLINE_US = 2000000;
+
+/// senderが今送るフレームをreceiverに渡し、確認応答をsenderに返す
+bool deliver(ReliableSender &sender, ReliableReceiver &receiver,
+             uint32_t now_us, ReliableReceiver::Message &msg,
+             bool lose_ack = false) {
+  const uint8_t *frame;
+  uint8_t len;
+  TEST_ASSERT_TRUE(sender.peek(now_us, frame, len));
+  sender.sent(now_us);
+  uint8_t ack[RELIABLE_HEADER_LEN];
+  bool fresh = receiver.accept(frame, len, ack, msg);
+  if (!lose_ack) {
+    TEST_ASSERT_TRUE(sender.onAck(ack, sizeof(ack), now_us + 1000));
+  }
+  return fresh;
+}
+
+} // namespace
+
+void setUp() {}
+void tearDown() {}
+
+void test_frame_layout() {
+  ReliableSender sender(RTO_US, DEADLINE_US, 0xA5C3);
+  const uint8_t data[] = {1, 2, 3, 4, 5};
+  TEST_ASSERT_TRUE(sender.send(MSG_CONFIG, data, sizeof(data), 0));
+  const uint8_t *frame;
+  uint8_t len;
+  TEST_ASSERT_TRUE(sender.peek(0, frame, len));
+  TEST_ASSERT_EQUAL(RELIABLE_HEADER_LEN + 5, len);
+  TEST_ASSERT_TRUE(len <= MU_MAX_DATALEN);
+  const uint8_t header[] = {RELIABLE_TAG_DATA, 0, MSG_CONFIG, 0xA5, 0xC3};
+  TEST_ASSERT_EQUAL_MEMORY(header, frame, RELIABLE_HEADER_LEN);
+  TEST_ASSERT_EQUAL_MEMORY(data, frame + RELIABLE_HEADER_LEN, 5);
+  uint8_t big[RELIABLE_MAX_DATALEN + 1] = {0};
+  TEST_ASSERT_FALSE(sender.send(MSG_MODE, big, sizeof(big), 0));
+}
+
+void test_ack_and_duplicate() {
+  ReliableSender sender(RTO_US, DEADLINE_US, 1);
+  ReliableReceiver receiver;
+  ReliableReceiver::Message msg;
+  const uint8_t data[] = {7};
+  sender.send(MSG_MODE, data, 1, 0);
+  // 確認応答が失われると送り直し、受信側は重複として中身を渡さない
+  TEST_ASSERT_TRUE(deliver(sender, receiver, 0, msg, true));
+  TEST_ASSERT_EQUAL(MSG_MODE, msg.cls);
+  TEST_ASSERT_EQUAL(1, msg.len);
+  TEST_ASSERT_EQUAL(7, msg.data[0]);
+  const uint8_t *frame;
+  uint8_t len;
+  TEST_ASSERT_FALSE(sender.peek(RTO_US - 1, frame, len));
+  TEST_ASSERT_FALSE(deliver(sender, receiver, RTO_US, msg));
+  TEST_ASSERT_FALSE(sender.pending());
+  TEST_ASSERT_EQUAL(1, receiver.received);
+  TEST_ASSERT_EQUAL(1, receiver.duplicates);
+  TEST_ASSERT_EQUAL(1, sender.stats().delivered);
+  TEST_ASSERT_EQUAL(1, sender.stats().retransmits);
+}
+
+void test_restart_with_new_session() {
+  ReliableReceiver receiver;
+  ReliableReceiver::Message msg;
+  const uint8_t data[] = {0};
+  // 以前は下位4ビットだけをセッションにしていたので、0x0112と0x0212は同じに見えた
+  const uint16_t sessions[] = {0x0112, 0x0212, 0x0213};
+  for (uint8_t k = 0; k < 3; k++) {
+    // 再起動した送信側は連番0から送る
+    ReliableSender sender(RTO_US, DEADLINE_US, sessions[k]);
+    for (uint8_t i = 0; i < 3; i++) {
+      sender.send(MSG_CONFIG, data, 1, i * 1000);
+      TEST_ASSERT_TRUE(deliver(sender, receiver, i * 1000, msg));
+    }
+    TEST_ASSERT_EQUAL(3, sender.stats().delivered);
+  }
+  TEST_ASSERT_EQUAL(9, receiver.received);
+  TEST_ASSERT_EQUAL(0, receiver.duplicates);
+}
+
+void test_ack_from_old_session_is_stale() {
+  ReliableSender old_sender(RTO_US, DEADLINE_US, 0x1234);
+  ReliableSender sender(RTO_US, DEADLINE_US, 0x5234);
+  ReliableReceiver receiver;
+  ReliableReceiver::Message msg;
+  const uint8_t data[] = {0};
+  old_sender.send(MSG_CONFIG, data, 1, 0);
+  sender.send(MSG_CONFIG, data, 1, 0);
+  const uint8_t *frame;
+  uint8_t len;
+  old_sender.peek(0, frame, len);
+  uint8_t ack[RELIABLE_HEADER_LEN];
+  receiver.accept(frame, len, ack, msg);
+  // 連番と種類が同じでもセッションが違う確認応答では届いたことにしない
+  TEST_ASSERT_TRUE(sender.onAck(ack, sizeof(ack), 0));
+  TEST_ASSERT_TRUE(sender.pending(MSG_CONFIG));
+  TEST_ASSERT_EQUAL(1, sender.stats().stale_acks);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_layout);
+  RUN_TEST(test_ack_and_duplicate);
+  RUN_TEST(test_restart_with_new_session);
+  RUN_TEST(test_ack_from_old_session_is_stale);
+  return UNITY_END();
+}
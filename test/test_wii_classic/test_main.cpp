@@ -0,0 +1,163 @@
+/**
+ * @file test_main.cpp
+ * @brief
+ * BasicWiiClassicの読み出しのタイミングのテスト。MockWireと進め方を決められる時計を使い、
+ * update()/sample()が待たずに戻り、1回の呼び出しでバスを1段階ずつしか使わないことを確かめる。
+ * pio test -e native -f test_wii_classic
+ * @version 0.1
+ *
+ */
+#include <unity.h>
+#include <MockWire.h>
+#include <wiiClassic.h>
+
+namespace {
+uint32_t now_us = 0;
+} // namespace
+
+// テストでは時計を手で進める(sim/のmicros()はリンクしない)
+uint32_t micros() { return now_us; }
+uint32_t millis() { return now_us / 1000; }
+
+namespace {
+
+// 読み出しで返す6バイト(UPだけ押されている。ボタンは押されると0)
+const uint8_t PAD_UP[6] = {0x20, 0x20, 0x10, 0x00, 0xff, 0xfe};
+
+void respond(MockWire &wire, const uint8_t data[6]) {
+  memcpy(wire.response, data, 6);
+  wire.response_len = 6;
+}
+
+bool isWrite(const MockWire::Event &e, uint8_t addr, uint8_t data) {
+  return e.kind == MockWire::Event::WRITE && e.addr == CLASSIC_ADDR &&
+         e.len == 2 && e.data[0] == addr && e.data[1] == data;
+}
+
+// 初期化を終えて最初の読み出しアドレスを書いたところまで進める
+void initialize(BasicWiiClassic<MockWire> &wii, controller::ControllerData &c) {
+  wii.init();
+  now_us += CLASSIC_INIT_WAIT_US;
+  wii.update(c);
+  now_us += CLASSIC_INIT_WAIT_US;
+  wii.update(c);
+}
+
+} // namespace
+
+void setUp() { now_us = 1000; }
+void tearDown() {}
+
+void test_init_sequence_without_waiting() {
+  MockWire wire(micros);
+  BasicWiiClassic<MockWire> wii(wire);
+  controller::ControllerData c;
+  wii.init();
+  TEST_ASSERT_EQUAL(1, wire.begins);
+  TEST_ASSERT_EQUAL(1, wire.count);
+  TEST_ASSERT_TRUE(isWrite(wire.last(), 0xF0, 0x55));
+  // 待ち時間中は呼ばれてもバスに触らずに戻る
+  now_us += CLASSIC_INIT_WAIT_US - 1;
+  TEST_ASSERT_FALSE(wii.update(c));
+  TEST_ASSERT_EQUAL(1, wire.count);
+  now_us += 1;
+  TEST_ASSERT_FALSE(wii.update(c));
+  TEST_ASSERT_EQUAL(2, wire.count);
+  TEST_ASSERT_TRUE(isWrite(wire.last(), 0xFB, 0x00));
+  now_us += CLASSIC_INIT_WAIT_US;
+  TEST_ASSERT_FALSE(wii.update(c));
+  TEST_ASSERT_EQUAL(3, wire.count);
+  TEST_ASSERT_TRUE(isWrite(wire.last(), 0x00, 0x00));
+  TEST_ASSERT_FALSE(wii.isConnected());
+}
+
+void test_update_reads_after_convert_time() {
+  MockWire wire(micros);
+  BasicWiiClassic<MockWire> wii(wire);
+  controller::ControllerData c;
+  respond(wire, PAD_UP);
+  initialize(wii, c);
+  size_t count = wire.count;
+  now_us += CLASSIC_CONVERT_US - 1;
+  TEST_ASSERT_FALSE(wii.update(c));
+  TEST_ASSERT_EQUAL(count, wire.count);
+  now_us += 1;
+  TEST_ASSERT_TRUE(wii.update(c));
+  TEST_ASSERT_EQUAL(count + 1, wire.count);
+  const MockWire::Event &read = wire.last();
+  TEST_ASSERT_EQUAL(MockWire::Event::READ, read.kind);
+  TEST_ASSERT_EQUAL(6, read.len);
+  // アドレスを書いてから変換時間が経ってから読む
+  TEST_ASSERT_EQUAL_UINT32(CLASSIC_CONVERT_US, read.time - wire.last(1).time);
+  TEST_ASSERT_EQUAL_UINT32(now_us, wii.readTime());
+  TEST_ASSERT_TRUE(wii.isConnected());
+  TEST_ASSERT_TRUE(c.button(controller::UP));
+  TEST_ASSERT_FALSE(c.button(controller::A));
+  // 次の読み出しはCLASSIC_PERIOD_USごと
+  now_us += CLASSIC_PERIOD_US - CLASSIC_CONVERT_US - 1;
+  TEST_ASSERT_FALSE(wii.update(c));
+  TEST_ASSERT_EQUAL(count + 1, wire.count);
+  now_us += 1;
+  TEST_ASSERT_FALSE(wii.update(c));
+  TEST_ASSERT_TRUE(isWrite(wire.last(), 0x00, 0x00));
+}
+
+void test_sample_reads_every_call() {
+  MockWire wire(micros);
+  BasicWiiClassic<MockWire> wii(wire);
+  controller::ControllerData c;
+  respond(wire, PAD_UP);
+  initialize(wii, c);
+  // CLASSIC_CONVERT_US以上の周期で呼べば毎回読み、すぐ次のアドレスを書く
+  for (int i = 0; i < 10; i++) {
+    size_t count = wire.count;
+    now_us += CLASSIC_CONVERT_US;
+    TEST_ASSERT_TRUE(wii.sample(c));
+    TEST_ASSERT_EQUAL(count + 2, wire.count);
+    TEST_ASSERT_EQUAL(MockWire::Event::READ, wire.last(1).kind);
+    TEST_ASSERT_TRUE(isWrite(wire.last(), 0x00, 0x00));
+  }
+  // 変換時間より早く呼ばれたら何もしない
+  size_t count = wire.count;
+  now_us += CLASSIC_CONVERT_US / 2;
+  TEST_ASSERT_FALSE(wii.sample(c));
+  TEST_ASSERT_EQUAL(count, wire.count);
+}
+
+void test_reconnect_after_errors() {
+  MockWire wire(micros);
+  BasicWiiClassic<MockWire> wii(wire);
+  controller::ControllerData c;
+  respond(wire, PAD_UP);
+  initialize(wii, c);
+  now_us += CLASSIC_CONVERT_US;
+  TEST_ASSERT_TRUE(wii.sample(c));
+  TEST_ASSERT_TRUE(wii.isConnected());
+  // 抜けると0xffが読める。21回続いたら切断とみなし、cをクリアして初期化し直す
+  const uint8_t unplugged[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+  respond(wire, unplugged);
+  for (int i = 0; i < 20; i++) {
+    now_us += CLASSIC_CONVERT_US;
+    TEST_ASSERT_FALSE(wii.sample(c));
+  }
+  now_us += CLASSIC_CONVERT_US;
+  TEST_ASSERT_TRUE(wii.sample(c));
+  TEST_ASSERT_FALSE(wii.isConnected());
+  TEST_ASSERT_FALSE(c.button(controller::UP));
+  TEST_ASSERT_EQUAL(2, wire.begins);
+  TEST_ASSERT_TRUE(isWrite(wire.last(), 0xF0, 0x55));
+  // 初期化し直している間も待たずに戻る
+  size_t count = wire.count;
+  now_us += CLASSIC_CONVERT_US;
+  TEST_ASSERT_FALSE(wii.sample(c));
+  TEST_ASSERT_EQUAL(count, wire.count);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_init_sequence_without_waiting);
+  RUN_TEST(test_update_reads_after_convert_time);
+  RUN_TEST(test_sample_reads_every_call);
+  RUN_TEST(test_reconnect_after_errors);
+  return UNITY_END();
+}